@@ -0,0 +1,436 @@
+/* Copyright (c) 2020 Wi-Fi Alliance                                                */
+
+/* Permission to use, copy, modify, and/or distribute this software for any         */
+/* purpose with or without fee is hereby granted, provided that the above           */
+/* copyright notice and this permission notice appear in all copies.                */
+
+/* THE SOFTWARE IS PROVIDED 'AS IS' AND THE AUTHOR DISCLAIMS ALL                    */
+/* WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED                    */
+/* WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL                     */
+/* THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR                       */
+/* CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING                        */
+/* FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF                       */
+/* CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT                       */
+/* OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS                          */
+/* SOFTWARE. */
+
+
+/* Microbenchmarks of the hot paths: the TLV codec, the API and TLV registries, the logger and the eloop
+ * timers. Built by "make bench" with the allocator wrapped, and printed as JSON with ns and allocations
+ * per operation, so runs of different commits and platforms can be compared. */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "eloop.h"
+#include "indigo_api.h"
+#include "indigo_log.h"
+#include "indigo_packet.h"
+#include "utils.h"
+
+#ifndef BENCH_COMMIT
+#define BENCH_COMMIT ""
+#endif
+
+/* Each benchmark doubles its iterations until a run takes this long */
+#define BENCH_MIN_NSEC              100000000ULL
+/* Timer counts of the eloop benchmarks */
+static const int bench_timer_counts[] = { 10, 100, 1000, 10000 };
+
+/* Allocations made through the wrapped allocator (-Wl,--wrap=malloc,...) */
+static unsigned long bench_allocs = 0;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t nmemb, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+void *__wrap_malloc(size_t size) {
+    bench_allocs++;
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t nmemb, size_t size) {
+    bench_allocs++;
+    return __real_calloc(nmemb, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+    bench_allocs++;
+    return __real_realloc(ptr, size);
+}
+
+/* A benchmark runs at least ops operations per call and returns how many it ran, or -1 when an operation
+ * fails, which stops the bench with an error */
+typedef long (*bench_func)(void *ctx, long ops);
+
+/* JSON of the results, printed at the end as stdout is muted meanwhile */
+static char bench_json[L_BUFFER_LEN * 2];
+static int bench_json_len = 0;
+static int bench_count = 0;
+
+/* Time and allocations of the setup, which bench_pause() and bench_resume() leave out */
+static unsigned long long bench_paused_at, bench_paused_nsec;
+static unsigned long bench_paused_allocs_at, bench_paused_allocs;
+
+static unsigned long long bench_now() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void bench_pause() {
+    bench_paused_at = bench_now();
+    bench_paused_allocs_at = bench_allocs;
+}
+
+static void bench_resume() {
+    bench_paused_nsec += bench_now() - bench_paused_at;
+    bench_paused_allocs += bench_allocs - bench_paused_allocs_at;
+}
+
+static void bench_run(const char *name, int n, bench_func fn, void *ctx) {
+    unsigned long long start, elapsed;
+    unsigned long allocs;
+    long ops = 1, done;
+
+    for (;;) {
+        bench_paused_nsec = bench_paused_allocs = 0;
+        allocs = bench_allocs;
+        start = bench_now();
+        done = fn(ctx, ops);
+        if (done < 0) {
+            fprintf(stderr, "%s n=%d failed\n", name, n);
+            exit(1);
+        }
+        elapsed = bench_now() - start - bench_paused_nsec;
+        allocs = bench_allocs - allocs - bench_paused_allocs;
+        if (elapsed >= BENCH_MIN_NSEC || ops >= (1L << 30)) {
+            break;
+        }
+        ops *= 2;
+    }
+    fprintf(stderr, "%-36s n=%-6d %10.1f ns/op %8.2f allocs/op\n", name, n,
+            (double) elapsed / done, (double) allocs / done);
+    bench_json_len += snprintf(bench_json + bench_json_len, sizeof(bench_json) - bench_json_len,
+        "%s    {\"name\": \"%s\", \"n\": %d, \"ops\": %ld, \"ns_per_op\": %.1f, \"allocs_per_op\": %.2f}",
+        bench_count++ ? ",\n" : "", name, n, done, (double) elapsed / done, (double) allocs / done);
+}
+
+/* AP_CONFIGURE request of test.py, 8 TLVs */
+static char request[] = {
+    0x01, 0x10, 0x02, 0x01, 0x51, 0xff, 0xff,
+    0x00, 0x01, 0x11, 'I', 'n', 'd', 'i', 'g', 'o', '_', '1', '6', '0', '2', '8', '3', '9', '5', '9', '4',
+    0x00, 0x07, 0x01, '1',
+    0x00, 0x02, 0x02, '1', '1',
+    0x00, 0x1e, 0x01, 'g',
+    0x00, 0x0e, 0x20, '0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'a', 'b', 'c', 'd', 'e', 'f',
+                      '0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'a', 'b', 'c', 'd', 'e', 'f',
+    0x00, 0x0b, 0x01, '2',
+    0x00, 0x0c, 0x03, 'S', 'A', 'E',
+    0x00, 0x0d, 0x04, 'C', 'C', 'M', 'P',
+};
+
+static struct packet_wrapper wrapper;
+static struct packet_arena arena;
+
+static long bench_parse_packet(void *ctx, long ops) {
+    long i;
+
+    for (i = 0; i < ops; i++) {
+        parse_packet(&wrapper, request, sizeof(request));
+        free_packet_wrapper(&wrapper);
+    }
+    return ops;
+}
+
+static long bench_parse_packet_views(void *ctx, long ops) {
+    long i;
+
+    for (i = 0; i < ops; i++) {
+        parse_packet_views(&wrapper, request, sizeof(request));
+        free_packet_wrapper(&wrapper);
+    }
+    return ops;
+}
+
+/* Response of a typical handler: status, message and a value */
+static void fill_response(struct packet_wrapper *resp) {
+    fill_wrapper_message_hdr(resp, API_CMD_RESPONSE, 0x0151);
+    fill_wrapper_tlv_byte(resp, TLV_STATUS, TLV_VALUE_STATUS_OK);
+    fill_wrapper_tlv_bytes(resp, TLV_MESSAGE, strlen(TLV_VALUE_OK), TLV_VALUE_OK);
+    fill_wrapper_tlv_bytes(resp, TLV_DUT_MAC_ADDR, 17, "00:11:22:33:44:55");
+}
+
+static long bench_assemble_packet(void *ctx, long ops) {
+    char buffer[BUFFER_LEN];
+    long i;
+
+    for (i = 0; i < ops; i++) {
+        assemble_packet(buffer, sizeof(buffer), &wrapper);
+    }
+    return ops;
+}
+
+static long bench_fill_assemble_packet(void *ctx, long ops) {
+    char buffer[BUFFER_LEN];
+    struct packet_wrapper resp;
+    long i;
+
+    memset(&resp, 0, sizeof(resp));
+    resp.arena = ctx;
+    for (i = 0; i < ops; i++) {
+        fill_response(&resp);
+        assemble_packet(buffer, sizeof(buffer), &resp);
+        free_packet_wrapper(&resp);
+    }
+    return ops;
+}
+
+/* Looks up each TLV of the request, or the IDs that are not in it */
+static long bench_find_wrapper_tlv(void *ctx, long ops) {
+    static const int hit[] = { 0x0001, 0x0007, 0x0002, 0x001e, 0x000e, 0x000b, 0x000c, 0x000d };
+    static const int miss[] = { 0x0003, 0x0004, 0x0005, 0x0006, 0x0008, 0x0009, 0x000a, 0x000f };
+    const int *ids = ctx ? miss : hit;
+    long i;
+
+    for (i = 0; i < ops; i++) {
+        if (find_wrapper_tlv_by_id(&wrapper, ids[i & 7]) == NULL && !ctx) {
+            return -1;
+        }
+    }
+    return ops;
+}
+
+static long bench_get_api_by_id(void *ctx, long ops) {
+    static const int ids[] = { API_AP_START_UP, API_AP_CONFIGURE, API_STA_ASSOCIATE, API_STA_CONFIGURE,
+                               API_GET_IP_ADDR, API_GET_MAC_ADDR, API_GET_CONTROL_APP_VERSION, API_START_LOOP_BACK_SERVER };
+    long i;
+
+    for (i = 0; i < ops; i++) {
+        get_api_by_id(ids[i & 7]);
+    }
+    return ops;
+}
+
+static long bench_get_tlv_by_id(void *ctx, long ops) {
+    static const int ids[] = { TLV_SSID, TLV_CHANNEL, TLV_WPA_KEY_MGMT, TLV_STATUS,
+                               TLV_MESSAGE, TLV_CONTROL_APP_VERSION, TLV_BSS_IDENTIFIER, TLV_DUT_MAC_ADDR };
+    long i;
+
+    for (i = 0; i < ops; i++) {
+        get_tlv_by_id(ids[i & 7]);
+    }
+    return ops;
+}
+
+/* The ring is drained outside of the measure every half ring, so the lines are queued rather than dropped */
+static long bench_indigo_logger(void *ctx, long ops) {
+    int level = *(int *) ctx;
+    long i;
+
+    for (i = 0; i < ops; i++) {
+        if (i && (i & (LOG_RING_SIZE / 2 - 1)) == 0) {
+            bench_pause();
+            indigo_log_flush();
+            bench_resume();
+        }
+        indigo_logger(level, "API %s: Return execution result %d", "AP_CONFIGURE", (int) i);
+    }
+    bench_pause();
+    indigo_log_flush();
+    bench_resume();
+    return ops;
+}
+
+static void bench_timeout(void *eloop_ctx, void *timeout_ctx) {
+}
+
+/* Register n timeouts spread over some seconds, or all due at once */
+static void bench_register_timeouts(int n, int spread, eloop_timeout_handle *handles) {
+    int i;
+    unsigned int secs, usecs;
+
+    for (i = 0; i < n; i++) {
+        secs = spread ? 10 + i % 7 : 0;
+        usecs = spread ? i % 1000000 : 0;
+        if (handles) {
+            eloop_register_timeout_handle(secs, usecs, bench_timeout, NULL, (void *)(long) i, &handles[i]);
+        } else {
+            eloop_register_timeout(secs, usecs, bench_timeout, NULL, (void *)(long) i);
+        }
+    }
+}
+
+/* Insert n timeouts into an empty loop */
+static long bench_eloop_register(void *ctx, long ops) {
+    int n = *(int *) ctx;
+    long done;
+
+    for (done = 0; done < ops; done += n) {
+        bench_pause();
+        eloop_init(NULL);
+        bench_resume();
+        bench_register_timeouts(n, 1, NULL);
+        bench_pause();
+        eloop_destroy();
+        bench_resume();
+    }
+    return done;
+}
+
+/* Cancel each of n timeouts by its context */
+static long bench_eloop_cancel(void *ctx, long ops) {
+    int i, n = *(int *) ctx;
+    long done;
+
+    for (done = 0; done < ops; done += n) {
+        bench_pause();
+        eloop_init(NULL);
+        bench_register_timeouts(n, 1, NULL);
+        bench_resume();
+        for (i = 0; i < n; i++) {
+            eloop_cancel_timeout(bench_timeout, NULL, (void *)(long) i);
+        }
+        bench_pause();
+        eloop_destroy();
+        bench_resume();
+    }
+    return done;
+}
+
+/* Cancel each of n timeouts by its handle */
+static long bench_eloop_cancel_handle(void *ctx, long ops) {
+    int i, n = *(int *) ctx;
+    long done;
+    eloop_timeout_handle *handles;
+
+    bench_pause();
+    handles = malloc(n * sizeof(eloop_timeout_handle));
+    bench_resume();
+    for (done = 0; done < ops; done += n) {
+        bench_pause();
+        eloop_init(NULL);
+        bench_register_timeouts(n, 1, handles);
+        bench_resume();
+        for (i = 0; i < n; i++) {
+            eloop_cancel_timeout_handle(handles[i]);
+        }
+        bench_pause();
+        eloop_destroy();
+        bench_resume();
+    }
+    free(handles);
+    return done;
+}
+
+/* Run the loop until n timeouts that are due at once have fired */
+static long bench_eloop_fire(void *ctx, long ops) {
+    int n = *(int *) ctx;
+    long done;
+
+    for (done = 0; done < ops; done += n) {
+        bench_pause();
+        eloop_init(NULL);
+        bench_register_timeouts(n, 0, NULL);
+        bench_resume();
+        eloop_run();
+        bench_pause();
+        eloop_destroy();
+        bench_resume();
+    }
+    return done;
+}
+
+int main(int argc, char *argv[]) {
+    static const struct {
+        const char *name;
+        bench_func fn;
+    } timer_benches[] = {
+        { "eloop_register_timeout", bench_eloop_register },
+        { "eloop_cancel_timeout", bench_eloop_cancel },
+        { "eloop_cancel_timeout_handle", bench_eloop_cancel_handle },
+        { "eloop_timeout_fire", bench_eloop_fire },
+    };
+    static const char *level_names[] = { "debugverbose", "debug", "info", "notice", "warning", "error" };
+    char name[64];
+    int i, j, level, out, default_level = log_category_level[LOG_CATEGORY_APP];
+
+    /* Every log line goes to /dev/null. The JSON is printed once stdout is back. */
+    fflush(stdout);
+    out = dup(STDOUT_FILENO);
+    if (out < 0 || freopen("/dev/null", "w", stdout) == NULL) {
+        fprintf(stderr, "Failed to mute stdout\n");
+        return 1;
+    }
+
+    register_apis();
+
+    /* The codec and the registries without the cost of their log lines, which indigo_logger_* shows */
+    indigo_log_set_level(LOG_CATEGORY_ALL, LOG_LEVEL_ERROR + 1);
+
+    bench_run("parse_packet", 8, bench_parse_packet, NULL);
+    bench_run("parse_packet_views", 8, bench_parse_packet_views, NULL);
+
+    memset(&wrapper, 0, sizeof(wrapper));
+    wrapper.arena = &arena;
+    fill_response(&wrapper);
+    bench_run("assemble_packet", wrapper.tlv_num, bench_assemble_packet, NULL);
+    free_packet_wrapper(&wrapper);
+    wrapper.arena = NULL;
+    bench_run("fill_assemble_packet", 3, bench_fill_assemble_packet, &arena);
+
+    parse_packet_views(&wrapper, request, sizeof(request));
+    bench_run("find_wrapper_tlv_by_id", wrapper.tlv_num, bench_find_wrapper_tlv, NULL);
+    bench_run("find_wrapper_tlv_by_id_miss", wrapper.tlv_num, bench_find_wrapper_tlv, &wrapper);
+    free_packet_wrapper(&wrapper);
+
+    bench_run("get_api_by_id", 8, bench_get_api_by_id, NULL);
+    bench_run("get_tlv_by_id", 8, bench_get_tlv_by_id, NULL);
+
+    /* Levels under the default level of the category cost a branch. The others are queued for the flusher
+     * thread, as in the app. */
+    indigo_log_set_level(LOG_CATEGORY_ALL, default_level);
+    indigo_log_init();
+    for (level = LOG_LEVEL_DEBUG_VERBOSE; level <= LOG_LEVEL_ERROR; level++) {
+        snprintf(name, sizeof(name), "indigo_logger_%s", level_names[level]);
+        bench_run(name, 1, bench_indigo_logger, &level);
+    }
+    /* The same line kept in the binary log, formatted only by the decoder */
+    level = LOG_LEVEL_INFO;
+    if (indigo_log_binary_open("/tmp/app_bench.blog") == 0) {
+        bench_run("indigo_logger_info_binary", 1, bench_indigo_logger, &level);
+        indigo_log_binary_close();
+        unlink("/tmp/app_bench.blog");
+    }
+    /* Without the flusher, the caller writes the line to the outputs itself */
+    indigo_log_deinit();
+    bench_run("indigo_logger_info_sync", 1, bench_indigo_logger, &level);
+
+    for (i = 0; i < sizeof(timer_benches) / sizeof(timer_benches[0]); i++) {
+        for (j = 0; j < sizeof(bench_timer_counts) / sizeof(bench_timer_counts[0]); j++) {
+            bench_run(timer_benches[i].name, bench_timer_counts[j], timer_benches[i].fn, (void *) &bench_timer_counts[j]);
+        }
+    }
+
+    fflush(stdout);
+    dup2(out, STDOUT_FILENO);
+    close(out);
+
+    printf("{\n  \"commit\": \"%s\",\n", BENCH_COMMIT);
+#ifdef _DUT_
+    printf("  \"role\": \"dut\",\n");
+#else
+    printf("  \"role\": \"platform\",\n");
+#endif
+#ifdef CONFIG_ELOOP_EPOLL
+    printf("  \"eloop\": \"epoll\",\n");
+#else
+    printf("  \"eloop\": \"select\",\n");
+#endif
+    printf("  \"benchmarks\": [\n%s\n  ]\n}\n", bench_json);
+    return 0;
+}
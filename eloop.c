@@ -1,5 +1,6 @@
 /*
- * Event loop based on select() loop
+ * Event loop based on select() loop, or on epoll() when built with
+ * CONFIG_ELOOP_EPOLL
  * Copyright (c) 2002-2005, Jouni Malinen <jkmaline@cc.hut.fi>
  *
  * This program is free software; you can redistribute it and/or modify
@@ -14,12 +15,22 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <stdarg.h>
 #include <string.h>
 #include <sys/time.h>
+#include <time.h>
 #include <sys/types.h>
+#include <sys/socket.h>
 #include <unistd.h>
 #include <errno.h>
 #include <signal.h>
+#include <stdint.h>
+#include <sys/timerfd.h>
+#include <sys/eventfd.h>
+#include <pthread.h>
+#ifdef CONFIG_ELOOP_EPOLL
+#include <sys/epoll.h>
+#endif /* CONFIG_ELOOP_EPOLL */
 
 #ifdef CONFIG_NATIVE_WINDOWS
 #include "common.h"
@@ -33,15 +44,70 @@ struct eloop_sock {
 	int sock;
 	void *eloop_data;
 	void *user_data;
-	void (*handler)(int sock, void *eloop_ctx, void *sock_ctx);
+	eloop_sock_handler handler;
+};
+
+#define ELOOP_EVENT_TYPES (EVENT_TYPE_EXCEPTION + 1)
+
+#ifdef CONFIG_ELOOP_EPOLL
+/* Entry of the fd-indexed table: one handler per event type */
+struct eloop_fd {
+	struct eloop_sock handlers[ELOOP_EVENT_TYPES];
+	uint32_t events;
+};
+#else /* CONFIG_ELOOP_EPOLL */
+struct eloop_sock_table {
+	int count;
+	struct eloop_sock *table;
+};
+#endif /* CONFIG_ELOOP_EPOLL */
+
+/* One pending write; datagrams keep their destination address */
+struct eloop_send_buf {
+	struct eloop_send_buf *next;
+	size_t len, off;
+	int flags;
+	socklen_t tolen;
+	struct sockaddr_storage to;
+	unsigned char data[];
+};
+
+struct eloop_send_queue {
+	int sock;
+	int stream;
+	size_t bytes;
+	struct eloop_send_buf *head, *tail;
+	struct eloop_send_queue *next;
 };
 
 struct eloop_timeout {
-	struct timeval time;
+	unsigned long long time; /* CLOCK_MONOTONIC deadline in usec */
 	void *eloop_data;
 	void *user_data;
 	void (*handler)(void *eloop_ctx, void *sock_ctx);
-	struct eloop_timeout *next;
+	unsigned int generation; /* bumped on every reuse of the slot */
+	int heap_index;          /* -1 while the slot is on the free list */
+	int next_free;
+};
+
+struct eloop_periodic {
+	int fd; /* timerfd on CLOCK_MONOTONIC */
+	void *eloop_data;
+	void *user_data;
+	void (*handler)(void *eloop_ctx, void *timeout_ctx,
+			unsigned int ticks);
+	struct eloop_periodic *next;
+};
+
+#ifndef ELOOP_WORKER_THREADS
+#define ELOOP_WORKER_THREADS 4
+#endif /* ELOOP_WORKER_THREADS */
+
+struct eloop_work {
+	void (*fn)(void *ctx);
+	void (*done_cb)(void *ctx);
+	void *ctx;
+	struct eloop_work *next;
 };
 
 struct eloop_signal {
@@ -51,13 +117,89 @@ struct eloop_signal {
 	int signaled;
 };
 
+#define ELOOP_STATS_BUCKETS 24
+#define ELOOP_STATS_HANDLERS 64
+
+enum eloop_stats_kind {
+	ELOOP_STATS_SOCK,
+	ELOOP_STATS_TIMEOUT,
+	ELOOP_STATS_PERIODIC,
+	ELOOP_STATS_SIGNAL,
+	ELOOP_STATS_WORK
+};
+
+/* Values in usec; bucket[0] counts 0 and bucket[i] counts [2^(i-1), 2^i) */
+struct eloop_hist {
+	unsigned long count;
+	unsigned long long total;
+	unsigned long long max;
+	unsigned long bucket[ELOOP_STATS_BUCKETS];
+};
+
+struct eloop_handler_stats {
+	void (*handler)(void);
+	enum eloop_stats_kind kind;
+	struct eloop_hist latency;
+};
+
+struct eloop_stats {
+	int enabled;
+	unsigned long long since;
+	/* Time from wake-up until the loop waits again */
+	struct eloop_hist iteration;
+	/* Actual fire time minus deadline of timeouts and periodic timers */
+	struct eloop_hist slip;
+	int handler_count;
+	unsigned long untracked;
+	struct eloop_handler_stats handlers[ELOOP_STATS_HANDLERS];
+};
+
 struct eloop_data {
 	void *user_data;
 
-	int max_sock, reader_count;
-	struct eloop_sock *readers;
-
-	struct eloop_timeout *timeout;
+	/* Number of registered <sock,type> handlers */
+	int max_sock, sock_count;
+	/* Set when a handler is unregistered while sockets are dispatched */
+	int sock_table_changed;
+#ifdef CONFIG_ELOOP_EPOLL
+	int epollfd;
+	int fd_table_size;
+	struct eloop_fd *fd_table;
+	/* Number of fds in the epoll set */
+	int fd_count;
+	int epoll_max_event_num;
+	struct epoll_event *epoll_events;
+#else /* CONFIG_ELOOP_EPOLL */
+	struct eloop_sock_table readers;
+	struct eloop_sock_table writers;
+	struct eloop_sock_table exceptions;
+#endif /* CONFIG_ELOOP_EPOLL */
+
+	struct eloop_send_queue *send_queues;
+
+	/* Timeouts live in a slot pool and are ordered by a binary min-heap of
+	 * slot indices, so insert and cancel by handle are O(log n). */
+	struct eloop_timeout *timeout_pool;
+	int timeout_pool_size;
+	int timeout_free;
+	int *timeout_heap;
+	int timeout_count;
+
+	struct eloop_periodic *periodic;
+
+	/* Worker pool of eloop_submit_work(), started on first use. Finished
+	 * work is moved to the done list and signalled through work_fd. */
+	pthread_t workers[ELOOP_WORKER_THREADS];
+	int worker_count;
+	int work_fd;
+	int work_stop;
+	int work_outstanding;
+	pthread_mutex_t work_lock;
+	pthread_cond_t work_cond;
+	struct eloop_work *work_head, *work_tail;
+	struct eloop_work *done_head, *done_tail;
+
+	struct eloop_stats *stats;
 
 	int signal_count;
 	struct eloop_signal *signals;
@@ -74,28 +216,430 @@ void eloop_init(void *user_data)
 {
 	memset(&eloop, 0, sizeof(eloop));
 	eloop.user_data = user_data;
+	eloop.timeout_free = -1;
+	eloop.work_fd = -1;
+	pthread_mutex_init(&eloop.work_lock, NULL);
+	pthread_cond_init(&eloop.work_cond, NULL);
+#ifdef CONFIG_ELOOP_EPOLL
+	eloop.epollfd = epoll_create1(EPOLL_CLOEXEC);
+	if (eloop.epollfd < 0)
+		perror("epoll_create1");
+#endif /* CONFIG_ELOOP_EPOLL */
 }
 
 
-int eloop_register_read_sock(int sock,
-			     void (*handler)(int sock, void *eloop_ctx,
-					     void *sock_ctx),
-			     void *eloop_data, void *user_data)
+static unsigned long long eloop_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long) ts.tv_sec * 1000000ULL +
+		ts.tv_nsec / 1000;
+}
+
+
+static void eloop_hist_add(struct eloop_hist *hist, unsigned long long usec)
+{
+	int i = 0;
+
+	while (i < ELOOP_STATS_BUCKETS - 1 && (1ULL << i) <= usec)
+		i++;
+	hist->bucket[i]++;
+	hist->count++;
+	hist->total += usec;
+	if (usec > hist->max)
+		hist->max = usec;
+}
+
+
+static void eloop_stats_handler(void (*handler)(void),
+				enum eloop_stats_kind kind,
+				unsigned long long start)
+{
+	struct eloop_stats *stats = eloop.stats;
+	struct eloop_handler_stats *entry;
+	int i;
+
+	/* Stats may have been disabled by the handler itself */
+	if (stats == NULL || !stats->enabled)
+		return;
+	for (i = 0; i < stats->handler_count; i++) {
+		entry = &stats->handlers[i];
+		if (entry->handler == handler && entry->kind == kind)
+			break;
+	}
+	if (i == stats->handler_count) {
+		if (i == ELOOP_STATS_HANDLERS) {
+			stats->untracked++;
+			return;
+		}
+		stats->handler_count++;
+		stats->handlers[i].handler = handler;
+		stats->handlers[i].kind = kind;
+	}
+	eloop_hist_add(&stats->handlers[i].latency, eloop_now() - start);
+}
+
+/* Start time of an instrumented call, or 0 when stats are disabled */
+#define ELOOP_STATS_START() \
+	(eloop.stats && eloop.stats->enabled ? eloop_now() : 0)
+#define ELOOP_STATS_END(handler, kind, start) \
+	do { \
+		if (start) \
+			eloop_stats_handler((void (*)(void)) (handler), \
+					    (kind), (start)); \
+	} while (0)
+
+
+static void eloop_stats_slip(unsigned long long usec)
+{
+	if (eloop.stats && eloop.stats->enabled)
+		eloop_hist_add(&eloop.stats->slip, usec);
+}
+
+
+int eloop_stats_enable(int enable)
+{
+	if (enable && eloop.stats == NULL) {
+		eloop.stats = (struct eloop_stats *)
+			calloc(1, sizeof(struct eloop_stats));
+		if (eloop.stats == NULL)
+			return -1;
+		eloop.stats->since = eloop_now();
+	}
+	if (eloop.stats)
+		eloop.stats->enabled = !!enable;
+
+	return 0;
+}
+
+
+int eloop_stats_enabled(void)
+{
+	return eloop.stats && eloop.stats->enabled;
+}
+
+
+void eloop_stats_reset(void)
+{
+	int enabled;
+
+	if (eloop.stats == NULL)
+		return;
+	enabled = eloop.stats->enabled;
+	memset(eloop.stats, 0, sizeof(struct eloop_stats));
+	eloop.stats->enabled = enabled;
+	eloop.stats->since = eloop_now();
+}
+
+
+static int eloop_stats_printf(char *buf, size_t size, int pos,
+			      const char *fmt, ...)
+{
+	va_list ap;
+	int res;
+
+	if ((size_t) pos >= size)
+		return pos;
+	va_start(ap, fmt);
+	res = vsnprintf(buf + pos, size - pos, fmt, ap);
+	va_end(ap);
+	if (res < 0)
+		return pos;
+	/* Keep the output at whole lines when it is truncated */
+	if ((size_t) (pos + res) >= size) {
+		buf[pos] = '\0';
+		return size;
+	}
+
+	return pos + res;
+}
+
+
+static int eloop_stats_hist(char *buf, size_t size, int pos, const char *name,
+			    struct eloop_hist *hist, int histograms)
+{
+	int i;
+
+	pos = eloop_stats_printf(buf, size, pos,
+				 "%s n=%lu avg=%lluus max=%lluus\n", name,
+				 hist->count,
+				 hist->count ? hist->total / hist->count : 0,
+				 hist->max);
+	if (!histograms || hist->count == 0)
+		return pos;
+	for (i = 0; i < ELOOP_STATS_BUCKETS; i++) {
+		if (hist->bucket[i] == 0)
+			continue;
+		if (i == ELOOP_STATS_BUCKETS - 1)
+			pos = eloop_stats_printf(buf, size, pos,
+						 "  >=%lluus: %lu\n",
+						 1ULL << (i - 1),
+						 hist->bucket[i]);
+		else
+			pos = eloop_stats_printf(buf, size, pos,
+						 "  <%lluus: %lu\n",
+						 1ULL << i, hist->bucket[i]);
+	}
+
+	return pos;
+}
+
+
+int eloop_stats_dump(char *buf, size_t size, int histograms)
+{
+	static const char *kinds[] = {
+		"sock", "timeout", "periodic", "signal", "work"
+	};
+	struct eloop_stats *stats = eloop.stats;
+	unsigned long long elapsed;
+	char name[64];
+	int i, pos = 0;
+
+	if (size == 0)
+		return 0;
+	buf[0] = '\0';
+	if (stats == NULL || (!stats->enabled && stats->since == 0))
+		return eloop_stats_printf(buf, size, pos,
+					  "eloop stats disabled\n");
+
+	elapsed = eloop_now() - stats->since;
+	pos = eloop_stats_printf(buf, size, pos,
+				 "eloop stats %s, %llu.%03llu s, %d socks, "
+				 "%d timeouts\n",
+				 stats->enabled ? "enabled" : "disabled",
+				 elapsed / 1000000, elapsed % 1000000 / 1000,
+				 eloop.sock_count, eloop.timeout_count);
+	pos = eloop_stats_hist(buf, size, pos, "iteration", &stats->iteration,
+			       histograms);
+	pos = eloop_stats_hist(buf, size, pos, "timer slip", &stats->slip,
+			       histograms);
+	for (i = 0; i < stats->handler_count; i++) {
+		snprintf(name, sizeof(name), "%s %p",
+			 kinds[stats->handlers[i].kind],
+			 (void *) stats->handlers[i].handler);
+		pos = eloop_stats_hist(buf, size, pos, name,
+				       &stats->handlers[i].latency,
+				       histograms);
+	}
+	if (stats->untracked)
+		pos = eloop_stats_printf(buf, size, pos,
+					 "untracked calls %lu\n",
+					 stats->untracked);
+
+	return (size_t) pos >= size ? (int) strlen(buf) : pos;
+}
+
+
+#ifdef CONFIG_ELOOP_EPOLL
+static const uint32_t eloop_epoll_events[ELOOP_EVENT_TYPES] = {
+	EPOLLIN, EPOLLOUT, EPOLLPRI
+};
+
+
+static int eloop_fd_table_grow(int sock)
+{
+	struct eloop_fd *tmp;
+	int new_size;
+
+	if (sock < eloop.fd_table_size)
+		return 0;
+
+	new_size = eloop.fd_table_size ? eloop.fd_table_size : 16;
+	while (new_size <= sock)
+		new_size *= 2;
+	tmp = (struct eloop_fd *)
+		realloc(eloop.fd_table, new_size * sizeof(struct eloop_fd));
+	if (tmp == NULL)
+		return -1;
+	memset(&tmp[eloop.fd_table_size], 0,
+	       (new_size - eloop.fd_table_size) * sizeof(struct eloop_fd));
+	eloop.fd_table = tmp;
+	eloop.fd_table_size = new_size;
+
+	return 0;
+}
+
+
+int eloop_register_sock(int sock, eloop_event_type type,
+			eloop_sock_handler handler,
+			void *eloop_data, void *user_data)
+{
+	struct epoll_event ev;
+	struct eloop_fd *fd;
+
+	if (sock < 0 || type < EVENT_TYPE_READ || type > EVENT_TYPE_EXCEPTION ||
+	    eloop_fd_table_grow(sock) < 0)
+		return -1;
+	fd = &eloop.fd_table[sock];
+	if (fd->handlers[type].handler) {
+		fprintf(stderr, "eloop: sock %d already registered for event "
+			"type %d\n", sock, type);
+		return -1;
+	}
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = fd->events | eloop_epoll_events[type];
+	ev.data.fd = sock;
+	if (epoll_ctl(eloop.epollfd, fd->events ? EPOLL_CTL_MOD : EPOLL_CTL_ADD,
+		      sock, &ev) < 0) {
+		perror("epoll_ctl");
+		return -1;
+	}
+	if (fd->events == 0)
+		eloop.fd_count++;
+	fd->events = ev.events;
+
+	fd->handlers[type].sock = sock;
+	fd->handlers[type].eloop_data = eloop_data;
+	fd->handlers[type].user_data = user_data;
+	fd->handlers[type].handler = handler;
+	eloop.sock_count++;
+	if (sock > eloop.max_sock)
+		eloop.max_sock = sock;
+
+	return 0;
+}
+
+
+void eloop_unregister_sock(int sock, eloop_event_type type)
+{
+	struct epoll_event ev;
+	struct eloop_fd *fd;
+
+	if (sock < 0 || sock >= eloop.fd_table_size ||
+	    type < EVENT_TYPE_READ || type > EVENT_TYPE_EXCEPTION)
+		return;
+	fd = &eloop.fd_table[sock];
+	if (fd->handlers[type].handler == NULL)
+		return;
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = fd->events & ~eloop_epoll_events[type];
+	ev.data.fd = sock;
+	if (ev.events == 0) {
+		if (epoll_ctl(eloop.epollfd, EPOLL_CTL_DEL, sock, NULL) < 0)
+			perror("epoll_ctl(DEL)");
+		eloop.fd_count--;
+	} else if (epoll_ctl(eloop.epollfd, EPOLL_CTL_MOD, sock, &ev) < 0) {
+		perror("epoll_ctl(MOD)");
+	}
+	fd->events = ev.events;
+	memset(&fd->handlers[type], 0, sizeof(struct eloop_sock));
+	eloop.sock_count--;
+	eloop.sock_table_changed = 1;
+}
+
+
+static int eloop_sock_call(struct eloop_fd *fd, eloop_event_type type)
+{
+	struct eloop_sock *handler = &fd->handlers[type];
+	eloop_sock_handler cb = handler->handler;
+	unsigned long long start;
+
+	if (cb == NULL)
+		return 0;
+	start = ELOOP_STATS_START();
+	cb(handler->sock, handler->eloop_data, handler->user_data);
+	ELOOP_STATS_END(cb, ELOOP_STATS_SOCK, start);
+	/* The remaining events may refer to sockets that were just
+	 * unregistered (or reused); they are level-triggered and will be
+	 * reported again on the next epoll_wait(). */
+	return eloop.sock_table_changed;
+}
+
+
+/* Make room for an event per fd in the epoll set. Only called before
+ * epoll_wait(), so the events stay in place while they are dispatched even
+ * if a handler registers more sockets. */
+static int eloop_epoll_events_grow(void)
 {
+	struct epoll_event *tmp;
+	int next;
+
+	if (eloop.fd_count <= eloop.epoll_max_event_num)
+		return 0;
+	next = eloop.epoll_max_event_num ? eloop.epoll_max_event_num : 8;
+	while (next < eloop.fd_count)
+		next *= 2;
+	tmp = (struct epoll_event *)
+		realloc(eloop.epoll_events, next * sizeof(struct epoll_event));
+	if (tmp == NULL)
+		return -1;
+	eloop.epoll_events = tmp;
+	eloop.epoll_max_event_num = next;
+
+	return 0;
+}
+
+
+static void eloop_sock_table_dispatch(struct epoll_event *events, int nfds)
+{
+	uint32_t revents;
+	int i, sock;
+
+	eloop.sock_table_changed = 0;
+	for (i = 0; i < nfds; i++) {
+		sock = events[i].data.fd;
+		if (sock >= eloop.fd_table_size)
+			continue;
+		revents = events[i].events;
+		/* Errors and hangups are reported like select() would: the
+		 * socket becomes readable and writable. The entry is looked up
+		 * again after each handler, which may grow the fd table. */
+		if ((revents & (EPOLLPRI | EPOLLERR | EPOLLHUP)) &&
+		    eloop_sock_call(&eloop.fd_table[sock],
+				    EVENT_TYPE_EXCEPTION))
+			break;
+		if ((revents & (EPOLLIN | EPOLLERR | EPOLLHUP)) &&
+		    eloop_sock_call(&eloop.fd_table[sock], EVENT_TYPE_READ))
+			break;
+		if ((revents & (EPOLLOUT | EPOLLERR | EPOLLHUP)) &&
+		    eloop_sock_call(&eloop.fd_table[sock], EVENT_TYPE_WRITE))
+			break;
+	}
+}
+
+#else /* CONFIG_ELOOP_EPOLL */
+
+static struct eloop_sock_table *eloop_get_sock_table(eloop_event_type type)
+{
+	switch (type) {
+	case EVENT_TYPE_READ:
+		return &eloop.readers;
+	case EVENT_TYPE_WRITE:
+		return &eloop.writers;
+	case EVENT_TYPE_EXCEPTION:
+		return &eloop.exceptions;
+	}
+
+	return NULL;
+}
+
+
+int eloop_register_sock(int sock, eloop_event_type type,
+			eloop_sock_handler handler,
+			void *eloop_data, void *user_data)
+{
+	struct eloop_sock_table *table = eloop_get_sock_table(type);
 	struct eloop_sock *tmp;
 
+	if (table == NULL)
+		return -1;
+
 	tmp = (struct eloop_sock *)
-		realloc(eloop.readers,
-			(eloop.reader_count + 1) * sizeof(struct eloop_sock));
+		realloc(table->table,
+			(table->count + 1) * sizeof(struct eloop_sock));
 	if (tmp == NULL)
 		return -1;
 
-	tmp[eloop.reader_count].sock = sock;
-	tmp[eloop.reader_count].eloop_data = eloop_data;
-	tmp[eloop.reader_count].user_data = user_data;
-	tmp[eloop.reader_count].handler = handler;
-	eloop.reader_count++;
-	eloop.readers = tmp;
+	tmp[table->count].sock = sock;
+	tmp[table->count].eloop_data = eloop_data;
+	tmp[table->count].user_data = user_data;
+	tmp[table->count].handler = handler;
+	table->count++;
+	table->table = tmp;
+	eloop.sock_count++;
 	if (sock > eloop.max_sock)
 		eloop.max_sock = sock;
 
@@ -103,101 +647,611 @@ int eloop_register_read_sock(int sock,
 }
 
 
-void eloop_unregister_read_sock(int sock)
+void eloop_unregister_sock(int sock, eloop_event_type type)
 {
+	struct eloop_sock_table *table = eloop_get_sock_table(type);
 	int i;
 
-	if (eloop.readers == NULL || eloop.reader_count == 0)
+	if (table == NULL || table->table == NULL || table->count == 0)
 		return;
 
-	for (i = 0; i < eloop.reader_count; i++) {
-		if (eloop.readers[i].sock == sock)
+	for (i = 0; i < table->count; i++) {
+		if (table->table[i].sock == sock)
 			break;
 	}
-	if (i == eloop.reader_count)
+	if (i == table->count)
 		return;
-	if (i != eloop.reader_count - 1) {
-		memmove(&eloop.readers[i], &eloop.readers[i + 1],
-			(eloop.reader_count - i - 1) *
+	if (i != table->count - 1) {
+		memmove(&table->table[i], &table->table[i + 1],
+			(table->count - i - 1) *
 			sizeof(struct eloop_sock));
 	}
-	eloop.reader_count--;
+	table->count--;
+	eloop.sock_count--;
+	eloop.sock_table_changed = 1;
 }
 
 
-int eloop_register_timeout(unsigned int secs, unsigned int usecs,
-			   void (*handler)(void *eloop_ctx, void *timeout_ctx),
-			   void *eloop_data, void *user_data)
+static void eloop_sock_table_set_fds(struct eloop_sock_table *table,
+				     fd_set *fds)
+{
+	int i;
+
+	FD_ZERO(fds);
+	for (i = 0; i < table->count; i++)
+		FD_SET(table->table[i].sock, fds);
+}
+
+
+static int eloop_sock_table_dispatch(struct eloop_sock_table *table,
+				     fd_set *fds)
+{
+	eloop_sock_handler cb;
+	unsigned long long start;
+	int i;
+
+	for (i = 0; i < table->count; i++) {
+		if (FD_ISSET(table->table[i].sock, fds)) {
+			cb = table->table[i].handler;
+			start = ELOOP_STATS_START();
+			cb(table->table[i].sock, table->table[i].eloop_data,
+			   table->table[i].user_data);
+			ELOOP_STATS_END(cb, ELOOP_STATS_SOCK, start);
+			if (eloop.sock_table_changed)
+				return 1;
+		}
+	}
+
+	return 0;
+}
+
+#endif /* CONFIG_ELOOP_EPOLL */
+
+
+int eloop_register_read_sock(int sock, eloop_sock_handler handler,
+			     void *eloop_data, void *user_data)
 {
-	struct eloop_timeout *timeout, *tmp, *prev;
+	return eloop_register_sock(sock, EVENT_TYPE_READ, handler,
+				   eloop_data, user_data);
+}
+
+
+void eloop_unregister_read_sock(int sock)
+{
+	eloop_unregister_sock(sock, EVENT_TYPE_READ);
+}
+
 
-	timeout = (struct eloop_timeout *) malloc(sizeof(*timeout));
-	if (timeout == NULL)
+int eloop_register_write_sock(int sock, eloop_sock_handler handler,
+			      void *eloop_data, void *user_data)
+{
+	return eloop_register_sock(sock, EVENT_TYPE_WRITE, handler,
+				   eloop_data, user_data);
+}
+
+
+void eloop_unregister_write_sock(int sock)
+{
+	eloop_unregister_sock(sock, EVENT_TYPE_WRITE);
+}
+
+
+int eloop_register_exception_sock(int sock, eloop_sock_handler handler,
+				  void *eloop_data, void *user_data)
+{
+	return eloop_register_sock(sock, EVENT_TYPE_EXCEPTION, handler,
+				   eloop_data, user_data);
+}
+
+
+void eloop_unregister_exception_sock(int sock)
+{
+	eloop_unregister_sock(sock, EVENT_TYPE_EXCEPTION);
+}
+
+
+static struct eloop_send_queue *eloop_send_queue_get(int sock)
+{
+	struct eloop_send_queue *queue;
+
+	for (queue = eloop.send_queues; queue; queue = queue->next) {
+		if (queue->sock == sock)
+			return queue;
+	}
+
+	return NULL;
+}
+
+
+static void eloop_send_queue_free(struct eloop_send_queue *queue)
+{
+	struct eloop_send_queue **prev;
+	struct eloop_send_buf *buf, *next;
+
+	for (prev = &eloop.send_queues; *prev; prev = &(*prev)->next) {
+		if (*prev == queue) {
+			*prev = queue->next;
+			break;
+		}
+	}
+	for (buf = queue->head; buf; buf = next) {
+		next = buf->next;
+		free(buf);
+	}
+	free(queue);
+}
+
+
+static void eloop_send_queue_flush(int sock, void *eloop_ctx, void *sock_ctx)
+{
+	struct eloop_send_queue *queue = eloop_ctx;
+	struct eloop_send_buf *buf;
+	ssize_t res;
+
+	while ((buf = queue->head) != NULL) {
+		res = sendto(sock, buf->data + buf->off, buf->len - buf->off,
+			     buf->flags | MSG_DONTWAIT | MSG_NOSIGNAL,
+			     buf->tolen ? (struct sockaddr *) &buf->to : NULL,
+			     buf->tolen);
+		if (res < 0) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK ||
+			    errno == EINTR)
+				return;
+			perror("eloop: sendto");
+			/* A broken stream cannot continue; a failed datagram
+			 * only loses itself. */
+			res = buf->len - buf->off;
+			if (queue->stream) {
+				queue->head = NULL;
+				queue->bytes = 0;
+				for (; buf; buf = queue->tail) {
+					queue->tail = buf->next;
+					free(buf);
+				}
+				break;
+			}
+		}
+		buf->off += res;
+		queue->bytes -= res;
+		if (buf->off < buf->len)
+			return;
+		queue->head = buf->next;
+		free(buf);
+	}
+
+	eloop_unregister_sock(sock, EVENT_TYPE_WRITE);
+	eloop_send_queue_free(queue);
+}
+
+
+int eloop_sock_send(int sock, const void *data, size_t len, int flags,
+		    const struct sockaddr *to, socklen_t tolen)
+{
+	struct eloop_send_queue *queue;
+	struct eloop_send_buf *buf;
+	ssize_t res;
+	int type;
+	socklen_t optlen;
+
+	if (tolen > sizeof(buf->to))
+		return -1;
+
+	queue = eloop_send_queue_get(sock);
+	if (queue == NULL) {
+		res = sendto(sock, data, len, flags | MSG_DONTWAIT | MSG_NOSIGNAL,
+			     to, tolen);
+		if (res >= 0 && (size_t) res == len)
+			return 0;
+		if (res < 0) {
+			if (errno != EAGAIN && errno != EWOULDBLOCK &&
+			    errno != EINTR)
+				return -1;
+			res = 0;
+		}
+		data = (const unsigned char *) data + res;
+		len -= res;
+
+		queue = (struct eloop_send_queue *) calloc(1, sizeof(*queue));
+		if (queue == NULL)
+			return -1;
+		queue->sock = sock;
+		optlen = sizeof(type);
+		queue->stream = getsockopt(sock, SOL_SOCKET, SO_TYPE, &type,
+					   &optlen) == 0 &&
+			type == SOCK_STREAM;
+		if (eloop_register_sock(sock, EVENT_TYPE_WRITE,
+					eloop_send_queue_flush, queue,
+					NULL) < 0) {
+			free(queue);
+			return -1;
+		}
+		queue->next = eloop.send_queues;
+		eloop.send_queues = queue;
+	}
+
+	if (queue->bytes + len > ELOOP_SEND_QUEUE_MAX)
+		return -1;
+	buf = (struct eloop_send_buf *) malloc(sizeof(*buf) + len);
+	if (buf == NULL)
+		return -1;
+	buf->next = NULL;
+	buf->len = len;
+	buf->off = 0;
+	buf->flags = flags;
+	buf->tolen = tolen;
+	if (tolen)
+		memcpy(&buf->to, to, tolen);
+	memcpy(buf->data, data, len);
+
+	if (queue->tail)
+		queue->tail->next = buf;
+	else
+		queue->head = buf;
+	queue->tail = buf;
+	queue->bytes += len;
+
+	return 0;
+}
+
+
+size_t eloop_sock_send_pending(int sock)
+{
+	struct eloop_send_queue *queue = eloop_send_queue_get(sock);
+
+	return queue ? queue->bytes : 0;
+}
+
+
+void eloop_sock_send_drop(int sock)
+{
+	struct eloop_send_queue *queue = eloop_send_queue_get(sock);
+
+	if (queue == NULL)
+		return;
+	eloop_unregister_sock(sock, EVENT_TYPE_WRITE);
+	eloop_send_queue_free(queue);
+}
+
+
+#define TIMEOUT_SLOT(i) (&eloop.timeout_pool[eloop.timeout_heap[(i)]])
+
+static void eloop_timeout_heap_set(int i, int slot)
+{
+	eloop.timeout_heap[i] = slot;
+	eloop.timeout_pool[slot].heap_index = i;
+}
+
+
+static void eloop_timeout_sift_up(int i)
+{
+	int slot = eloop.timeout_heap[i];
+	unsigned long long time = eloop.timeout_pool[slot].time;
+	int parent;
+
+	while (i > 0) {
+		parent = (i - 1) / 2;
+		if (TIMEOUT_SLOT(parent)->time <= time)
+			break;
+		eloop_timeout_heap_set(i, eloop.timeout_heap[parent]);
+		i = parent;
+	}
+	eloop_timeout_heap_set(i, slot);
+}
+
+
+static void eloop_timeout_sift_down(int i)
+{
+	int slot = eloop.timeout_heap[i];
+	unsigned long long time = eloop.timeout_pool[slot].time;
+	int child;
+
+	for (;;) {
+		child = 2 * i + 1;
+		if (child >= eloop.timeout_count)
+			break;
+		if (child + 1 < eloop.timeout_count &&
+		    TIMEOUT_SLOT(child + 1)->time < TIMEOUT_SLOT(child)->time)
+			child++;
+		if (time <= TIMEOUT_SLOT(child)->time)
+			break;
+		eloop_timeout_heap_set(i, eloop.timeout_heap[child]);
+		i = child;
+	}
+	eloop_timeout_heap_set(i, slot);
+}
+
+
+static void eloop_timeout_free_slot(int slot)
+{
+	struct eloop_timeout *timeout = &eloop.timeout_pool[slot];
+
+	timeout->heap_index = -1;
+	timeout->handler = NULL;
+	timeout->generation++;
+	timeout->next_free = eloop.timeout_free;
+	eloop.timeout_free = slot;
+}
+
+
+/* Remove the heap entry at index i and return its slot to the free list */
+static void eloop_timeout_remove(int i)
+{
+	int slot = eloop.timeout_heap[i];
+
+	eloop.timeout_count--;
+	if (i != eloop.timeout_count) {
+		eloop_timeout_heap_set(i,
+				       eloop.timeout_heap[eloop.timeout_count]);
+		if (i > 0 && TIMEOUT_SLOT(i)->time <
+		    TIMEOUT_SLOT((i - 1) / 2)->time)
+			eloop_timeout_sift_up(i);
+		else
+			eloop_timeout_sift_down(i);
+	}
+	eloop_timeout_free_slot(slot);
+}
+
+
+static int eloop_timeout_pool_grow(void)
+{
+	struct eloop_timeout *pool;
+	int *heap;
+	int i, size;
+
+	size = eloop.timeout_pool_size ? eloop.timeout_pool_size * 2 : 16;
+	pool = (struct eloop_timeout *)
+		realloc(eloop.timeout_pool, size * sizeof(*pool));
+	if (pool == NULL)
 		return -1;
-	gettimeofday(&timeout->time, NULL);
-	timeout->time.tv_sec += secs;
-	timeout->time.tv_usec += usecs;
-	while (timeout->time.tv_usec >= 1000000) {
-		timeout->time.tv_sec++;
-		timeout->time.tv_usec -= 1000000;
+	eloop.timeout_pool = pool;
+	heap = (int *) realloc(eloop.timeout_heap, size * sizeof(*heap));
+	if (heap == NULL)
+		return -1;
+	eloop.timeout_heap = heap;
+
+	for (i = size - 1; i >= eloop.timeout_pool_size; i--) {
+		memset(&pool[i], 0, sizeof(pool[i]));
+		pool[i].generation = 1;
+		pool[i].heap_index = -1;
+		pool[i].next_free = eloop.timeout_free;
+		eloop.timeout_free = i;
 	}
+	eloop.timeout_pool_size = size;
+
+	return 0;
+}
+
+
+int eloop_register_timeout_handle(unsigned int secs, unsigned int usecs,
+				  void (*handler)(void *eloop_ctx,
+						  void *timeout_ctx),
+				  void *eloop_data, void *user_data,
+				  eloop_timeout_handle *handle)
+{
+	struct eloop_timeout *timeout;
+	int slot;
+
+	if (eloop.timeout_free < 0 && eloop_timeout_pool_grow() < 0)
+		return -1;
+
+	slot = eloop.timeout_free;
+	timeout = &eloop.timeout_pool[slot];
+	eloop.timeout_free = timeout->next_free;
+
+	timeout->time = eloop_now() + secs * 1000000ULL + usecs;
 	timeout->eloop_data = eloop_data;
 	timeout->user_data = user_data;
 	timeout->handler = handler;
-	timeout->next = NULL;
 
-	if (eloop.timeout == NULL) {
-		eloop.timeout = timeout;
+	eloop.timeout_heap[eloop.timeout_count] = slot;
+	eloop_timeout_sift_up(eloop.timeout_count++);
+
+	if (handle)
+		*handle = ((eloop_timeout_handle) timeout->generation << 32) |
+			(unsigned int) slot;
+
+	return 0;
+}
+
+
+int eloop_register_timeout(unsigned int secs, unsigned int usecs,
+			   void (*handler)(void *eloop_ctx, void *timeout_ctx),
+			   void *eloop_data, void *user_data)
+{
+	return eloop_register_timeout_handle(secs, usecs, handler, eloop_data,
+					     user_data, NULL);
+}
+
+
+int eloop_cancel_timeout_handle(eloop_timeout_handle handle)
+{
+	unsigned int slot = (unsigned int) (handle & 0xffffffff);
+	unsigned int generation = (unsigned int) (handle >> 32);
+	struct eloop_timeout *timeout;
+
+	if (slot >= (unsigned int) eloop.timeout_pool_size)
 		return 0;
+	timeout = &eloop.timeout_pool[slot];
+	if (timeout->generation != generation || timeout->heap_index < 0)
+		return 0;
+
+	eloop_timeout_remove(timeout->heap_index);
+
+	return 1;
+}
+
+
+int eloop_cancel_timeout(void (*handler)(void *eloop_ctx, void *sock_ctx),
+			 void *eloop_data, void *user_data)
+{
+	struct eloop_timeout *timeout;
+	int i, kept = 0, removed = 0;
+
+	/* Matching has to look at every entry anyway, so compact the heap in
+	 * one pass and rebuild it instead of removing entries one by one. */
+	for (i = 0; i < eloop.timeout_count; i++) {
+		timeout = TIMEOUT_SLOT(i);
+		if (timeout->handler == handler &&
+		    (timeout->eloop_data == eloop_data ||
+		     eloop_data == ELOOP_ALL_CTX) &&
+		    (timeout->user_data == user_data ||
+		     user_data == ELOOP_ALL_CTX)) {
+			eloop_timeout_free_slot(eloop.timeout_heap[i]);
+			removed++;
+		} else
+			eloop.timeout_heap[kept++] = eloop.timeout_heap[i];
 	}
 
-	prev = NULL;
-	tmp = eloop.timeout;
-	while (tmp != NULL) {
-		if (timercmp(&timeout->time, &tmp->time, <))
+	if (removed) {
+		eloop.timeout_count = kept;
+		for (i = 0; i < kept; i++)
+			eloop.timeout_pool[eloop.timeout_heap[i]].heap_index =
+				i;
+		for (i = kept / 2 - 1; i >= 0; i--)
+			eloop_timeout_sift_down(i);
+	}
+
+	return removed;
+}
+
+
+/* Run every timeout whose deadline is not later than now */
+static void eloop_process_timeouts(void)
+{
+	struct eloop_timeout *timeout;
+	void (*handler)(void *eloop_ctx, void *sock_ctx);
+	void *eloop_data, *user_data;
+	unsigned long long now, start;
+
+	now = eloop_now();
+	while (eloop.timeout_count > 0 && !eloop.terminate) {
+		timeout = TIMEOUT_SLOT(0);
+		if (timeout->time > now)
 			break;
-		prev = tmp;
-		tmp = tmp->next;
+		handler = timeout->handler;
+		eloop_data = timeout->eloop_data;
+		user_data = timeout->user_data;
+		/* The handler may register or cancel timeouts (and grow the
+		 * pool), so release the slot before calling it. */
+		eloop_stats_slip(now - timeout->time);
+		eloop_timeout_remove(0);
+		start = ELOOP_STATS_START();
+		handler(eloop_data, user_data);
+		ELOOP_STATS_END(handler, ELOOP_STATS_TIMEOUT, start);
 	}
+}
+
 
-	if (prev == NULL) {
-		timeout->next = eloop.timeout;
-		eloop.timeout = timeout;
-	} else {
-		timeout->next = prev->next;
-		prev->next = timeout;
+static void eloop_periodic_receive(int sock, void *eloop_ctx, void *sock_ctx)
+{
+	struct eloop_periodic *periodic = eloop_ctx;
+	void (*handler)(void *eloop_ctx, void *timeout_ctx,
+			unsigned int ticks) = periodic->handler;
+	uint64_t expirations = 0;
+	struct itimerspec its;
+	unsigned long long start, period, left;
+
+	if (read(sock, &expirations, sizeof(expirations)) !=
+	    sizeof(expirations) || expirations == 0)
+		return;
+	if (expirations > 0xffffffff)
+		expirations = 0xffffffff;
+
+	/* The latest tick was one period before the next one */
+	if (eloop_stats_enabled() && timerfd_gettime(sock, &its) == 0) {
+		period = its.it_interval.tv_sec * 1000000ULL +
+			its.it_interval.tv_nsec / 1000;
+		left = its.it_value.tv_sec * 1000000ULL +
+			its.it_value.tv_nsec / 1000;
+		eloop_stats_slip(period > left ? period - left : 0);
 	}
 
+	/* The handler may cancel this (or any other) periodic timer */
+	start = ELOOP_STATS_START();
+	handler(periodic->eloop_data, periodic->user_data,
+		(unsigned int) expirations);
+	ELOOP_STATS_END(handler, ELOOP_STATS_PERIODIC, start);
+}
+
+
+int eloop_register_periodic(unsigned int secs, unsigned int usecs,
+			    void (*handler)(void *eloop_ctx,
+					    void *timeout_ctx,
+					    unsigned int ticks),
+			    void *eloop_data, void *user_data)
+{
+	struct eloop_periodic *periodic;
+	struct itimerspec spec;
+
+	secs += usecs / 1000000;
+	usecs %= 1000000;
+	if (secs == 0 && usecs == 0)
+		return -1;
+
+	periodic = (struct eloop_periodic *) malloc(sizeof(*periodic));
+	if (periodic == NULL)
+		return -1;
+	periodic->fd = timerfd_create(CLOCK_MONOTONIC,
+				      TFD_NONBLOCK | TFD_CLOEXEC);
+	if (periodic->fd < 0) {
+		perror("timerfd_create");
+		free(periodic);
+		return -1;
+	}
+	periodic->eloop_data = eloop_data;
+	periodic->user_data = user_data;
+	periodic->handler = handler;
+
+	/* Absolute deadlines: ticks stay on the original grid no matter how
+	 * long the handler or the rest of the loop takes. */
+	memset(&spec, 0, sizeof(spec));
+	clock_gettime(CLOCK_MONOTONIC, &spec.it_value);
+	spec.it_interval.tv_sec = secs;
+	spec.it_interval.tv_nsec = usecs * 1000;
+	if (timerfd_settime(periodic->fd, TFD_TIMER_ABSTIME, &spec, NULL) < 0 ||
+	    eloop_register_read_sock(periodic->fd, eloop_periodic_receive,
+				     periodic, NULL) < 0) {
+		close(periodic->fd);
+		free(periodic);
+		return -1;
+	}
+
+	periodic->next = eloop.periodic;
+	eloop.periodic = periodic;
+
 	return 0;
 }
 
 
-int eloop_cancel_timeout(void (*handler)(void *eloop_ctx, void *sock_ctx),
-			 void *eloop_data, void *user_data)
+int eloop_cancel_periodic(void (*handler)(void *eloop_ctx, void *timeout_ctx,
+					  unsigned int ticks),
+			  void *eloop_data, void *user_data)
 {
-	struct eloop_timeout *timeout, *prev, *next;
+	struct eloop_periodic *periodic, *prev, *next;
 	int removed = 0;
 
 	prev = NULL;
-	timeout = eloop.timeout;
-	while (timeout != NULL) {
-		next = timeout->next;
+	periodic = eloop.periodic;
+	while (periodic != NULL) {
+		next = periodic->next;
 
-		if (timeout->handler == handler &&
-		    (timeout->eloop_data == eloop_data ||
+		if (periodic->handler == handler &&
+		    (periodic->eloop_data == eloop_data ||
 		     eloop_data == ELOOP_ALL_CTX) &&
-		    (timeout->user_data == user_data ||
+		    (periodic->user_data == user_data ||
 		     user_data == ELOOP_ALL_CTX)) {
 			if (prev == NULL)
-				eloop.timeout = next;
+				eloop.periodic = next;
 			else
 				prev->next = next;
-			free(timeout);
+			eloop_unregister_read_sock(periodic->fd);
+			close(periodic->fd);
+			free(periodic);
 			removed++;
 		} else
-			prev = timeout;
+			prev = periodic;
 
-		timeout = next;
+		periodic = next;
 	}
 
 	return removed;
@@ -205,6 +1259,177 @@ int eloop_cancel_timeout(void (*handler)(void *eloop_ctx, void *sock_ctx),
 
 
 #ifndef CONFIG_NATIVE_WINDOWS
+static void * eloop_worker(void *arg)
+{
+	struct eloop_work *work;
+	uint64_t one = 1;
+
+	pthread_mutex_lock(&eloop.work_lock);
+	for (;;) {
+		while (eloop.work_head == NULL && !eloop.work_stop)
+			pthread_cond_wait(&eloop.work_cond, &eloop.work_lock);
+		if (eloop.work_head == NULL)
+			break;
+		work = eloop.work_head;
+		eloop.work_head = work->next;
+		if (eloop.work_head == NULL)
+			eloop.work_tail = NULL;
+		pthread_mutex_unlock(&eloop.work_lock);
+
+		work->fn(work->ctx);
+
+		pthread_mutex_lock(&eloop.work_lock);
+		work->next = NULL;
+		if (eloop.done_tail)
+			eloop.done_tail->next = work;
+		else
+			eloop.done_head = work;
+		eloop.done_tail = work;
+		if (write(eloop.work_fd, &one, sizeof(one)) < 0)
+			perror("eloop: eventfd write");
+	}
+	pthread_mutex_unlock(&eloop.work_lock);
+
+	return NULL;
+}
+
+
+static void eloop_work_receive(int sock, void *eloop_ctx, void *sock_ctx)
+{
+	struct eloop_work *work, *next;
+	unsigned long long start;
+	uint64_t count;
+
+	if (read(sock, &count, sizeof(count)) < 0 && errno != EAGAIN)
+		perror("eloop: eventfd read");
+
+	pthread_mutex_lock(&eloop.work_lock);
+	work = eloop.done_head;
+	eloop.done_head = eloop.done_tail = NULL;
+	pthread_mutex_unlock(&eloop.work_lock);
+
+	for (; work; work = next) {
+		next = work->next;
+		/* Drop the reader before the last callback runs, so a callback
+		 * that submits new work registers it again. */
+		if (--eloop.work_outstanding == 0)
+			eloop_unregister_read_sock(eloop.work_fd);
+		if (work->done_cb) {
+			start = ELOOP_STATS_START();
+			work->done_cb(work->ctx);
+			ELOOP_STATS_END(work->done_cb, ELOOP_STATS_WORK, start);
+		}
+		free(work);
+	}
+}
+
+
+static int eloop_work_start(void)
+{
+	sigset_t all, old;
+	int i;
+
+	eloop.work_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (eloop.work_fd < 0) {
+		perror("eventfd");
+		return -1;
+	}
+
+	/* Signals are left to the loop thread so they interrupt its wait */
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &old);
+	for (i = 0; i < ELOOP_WORKER_THREADS; i++) {
+		if (pthread_create(&eloop.workers[i], NULL, eloop_worker,
+				   NULL) != 0)
+			break;
+		eloop.worker_count++;
+	}
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+	if (eloop.worker_count == 0) {
+		fprintf(stderr, "eloop: failed to start worker threads\n");
+		close(eloop.work_fd);
+		eloop.work_fd = -1;
+		return -1;
+	}
+
+	return 0;
+}
+
+
+int eloop_submit_work(void (*fn)(void *ctx), void (*done_cb)(void *ctx),
+		      void *ctx)
+{
+	struct eloop_work *work;
+
+	if (fn == NULL)
+		return -1;
+	if (eloop.work_fd < 0 && eloop_work_start() < 0)
+		return -1;
+	if (eloop.work_outstanding == 0 &&
+	    eloop_register_read_sock(eloop.work_fd, eloop_work_receive,
+				     NULL, NULL) < 0)
+		return -1;
+
+	work = (struct eloop_work *) malloc(sizeof(*work));
+	if (work == NULL) {
+		if (eloop.work_outstanding == 0)
+			eloop_unregister_read_sock(eloop.work_fd);
+		return -1;
+	}
+	work->fn = fn;
+	work->done_cb = done_cb;
+	work->ctx = ctx;
+	work->next = NULL;
+	eloop.work_outstanding++;
+
+	pthread_mutex_lock(&eloop.work_lock);
+	if (eloop.work_tail)
+		eloop.work_tail->next = work;
+	else
+		eloop.work_head = work;
+	eloop.work_tail = work;
+	pthread_cond_signal(&eloop.work_cond);
+	pthread_mutex_unlock(&eloop.work_lock);
+
+	return 0;
+}
+
+
+static void eloop_work_destroy(void)
+{
+	struct eloop_work *work, *next;
+	int i;
+
+	pthread_mutex_lock(&eloop.work_lock);
+	eloop.work_stop = 1;
+	/* Queued work that has not started is dropped */
+	work = eloop.work_head;
+	eloop.work_head = eloop.work_tail = NULL;
+	pthread_cond_broadcast(&eloop.work_cond);
+	pthread_mutex_unlock(&eloop.work_lock);
+	for (; work; work = next) {
+		next = work->next;
+		free(work);
+	}
+
+	for (i = 0; i < eloop.worker_count; i++)
+		pthread_join(eloop.workers[i], NULL);
+	eloop.worker_count = 0;
+
+	for (work = eloop.done_head; work; work = next) {
+		next = work->next;
+		free(work);
+	}
+	eloop.done_head = eloop.done_tail = NULL;
+	if (eloop.work_fd >= 0)
+		close(eloop.work_fd);
+	eloop.work_fd = -1;
+	pthread_mutex_destroy(&eloop.work_lock);
+	pthread_cond_destroy(&eloop.work_cond);
+}
+
+
 static void eloop_handle_alarm(int sig)
 {
 	fprintf(stderr, "eloop: could not process SIGINT or SIGTERM in two "
@@ -244,6 +1469,7 @@ static void eloop_handle_signal(int sig)
 
 static void eloop_process_pending_signals(void)
 {
+	unsigned long long start;
 	int i;
 
 	if (eloop.signaled == 0)
@@ -260,9 +1486,12 @@ static void eloop_process_pending_signals(void)
 	for (i = 0; i < eloop.signal_count; i++) {
 		if (eloop.signals[i].signaled) {
 			eloop.signals[i].signaled = 0;
+			start = ELOOP_STATS_START();
 			eloop.signals[i].handler(eloop.signals[i].sig,
 						 eloop.user_data,
 						 eloop.signals[i].user_data);
+			ELOOP_STATS_END(eloop.signals[i].handler,
+					ELOOP_STATS_SIGNAL, start);
 		}
 	}
 }
@@ -296,71 +1525,101 @@ int eloop_register_signal(int sig,
 
 void eloop_run(void)
 {
-	fd_set *rfds;
-	int i, res;
-	struct timeval tv, now;
-
+#ifdef CONFIG_ELOOP_EPOLL
+	struct epoll_event dummy_event, *events;
+	int max_events, timeout_ms;
+#else /* CONFIG_ELOOP_EPOLL */
+	fd_set *rfds, *wfds, *efds;
+#endif /* CONFIG_ELOOP_EPOLL */
+	int res;
+	struct timeval tv;
+	unsigned long long now, next, wakeup;
+
+#ifndef CONFIG_ELOOP_EPOLL
 	rfds = malloc(sizeof(*rfds));
-	if (rfds == NULL) {
+	wfds = malloc(sizeof(*wfds));
+	efds = malloc(sizeof(*efds));
+	if (rfds == NULL || wfds == NULL || efds == NULL) {
 		printf("eloop_run - malloc failed\n");
-		return;
+		goto out;
 	}
+#endif /* CONFIG_ELOOP_EPOLL */
 
 	while (!eloop.terminate &&
-		(eloop.timeout || eloop.reader_count > 0)) {
-		if (eloop.timeout) {
-			gettimeofday(&now, NULL);
-			if (timercmp(&now, &eloop.timeout->time, <))
-				timersub(&eloop.timeout->time, &now, &tv);
-			else
-				tv.tv_sec = tv.tv_usec = 0;
+		(eloop.timeout_count > 0 || eloop.sock_count > 0)) {
+		if (eloop.timeout_count > 0) {
+			now = eloop_now();
+			next = TIMEOUT_SLOT(0)->time;
+			next = next > now ? next - now : 0;
+			tv.tv_sec = next / 1000000;
+			tv.tv_usec = next % 1000000;
 #if 0
 			printf("next timeout in %lu.%06lu sec\n",
 			       tv.tv_sec, tv.tv_usec);
 #endif
 		}
 
-		FD_ZERO(rfds);
-		for (i = 0; i < eloop.reader_count; i++)
-			FD_SET(eloop.readers[i].sock, rfds);
-		res = select(eloop.max_sock + 1, rfds, NULL, NULL,
-			     eloop.timeout ? &tv : NULL);
+#ifdef CONFIG_ELOOP_EPOLL
+		if (eloop_epoll_events_grow() < 0) {
+			printf("eloop_run - realloc failed\n");
+			return;
+		}
+		if (eloop.epoll_events) {
+			events = eloop.epoll_events;
+			max_events = eloop.epoll_max_event_num;
+		} else {
+			events = &dummy_event;
+			max_events = 1;
+		}
+		/* Round up so that a pending timeout never busy-loops */
+		timeout_ms = eloop.timeout_count > 0 ?
+			tv.tv_sec * 1000 + (tv.tv_usec + 999) / 1000 : -1;
+		res = epoll_wait(eloop.epollfd, events, max_events,
+				 timeout_ms);
 		if (res < 0 && errno != EINTR) {
-			perror("select");
-			free(rfds);
+			perror("epoll_wait");
 			return;
 		}
+#else /* CONFIG_ELOOP_EPOLL */
+		eloop_sock_table_set_fds(&eloop.readers, rfds);
+		eloop_sock_table_set_fds(&eloop.writers, wfds);
+		eloop_sock_table_set_fds(&eloop.exceptions, efds);
+		res = select(eloop.max_sock + 1, rfds, wfds, efds,
+			     eloop.timeout_count > 0 ? &tv : NULL);
+		if (res < 0 && errno != EINTR) {
+			perror("select");
+			goto out;
+		}
+#endif /* CONFIG_ELOOP_EPOLL */
+		wakeup = ELOOP_STATS_START();
 		eloop_process_pending_signals();
 
-		/* check if some registered timeouts have occurred */
-		if (eloop.timeout) {
-			struct eloop_timeout *tmp;
-
-			gettimeofday(&now, NULL);
-			if (!timercmp(&now, &eloop.timeout->time, <)) {
-				tmp = eloop.timeout;
-				eloop.timeout = eloop.timeout->next;
-				tmp->handler(tmp->eloop_data,
-					     tmp->user_data);
-				free(tmp);
-			}
-
+		/* run all registered timeouts that have expired */
+		eloop_process_timeouts();
+
+		if (res > 0) {
+#ifdef CONFIG_ELOOP_EPOLL
+			eloop_sock_table_dispatch(events, res);
+#else /* CONFIG_ELOOP_EPOLL */
+			eloop.sock_table_changed = 0;
+			if (!eloop_sock_table_dispatch(&eloop.readers, rfds) &&
+			    !eloop_sock_table_dispatch(&eloop.writers, wfds))
+				eloop_sock_table_dispatch(&eloop.exceptions,
+							  efds);
+#endif /* CONFIG_ELOOP_EPOLL */
 		}
 
-		if (res <= 0)
-			continue;
-
-		for (i = 0; i < eloop.reader_count; i++) {
-			if (FD_ISSET(eloop.readers[i].sock, rfds)) {
-				eloop.readers[i].handler(
-					eloop.readers[i].sock,
-					eloop.readers[i].eloop_data,
-					eloop.readers[i].user_data);
-			}
-		}
+		if (wakeup && eloop.stats && eloop.stats->enabled)
+			eloop_hist_add(&eloop.stats->iteration,
+				       eloop_now() - wakeup);
 	}
 
+#ifndef CONFIG_ELOOP_EPOLL
+out:
 	free(rfds);
+	free(wfds);
+	free(efds);
+#endif /* CONFIG_ELOOP_EPOLL */
 }
 
 
@@ -372,16 +1631,34 @@ void eloop_terminate(void)
 
 void eloop_destroy(void)
 {
-	struct eloop_timeout *timeout, *prev;
+	struct eloop_periodic *periodic, *prev;
 
-	timeout = eloop.timeout;
-	while (timeout != NULL) {
-		prev = timeout;
-		timeout = timeout->next;
+	periodic = eloop.periodic;
+	while (periodic != NULL) {
+		prev = periodic;
+		periodic = periodic->next;
+		close(prev->fd);
 		free(prev);
 	}
-	free(eloop.readers);
+	eloop_work_destroy();
+	free(eloop.stats);
+	free(eloop.timeout_pool);
+	free(eloop.timeout_heap);
+	while (eloop.send_queues)
+		eloop_send_queue_free(eloop.send_queues);
 	free(eloop.signals);
+#ifdef CONFIG_ELOOP_EPOLL
+	free(eloop.fd_table);
+	free(eloop.epoll_events);
+#else /* CONFIG_ELOOP_EPOLL */
+	free(eloop.readers.table);
+	free(eloop.writers.table);
+	free(eloop.exceptions.table);
+#endif /* CONFIG_ELOOP_EPOLL */
+#ifdef CONFIG_ELOOP_EPOLL
+	if (eloop.epollfd >= 0)
+		close(eloop.epollfd);
+#endif /* CONFIG_ELOOP_EPOLL */
 }
 
 
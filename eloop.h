@@ -15,7 +15,10 @@
  * from registered timeouts (i.e., do something after N seconds), sockets
  * (e.g., a new packet available for reading), and signals. eloop.c is an
  * implementation of this interface using select() and sockets. This is
- * suitable for most UNIX/POSIX systems. When porting to other operating
+ * suitable for most UNIX/POSIX systems. On Linux, building with
+ * CONFIG_ELOOP_EPOLL replaces select() with epoll() and an fd-indexed handler
+ * table, which removes the FD_SETSIZE limit and the per-iteration scan of all
+ * registered sockets. When porting to other operating
  * systems, it may be necessary to replace that implementation with OS specific
  * mechanisms.
  */
@@ -23,9 +26,38 @@
 #ifndef ELOOP_H
 #define ELOOP_H
 
+#include <stddef.h>
+#include <sys/socket.h>
+
 /* Magic number for eloop_cancel_timeout() */
 #define ELOOP_ALL_CTX (void *) -1
 
+/* Upper bound of the bytes queued by eloop_sock_send() for one socket */
+#define ELOOP_SEND_QUEUE_MAX (256 * 1024)
+
+/**
+ * eloop_event_type - eloop socket event type for eloop_register_sock()
+ * @EVENT_TYPE_READ: Socket has data available for reading
+ * @EVENT_TYPE_WRITE: Socket has room for new data to be written
+ * @EVENT_TYPE_EXCEPTION: An exception has been reported
+ */
+typedef enum {
+	EVENT_TYPE_READ = 0,
+	EVENT_TYPE_WRITE,
+	EVENT_TYPE_EXCEPTION
+} eloop_event_type;
+
+/**
+ * eloop_sock_handler - eloop socket event callback type
+ * @sock: File descriptor number for the socket
+ * @eloop_ctx: Registered callback context data (eloop_data)
+ * @sock_ctx: Registered callback context data (user_data)
+ */
+typedef void (*eloop_sock_handler)(int sock, void *eloop_ctx, void *sock_ctx);
+
+/* Opaque handle of a single registered timeout; 0 is never a valid handle */
+typedef unsigned long long eloop_timeout_handle;
+
 /**
  * eloop_init() - Initialize global event loop data
  * @user_data: Pointer to global data passed as eloop_ctx to signal handlers
@@ -48,9 +80,7 @@ void eloop_init(void *user_data);
  * function will be called whenever data is available for reading from the
  * socket.
  */
-int eloop_register_read_sock(int sock,
-			     void (*handler)(int sock, void *eloop_ctx,
-					     void *sock_ctx),
+int eloop_register_read_sock(int sock, eloop_sock_handler handler,
 			     void *eloop_data, void *user_data);
 
 /**
@@ -62,6 +92,106 @@ int eloop_register_read_sock(int sock,
  */
 void eloop_unregister_read_sock(int sock);
 
+/**
+ * eloop_register_write_sock - Register handler for write events
+ * @sock: File descriptor number for the socket
+ * @handler: Callback function to be called when the socket is writable
+ * @eloop_data: Callback context data (eloop_ctx)
+ * @user_data: Callback context data (sock_ctx)
+ * Returns: 0 on success, -1 on failure
+ *
+ * Register a write socket notifier for the given file descriptor. The handler
+ * function will be called whenever data can be written to the socket, so it
+ * should be unregistered as soon as there is nothing left to write. A
+ * nonblocking connect() is reported complete through this event.
+ */
+int eloop_register_write_sock(int sock, eloop_sock_handler handler,
+			      void *eloop_data, void *user_data);
+
+/**
+ * eloop_unregister_write_sock - Unregister handler for write events
+ * @sock: File descriptor number for the socket
+ */
+void eloop_unregister_write_sock(int sock);
+
+/**
+ * eloop_register_exception_sock - Register handler for exception events
+ * @sock: File descriptor number for the socket
+ * @handler: Callback function to be called on an exception condition
+ * @eloop_data: Callback context data (eloop_ctx)
+ * @user_data: Callback context data (sock_ctx)
+ * Returns: 0 on success, -1 on failure
+ *
+ * With CONFIG_ELOOP_EPOLL, errors and hangups are reported to this handler
+ * as well; they are also reported to the read and write handlers the same
+ * way select() marks such a socket readable and writable.
+ */
+int eloop_register_exception_sock(int sock, eloop_sock_handler handler,
+				  void *eloop_data, void *user_data);
+
+/**
+ * eloop_unregister_exception_sock - Unregister handler for exception events
+ * @sock: File descriptor number for the socket
+ */
+void eloop_unregister_exception_sock(int sock);
+
+/**
+ * eloop_register_sock - Register handler for socket events
+ * @sock: File descriptor number for the socket
+ * @type: Type of event to wait for
+ * @handler: Callback function to be called when the event is triggered
+ * @eloop_data: Callback context data (eloop_ctx)
+ * @user_data: Callback context data (sock_ctx)
+ * Returns: 0 on success, -1 on failure
+ *
+ * Generic version of eloop_register_{read,write,exception}_sock(). Each
+ * socket can have at most one handler per event type.
+ */
+int eloop_register_sock(int sock, eloop_event_type type,
+			eloop_sock_handler handler,
+			void *eloop_data, void *user_data);
+
+/**
+ * eloop_unregister_sock - Unregister handler for socket events
+ * @sock: File descriptor number for the socket
+ * @type: Type of event for which sock was registered
+ */
+void eloop_unregister_sock(int sock, eloop_event_type type);
+
+/**
+ * eloop_sock_send - Send data without blocking the event loop
+ * @sock: File descriptor number for the socket
+ * @data: Data to send
+ * @len: Length of data
+ * @flags: sendto() flags; MSG_DONTWAIT and MSG_NOSIGNAL are always added
+ * @to: Destination address or %NULL for a connected socket
+ * @tolen: Length of the destination address
+ * Returns: 0 if the data was sent or queued, -1 on failure
+ *
+ * Data is sent right away when the socket has room and nothing else is
+ * queued for it. Otherwise the remainder is copied to a per-socket queue that
+ * is flushed in order from a write handler owned by the event loop, so the
+ * caller must not register its own write handler for this socket. Datagrams
+ * keep their destination address while queued. At most ELOOP_SEND_QUEUE_MAX
+ * bytes are queued per socket. Call eloop_sock_send_drop() before closing the
+ * socket.
+ */
+int eloop_sock_send(int sock, const void *data, size_t len, int flags,
+		    const struct sockaddr *to, socklen_t tolen);
+
+/**
+ * eloop_sock_send_pending - Get the number of bytes queued for a socket
+ * @sock: File descriptor number for the socket
+ * Returns: Number of bytes not yet written by eloop_sock_send()
+ */
+size_t eloop_sock_send_pending(int sock);
+
+/**
+ * eloop_sock_send_drop - Discard data queued for a socket
+ * @sock: File descriptor number for the socket
+ */
+void eloop_sock_send_drop(int sock);
+
 /**
  * eloop_register_timeout - Register timeout
  * @secs: Number of seconds to the timeout
@@ -72,12 +202,33 @@ void eloop_unregister_read_sock(int sock);
  * Returns: 0 on success, -1 on failure
  *
  * Register a timeout that will cause the handler function to be called after
- * given time.
+ * given time. Timeouts are measured against CLOCK_MONOTONIC, so changes of the
+ * wall clock do not affect them.
  */
 int eloop_register_timeout(unsigned int secs, unsigned int usecs,
 			   void (*handler)(void *eloop_ctx, void *timeout_ctx),
 			   void *eloop_data, void *user_data);
 
+/**
+ * eloop_register_timeout_handle - Register timeout and return its handle
+ * @secs: Number of seconds to the timeout
+ * @usecs: Number of microseconds to the timeout
+ * @handler: Callback function to be called when timeout occurs
+ * @eloop_data: Callback context data (eloop_ctx)
+ * @user_data: Callback context data (sock_ctx)
+ * @handle: Buffer for the handle of the timeout, or %NULL
+ * Returns: 0 on success, -1 on failure
+ *
+ * Same as eloop_register_timeout(), but provides a handle that can be passed
+ * to eloop_cancel_timeout_handle() to cancel exactly this timeout in
+ * O(log n).
+ */
+int eloop_register_timeout_handle(unsigned int secs, unsigned int usecs,
+				  void (*handler)(void *eloop_ctx,
+						  void *timeout_ctx),
+				  void *eloop_data, void *user_data,
+				  eloop_timeout_handle *handle);
+
 /**
  * eloop_cancel_timeout - Cancel timeouts
  * @handler: Matching callback function
@@ -92,6 +243,65 @@ int eloop_register_timeout(unsigned int secs, unsigned int usecs,
 int eloop_cancel_timeout(void (*handler)(void *eloop_ctx, void *sock_ctx),
 			 void *eloop_data, void *user_data);
 
+/**
+ * eloop_cancel_timeout_handle - Cancel a timeout by its handle
+ * @handle: Handle from eloop_register_timeout_handle()
+ * Returns: 1 if the timeout was cancelled, 0 if it already fired, was
+ * cancelled before or the handle is invalid
+ */
+int eloop_cancel_timeout_handle(eloop_timeout_handle handle);
+
+/**
+ * eloop_register_periodic - Register periodic timer
+ * @secs: Number of seconds in the period
+ * @usecs: Number of microseconds in the period
+ * @handler: Callback function to be called on every tick
+ * @eloop_data: Callback context data (eloop_ctx)
+ * @user_data: Callback context data (timeout_ctx)
+ * Returns: 0 on success, -1 on failure
+ *
+ * Register a timer backed by timerfd on CLOCK_MONOTONIC that fires on a fixed
+ * grid of absolute deadlines, starting right away and then every period. The
+ * handler gets the number of ticks that expired since its previous call
+ * (normally 1), so a sender that fell behind can catch up in one batch
+ * instead of drifting. The timer stays active until cancelled with
+ * eloop_cancel_periodic(). A zero period is rejected.
+ */
+int eloop_register_periodic(unsigned int secs, unsigned int usecs,
+			    void (*handler)(void *eloop_ctx,
+					    void *timeout_ctx,
+					    unsigned int ticks),
+			    void *eloop_data, void *user_data);
+
+/**
+ * eloop_cancel_periodic - Cancel periodic timers
+ * @handler: Matching callback function
+ * @eloop_data: Matching eloop_data or %ELOOP_ALL_CTX to match all
+ * @user_data: Matching user_data or %ELOOP_ALL_CTX to match all
+ * Returns: Number of cancelled periodic timers
+ */
+int eloop_cancel_periodic(void (*handler)(void *eloop_ctx, void *timeout_ctx,
+					  unsigned int ticks),
+			  void *eloop_data, void *user_data);
+
+/**
+ * eloop_submit_work - Run a blocking function outside the event loop
+ * @fn: Function to be called in a worker thread
+ * @done_cb: Callback function to be called in the event loop thread after fn
+ * has returned, or %NULL
+ * @ctx: Context data passed to both fn and done_cb
+ * Returns: 0 on success, -1 on failure
+ *
+ * fn runs in one of a small fixed set of worker threads, started on first
+ * use, so it must not call eloop_* functions or touch data that the event
+ * loop uses without its own locking. Completion is delivered through an
+ * eventfd registered as a read socket, so done_cb runs like any other
+ * handler and may use the rest of the code as usual. Work that is still
+ * queued when eloop_destroy() is called is dropped without calling done_cb.
+ */
+int eloop_submit_work(void (*fn)(void *ctx), void (*done_cb)(void *ctx),
+		      void *ctx);
+
 /**
  * eloop_register_signal - Register handler for signals
  * @sig: Signal number (e.g., SIGHUP)
@@ -113,12 +323,49 @@ int eloop_register_signal(int sig,
 					  void *signal_ctx),
 			  void *user_data);
 
+/**
+ * eloop_stats_enable - Enable or disable event loop statistics
+ * @enable: 1 to start collecting statistics, 0 to stop
+ * Returns: 0 on success, -1 on failure
+ *
+ * While enabled, eloop records call counts and latency histograms for every
+ * registered socket, timeout, periodic timer, signal and work completion
+ * handler, the time each loop wake-up takes and how late timers fire. When
+ * disabled, the cost is a single branch per handler call. Statistics
+ * collected so far are kept when disabling.
+ */
+int eloop_stats_enable(int enable);
+
+/**
+ * eloop_stats_enabled - Check whether event loop statistics are collected
+ * Returns: 1 if enabled, 0 if not
+ */
+int eloop_stats_enabled(void);
+
+/**
+ * eloop_stats_reset - Clear collected event loop statistics
+ */
+void eloop_stats_reset(void);
+
+/**
+ * eloop_stats_dump - Write event loop statistics as text
+ * @buf: Buffer for the text
+ * @size: Size of buf
+ * @histograms: 1 to include the non-empty latency histogram buckets
+ * Returns: Number of characters written to buf
+ *
+ * Handlers are identified by kind and function address. The output is cut at
+ * a line boundary if buf is too small.
+ */
+int eloop_stats_dump(char *buf, size_t size, int histograms);
+
 /**
  * eloop_run - Start the event loop
  *
  * Start the event loop and continue running as long as there are any
  * registered event handlers. This function is run after event loop has been
  * initialized with event_init() and one or more events have been registered.
+ * Every timeout that has expired is run on each wakeup, in deadline order.
  */
 void eloop_run(void);
 
@@ -21,9 +21,27 @@
 /* API */
 #define NAME_SIZE     64
 
+/* Type of a TLV value. The values of the types but TLV_TYPE_STRING are decoded when a request is parsed. */
+enum tlv_type {
+    TLV_TYPE_STRING = 0,
+    TLV_TYPE_INT,
+    TLV_TYPE_DOUBLE,
+    TLV_TYPE_MAC,
+    TLV_TYPE_IPV4,
+};
+
+struct indigo_tlv_schema {
+    enum tlv_type type;
+    /* Bounds of a number, and the value of an INT or DOUBLE TLV missing from the request */
+    double min;
+    double max;
+    double def;
+};
+
 struct indigo_tlv {
     unsigned short id;
     char name[NAME_SIZE];
+    const struct indigo_tlv_schema *schema;
 };
 
 struct indigo_api {
@@ -31,282 +49,365 @@ struct indigo_api {
     char name[NAME_SIZE];
     int (*verify)(struct packet_wrapper *req, struct packet_wrapper *resp);
     int (*handle)(struct packet_wrapper *req, struct packet_wrapper *resp);
+    /* Most arena bytes a request of the API used for its ACK and response */
+    int arena_high_water;
 };
 
 /* API definition */
 #define API_VERSION                             0x01
+/* Extended encoding. TLV lengths take 2 bytes and a message over a datagram is sent in fragments.
+ * A tool opts in with the version of its request, and the ACK and response use the same version.
+ * Only the TLVs of the ACK and response may be longer. A request TLV is still limited to TLV_VALUE_SIZE - 1
+ * bytes, as the handlers copy the values into buffers of TLV_VALUE_SIZE. */
+#define API_VERSION_EXTENDED                    0x02
 #define API_RESERVED_BYTE                       0xff
 
-/* Message type definition */
-#define API_CMD_RESPONSE                        0x0000
-#define API_CMD_ACK                             0x0001
-
-#define API_AP_START_UP                         0x1000
-#define API_AP_STOP                             0x1001
-#define API_AP_CONFIGURE                        0x1002
-#define API_AP_TRIGGER_CHANSWITCH               0x1003
-#define API_AP_SEND_DISCONNECT                  0x1004
-#define API_AP_SET_PARAM                        0x1005
-#define API_AP_SEND_BTM_REQ                     0x1006
-#define API_AP_SEND_ARP_MSGS                    0x1007
-#define API_AP_START_WPS                        0x1008
-#define API_AP_CONFIGURE_WSC                    0x1009
-
-#define API_STA_ASSOCIATE                       0x2000
-#define API_STA_CONFIGURE                       0x2001
-#define API_STA_DISCONNECT                      0x2002
-#define API_STA_SEND_DISCONNECT                 0x2003
-#define API_STA_REASSOCIATE                     0x2004
-#define API_STA_SET_PARAM                       0x2005
-#define API_STA_SEND_BTM_QUERY                  0x2006
-#define API_STA_SEND_ANQP_QUERY                 0x2007
-#define API_STA_START_UP                        0x2008
-#define API_STA_SET_PHY_MODE                    0x2009
-#define API_STA_SET_CHANNEL_WIDTH               0x200a
-#define API_STA_POWER_SAVE                      0x200b
-#define API_P2P_START_UP                        0x200c
-#define API_P2P_FIND                            0x200d
-#define API_P2P_LISTEN                          0x200e
-#define API_P2P_ADD_GROUP                       0x200f
-#define API_P2P_START_WPS                       0x2010
-#define API_P2P_CONNECT                         0x2011
-#define API_STA_HS2_ASSOCIATE                   0x2012
-#define API_STA_ADD_CREDENTIAL                  0x2013
-#define API_STA_SCAN                            0x2014
-#define API_P2P_GET_INTENT_VALUE                0x2015
-#define API_STA_START_WPS                       0x2016
-#define API_STA_INSTALL_PPSMO                   0x2017
-#define API_P2P_INVITE                          0x2018
-#define API_P2P_STOP_GROUP                      0x2019
-#define API_P2P_SET_SERV_DISC                   0x201a
-#define API_STA_SEND_ICON_REQ                   0x201b
-#define API_P2P_SET_EXT_LISTEN                  0x201c
-#define API_STA_ENABLE_WSC                      0x201d
-
-#define API_GET_IP_ADDR                         0x5000
-#define API_GET_MAC_ADDR                        0x5001
-#define API_GET_CONTROL_APP_VERSION             0x5002
-#define API_START_LOOP_BACK_SERVER              0x5003
-#define API_STOP_LOOP_BACK_SERVER               0x5004
-#define API_CREATE_NEW_INTERFACE_BRIDGE_NETWORK 0x5005
-#define API_ASSIGN_STATIC_IP                    0x5006
-#define API_DEVICE_RESET                        0x5007
-#define API_SEND_LOOP_BACK_DATA                 0x5008
-#define API_STOP_LOOP_BACK_DATA                 0x5009
-#define API_START_DHCP                          0x500a
-#define API_STOP_DHCP                           0x500b
-#define API_GET_WSC_PIN                         0x500c
-#define API_GET_WSC_CRED                        0x500d
-
-/* TLV definition */
-#define TLV_SSID                                0x0001
-#define TLV_CHANNEL                             0x0002
-#define TLV_WEP_KEY0                            0x0003
-#define TLV_AUTH_ALGORITHM                      0x0004
-#define TLV_WEP_DEFAULT_KEY                     0x0005
-#define TLV_IEEE80211_D                         0x0006
-#define TLV_IEEE80211_N                         0x0007
-#define TLV_IEEE80211_AC                        0x0008
-#define TLV_COUNTRY_CODE                        0x0009
-#define TLV_WMM_ENABLED                         0x000a
-#define TLV_WPA                                 0x000b
-#define TLV_WPA_KEY_MGMT                        0x000c
-#define TLV_RSN_PAIRWISE                        0x000d
-#define TLV_WPA_PASSPHRASE                      0x000e
-#define TLV_WPA_PAIRWISE                        0x000f
-#define TLV_HT_CAPB                             0x0010
-#define TLV_IEEE80211_H                         0x0011
-#define TLV_IEEE80211_W                         0x0012
-#define TLV_VHT_OPER_CHWIDTH                    0x0013
-#define TLV_VHT_CAPB                            0x0014
-#define TLV_IEEE8021_X                          0x0015
-#define TLV_EAP_SERVER                          0x0016
-#define TLV_AUTH_SERVER_ADDR                    0x0017
-#define TLV_AUTH_SERVER_PORT                    0x0018
-#define TLV_AUTH_SERVER_SHARED_SECRET           0x0019
-#define TLV_INTERFACE_NAME                      0x001a
-#define TLV_NEW_INTERFACE_NAME                  0x001b
-#define TLV_FREQUENCY                           0x001c
-#define TLV_BSS_IDENTIFIER                      0x001d
-#define TLV_HW_MODE                             0x001e
-#define TLV_VHT_OPER_CENTR_FREQ                 0x001f
-#define TLV_RESET_TYPE                          0x0020
-#define APP_TYPE                                0x0021
-#define TLV_OP_CLASS                            0x0022
-#define TLV_IE_OVERRIDE                         0x0023
-#define TLV_HOME_FQDN                           0x0024
-#define TLV_USERNAME                            0x0025
-#define TLV_PREFER                              0x0026
-#define TLV_CREDENTIAL_TYPE                     0x0027
-#define TLV_ADDRESS                             0x0028
-#define TLV_DISABLE_PMKSA_CACHING               0x0033
-#define TLV_SAE_ANTI_CLOGGING_THRESHOLD         0x0034
-#define TLV_STA_SSID                            0x0035
-#define TLV_KEY_MGMT                            0x0036
-#define TLV_STA_WEP_KEY0                        0x0037
-#define TLV_WEP_TX_KEYIDX                       0x0038
-#define TLV_GROUP                               0x0039
-#define TLV_PSK                                 0x003a
-#define TLV_PROTO                               0x003b
-#define TLV_STA_IEEE80211_W                     0x003c
-#define TLV_PAIRWISE                            0x003d
-#define TLV_EAP                                 0x003e
-#define TLV_PHASE2                              0x003f
-#define TLV_IDENTITY                            0x0040
-#define TLV_PASSWORD                            0x0041
-#define TLV_CA_CERT                             0x0042
-#define TLV_PHASE1                              0x0043
-#define TLV_CLIENT_CERT                         0x0044
-#define TLV_PRIVATE_KEY                         0x0045
-#define TLV_STA_POWER_SAVE                      0x0052
-#define TLV_STATIC_IP                           0x0055
-#define TLV_DEBUG_LEVEL                         0x0057
-#define TLV_DUT_IP_ADDRESS                      0x0058
-#define TLV_HOSTAPD_FILE_NAME                   0x0059
-#define TLV_ROLE                                0x005c
-#define TLV_BAND                                0x005d
-#define TLV_BSSID                               0x005e
-#define TLV_ARP_TRANSMISSION_RATE               0x005f
-#define TLV_ARP_TARGET_IP                       0x0060
-#define TLV_ARP_FRAME_COUNT                     0x0062
-#define TLV_PACKET_COUNT                        0x0067
-#define TLV_PACKET_TYPE                         0x0068
-#define TLV_PACKET_RATE                         0x0069
-#define TLV_PHYMODE                             0x006a
-#define TLV_CHANNEL_WIDTH                       0x006b
-#define TLV_PAC_FILE                            0x006d
-#define TLV_STA_SAE_GROUPS                      0x006e
-#define TLV_SAE_GROUPS                          0x0071
-#define TLV_IEEE80211_AX                        0x0072
-#define TLV_HE_OPER_CHWIDTH                     0x0073
-#define TLV_HE_OPER_CENTR_FREQ                  0x0074
-#define TLV_MBO                                 0x0075
-#define TLV_MBO_CELL_DATA_CONN_PREF             0x0076
-#define TLV_BSS_TRANSITION                      0x0077
-#define TLV_INTERWORKING                        0x0078
-#define TLV_RRM_NEIGHBOR_REPORT                 0x0079
-#define TLV_RRM_BEACON_REPORT                   0x007a
-#define TLV_COUNTRY3                            0x007b
-#define TLV_MBO_CELL_CAPA                       0x007c
-#define TLV_DOMAIN_MATCH                        0x007d
-#define TLV_DOMAIN_SUFFIX_MATCH                 0x007e
-#define TLV_MBO_ASSOC_DISALLOW                  0x007f
-#define TLV_DISASSOC_IMMINENT                   0x0081
-#define TLV_BSS_TERMINATION                     0x0082
-#define TLV_DISASSOC_TIMER                      0x0083
-#define TLV_BSS_TERMINATION_TSF                 0x0084
-#define TLV_BSS_TERMINATION_DURATION            0x0085
-#define TLV_REASSOCIAITION_RETRY_DELAY          0x0086
-#define TLV_BTMQUERY_REASON_CODE                0x0087
-#define TLV_CANDIDATE_LIST                      0x0088
-#define TLV_ANQP_INFO_ID                        0x0089
-#define TLV_GAS_COMEBACK_DELAY                  0x008a
-#define TLV_SAE_PWE                             0x008d
-#define TLV_OWE_GROUPS                          0x008e
-#define TLV_STA_OWE_GROUP                       0x008f
-#define TLV_HE_MU_EDCA                          0x0090
-#define TLV_RSNXE_OVERRIDE_EAPOL                0x0092
-#define TLV_TRANSITION_DISABLE                  0x0093
-#define TLV_SAE_CONFIRM_IMMEDIATE               0x0094
-#define TLV_RAND_MAC_ADDR                       0x0095
-#define TLV_PREASSOC_RAND_MAC_ADDR              0x0096
-#define TLV_RAND_ADDR_LIFETIME                  0x0097
-#define TLV_DROP_SA                             0x0098
-#define TLV_SERVER_CERT                         0x0099
-
-#define TLV_CONTROL_INTERFACE                   0x009c
-#define TLV_PACKET_SIZE                         0x009d
-#define TLV_DUT_UDP_PORT                        0x009e
-#define TLV_SKIP_6G_BSS_SECURITY_CHECK          0x00a1
-#define TLV_OWE_TRANSITION_BSS_IDENTIFIER       0x00a2
-#define TLV_FREQ_LIST                           0x00a3
-#define TLV_BSSID_FILTER_LIST                   0x00a4
-#define TLV_HE_BEACON_TX_SU_PPDU                0x00a5
-#define TLV_HE_6G_ONLY                          0x00a6
-#define TLV_HE_UNSOL_PR_RESP_CADENCE            0x00a7
-#define TLV_HE_FILS_DISCOVERY_TX                0x00a8
-#define TLV_HS20                                0x00a9
-#define TLV_ACCESS_NETWORK_TYPE                 0x00aa
-#define TLV_INTERNET                            0x00ab
-#define TLV_VENUE_GROUP                         0x00ac
-#define TLV_VENUE_TYPE                          0x00ad
-#define TLV_HESSID                              0x00ae
-#define TLV_OSU_SSID                            0x00af
-#define TLV_ANQP_3GPP_CELL_NETWORK_INFO         0x00b0 
-#define TLV_PROXY_ARP                           0x00b1
-#define TLV_BSSLOAD_ENABLE                      0x00b2
-#define TLV_ROAMING_CONSORTIUM                  0x00b3
-#define TLV_NETWORK_AUTH_TYPE                   0x00b4
-#define TLV_DOMAIN_LIST                         0x00b5
-#define TLV_HS20_OPERATOR_FRIENDLY_NAME         0x00b6
-#define TLV_NAI_REALM                           0x00b7
-#define TLV_VENUE_NAME                          0x00b8
-#define TLV_IPADDR_TYPE_AVAILABILITY            0x00b9
-#define TLV_HS20_WAN_METRICS                    0x00ba
-#define TLV_HS20_CONN_CAPABILITY                0x00bb
-#define TLV_VENUE_URL                           0x00bc
-#define TLV_OPERATOR_ICON_METADATA              0x00bd
-#define TLV_OSU_PROVIDERS_LIST                  0x00be
-#define TLV_OSU_PROVIDERS_NAI_LIST              0x00bf
-#define TLV_REALM                               0x00c0
-#define TLV_IMSI                                0x00c1
-#define TLV_MILENAGE                            0x00c2
-#define TLV_PPSMO_FILE                          0x00c3
-#define TLV_OSU_SERVER_URI                      0x00c4
-#define TLV_OSU_METHOD                          0x00c5
-#define TLV_GO_INTENT                           0x00c6
-#define TLV_WSC_METHOD                          0x00c7
-#define TLV_PIN_METHOD                          0x00c8
-#define TLV_PIN_CODE                            0x00c9
-#define TLV_P2P_CONN_TYPE                       0x00ca
-#define TLV_HS20_OPERATING_CLASS_INDICATION     0x00cb
-#define TLV_WPS_ENABLE                          0x00cc
-#define TLV_UPDATE_CONFIG                       0x00cd
-#define TLV_EAP_FRAG_SIZE                       0x00ce
-#define TLV_PERFORM_WPS_IE_FRAG                 0x00cf
-#define TLV_ADVICE_OF_CHARGE                    0x00d0
-#define TLV_IGNORE_BROADCAST_SSID               0x00d1
-#define TLV_PERSISTENT                          0x00d2
-#define TLV_WSC_CONFIG_ONLY                     0x00d3
-#define TLV_ICON_FILE                           0x00d4
-#define TLV_P2P_DISABLED                        0x00d5
-#define TLV_MANAGE_P2P                          0x00d6
-#define TLV_AP_STA_COEXIST                      0x00d7
-#define TLV_WPS_INDEPENDENT                     0x00d8
-#define TLV_LOCAL_PWR_CONST                     0x00d9
-#define TLV_SPECTRUM_MGMT_REQ                   0x00da
-#define TLV_CAPTURE_FILE                        0x00db
-#define TLV_CAPTURE_FILTER                      0x00dc
-#define TLV_CAPTURE_INFILE                      0x00dd
-#define TLV_CAPTURE_OUTFILE                     0x00de
-#define TLV_TP_IP_ADDRESS                       0x00df
-#define TLV_WPS_ER_SUPPORT                      0x00e0
-#define TLV_ADDITIONAL_TEST_PLATFORM_ID         0x00e1
-
-// class ResponseTLV
-// List of TLV used in the QuickTrack API response and ACK messages from the DUT
-#define TLV_MESSAGE                             0xa000
-#define TLV_STATUS                              0xa001
-#define TLV_DUT_WLAN_IP_ADDR                    0xa002
-#define TLV_DUT_MAC_ADDR                        0xa003
-#define TLV_CONTROL_APP_VERSION                 0xa004
-#define TLV_LOOP_BACK_DATA_RECEIVED             0xa005
-#define TLV_LOOP_BACK_DATA_SENT                 0xa006
-#define TLV_ARP_RECV_NUM                        0xa007
-#define TLV_TEST_PLATFORM_APP_VERSION           0xa008
-#define TLV_LOOP_BACK_SERVER_PORT               0xa009
-#define TLV_WSC_PIN_CODE                        0xa00a
-#define TLV_P2P_INTENT_VALUE                    0xa00b
-#define TLV_WSC_SSID                            0xa00c
-#define TLV_WSC_WPA_KEY_MGMT                    0xa00d
-#define TLV_WSC_WPA_PASSPHRASE                  0xa00e
-#define TLV_PASSPOINT_ICON_CHECKSUM             0xa00f
+/* Message types of the QuickTrack API, X(symbol, ID, name). The IDs, the API list and its lookup
+ * table in indigo_api.c are generated from here. An ID must fit API_SLOT(). */
+#define INDIGO_API_LIST(X) \
+    /* Common */ \
+    X(API_CMD_RESPONSE,                        0x0000, "CMD_RESPONSE") \
+    X(API_CMD_ACK,                             0x0001, "CMD_ACK") \
+    \
+    /* AP specific */ \
+    X(API_AP_START_UP,                         0x1000, "AP_START_UP") \
+    X(API_AP_STOP,                             0x1001, "AP_STOP") \
+    X(API_AP_CONFIGURE,                        0x1002, "AP_CONFIGURE") \
+    X(API_AP_TRIGGER_CHANSWITCH,               0x1003, "AP_TRIGGER_CHANSWITCH") \
+    X(API_AP_SEND_DISCONNECT,                  0x1004, "AP_SEND_DISCONNECT") \
+    X(API_AP_SET_PARAM,                        0x1005, "API_AP_SET_PARAM") \
+    X(API_AP_SEND_BTM_REQ,                     0x1006, "API_AP_SEND_BTM_REQ") \
+    X(API_AP_SEND_ARP_MSGS,                    0x1007, "API_AP_SEND_ARP_MSGS") \
+    X(API_AP_START_WPS,                        0x1008, "AP_START_WPS") \
+    X(API_AP_CONFIGURE_WSC,                    0x1009, "AP_CONFIGURE_WSC") \
+    \
+    /* Station specific */ \
+    X(API_STA_ASSOCIATE,                       0x2000, "STA_ASSOCIATE") \
+    X(API_STA_CONFIGURE,                       0x2001, "STA_CONFIGURE") \
+    X(API_STA_DISCONNECT,                      0x2002, "STA_DISCONNECT") \
+    X(API_STA_SEND_DISCONNECT,                 0x2003, "STA_SEND_DISCONNECT") \
+    X(API_STA_REASSOCIATE,                     0x2004, "STA_REASSOCIATE") \
+    X(API_STA_SET_PARAM,                       0x2005, "STA_SET_PARAM") \
+    X(API_STA_SEND_BTM_QUERY,                  0x2006, "STA_SEND_BTM_QUERY") \
+    X(API_STA_SEND_ANQP_QUERY,                 0x2007, "STA_SEND_ANQP_QUERY") \
+    X(API_STA_START_UP,                        0x2008, "STA_START_UP") \
+    X(API_STA_SET_PHY_MODE,                    0x2009, "STA_SET_PHY_MODE") \
+    X(API_STA_SET_CHANNEL_WIDTH,               0x200a, "STA_SET_CHANNEL_WIDTH") \
+    X(API_STA_POWER_SAVE,                      0x200b, "STA_POWER_SAVE") \
+    X(API_P2P_START_UP,                        0x200c, "P2P_START_UP") \
+    X(API_P2P_FIND,                            0x200d, "P2P_FIND") \
+    X(API_P2P_LISTEN,                          0x200e, "P2P_LISTEN") \
+    X(API_P2P_ADD_GROUP,                       0x200f, "P2P_ADD_GROUP") \
+    X(API_P2P_START_WPS,                       0x2010, "P2P_START_WPS") \
+    X(API_P2P_CONNECT,                         0x2011, "P2P_CONNECT") \
+    X(API_STA_HS2_ASSOCIATE,                   0x2012, "API_STA_HS2_ASSOCIATE") \
+    X(API_STA_ADD_CREDENTIAL,                  0x2013, "API_STA_ADD_CREDENTIAL") \
+    X(API_STA_SCAN,                            0x2014, "STA_SCAN") \
+    X(API_P2P_GET_INTENT_VALUE,                0x2015, "P2P_GET_INTENT_VALUE") \
+    X(API_STA_START_WPS,                       0x2016, "STA_START_WPS") \
+    X(API_STA_INSTALL_PPSMO,                   0x2017, "API_STA_INSTALL_PPSMO") \
+    X(API_P2P_INVITE,                          0x2018, "P2P_INVITE") \
+    X(API_P2P_STOP_GROUP,                      0x2019, "P2P_STOP_GROUP") \
+    X(API_P2P_SET_SERV_DISC,                   0x201a, "P2P_SET_SERV_DISC") \
+    X(API_STA_SEND_ICON_REQ,                   0x201b, "STA_SEND_ICON_REQ") \
+    X(API_P2P_SET_EXT_LISTEN,                  0x201c, "P2P_SET_EXT_LISTEN") \
+    X(API_STA_ENABLE_WSC,                      0x201d, "STA_ENABLE_WSC") \
+    \
+    /* Network operation. E.g., get/set IP address, get MAC address, send the UDP data and reset */ \
+    X(API_GET_IP_ADDR,                         0x5000, "GET_IP_ADDR") \
+    X(API_GET_MAC_ADDR,                        0x5001, "GET_MAC_ADDR") \
+    X(API_GET_CONTROL_APP_VERSION,             0x5002, "GET_CONTROL_APP_VERSION") \
+    X(API_START_LOOP_BACK_SERVER,              0x5003, "START_LOOP_BACK_SERVER") \
+    X(API_STOP_LOOP_BACK_SERVER,               0x5004, "STOP_LOOP_BACK_SERVER") \
+    X(API_CREATE_NEW_INTERFACE_BRIDGE_NETWORK, 0x5005, "CREATE_NEW_INTERFACE_BRIDGE_NETWORK") \
+    X(API_ASSIGN_STATIC_IP,                    0x5006, "ASSIGN_STATIC_IP") \
+    X(API_DEVICE_RESET,                        0x5007, "DEVICE_RESET") \
+    X(API_SEND_LOOP_BACK_DATA,                 0x5008, "SEND_LOOP_BACK_DATA") \
+    X(API_STOP_LOOP_BACK_DATA,                 0x5009, "STOP_LOOP_BACK_DATA") \
+    X(API_START_DHCP,                          0x500a, "START_DHCP") \
+    X(API_STOP_DHCP,                           0x500b, "STOP_DHCP") \
+    X(API_GET_WSC_PIN,                         0x500c, "GET_WSC_PIN") \
+    X(API_GET_WSC_CRED,                        0x500d, "GET_WSC_CRED") \
+    X(API_GET_EVENT_LOOP_STATS,                0x500e, "GET_EVENT_LOOP_STATS") \
+    X(API_BATCH_COMMANDS,                      0x500f, "BATCH_COMMANDS") \
+    X(API_SET_LOG_LEVEL,                       0x5010, "SET_LOG_LEVEL")
+
+enum {
+#define API_ID(symbol, id, name) symbol = id,
+    INDIGO_API_LIST(API_ID)
+#undef API_ID
+};
+
+/* TLVs of the QuickTrack API, X(symbol, ID, name). An ID must fit TLV_SLOT(). */
+#define INDIGO_TLV_LIST(X) \
+    /* TLV definition */ \
+    X(TLV_SSID,                                0x0001, "SSID") \
+    X(TLV_CHANNEL,                             0x0002, "CHANNEL") \
+    X(TLV_WEP_KEY0,                            0x0003, "WEP_KEY0") \
+    X(TLV_AUTH_ALGORITHM,                      0x0004, "AUTH_ALGORITHM") \
+    X(TLV_WEP_DEFAULT_KEY,                     0x0005, "WEP_DEFAULT_KEY") \
+    X(TLV_IEEE80211_D,                         0x0006, "IEEE80211_D") \
+    X(TLV_IEEE80211_N,                         0x0007, "IEEE80211_N") \
+    X(TLV_IEEE80211_AC,                        0x0008, "IEEE80211_AC") \
+    X(TLV_COUNTRY_CODE,                        0x0009, "COUNTRY_CODE") \
+    X(TLV_WMM_ENABLED,                         0x000a, "WMM_ENABLED") \
+    X(TLV_WPA,                                 0x000b, "WPA") \
+    X(TLV_WPA_KEY_MGMT,                        0x000c, "WPA_KEY_MGMT") \
+    X(TLV_RSN_PAIRWISE,                        0x000d, "RSN_PAIRWISE") \
+    X(TLV_WPA_PASSPHRASE,                      0x000e, "WPA_PASSPHRASE") \
+    X(TLV_WPA_PAIRWISE,                        0x000f, "WPA_PAIRWISE") \
+    X(TLV_HT_CAPB,                             0x0010, "HT_CAPB") \
+    X(TLV_IEEE80211_H,                         0x0011, "IEEE80211_H") \
+    X(TLV_IEEE80211_W,                         0x0012, "IEEE80211_W") \
+    X(TLV_VHT_OPER_CHWIDTH,                    0x0013, "VHT_OPER_CHWIDTH") \
+    X(TLV_VHT_CAPB,                            0x0014, "VHT_CAPB") \
+    X(TLV_IEEE8021_X,                          0x0015, "IEEE8021_X") \
+    X(TLV_EAP_SERVER,                          0x0016, "EAP_SERVER") \
+    X(TLV_AUTH_SERVER_ADDR,                    0x0017, "AUTH_SERVER_ADDR") \
+    X(TLV_AUTH_SERVER_PORT,                    0x0018, "AUTH_SERVER_PORT") \
+    X(TLV_AUTH_SERVER_SHARED_SECRET,           0x0019, "AUTH_SERVER_SHARED_SECRET") \
+    X(TLV_INTERFACE_NAME,                      0x001a, "INTERFACE_NAME") \
+    X(TLV_NEW_INTERFACE_NAME,                  0x001b, "NEW_INTERFACE_NAME") \
+    X(TLV_FREQUENCY,                           0x001c, "FREQUENCY") \
+    X(TLV_BSS_IDENTIFIER,                      0x001d, "BSS_IDENTIFIER") \
+    X(TLV_HW_MODE,                             0x001e, "HW_MODE") \
+    X(TLV_VHT_OPER_CENTR_FREQ,                 0x001f, "VHT_OPER_CENTR_FREQ") \
+    X(TLV_RESET_TYPE,                          0x0020, "RESET_TYPE") \
+    X(APP_TYPE,                                0x0021, "APP_TYPE") \
+    X(TLV_OP_CLASS,                            0x0022, "OP_CLASS") \
+    X(TLV_IE_OVERRIDE,                         0x0023, "IE_OVERRIDE") \
+    X(TLV_HOME_FQDN,                           0x0024, "HOME_FQDN") \
+    X(TLV_USERNAME,                            0x0025, "USERNAME") \
+    X(TLV_PREFER,                              0x0026, "PREFER") \
+    X(TLV_CREDENTIAL_TYPE,                     0x0027, "CREDENTIAL_TYPE") \
+    X(TLV_ADDRESS,                             0x0028, "ADDRESS") \
+    X(TLV_DISABLE_PMKSA_CACHING,               0x0033, "DISABLE_PMKSA_CACHING") \
+    X(TLV_SAE_ANTI_CLOGGING_THRESHOLD,         0x0034, "SAE_ANTI_CLOGGING_THRESHOLD") \
+    X(TLV_STA_SSID,                            0x0035, "STA_SSID") \
+    X(TLV_KEY_MGMT,                            0x0036, "KEY_MGMT") \
+    X(TLV_STA_WEP_KEY0,                        0x0037, "STA_WEP_KEY0") \
+    X(TLV_WEP_TX_KEYIDX,                       0x0038, "WEP_TX_KEYIDX") \
+    X(TLV_GROUP,                               0x0039, "GROUP") \
+    X(TLV_PSK,                                 0x003a, "PSK") \
+    X(TLV_PROTO,                               0x003b, "PROTO") \
+    X(TLV_STA_IEEE80211_W,                     0x003c, "STA_IEEE80211_W") \
+    X(TLV_PAIRWISE,                            0x003d, "PAIRWISE") \
+    X(TLV_EAP,                                 0x003e, "EAP") \
+    X(TLV_PHASE2,                              0x003f, "PHASE2") \
+    X(TLV_IDENTITY,                            0x0040, "IDENTITY") \
+    X(TLV_PASSWORD,                            0x0041, "PASSWORD") \
+    X(TLV_CA_CERT,                             0x0042, "CA_CERT") \
+    X(TLV_PHASE1,                              0x0043, "PHASE1") \
+    X(TLV_CLIENT_CERT,                         0x0044, "CLIENT_CERT") \
+    X(TLV_PRIVATE_KEY,                         0x0045, "PRIVATE_KEY") \
+    X(TLV_STA_POWER_SAVE,                      0x0052, "STA_POWER_SAVE") \
+    X(TLV_STATIC_IP,                           0x0055, "STATIC_IP") \
+    X(TLV_DEBUG_LEVEL,                         0x0057, "DEBUG_LEVEL") \
+    X(TLV_DUT_IP_ADDRESS,                      0x0058, "DUT_IP_ADDRESS") \
+    X(TLV_HOSTAPD_FILE_NAME,                   0x0059, "HOSTAPD_FILE_NAME") \
+    X(TLV_ROLE,                                0x005c, "ROLE") \
+    X(TLV_BAND,                                0x005d, "BAND") \
+    X(TLV_BSSID,                               0x005e, "BSSID") \
+    X(TLV_ARP_TRANSMISSION_RATE,               0x005f, "ARP_TRANSMISSION_RATE") \
+    X(TLV_ARP_TARGET_IP,                       0x0060, "ARP_TARGET_IP") \
+    X(TLV_ARP_FRAME_COUNT,                     0x0062, "ARP_FRAME_COUNT") \
+    X(TLV_PACKET_COUNT,                        0x0067, "PACKET_COUNT") \
+    X(TLV_PACKET_TYPE,                         0x0068, "PACKET_TYPE") \
+    X(TLV_PACKET_RATE,                         0x0069, "PACKET_RATE") \
+    X(TLV_PHYMODE,                             0x006a, "PHYMODE") \
+    X(TLV_CHANNEL_WIDTH,                       0x006b, "CHANNEL_WIDTH") \
+    X(TLV_PAC_FILE,                            0x006d, "PAC_FILE") \
+    X(TLV_STA_SAE_GROUPS,                      0x006e, "STA_SAE_GROUPS") \
+    X(TLV_SAE_GROUPS,                          0x0071, "SAE_GROUPS") \
+    X(TLV_IEEE80211_AX,                        0x0072, "IEEE80211_AX") \
+    X(TLV_HE_OPER_CHWIDTH,                     0x0073, "HE_OPER_CHWIDTH") \
+    X(TLV_HE_OPER_CENTR_FREQ,                  0x0074, "HE_OPER_CENTR_FREQ") \
+    X(TLV_MBO,                                 0x0075, "MBO") \
+    X(TLV_MBO_CELL_DATA_CONN_PREF,             0x0076, "MBO_CELL_DATA_CONN_PREF") \
+    X(TLV_BSS_TRANSITION,                      0x0077, "BSS_TRANSITION") \
+    X(TLV_INTERWORKING,                        0x0078, "INTERWORKING") \
+    X(TLV_RRM_NEIGHBOR_REPORT,                 0x0079, "RRM_NEIGHBOR_REPORT") \
+    X(TLV_RRM_BEACON_REPORT,                   0x007a, "RRM_BEACON_REPORT") \
+    X(TLV_COUNTRY3,                            0x007b, "COUNTRY3") \
+    X(TLV_MBO_CELL_CAPA,                       0x007c, "MBO_CELL_CAPA") \
+    X(TLV_DOMAIN_MATCH,                        0x007d, "TLV_DOMAIN_MATCH") \
+    X(TLV_DOMAIN_SUFFIX_MATCH,                 0x007e, "TLV_DOMAIN_SUFFIX_MATCH") \
+    X(TLV_MBO_ASSOC_DISALLOW,                  0x007f, "TLV_MBO_ASSOC_DISALLOW") \
+    X(TLV_DISASSOC_IMMINENT,                   0x0081, "TLV_DISASSOC_IMMINENT") \
+    X(TLV_BSS_TERMINATION,                     0x0082, "TLV_BSS_TERMINATION") \
+    X(TLV_DISASSOC_TIMER,                      0x0083, "TLV_DISASSOC_TIMER") \
+    X(TLV_BSS_TERMINATION_TSF,                 0x0084, "TLV_BSS_TERMINATION_TSF") \
+    X(TLV_BSS_TERMINATION_DURATION,            0x0085, "TLV_BSS_TERMINATION_DURATION") \
+    X(TLV_REASSOCIAITION_RETRY_DELAY,          0x0086, "TLV_REASSOCIAITION_RETRY_DELAY") \
+    X(TLV_BTMQUERY_REASON_CODE,                0x0087, "TLV_BTMQUERY_REASON_CODE") \
+    X(TLV_CANDIDATE_LIST,                      0x0088, "TLV_CANDIDATE_LIST") \
+    X(TLV_ANQP_INFO_ID,                        0x0089, "TLV_ANQP_INFO_ID") \
+    X(TLV_GAS_COMEBACK_DELAY,                  0x008a, "TLV_GAS_COMEBACK_DELAY") \
+    X(TLV_SAE_PWE,                             0x008d, "TLV_SAE_PWE") \
+    X(TLV_OWE_GROUPS,                          0x008e, "TLV_OWE_GROUPS") \
+    X(TLV_STA_OWE_GROUP,                       0x008f, "TLV_STA_OWE_GROUP") \
+    X(TLV_HE_MU_EDCA,                          0x0090, "TLV_HE_MU_EDCA") \
+    X(TLV_RSNXE_OVERRIDE_EAPOL,                0x0092, "TLV_RSNXE_OVERRIDE_EAPOL") \
+    X(TLV_TRANSITION_DISABLE,                  0x0093, "TLV_TRANSITION_DISABLE") \
+    X(TLV_SAE_CONFIRM_IMMEDIATE,               0x0094, "SAE_CONFIRM_IMMEDIATE") \
+    X(TLV_RAND_MAC_ADDR,                       0x0095, "RAND_MAC_ADDR") \
+    X(TLV_PREASSOC_RAND_MAC_ADDR,              0x0096, "PREASSOC_RAND_MAC_ADDR") \
+    X(TLV_RAND_ADDR_LIFETIME,                  0x0097, "RAND_ADDR_LIFETIME") \
+    X(TLV_DROP_SA,                             0x0098, "DROP_SA") \
+    X(TLV_SERVER_CERT,                         0x0099, "SERVER_CERT") \
+    \
+    X(TLV_CONTROL_INTERFACE,                   0x009c, "CONTROL_INTERFACE") \
+    X(TLV_PACKET_SIZE,                         0x009d, "PACKET_SIZE") \
+    X(TLV_DUT_UDP_PORT,                        0x009e, "DUT_UDP_PORT") \
+    X(TLV_SKIP_6G_BSS_SECURITY_CHECK,          0x00a1, "SKIP_6G_BSS_SECURITY_CHECK") \
+    X(TLV_OWE_TRANSITION_BSS_IDENTIFIER,       0x00a2, "OWE_TRANSITION_BSS_IDENTIFIER") \
+    X(TLV_FREQ_LIST,                           0x00a3, "FREQ_LIST") \
+    X(TLV_BSSID_FILTER_LIST,                   0x00a4, "BSSID_FILTER_LIST") \
+    X(TLV_HE_BEACON_TX_SU_PPDU,                0x00a5, "HE_BEACON_TX_SU_PPDU") \
+    X(TLV_HE_6G_ONLY,                          0x00a6, "HE_6G_ONLY") \
+    X(TLV_HE_UNSOL_PR_RESP_CADENCE,            0x00a7, "UNSOL_PR_RESP_CADENCE") \
+    X(TLV_HE_FILS_DISCOVERY_TX,                0x00a8, "FILS_DISCOERY_TX") \
+    X(TLV_HS20,                                0x00a9, "HS20") \
+    X(TLV_ACCESS_NETWORK_TYPE,                 0x00aa, "ACCESS_NETWORK_TYPE") \
+    X(TLV_INTERNET,                            0x00ab, "INTERNET") \
+    X(TLV_VENUE_GROUP,                         0x00ac, "VENUE_GROUP") \
+    X(TLV_VENUE_TYPE,                          0x00ad, "VENUE_TYPE") \
+    X(TLV_HESSID,                              0x00ae, "HESSID") \
+    X(TLV_OSU_SSID,                            0x00af, "OSU_SSID") \
+    X(TLV_ANQP_3GPP_CELL_NETWORK_INFO,         0x00b0, "ANQP_3GPP_CELL_NETWORK_INFO") \
+    X(TLV_PROXY_ARP,                           0x00b1, "PROXY_ARP") \
+    X(TLV_BSSLOAD_ENABLE,                      0x00b2, "BSSLOAD_ENABLE") \
+    X(TLV_ROAMING_CONSORTIUM,                  0x00b3, "ROAMING_CONSORTIUM") \
+    X(TLV_NETWORK_AUTH_TYPE,                   0x00b4, "NETWORK_AUTH_TYPE") \
+    X(TLV_DOMAIN_LIST,                         0x00b5, "DOMAIN_LIST") \
+    X(TLV_HS20_OPERATOR_FRIENDLY_NAME,         0x00b6, "HS20_OPERATOR_FRIENDLY_NAME") \
+    X(TLV_NAI_REALM,                           0x00b7, "NAI_REALM") \
+    X(TLV_VENUE_NAME,                          0x00b8, "VENUE_NAME") \
+    X(TLV_IPADDR_TYPE_AVAILABILITY,            0x00b9, "IPADDR_TYPE_AVAILABILITY") \
+    X(TLV_HS20_WAN_METRICS,                    0x00ba, "HS20_WAN_METRICS") \
+    X(TLV_HS20_CONN_CAPABILITY,                0x00bb, "HS20_CONN_CAPABILITY") \
+    X(TLV_VENUE_URL,                           0x00bc, "VENUE_URL") \
+    X(TLV_OPERATOR_ICON_METADATA,              0x00bd, "OPERATOR_ICON_METADATA") \
+    X(TLV_OSU_PROVIDERS_LIST,                  0x00be, "OSU_PROVIDERS_LIST") \
+    X(TLV_OSU_PROVIDERS_NAI_LIST,              0x00bf, "OSU_PROVIDERS_NAI_LIST") \
+    X(TLV_REALM,                               0x00c0, "REALM") \
+    X(TLV_IMSI,                                0x00c1, "IMSI") \
+    X(TLV_MILENAGE,                            0x00c2, "MILENAGE") \
+    X(TLV_PPSMO_FILE,                          0x00c3, "PPSMO_FILE") \
+    X(TLV_OSU_SERVER_URI,                      0x00c4, "OSU_SERVER_URI") \
+    X(TLV_OSU_METHOD,                          0x00c5, "OSU_METHOD") \
+    X(TLV_GO_INTENT,                           0x00c6, "GO_INTENT") \
+    X(TLV_WSC_METHOD,                          0x00c7, "WSC_METHOD") \
+    X(TLV_PIN_METHOD,                          0x00c8, "PIN_METHOD") \
+    X(TLV_PIN_CODE,                            0x00c9, "PIN_CODE") \
+    X(TLV_P2P_CONN_TYPE,                       0x00ca, "P2P_CONN_TYPE") \
+    X(TLV_HS20_OPERATING_CLASS_INDICATION,     0x00cb, "HS20_OPERATING_CLASS_INDICATION") \
+    X(TLV_WPS_ENABLE,                          0x00cc, "WPS_ENABLE") \
+    X(TLV_UPDATE_CONFIG,                       0x00cd, "UPDATE_CONFIG") \
+    X(TLV_EAP_FRAG_SIZE,                       0x00ce, "EAP_FRAG_SIZE") \
+    X(TLV_PERFORM_WPS_IE_FRAG,                 0x00cf, "PERFORM_WPS_IE_FRAG") \
+    X(TLV_ADVICE_OF_CHARGE,                    0x00d0, "ADVICE_OF_CHARGE") \
+    X(TLV_IGNORE_BROADCAST_SSID,               0x00d1, "IGNORE_BROADCAST_SSID") \
+    X(TLV_PERSISTENT,                          0x00d2, "PERSISTENT_GROUP") \
+    X(TLV_WSC_CONFIG_ONLY,                     0x00d3, "WSC_CONFIG_ONLY") \
+    X(TLV_ICON_FILE,                           0x00d4, "ICON_FILE") \
+    X(TLV_P2P_DISABLED,                        0x00d5, "P2P_DISABLED") \
+    X(TLV_MANAGE_P2P,                          0x00d6, "MANAGE_P2P") \
+    X(TLV_AP_STA_COEXIST,                      0x00d7, "AP_STA_COEXIST") \
+    X(TLV_WPS_INDEPENDENT,                     0x00d8, "WPS_INDEPENDENT") \
+    X(TLV_LOCAL_PWR_CONST,                     0x00d9, "LOCAL_PWR_CONST") \
+    X(TLV_SPECTRUM_MGMT_REQ,                   0x00da, "SPECTRUM_MGMT_REQ") \
+    X(TLV_CAPTURE_FILE,                        0x00db, "CAPTURE_FILE") \
+    X(TLV_CAPTURE_FILTER,                      0x00dc, "CAPTURE_FILTER") \
+    X(TLV_CAPTURE_INFILE,                      0x00dd, "CAPTURE_INFILE") \
+    X(TLV_CAPTURE_OUTFILE,                     0x00de, "CAPTURE_OUTFILE") \
+    X(TLV_TP_IP_ADDRESS,                       0x00df, "TP_IP_ADDRESS") \
+    X(TLV_WPS_ER_SUPPORT,                      0x00e0, "WPS_ER_SUPPORT") \
+    X(TLV_ADDITIONAL_TEST_PLATFORM_ID,         0x00e1, "ADDITIONAL_TEST_PLATFORM_ID") \
+    X(TLV_EVENT_LOOP_STATS_ACTION,             0x00e2, "EVENT_LOOP_STATS_ACTION") \
+    X(TLV_BATCH_STOP_ON_ERROR,                 0x00e3, "BATCH_STOP_ON_ERROR") \
+    X(TLV_BATCH_COMMAND,                       0x00e4, "BATCH_COMMAND") \
+    X(TLV_BATCH_COMMAND_MORE,                  0x00e5, "BATCH_COMMAND_MORE") \
+    X(TLV_LOG_CATEGORY,                        0x00e6, "LOG_CATEGORY") \
+    X(TLV_LOG_LEVEL,                           0x00e7, "LOG_LEVEL") \
+    \
+    /* class ResponseTLV */ \
+    /* List of TLV used in the QuickTrack API response and ACK messages from the DUT */ \
+    X(TLV_MESSAGE,                             0xa000, "MESSAGE") \
+    X(TLV_STATUS,                              0xa001, "STATUS") \
+    X(TLV_DUT_WLAN_IP_ADDR,                    0xa002, "DUT_WLAN_IP_ADDR") \
+    X(TLV_DUT_MAC_ADDR,                        0xa003, "DUT_MAC_ADDR") \
+    X(TLV_CONTROL_APP_VERSION,                 0xa004, "CONTROL_APP_VERSION") \
+    X(TLV_LOOP_BACK_DATA_RECEIVED,             0xa005, "LOOP_BACK_DATA_RECEIVED") \
+    X(TLV_LOOP_BACK_DATA_SENT,                 0xa006, "LOOP_BACK_DATA_SENT") \
+    X(TLV_ARP_RECV_NUM,                        0xa007, "ARP_RECV_NUM") \
+    X(TLV_TEST_PLATFORM_APP_VERSION,           0xa008, "TEST_PLATFORM_APP_VERSION") \
+    X(TLV_LOOP_BACK_SERVER_PORT,               0xa009, "LOOP_BACK_SERVER_PORT") \
+    X(TLV_WSC_PIN_CODE,                        0xa00a, "WSC_PIN_CODE") \
+    X(TLV_P2P_INTENT_VALUE,                    0xa00b, "P2P_INTENT_VALUE") \
+    X(TLV_WSC_SSID,                            0xa00c, "WSC_SSID") \
+    X(TLV_WSC_WPA_KEY_MGMT,                    0xa00d, "WSC_WPA_KEY_MGMT") \
+    X(TLV_WSC_WPA_PASSPHRASE,                  0xa00e, "WSC_WPA_PASSPHRASE") \
+    X(TLV_PASSPOINT_ICON_CHECKSUM,             0xa00f, "PASSPOINT_ICON_CHECKSUM") \
+    X(TLV_EVENT_LOOP_STATS,                    0xa010, "EVENT_LOOP_STATS") \
+    X(TLV_BATCH_RESPONSE,                      0xa011, "BATCH_RESPONSE") \
+    X(TLV_BATCH_RESPONSE_MORE,                 0xa012, "BATCH_RESPONSE_MORE") \
+    X(TLV_LOG_LEVELS,                          0xa013, "LOG_LEVELS")
+
+/* Schema of the TLVs with a typed value: X(symbol, type, min, max, default). Any other TLV is a string.
+ * A request with a value that doesn't decode or is out of the bounds fails to parse. */
+#define INDIGO_TLV_SCHEMA_LIST(X) \
+    X(TLV_CHANNEL,                             TLV_TYPE_INT,    0, 233, 0) \
+    X(TLV_FREQUENCY,                           TLV_TYPE_INT,    0, 7125, 0) \
+    X(TLV_RESET_TYPE,                          TLV_TYPE_INT,    0, RESET_TYPE_RECONFIGURE, 0) \
+    X(TLV_OP_CLASS,                            TLV_TYPE_INT,    0, 255, 0) \
+    X(TLV_ROLE,                                TLV_TYPE_INT,    DUT_TYPE_STAUT, DUT_TYPE_P2PUT, 0) \
+    X(TLV_BSS_IDENTIFIER,                      TLV_TYPE_INT,    0, 0x3ff, 0) \
+    X(TLV_OWE_TRANSITION_BSS_IDENTIFIER,       TLV_TYPE_INT,    0, 0x3ff, 0) \
+    X(TLV_HE_OPER_CHWIDTH,                     TLV_TYPE_INT,    0, 3, 0) \
+    X(TLV_VHT_OPER_CHWIDTH,                    TLV_TYPE_INT,    0, 3, 0) \
+    X(TLV_HE_UNSOL_PR_RESP_CADENCE,            TLV_TYPE_INT,    0, 65535, 0) \
+    X(TLV_DEBUG_LEVEL,                         TLV_TYPE_INT,    0, 255, 0) \
+    X(TLV_DUT_IP_ADDRESS,                      TLV_TYPE_IPV4,   0, 0, 0) \
+    X(TLV_TP_IP_ADDRESS,                       TLV_TYPE_IPV4,   0, 0, 0) \
+    X(TLV_BSSID,                               TLV_TYPE_MAC,    0, 0, 0) \
+    X(TLV_ARP_TRANSMISSION_RATE,               TLV_TYPE_INT,    1, 1000, 1) \
+    X(TLV_ARP_TARGET_IP,                       TLV_TYPE_IPV4,   0, 0, 0) \
+    X(TLV_ARP_FRAME_COUNT,                     TLV_TYPE_INT,    0, 65535, 2) \
+    X(TLV_PACKET_COUNT,                        TLV_TYPE_INT,    -1, 1000000, 10) \
+    X(TLV_PACKET_RATE,                         TLV_TYPE_DOUBLE, 0, 1000, 1) \
+    X(TLV_PACKET_SIZE,                         TLV_TYPE_INT,    1, 65507, 1000) \
+    X(TLV_DUT_UDP_PORT,                        TLV_TYPE_INT,    1, 65535, 0) \
+    X(TLV_GO_INTENT,                           TLV_TYPE_INT,    0, 15, 0) \
+    X(TLV_P2P_CONN_TYPE,                       TLV_TYPE_INT,    0, P2P_CONN_TYPE_AUTH, 0) \
+    X(TLV_ADDITIONAL_TEST_PLATFORM_ID,         TLV_TYPE_INT,    0, 0xffff, 0) \
+    X(TLV_EVENT_LOOP_STATS_ACTION,             TLV_TYPE_INT,    EVENT_LOOP_STATS_DISABLE, EVENT_LOOP_STATS_RESET, 0) \
+    X(TLV_BATCH_STOP_ON_ERROR,                 TLV_TYPE_INT,    0, 1, 1) \
+    X(TLV_LOG_LEVEL,                           TLV_TYPE_INT,    LOG_LEVEL_DEBUG_VERBOSE, LOG_LEVEL_ERROR + 1, LOG_LEVEL_DEBUG)
+
+enum {
+#define TLV_ID(symbol, id, name) symbol = id,
+    INDIGO_TLV_LIST(TLV_ID)
+#undef TLV_ID
+};
+
+/* Direct-indexed lookup slots. APIs are 0xN0xx with xx < 0x40, TLVs are 0x00xx or 0xa0xx. */
+#define API_SLOTS                               (16 * 64)
+#define API_SLOT_VALID(id)                      (((id) & ~0xf03f) == 0)
+#define API_SLOT(id)                            ((((id) >> 12) << 6) | ((id) & 0x3f))
+#define TLV_SLOTS                               (2 * 256)
+#define TLV_SLOT_VALID(id)                      (((id) >> 8) == 0x00 || ((id) >> 8) == 0xa0)
+#define TLV_SLOT(id)                            ((((id) >> 8) == 0xa0 ? 256 : 0) | ((id) & 0xff))
 
 /* TLV Value */
 #define DUT_TYPE_STAUT                          0x01
 #define DUT_TYPE_APUT                           0x02
 #define DUT_TYPE_P2PUT                          0x03
 
+#define EVENT_LOOP_STATS_DISABLE                0
+#define EVENT_LOOP_STATS_ENABLE                 1
+#define EVENT_LOOP_STATS_RESET                  2
+
 #define TLV_BAND_24GHZ                          "2.4GHz"
 #define TLV_BAND_5GHZ                           "5GHz"
 #define TLV_BAND_6GHZ                           "6GHz"
@@ -324,6 +425,7 @@ struct indigo_api {
 #define TLV_VALUE_WPA_SET_PARAMETER_NO_OK       "Failed to set parameter."
 #define TLV_VALUE_WPA_PARAMETER_NOT_SUPPORT     "The set parameter is not supported"
 #define TLV_VALUE_HOSTAPD_START_OK              "AP is up : Hostapd service is active"
+#define TLV_VALUE_HOSTAPD_START_NOT_OK          "Failed to start hostapd service."
 #define TLV_VALUE_ASSIGN_STATIC_IP_OK           "Static IP successfully assigned to wireless interface"
 #define TLV_VALUE_ASSIGN_STATIC_IP_NOT_OK       "Static IP failed to be assigned to wireless interface"
 #define TLV_VALUE_LOOPBACK_SVR_START_OK         "Loop back server initialized"
@@ -390,8 +492,9 @@ struct indigo_api {
 #define WPS_ENABLE_OOB                          0x02
 
 struct indigo_api* get_api_by_id(int id);
-struct indigo_tlv* get_tlv_by_id(int id);
+const struct indigo_tlv* get_tlv_by_id(int id);
 char* get_api_type_by_id(int id);
+int get_api_arena_stats(char *buffer, int size);
 
 typedef int (*api_callback_func)(struct packet_wrapper *req, struct packet_wrapper *resp);
 void register_api(int id, api_callback_func verify, api_callback_func handle);
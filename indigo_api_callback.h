@@ -31,120 +31,162 @@ struct anqp_tlv_to_config_name {
     char config[NAME_SIZE];
 };
 
+#define TLV_CONFIG_ENTRY(tlv, config_name, quoted) { tlv, config_name, quoted },
+
+/* The config lists are indexed by TLV_SLOT() of the TLV ID */
+static struct tlv_to_config_name* find_tlv_config_by_slot(const unsigned char *slots, struct tlv_to_config_name *list, int tlv_id) {
+    if (tlv_id < 0 || !TLV_SLOT_VALID(tlv_id) || slots[TLV_SLOT(tlv_id)] == 0) {
+        return NULL;
+    }
+    return &list[slots[TLV_SLOT(tlv_id)] - 1];
+}
+
+/* hostapd and wpa_supplicant configuration names of the TLVs, X(TLV, config name, quoted) */
+#define TLV_CONFIG_LIST(X) \
+    /* hapds */ \
+    X(TLV_SSID, "ssid", 0) \
+    X(TLV_CHANNEL, "channel", 0) \
+    X(TLV_WEP_KEY0, "wep_key0", 0) \
+    X(TLV_HW_MODE, "hw_mode", 0) \
+    X(TLV_AUTH_ALGORITHM, "auth_algs", 0) \
+    X(TLV_WEP_DEFAULT_KEY, "wep_default_key", 0) \
+    X(TLV_IEEE80211_D, "ieee80211d", 0) \
+    X(TLV_IEEE80211_N, "ieee80211n", 0) \
+    X(TLV_IEEE80211_AC, "ieee80211ac", 0) \
+    X(TLV_COUNTRY_CODE, "country_code", 0) \
+    X(TLV_WMM_ENABLED, "wmm_enabled", 0) \
+    X(TLV_WPA, "wpa", 0) \
+    X(TLV_WPA_KEY_MGMT, "wpa_key_mgmt", 0) \
+    X(TLV_RSN_PAIRWISE, "rsn_pairwise", 0) \
+    X(TLV_WPA_PASSPHRASE, "wpa_passphrase", 0) \
+    X(TLV_WPA_PAIRWISE, "wpa_pairwise", 0) \
+    X(TLV_HT_CAPB, "ht_capab", 0) \
+    X(TLV_IEEE80211_W, "ieee80211w", 0) \
+    X(TLV_IEEE80211_H, "ieee80211h", 0) \
+    X(TLV_VHT_OPER_CHWIDTH, "vht_oper_chwidth", 0) \
+    X(TLV_VHT_OPER_CENTR_FREQ, "vht_oper_centr_freq_seg0_idx", 0) \
+    X(TLV_VHT_CAPB, "vht_capab", 0) \
+    X(TLV_IEEE8021_X, "ieee8021x", 0) \
+    X(TLV_EAP_SERVER, "eap_server", 0) \
+    X(TLV_AUTH_SERVER_ADDR, "auth_server_addr", 0) \
+    X(TLV_AUTH_SERVER_PORT, "auth_server_port", 0) \
+    X(TLV_AUTH_SERVER_SHARED_SECRET, "auth_server_shared_secret", 0) \
+    X(TLV_IE_OVERRIDE, "own_ie_override", 0) \
+    X(TLV_SAE_ANTI_CLOGGING_THRESHOLD, "sae_anti_clogging_threshold", 0) \
+    X(TLV_DISABLE_PMKSA_CACHING, "disable_pmksa_caching", 0) \
+    X(TLV_SAE_GROUPS, "sae_groups", 0) \
+    X(TLV_IEEE80211_AX, "ieee80211ax", 0) \
+    X(TLV_HE_OPER_CHWIDTH, "he_oper_chwidth", 0) \
+    X(TLV_HE_OPER_CENTR_FREQ, "he_oper_centr_freq_seg0_idx", 0) \
+    X(TLV_MBO, "mbo", 0) \
+    X(TLV_MBO_CELL_DATA_CONN_PREF, "mbo_cell_data_conn_pref", 0) \
+    X(TLV_BSS_TRANSITION, "bss_transition", 0) \
+    X(TLV_INTERWORKING, "interworking", 0) \
+    X(TLV_RRM_NEIGHBOR_REPORT, "rrm_neighbor_report", 0) \
+    X(TLV_RRM_BEACON_REPORT, "rrm_beacon_report", 0) \
+    X(TLV_COUNTRY3, "country3", 0) \
+    X(TLV_MBO_CELL_CAPA, "mbo_cell_capa", 0) \
+    X(TLV_MBO_ASSOC_DISALLOW, "mbo_assoc_disallow", 0) \
+    X(TLV_GAS_COMEBACK_DELAY, "gas_comeback_delay", 0) \
+    X(TLV_SAE_PWE, "sae_pwe", 0) \
+    X(TLV_OWE_GROUPS, "owe_groups", 0) \
+    X(TLV_HE_MU_EDCA, "he_mu_edca_qos_info_param_count", 0) \
+    X(TLV_TRANSITION_DISABLE, "transition_disable", 0) \
+    X(TLV_CONTROL_INTERFACE, "ctrl_interface", 0) \
+    X(TLV_RSNXE_OVERRIDE_EAPOL, "rsnxe_override_eapol", 0) \
+    X(TLV_SAE_CONFIRM_IMMEDIATE, "sae_confirm_immediate", 0) \
+    X(TLV_OWE_TRANSITION_BSS_IDENTIFIER, "owe_transition_ifname", 0) \
+    X(TLV_OP_CLASS, "op_class", 0) \
+    X(TLV_HE_UNSOL_PR_RESP_CADENCE, "unsol_bcast_probe_resp_interval", 0) \
+    X(TLV_HE_FILS_DISCOVERY_TX, "fils_discovery_max_interval", 0) \
+    X(TLV_SKIP_6G_BSS_SECURITY_CHECK, "skip_6g_bss_security_check", 0) \
+    X(TLV_HS20, "hs20", 0) \
+    X(TLV_ACCESS_NETWORK_TYPE, "access_network_type", 0) \
+    X(TLV_INTERNET, "internet", 0) \
+    X(TLV_VENUE_GROUP, "venue_group", 0) \
+    X(TLV_VENUE_TYPE, "venue_type", 0) \
+    X(TLV_HESSID, "hessid", 0) \
+    X(TLV_ANQP_3GPP_CELL_NETWORK_INFO, "anqp_3gpp_cell_net", 0) \
+    X(TLV_OSU_SSID, "osu_ssid", 0) \
+    X(TLV_PROXY_ARP, "proxy_arp", 0) \
+    X(TLV_OSU_SERVER_URI, "osu_server_uri", 0) \
+    X(TLV_OSU_METHOD, "osu_method_list", 0) \
+    X(TLV_DOMAIN_LIST, "domain_name", 0) \
+    X(TLV_IGNORE_BROADCAST_SSID, "ignore_broadcast_ssid", 0) \
+    X(TLV_MANAGE_P2P, "manage_p2p", 0) \
+    X(TLV_WPS_INDEPENDENT, "wps_independent", 0) \
+    X(TLV_LOCAL_PWR_CONST, "local_pwr_constraint", 0) \
+    X(TLV_SPECTRUM_MGMT_REQ, "spectrum_mgmt_required", 0) \
+    \
+    /* wpas, seperate? */ \
+    X(TLV_STA_SSID, "ssid", 1) \
+    X(TLV_KEY_MGMT, "key_mgmt", 0) \
+    X(TLV_STA_WEP_KEY0, "wep_key0", 0) \
+    X(TLV_WEP_TX_KEYIDX, "wep_tx_keyidx", 0) \
+    X(TLV_GROUP, "group", 0) \
+    X(TLV_PSK, "psk", 1) \
+    X(TLV_PROTO, "proto", 0) \
+    X(TLV_STA_IEEE80211_W, "ieee80211w", 0) \
+    X(TLV_PAIRWISE, "pairwise", 0) \
+    X(TLV_EAP, "eap", 0) \
+    X(TLV_PHASE1, "phase1", 1) \
+    X(TLV_PHASE2, "phase2", 1) \
+    X(TLV_IDENTITY, "identity", 1) \
+    X(TLV_PASSWORD, "password", 1) \
+    X(TLV_CA_CERT, "ca_cert", 1) \
+    X(TLV_SERVER_CERT, "ca_cert", 1) \
+    X(TLV_PRIVATE_KEY, "private_key", 1) \
+    X(TLV_CLIENT_CERT, "client_cert", 1) \
+    X(TLV_DOMAIN_MATCH, "domain_match", 1) \
+    X(TLV_DOMAIN_SUFFIX_MATCH, "domain_suffix_match", 1) \
+    X(TLV_PAC_FILE, "pac_file", 1) \
+    X(TLV_STA_OWE_GROUP, "owe_group", 0) \
+    X(TLV_BSSID, "bssid", 0) \
+    X(TLV_REALM, "realm", 1) \
+    X(TLV_IMSI, "imsi", 1) \
+    X(TLV_MILENAGE, "milenage", 1) \
+    X(TLV_BSSID_FILTER_LIST, "bssid_filter", 0) \
+    X(TLV_USERNAME, "username", 1) \
+    X(TLV_HOME_FQDN, "domain", 1) \
+    X(TLV_PREFER, "priority", 0) \
+    \
+    /* hapd + wpas */ \
+    X(TLV_EAP_FRAG_SIZE, "fragment_size", 0)
+
 struct tlv_to_config_name maps[] = {
-    /* hapds */
-    { TLV_SSID, "ssid", 0 },
-    { TLV_CHANNEL, "channel", 0 },
-    { TLV_WEP_KEY0, "wep_key0", 0 },
-    { TLV_HW_MODE, "hw_mode", 0 },
-    { TLV_AUTH_ALGORITHM, "auth_algs", 0 },
-    { TLV_WEP_DEFAULT_KEY, "wep_default_key", 0 },
-    { TLV_IEEE80211_D, "ieee80211d", 0 },
-    { TLV_IEEE80211_N, "ieee80211n", 0 },
-    { TLV_IEEE80211_AC, "ieee80211ac", 0 },
-    { TLV_COUNTRY_CODE, "country_code", 0 },
-    { TLV_WMM_ENABLED, "wmm_enabled", 0 },
-    { TLV_WPA, "wpa", 0 },
-    { TLV_WPA_KEY_MGMT, "wpa_key_mgmt", 0 },
-    { TLV_RSN_PAIRWISE, "rsn_pairwise", 0 },
-    { TLV_WPA_PASSPHRASE, "wpa_passphrase", 0 },
-    { TLV_WPA_PAIRWISE, "wpa_pairwise", 0 },
-    { TLV_HT_CAPB, "ht_capab", 0 },
-    { TLV_IEEE80211_W, "ieee80211w", 0 },
-    { TLV_IEEE80211_H, "ieee80211h", 0 },
-    { TLV_VHT_OPER_CHWIDTH, "vht_oper_chwidth", 0 },
-    { TLV_VHT_OPER_CENTR_FREQ, "vht_oper_centr_freq_seg0_idx", 0 },
-    { TLV_VHT_CAPB, "vht_capab", 0 },
-    { TLV_IEEE8021_X, "ieee8021x", 0 },
-    { TLV_EAP_SERVER, "eap_server", 0 },
-    { TLV_AUTH_SERVER_ADDR, "auth_server_addr", 0 },
-    { TLV_AUTH_SERVER_PORT, "auth_server_port", 0 },
-    { TLV_AUTH_SERVER_SHARED_SECRET, "auth_server_shared_secret", 0 },
-    { TLV_IE_OVERRIDE, "own_ie_override", 0 }, // HostAPD Python Interface
-    { TLV_SAE_ANTI_CLOGGING_THRESHOLD, "sae_anti_clogging_threshold", 0 }, // HostAPD Python Interface
-    { TLV_DISABLE_PMKSA_CACHING, "disable_pmksa_caching", 0 },  // HostAPD Python Interface
-    { TLV_SAE_GROUPS, "sae_groups", 0 },
-    { TLV_IEEE80211_AX, "ieee80211ax", 0 },
-    { TLV_HE_OPER_CHWIDTH, "he_oper_chwidth", 0 },
-    { TLV_HE_OPER_CENTR_FREQ, "he_oper_centr_freq_seg0_idx", 0 },
-    { TLV_MBO, "mbo", 0 },
-    { TLV_MBO_CELL_DATA_CONN_PREF, "mbo_cell_data_conn_pref", 0 },
-    { TLV_BSS_TRANSITION, "bss_transition", 0 },
-    { TLV_INTERWORKING, "interworking", 0 },
-    { TLV_RRM_NEIGHBOR_REPORT, "rrm_neighbor_report", 0 },
-    { TLV_RRM_BEACON_REPORT, "rrm_beacon_report", 0 },
-    { TLV_COUNTRY3, "country3", 0 },
-    { TLV_MBO_CELL_CAPA, "mbo_cell_capa", 0 },
-    { TLV_MBO_ASSOC_DISALLOW, "mbo_assoc_disallow", 0 },
-    { TLV_GAS_COMEBACK_DELAY, "gas_comeback_delay", 0 },
-    { TLV_SAE_PWE, "sae_pwe", 0 },
-    { TLV_OWE_GROUPS, "owe_groups", 0 },
-    { TLV_HE_MU_EDCA, "he_mu_edca_qos_info_param_count", 0 },
-    { TLV_TRANSITION_DISABLE, "transition_disable", 0 },
-    { TLV_CONTROL_INTERFACE, "ctrl_interface", 0 },
-    { TLV_RSNXE_OVERRIDE_EAPOL, "rsnxe_override_eapol", 0 },
-    { TLV_SAE_CONFIRM_IMMEDIATE, "sae_confirm_immediate", 0 },
-    { TLV_OWE_TRANSITION_BSS_IDENTIFIER, "owe_transition_ifname", 0 },
-    { TLV_OP_CLASS, "op_class", 0 },
-    { TLV_HE_UNSOL_PR_RESP_CADENCE, "unsol_bcast_probe_resp_interval", 0 },
-    { TLV_HE_FILS_DISCOVERY_TX, "fils_discovery_max_interval", 0 },
-    { TLV_SKIP_6G_BSS_SECURITY_CHECK, "skip_6g_bss_security_check", 0 },
-    { TLV_HS20, "hs20", 0 },
-    { TLV_ACCESS_NETWORK_TYPE, "access_network_type", 0 },
-    { TLV_INTERNET, "internet", 0 },
-    { TLV_VENUE_GROUP, "venue_group", 0 },
-    { TLV_VENUE_TYPE, "venue_type", 0 },
-    { TLV_HESSID, "hessid", 0 },
-    { TLV_ANQP_3GPP_CELL_NETWORK_INFO, "anqp_3gpp_cell_net", 0 },
-    { TLV_OSU_SSID, "osu_ssid", 0 },
-    { TLV_PROXY_ARP, "proxy_arp", 0 },
-    { TLV_OSU_SERVER_URI, "osu_server_uri", 0 },
-    { TLV_OSU_METHOD, "osu_method_list", 0 },
-    { TLV_DOMAIN_LIST, "domain_name", 0 },
-    { TLV_IGNORE_BROADCAST_SSID, "ignore_broadcast_ssid", 0 },
-    { TLV_MANAGE_P2P, "manage_p2p", 0 },
-    { TLV_WPS_INDEPENDENT, "wps_independent", 0 },
-    { TLV_LOCAL_PWR_CONST, "local_pwr_constraint", 0 },
-    { TLV_SPECTRUM_MGMT_REQ, "spectrum_mgmt_required", 0 },
+    TLV_CONFIG_LIST(TLV_CONFIG_ENTRY)
+};
 
-    /* wpas, seperate? */
-    { TLV_STA_SSID, "ssid", 1 },
-    { TLV_KEY_MGMT, "key_mgmt", 0 },
-    { TLV_STA_WEP_KEY0, "wep_key0", 0 },
-    { TLV_WEP_TX_KEYIDX, "wep_tx_keyidx", 0 },
-    { TLV_GROUP, "group", 0 },
-    { TLV_PSK, "psk", 1 },
-    { TLV_PROTO, "proto", 0 },
-    { TLV_STA_IEEE80211_W, "ieee80211w", 0 },
-    { TLV_PAIRWISE, "pairwise", 0 },
-    { TLV_EAP, "eap", 0 },
-    { TLV_PHASE1, "phase1", 1 },
-    { TLV_PHASE2, "phase2", 1 },
-    { TLV_IDENTITY, "identity", 1 },
-    { TLV_PASSWORD, "password", 1 },
-    { TLV_CA_CERT, "ca_cert", 1 },
-    { TLV_SERVER_CERT, "ca_cert", 1 },
-    { TLV_PRIVATE_KEY, "private_key", 1 },
-    { TLV_CLIENT_CERT, "client_cert", 1 },
-    { TLV_DOMAIN_MATCH, "domain_match", 1 },
-    { TLV_DOMAIN_SUFFIX_MATCH, "domain_suffix_match", 1 },
-    { TLV_PAC_FILE, "pac_file", 1 },
-    { TLV_STA_OWE_GROUP, "owe_group", 0 },
-    { TLV_BSSID, "bssid", 0 },
-    { TLV_REALM, "realm", 1 },
-    { TLV_IMSI, "imsi", 1 },    
-    { TLV_MILENAGE, "milenage", 1 },
-    { TLV_BSSID_FILTER_LIST, "bssid_filter", 0 },
-    { TLV_USERNAME, "username", 1 },
-    { TLV_HOME_FQDN, "domain", 1 },
-    { TLV_PREFER, "priority", 0 },
+enum {
+#define MAPS_POSITION(tlv, config_name, quoted) MAPS_POSITION_##tlv,
+    TLV_CONFIG_LIST(MAPS_POSITION)
+#undef MAPS_POSITION
+};
 
-    /* hapd + wpas */
-    { TLV_EAP_FRAG_SIZE, "fragment_size", 0 },
+static const unsigned char maps_slots[TLV_SLOTS] = {
+#define MAPS_SLOT(tlv, config_name, quoted) [TLV_SLOT(tlv)] = MAPS_POSITION_##tlv + 1,
+    TLV_CONFIG_LIST(MAPS_SLOT)
+#undef MAPS_SLOT
 };
 
+/* Configurations whose value is a semicolon separated list, X(TLV, config name, quoted) */
+#define SEMICOLON_CONFIG_LIST(X) \
+    X(TLV_ROAMING_CONSORTIUM, "roaming_consortium", 0)
+
 struct tlv_to_config_name semicolon_list[] = {
-    { TLV_ROAMING_CONSORTIUM, "roaming_consortium", 0 },
+    SEMICOLON_CONFIG_LIST(TLV_CONFIG_ENTRY)
+};
+
+enum {
+#define SEMICOLON_POSITION(tlv, config_name, quoted) SEMICOLON_POSITION_##tlv,
+    SEMICOLON_CONFIG_LIST(SEMICOLON_POSITION)
+#undef SEMICOLON_POSITION
+};
+
+static const unsigned char semicolon_list_slots[TLV_SLOTS] = {
+#define SEMICOLON_SLOT(tlv, config_name, quoted) [TLV_SLOT(tlv)] = SEMICOLON_POSITION_##tlv + 1,
+    SEMICOLON_CONFIG_LIST(SEMICOLON_SLOT)
+#undef SEMICOLON_SLOT
 };
 
 struct anqp_tlv_to_config_name anqp_maps[] = {
@@ -174,50 +216,54 @@ struct anqp_tlv_to_config_name anqp_maps[] = {
 };
 
 char* find_tlv_config_name(int tlv_id) {
-    int i;
-    for (i = 0; i < sizeof(maps)/sizeof(struct tlv_to_config_name); i++) {
-        if (tlv_id == maps[i].tlv_id) {
-            return maps[i].config_name;
-        }
-    }
-    return NULL;
+    struct tlv_to_config_name *cfg = find_tlv_config_by_slot(maps_slots, maps, tlv_id);
+
+    return cfg ? cfg->config_name : NULL;
 }
 
 struct tlv_to_config_name* find_tlv_config(int tlv_id) {
-    int i;
-    for (i = 0; i < sizeof(maps)/sizeof(struct tlv_to_config_name); i++) {
-        if (tlv_id == maps[i].tlv_id) {
-            return &maps[i];
-        }
-    }
-    return NULL;
+    return find_tlv_config_by_slot(maps_slots, maps, tlv_id);
+}
+
+struct tlv_to_config_name* find_semicolon_tlv_config(int tlv_id) {
+    return find_tlv_config_by_slot(semicolon_list_slots, semicolon_list, tlv_id);
 }
 
+/* wpa_supplicant global configuration names of the TLVs, X(TLV, config name, quoted) */
+#define WPAS_GLOBAL_CONFIG_LIST(X) \
+    X(TLV_STA_SAE_GROUPS, "sae_groups", 0) \
+    X(TLV_MBO_CELL_CAPA, "mbo_cell_capa", 0) \
+    X(TLV_SAE_PWE, "sae_pwe", 0) \
+    X(TLV_CONTROL_INTERFACE, "ctrl_interface", 0) \
+    X(TLV_RAND_MAC_ADDR, "mac_addr", 0) \
+    X(TLV_PREASSOC_RAND_MAC_ADDR, "preassoc_mac_addr", 0) \
+    X(TLV_RAND_ADDR_LIFETIME, "rand_addr_lifetime", 0) \
+    X(TLV_HS20, "hs20", 0) \
+    X(TLV_INTERWORKING, "interworking", 0) \
+    X(TLV_HESSID, "hessid", 0) \
+    X(TLV_ACCESS_NETWORK_TYPE, "access_network_type", 0) \
+    X(TLV_FREQ_LIST, "freq_list", 0) \
+    X(TLV_UPDATE_CONFIG, "update_config", 0) \
+    X(TLV_P2P_DISABLED, "p2p_disabled", 0)
+
 struct tlv_to_config_name wpas_global_maps[] = {
-    { TLV_STA_SAE_GROUPS, "sae_groups", 0 },
-    { TLV_MBO_CELL_CAPA, "mbo_cell_capa", 0 },
-    { TLV_SAE_PWE, "sae_pwe", 0 },
-    { TLV_CONTROL_INTERFACE, "ctrl_interface", 0 },
-    { TLV_RAND_MAC_ADDR, "mac_addr", 0 },
-    { TLV_PREASSOC_RAND_MAC_ADDR, "preassoc_mac_addr", 0 },
-    { TLV_RAND_ADDR_LIFETIME, "rand_addr_lifetime", 0 },
-    { TLV_HS20, "hs20", 0 },
-    { TLV_INTERWORKING, "interworking", 0 },
-    { TLV_HESSID, "hessid", 0 },
-    { TLV_ACCESS_NETWORK_TYPE, "access_network_type", 0 },
-    { TLV_FREQ_LIST, "freq_list", 0 },
-    { TLV_UPDATE_CONFIG, "update_config", 0 },
-    { TLV_P2P_DISABLED, "p2p_disabled", 0 },
+    WPAS_GLOBAL_CONFIG_LIST(TLV_CONFIG_ENTRY)
+};
+
+enum {
+#define WPAS_GLOBAL_POSITION(tlv, config_name, quoted) WPAS_GLOBAL_POSITION_##tlv,
+    WPAS_GLOBAL_CONFIG_LIST(WPAS_GLOBAL_POSITION)
+#undef WPAS_GLOBAL_POSITION
+};
+
+static const unsigned char wpas_global_maps_slots[TLV_SLOTS] = {
+#define WPAS_GLOBAL_SLOT(tlv, config_name, quoted) [TLV_SLOT(tlv)] = WPAS_GLOBAL_POSITION_##tlv + 1,
+    WPAS_GLOBAL_CONFIG_LIST(WPAS_GLOBAL_SLOT)
+#undef WPAS_GLOBAL_SLOT
 };
 
 struct tlv_to_config_name* find_wpas_global_config_name(int tlv_id) {
-    int i;
-    for (i = 0; i < sizeof(wpas_global_maps)/sizeof(struct tlv_to_config_name); i++) {
-        if (tlv_id == wpas_global_maps[i].tlv_id) {
-            return &wpas_global_maps[i];
-        }
-    }
-    return NULL;
+    return find_tlv_config_by_slot(wpas_global_maps_slots, wpas_global_maps, tlv_id);
 }
 
 struct tlv_to_config_name* find_generic_tlv_config(int tlv_id, struct tlv_to_config_name* arr, int arr_size) {
@@ -245,6 +291,8 @@ static int start_dhcp_handler(struct packet_wrapper *req, struct packet_wrapper
 static int stop_dhcp_handler(struct packet_wrapper *req, struct packet_wrapper *resp);
 static int get_wsc_pin_handler(struct packet_wrapper *req, struct packet_wrapper *resp);
 static int get_wsc_cred_handler(struct packet_wrapper *req, struct packet_wrapper *resp);
+static int get_event_loop_stats_handler(struct packet_wrapper *req, struct packet_wrapper *resp);
+static int set_log_level_handler(struct packet_wrapper *req, struct packet_wrapper *resp);
 /* AP */
 static int stop_ap_handler(struct packet_wrapper *req, struct packet_wrapper *resp);
 static int configure_ap_handler(struct packet_wrapper *req, struct packet_wrapper *resp);
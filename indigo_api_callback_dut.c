@@ -22,16 +22,19 @@
 #include <arpa/inet.h>
 
 #include "indigo_api.h"
+#include "indigo_log.h"
+#include "indigo_process.h"
 #include "vendor_specific.h"
 #include "utils.h"
+#include "indigo_request.h"
 #include "wpa_ctrl.h"
 #include "indigo_api_callback.h"
 #include "hs2_profile.h"
+#include "eloop.h"
 
 static char pac_file_path[S_BUFFER_LEN] = {0};
 struct interface_info* band_transmitter[16];
 struct interface_info* band_first_wlan[16];
-extern struct sockaddr_in *tool_addr;
 int sta_configured = 0;
 int sta_started = 0;
 
@@ -49,6 +52,9 @@ void register_apis() {
     register_api(API_STOP_DHCP, NULL, stop_dhcp_handler);
     register_api(API_GET_WSC_PIN, NULL, get_wsc_pin_handler);
     register_api(API_GET_WSC_CRED, NULL, get_wsc_cred_handler);
+    register_api(API_GET_EVENT_LOOP_STATS, NULL, get_event_loop_stats_handler);
+    register_api(API_BATCH_COMMANDS, NULL, indigo_request_batch_commands);
+    register_api(API_SET_LOG_LEVEL, NULL, set_log_level_handler);
     /* AP */
     register_api(API_AP_START_UP, NULL, start_ap_handler);
     register_api(API_AP_STOP, NULL, stop_ap_handler);
@@ -91,6 +97,7 @@ void register_apis() {
 }
 
 static int get_control_app_handler(struct packet_wrapper *req, struct packet_wrapper *resp) {
+    struct sockaddr_in *tool_addr = get_tool_addr();
     char ipAddress[INET_ADDRSTRLEN];
     char buffer[S_BUFFER_LEN];
 #ifdef _VERSION_
@@ -110,26 +117,102 @@ static int get_control_app_handler(struct packet_wrapper *req, struct packet_wra
     return 0;
 }
 
-static int reset_device_handler(struct packet_wrapper *req, struct packet_wrapper *resp) {
-    int len, status = TLV_VALUE_STATUS_NOT_OK;
+static int get_event_loop_stats_handler(struct packet_wrapper *req, struct packet_wrapper *resp) {
+    int len, pos, status = TLV_VALUE_STATUS_OK;
+    char *message = TLV_VALUE_OK;
+    /* Statistics are split to TLVs of up to 255 bytes and fit one response packet.
+     * The extended encoding carries them whole in one TLV. */
+    char buffer[L_BUFFER_LEN];
+    int extended = req->hdr.version == API_VERSION_EXTENDED;
+    int size = extended ? sizeof(buffer) : 5 * (TLV_VALUE_SIZE - 1) + 1;
+    long long action;
+
+    /* TLV: EVENT_LOOP_STATS_ACTION (Optional) */
+    if (find_wrapper_tlv_by_id(req, TLV_EVENT_LOOP_STATS_ACTION)) {
+        action = get_wrapper_tlv_int(req, TLV_EVENT_LOOP_STATS_ACTION);
+        switch (action) {
+        case EVENT_LOOP_STATS_DISABLE:
+            eloop_stats_enable(0);
+            break;
+        case EVENT_LOOP_STATS_ENABLE:
+            if (eloop_stats_enable(1) < 0) {
+                status = TLV_VALUE_STATUS_NOT_OK;
+                message = TLV_VALUE_NOT_OK;
+            }
+            break;
+        case EVENT_LOOP_STATS_RESET:
+            eloop_stats_reset();
+            break;
+        default:
+            indigo_log(LOG_CATEGORY_ELOOP, LOG_LEVEL_ERROR, "Unknown event loop stats action %lld", action);
+            status = TLV_VALUE_STATUS_NOT_OK;
+            message = TLV_VALUE_NOT_OK;
+            break;
+        }
+    }
+
+    fill_wrapper_message_hdr(resp, API_CMD_RESPONSE, req->hdr.seq);
+    fill_wrapper_tlv_byte(resp, TLV_STATUS, status);
+    fill_wrapper_tlv_bytes(resp, TLV_MESSAGE, strlen(message), message);
+    len = eloop_stats_dump(buffer, size, 0);
+    len += indigo_request_batch_dump(buffer + len, size - len);
+    if (extended) {
+        fill_wrapper_tlv_bytes(resp, TLV_EVENT_LOOP_STATS, len, buffer);
+        return 0;
+    }
+    for (pos = 0; pos < len; pos += TLV_VALUE_SIZE - 1) {
+        fill_wrapper_tlv_bytes(resp, TLV_EVENT_LOOP_STATS,
+            len - pos < TLV_VALUE_SIZE - 1 ? len - pos : TLV_VALUE_SIZE - 1, buffer + pos);
+    }
+    return 0;
+}
+
+static int set_log_level_handler(struct packet_wrapper *req, struct packet_wrapper *resp) {
+    int len, category = LOG_CATEGORY_ALL, status = TLV_VALUE_STATUS_OK;
+    char *message = TLV_VALUE_OK;
+    char name[TLV_VALUE_SIZE], buffer[S_BUFFER_LEN];
+    long long level;
+
+    /* TLV: LOG_CATEGORY (Optional). All the categories when it is missing. */
+    if (get_wrapper_tlv_string(req, TLV_LOG_CATEGORY, name, sizeof(name)) > 0) {
+        category = indigo_log_category_by_name(name);
+    }
+
+    /* TLV: LOG_LEVEL (Optional). The levels are only returned when it is missing. */
+    if (category < LOG_CATEGORY_ALL) {
+        indigo_logger(LOG_LEVEL_ERROR, "Unknown log category %s", name);
+        status = TLV_VALUE_STATUS_NOT_OK;
+        message = TLV_VALUE_NOT_OK;
+    } else if (find_wrapper_tlv_by_id(req, TLV_LOG_LEVEL)) {
+        level = get_wrapper_tlv_int(req, TLV_LOG_LEVEL);
+        indigo_log_set_level(category, level);
+        indigo_logger(LOG_LEVEL_NOTICE, "Log level of %s set to %lld",
+                      category == LOG_CATEGORY_ALL ? "all" : name, level);
+    }
+
+    fill_wrapper_message_hdr(resp, API_CMD_RESPONSE, req->hdr.seq);
+    fill_wrapper_tlv_byte(resp, TLV_STATUS, status);
+    fill_wrapper_tlv_bytes(resp, TLV_MESSAGE, strlen(message), message);
+    len = indigo_log_levels_dump(buffer, sizeof(buffer));
+    fill_wrapper_tlv_bytes(resp, TLV_LOG_LEVELS, len, buffer);
+    return 0;
+}
+
+static int reset_device_stopped(struct packet_wrapper *req, struct packet_wrapper *resp) {
+    int role, status = TLV_VALUE_STATUS_NOT_OK;
     char *message = TLV_VALUE_RESET_NOT_OK;
-    char buffer[TLV_VALUE_SIZE];
-    char role[TLV_VALUE_SIZE], log_level[TLV_VALUE_SIZE], band[TLV_VALUE_SIZE];
+    char band[TLV_VALUE_SIZE];
     struct tlv_hdr *tlv = NULL;
+    int log_level = -1;
 
     /* TLV: ROLE */
-    tlv = find_wrapper_tlv_by_id(req, TLV_ROLE);
-    memset(role, 0, sizeof(role));
-    if (tlv) {
-        memcpy(role, tlv->value, tlv->len);
-    } else {
+    if (find_wrapper_tlv_by_id(req, TLV_ROLE) == NULL) {
         goto done;
     }
+    role = get_wrapper_tlv_int(req, TLV_ROLE);
     /* TLV: DEBUG_LEVEL */
-    tlv = find_wrapper_tlv_by_id(req, TLV_DEBUG_LEVEL);
-    memset(log_level, 0, sizeof(log_level));
-    if (tlv) {
-        memcpy(log_level, tlv->value, tlv->len);
+    if (find_wrapper_tlv_by_id(req, TLV_DEBUG_LEVEL)) {
+        log_level = get_wrapper_tlv_int(req, TLV_DEBUG_LEVEL);
     }
     /* TLV: TLV_BAND */
     memset(band, 0, sizeof(band));
@@ -138,37 +221,29 @@ static int reset_device_handler(struct packet_wrapper *req, struct packet_wrappe
         memcpy(band, tlv->value, tlv->len);
     }
 
-    if (atoi(role) == DUT_TYPE_STAUT) {
-        /* stop the wpa_supplicant and release IP address */
-        memset(buffer, 0, sizeof(buffer));
-        sprintf(buffer, "killall %s 1>/dev/null 2>/dev/null", get_wpas_exec_file());
-        system(buffer);
-        sleep(1);
+    if (role == DUT_TYPE_STAUT) {
+        /* wpa_supplicant is stopped, release IP address */
         reset_interface_ip(get_wireless_interface());
-        if (strlen(log_level)) {
-            set_wpas_debug_level(get_debug_level(atoi(log_level)));
+        if (log_level >= 0) {
+            set_wpas_debug_level(get_debug_level(log_level));
         }
         sta_configured = 0;
         sta_started = 0;
-    } else if (atoi(role) == DUT_TYPE_APUT) {
-        /* stop the hostapd and release IP address */
-        memset(buffer, 0, sizeof(buffer));
-        sprintf(buffer, "killall %s 1>/dev/null 2>/dev/null", get_hapd_exec_file());
-        system(buffer);
-        sleep(1);
+    } else if (role == DUT_TYPE_APUT) {
+        /* hostapd is stopped, release IP address */
         reset_interface_ip(get_wireless_interface());
-        if (strlen(log_level)) {
-            set_hostapd_debug_level(get_debug_level(atoi(log_level)));
+        if (log_level >= 0) {
+            set_hostapd_debug_level(get_debug_level(log_level));
         }
         reset_bridge(get_wlans_bridge());
         /* reset interfaces info */
         clear_interfaces_resource();
-    } else if (atoi(role) == DUT_TYPE_P2PUT) {
+    } else if (role == DUT_TYPE_P2PUT) {
         /* If TP is P2P client, GO can't stop before client removes group monitor if */
         // sprintf(buffer, "killall %s 1>/dev/null 2>/dev/null", get_wpas_exec_file());
         // reset_interface_ip(get_wireless_interface());
-        if (strlen(log_level)) {
-            set_wpas_debug_level(get_debug_level(atoi(log_level)));
+        if (log_level >= 0) {
+            set_wpas_debug_level(get_debug_level(log_level));
         }
     }
 
@@ -198,44 +273,41 @@ done:
     return 0;
 }
 
+static int reset_device_handler(struct packet_wrapper *req, struct packet_wrapper *resp) {
+    /* TLV: ROLE */
+    int role = get_wrapper_tlv_int(req, TLV_ROLE);
+
+    /* Stop the daemon of the role first. Other requests are served meanwhile. */
+    if (role == DUT_TYPE_STAUT) {
+        process_stop_async(get_wpas_exec_file(), indigo_request_event, indigo_request_defer_event(reset_device_stopped));
+        return 0;
+    } else if (role == DUT_TYPE_APUT) {
+        process_stop_async(get_hapd_exec_file(), indigo_request_event, indigo_request_defer_event(reset_device_stopped));
+        return 0;
+    }
+    return reset_device_stopped(req, resp);
+}
+
 // RESP: {<ResponseTLV.STATUS: 40961>: '0', <ResponseTLV.MESSAGE: 40960>: 'AP stop completed : Hostapd service is inactive.'} 
-static int stop_ap_handler(struct packet_wrapper *req, struct packet_wrapper *resp) {
+static int stop_ap_stopped(struct packet_wrapper *req, struct packet_wrapper *resp) {
     int len = 0, reset = 0;
-    char buffer[S_BUFFER_LEN], reset_type[16];
-    char *parameter[] = {"pidof", get_hapd_exec_file(), NULL};
     char *message = NULL;
-    struct tlv_hdr *tlv = NULL;
 
     /* TLV: RESET_TYPE */
-    tlv = find_wrapper_tlv_by_id(req, TLV_RESET_TYPE);
-    memset(reset_type, 0, sizeof(reset_type));
-    if (tlv) {
-        memcpy(reset_type, tlv->value, tlv->len);
-        reset = atoi(reset_type);
-        indigo_logger(LOG_LEVEL_DEBUG, "Reset Type: %d", reset);
+    if (find_wrapper_tlv_by_id(req, TLV_RESET_TYPE)) {
+        reset = get_wrapper_tlv_int(req, TLV_RESET_TYPE);
     }
 
-    if (reset == RESET_TYPE_INIT) {
-        open_tc_app_log();
-        system("rm -rf /var/log/hostapd.log >/dev/null 2>/dev/null");
-    }
-
-    memset(buffer, 0, sizeof(buffer));
-    sprintf(buffer, "killall %s 1>/dev/null 2>/dev/null", get_hapd_exec_file());
-    system(buffer);
-    sleep(2);
-
 #ifdef _OPENWRT_
 #else
     len = system("rfkill unblock wlan");
     if (len) {
-        indigo_logger(LOG_LEVEL_DEBUG, "Failed to run rfkill unblock wlan");
+        indigo_log(LOG_CATEGORY_HAPD, LOG_LEVEL_DEBUG, "Failed to run rfkill unblock wlan");
     }
     sleep(1);
 #endif
 
-    memset(buffer, 0, sizeof(buffer));
-    len = pipe_command(buffer, sizeof(buffer), "/bin/pidof", parameter);
+    len = process_find(get_hapd_exec_file());
     if (len) {
         message = TLV_VALUE_HOSTAPD_STOP_NOT_OK;
     } else {
@@ -259,6 +331,25 @@ static int stop_ap_handler(struct packet_wrapper *req, struct packet_wrapper *re
     return 0;
 }
 
+static int stop_ap_handler(struct packet_wrapper *req, struct packet_wrapper *resp) {
+    int reset = 0;
+
+    /* TLV: RESET_TYPE */
+    if (find_wrapper_tlv_by_id(req, TLV_RESET_TYPE)) {
+        reset = get_wrapper_tlv_int(req, TLV_RESET_TYPE);
+        indigo_log(LOG_CATEGORY_HAPD, LOG_LEVEL_DEBUG, "Reset Type: %d", reset);
+    }
+
+    if (reset == RESET_TYPE_INIT) {
+        open_tc_app_log();
+        system("rm -rf /var/log/hostapd.log >/dev/null 2>/dev/null");
+    }
+
+    /* The response is sent once the daemon has exited. Other requests are served meanwhile. */
+    process_stop_async(get_hapd_exec_file(), indigo_request_event, indigo_request_defer_event(stop_ap_stopped));
+    return 0;
+}
+
 #ifdef _RESERVED_
 /* The function is reserved for the defeault hostapd config */
 #define HOSTAPD_DEFAULT_CONFIG_SSID                 "QuickTrack"
@@ -304,13 +395,12 @@ static int generate_hostapd_config(char *output, int output_size, struct packet_
     int i, enable_ac = 0, enable_11h = 0, enable_hs20 = 0;
     int enable_wps = 0, use_mbss = 0;
     char buffer[S_BUFFER_LEN], cfg_item[2*BUFFER_LEN];
-    char band[64], value[16];
+    char band[64];
     char country[16];
     struct tlv_to_config_name* cfg = NULL;
     struct tlv_hdr *tlv = NULL;
     int is_6g_only = 0, unsol_pr_resp_interval = 0;
     struct tlv_to_profile *profile = NULL; 
-    int semicolon_list_size = sizeof(semicolon_list) / sizeof(struct tlv_to_config_name);
     int hs20_icons_attached = 0;
     int is_multiple_bssid = 0;
 
@@ -339,9 +429,7 @@ static int generate_hostapd_config(char *output, int output_size, struct packet_
         memset(cfg_item, 0, sizeof(cfg_item));
 
         if (tlv->id == TLV_CHANNEL) {
-            memset(value, 0, sizeof(value));
-            memcpy(value, tlv->value, tlv->len);
-            channel = atoi(value);
+            channel = get_wrapper_tlv_int(wrapper, tlv->id);
             if (is_multiple_bssid) {
                /* channel will be configured on the first wlan */
                continue; 
@@ -364,7 +452,7 @@ static int generate_hostapd_config(char *output, int output_size, struct packet_
         /* This is used when hostapd will use multiple lines to 
          * configure multiple items in the same configuration parameter
          * (use semicolon to separate multiple configurations) */
-        cfg = find_generic_tlv_config(tlv->id, semicolon_list, semicolon_list_size);
+        cfg = find_semicolon_tlv_config(tlv->id);
         if (cfg) {
             char *token = NULL, *delimit = ";";
 
@@ -401,7 +489,7 @@ static int generate_hostapd_config(char *output, int output_size, struct packet_
             }
 
             if (atoi(buffer) > profile->size) {
-               indigo_logger(LOG_LEVEL_ERROR, "profile index out of bound!: %d, array_size:%d", atoi(buffer), profile->size);
+               indigo_log(LOG_CATEGORY_HAPD, LOG_LEVEL_ERROR, "profile index out of bound!: %d, array_size:%d", atoi(buffer), profile->size);
             } else {
                 hs2_config = (char *)profile->profile[atoi(buffer)];
             }
@@ -418,7 +506,7 @@ static int generate_hostapd_config(char *output, int output_size, struct packet_
             /* To get AP wps vendor info */
             wps_setting *s = get_vendor_wps_settings(WPS_AP);
             if (!s) {
-                indigo_logger(LOG_LEVEL_WARNING, "Failed to get APUT WPS settings");
+                indigo_log(LOG_CATEGORY_HAPD, LOG_LEVEL_WARNING, "Failed to get APUT WPS settings");
                 continue;
             }
             enable_wps = 1;
@@ -430,7 +518,7 @@ static int generate_hostapd_config(char *output, int output_size, struct packet_
                     sprintf(cfg_item, "%s=%s\n", s[j].wkey, s[j].value);
                     strcat(output, cfg_item);
                 }
-                indigo_logger(LOG_LEVEL_INFO, "APUT Configure WPS: OOB.");
+                indigo_log(LOG_CATEGORY_HAPD, LOG_LEVEL_INFO, "APUT Configure WPS: OOB.");
             } else if (atoi(buffer) == WPS_ENABLE_NORMAL){
                 /* WPS Normal: Configure manually. */
                 for (j = 0; j < AP_SETTING_NUM; j++) {
@@ -448,9 +536,9 @@ static int generate_hostapd_config(char *output, int output_size, struct packet_
                     }
                     strcat(output, cfg_item);
                 }
-                indigo_logger(LOG_LEVEL_INFO, "APUT Configure WPS: Manually Configured.");
+                indigo_log(LOG_CATEGORY_HAPD, LOG_LEVEL_INFO, "APUT Configure WPS: Manually Configured.");
             } else {
-                indigo_logger(LOG_LEVEL_ERROR, "Unknown WPS TLV value: %d (TLV ID 0x%04x)", atoi(buffer), tlv->id);
+                indigo_log(LOG_CATEGORY_HAPD, LOG_LEVEL_ERROR, "Unknown WPS TLV value: %d (TLV ID 0x%04x)", atoi(buffer), tlv->id);
             }
             continue;
         }
@@ -471,7 +559,7 @@ static int generate_hostapd_config(char *output, int output_size, struct packet_
 
         cfg = find_tlv_config(tlv->id);
         if (!cfg) {
-            indigo_logger(LOG_LEVEL_ERROR, "Unknown AP configuration name: TLV ID 0x%04x", tlv->id);
+            indigo_log(LOG_CATEGORY_HAPD, LOG_LEVEL_ERROR, "Unknown AP configuration name: TLV ID 0x%04x", tlv->id);
             continue;
         }
 
@@ -501,9 +589,7 @@ static int generate_hostapd_config(char *output, int output_size, struct packet_
         }
 
         if (tlv->id == TLV_HE_OPER_CHWIDTH) {
-            memset(value, 0, sizeof(value));
-            memcpy(value, tlv->value, tlv->len);
-            chwidth = atoi(value);
+            chwidth = get_wrapper_tlv_int(wrapper, tlv->id);
             chwidthset = 1;
 #ifdef _WTS_OPENWRT_
             continue;
@@ -511,9 +597,7 @@ static int generate_hostapd_config(char *output, int output_size, struct packet_
         }
 
         if (tlv->id == TLV_VHT_OPER_CHWIDTH) {
-            memset(value, 0, sizeof(value));
-            memcpy(value, tlv->value, tlv->len);
-            chwidth = atoi(value);
+            chwidth = get_wrapper_tlv_int(wrapper, tlv->id);
             vht_chwidthset = 1;
         }
 
@@ -560,9 +644,7 @@ static int generate_hostapd_config(char *output, int output_size, struct packet_
 #endif
 
         if (tlv->id == TLV_HE_UNSOL_PR_RESP_CADENCE) {
-            memset(value, 0, sizeof(value));
-            memcpy(value, tlv->value, tlv->len);
-            unsol_pr_resp_interval = atoi(value);
+            unsol_pr_resp_interval = get_wrapper_tlv_int(wrapper, tlv->id);
         }
 
         if (tlv->id == TLV_HS20 && strstr(tlv->value, "1")) {
@@ -573,17 +655,14 @@ static int generate_hostapd_config(char *output, int output_size, struct packet_
             struct bss_identifier_info bss_info;
             struct interface_info *wlan;
             int bss_identifier;
-            char bss_identifier_str[8];
             memset(&bss_info, 0, sizeof(bss_info));
-            memset(bss_identifier_str, 0, sizeof(bss_identifier_str));
-            memcpy(bss_identifier_str, tlv->value, tlv->len);
-            bss_identifier = atoi(bss_identifier_str);
+            bss_identifier = get_wrapper_tlv_int(wrapper, TLV_OWE_TRANSITION_BSS_IDENTIFIER);
             parse_bss_identifier(bss_identifier, &bss_info);
             wlan = get_wireless_interface_info(bss_info.band, bss_info.identifier);
             if (NULL == wlan) {
                 wlan = assign_wireless_interface_info(&bss_info);
             }
-            indigo_logger(LOG_LEVEL_DEBUG, "TLV_OWE_TRANSITION_BSS_IDENTIFIER: TLV_BSS_IDENTIFIER 0x%x identifier %d mapping ifname %s\n", 
+            indigo_log(LOG_CATEGORY_HAPD, LOG_LEVEL_DEBUG, "TLV_OWE_TRANSITION_BSS_IDENTIFIER: TLV_BSS_IDENTIFIER 0x%x identifier %d mapping ifname %s\n", 
                     bss_identifier,
                     bss_info.identifier,
                     wlan ? wlan->ifname : "n/a"
@@ -777,7 +856,7 @@ static int configure_ap_handler(struct packet_wrapper *req, struct packet_wrappe
     char *message = "DUT configured as AP : Configuration file created";
     int bss_identifier = 0, band;
     struct interface_info* wlan = NULL;
-    char bss_identifier_str[16], hw_mode_str[8];
+    char hw_mode_str[8];
     struct bss_identifier_info bss_info;
 
     memset(buffer, 0, sizeof(buffer));
@@ -786,9 +865,7 @@ static int configure_ap_handler(struct packet_wrapper *req, struct packet_wrappe
     memset(&bss_info, 0, sizeof(bss_info));
     if (tlv) {
         /* Multiple wlans configure must carry TLV_BSS_IDENTIFIER */
-        memset(bss_identifier_str, 0, sizeof(bss_identifier_str));
-        memcpy(bss_identifier_str, tlv->value, tlv->len);
-        bss_identifier = atoi(bss_identifier_str);
+        bss_identifier = get_wrapper_tlv_int(req, TLV_BSS_IDENTIFIER);
         parse_bss_identifier(bss_identifier, &bss_info);
         wlan = get_wireless_interface_info(bss_info.band, bss_info.identifier);
         if (NULL == wlan) {
@@ -800,7 +877,7 @@ static int configure_ap_handler(struct packet_wrapper *req, struct packet_wrappe
                 band_transmitter[bss_info.band] = wlan;
             }
         }
-        indigo_logger(LOG_LEVEL_DEBUG, "TLV_BSS_IDENTIFIER 0x%x band %d multiple_bssid %d transmitter %d identifier %d\n", 
+        indigo_log(LOG_CATEGORY_HAPD, LOG_LEVEL_DEBUG, "TLV_BSS_IDENTIFIER 0x%x band %d multiple_bssid %d transmitter %d identifier %d\n", 
                bss_identifier,
                bss_info.band,
                bss_info.mbssid_enable,
@@ -828,7 +905,7 @@ static int configure_ap_handler(struct packet_wrapper *req, struct packet_wrappe
         }
     }
     if (wlan) {
-        indigo_logger(LOG_LEVEL_DEBUG, "ifname %s hostapd conf file %s\n", 
+        indigo_log(LOG_CATEGORY_HAPD, LOG_LEVEL_DEBUG, "ifname %s hostapd conf file %s\n", 
                wlan ? wlan->ifname : "n/a",
                wlan ? wlan->hapd_conf_file: "n/a"
                );
@@ -838,13 +915,13 @@ static int configure_ap_handler(struct packet_wrapper *req, struct packet_wrappe
 #if HOSTAPD_SUPPORT_MBSSID
             if (bss_info.mbssid_enable && !bss_info.transmitter) {
                 if (band_transmitter[bss_info.band]) {
-                    indigo_logger(LOG_LEVEL_DEBUG, "Append bss conf to %s", band_transmitter[bss_info.band]->hapd_conf_file);
+                    indigo_log(LOG_CATEGORY_HAPD, LOG_LEVEL_DEBUG, "Append bss conf to %s", band_transmitter[bss_info.band]->hapd_conf_file);
                     append_file(band_transmitter[bss_info.band]->hapd_conf_file, buffer, len);
                 }
                 memset(wlan->hapd_conf_file, 0, sizeof(wlan->hapd_conf_file));
             }
             else if (band_first_wlan[bss_info.band]) {
-                indigo_logger(LOG_LEVEL_DEBUG, "Append bss conf to %s", band_first_wlan[bss_info.band]->hapd_conf_file);
+                indigo_log(LOG_CATEGORY_HAPD, LOG_LEVEL_DEBUG, "Append bss conf to %s", band_first_wlan[bss_info.band]->hapd_conf_file);
                 append_file(band_first_wlan[bss_info.band]->hapd_conf_file, buffer, len);
                 memset(wlan->hapd_conf_file, 0, sizeof(wlan->hapd_conf_file));
             } else
@@ -869,12 +946,47 @@ static int configure_ap_handler(struct packet_wrapper *req, struct packet_wrappe
 #ifdef HOSTAPD_SUPPORT_MBSSID_WAR
 extern int use_openwrt_wpad;
 #endif
+
+static int start_ap_done(struct packet_wrapper *req, struct packet_wrapper *resp, int status) {
+    char *message = status == TLV_VALUE_STATUS_OK ? TLV_VALUE_HOSTAPD_START_OK : TLV_VALUE_HOSTAPD_START_NOT_OK;
+
+#ifndef _WTS_OPENWRT_
+    iterate_all_wlan_interfaces(start_ap_set_wlan_params);
+#endif
+
+    bridge_init(get_wlans_bridge());
+
+    fill_wrapper_message_hdr(resp, API_CMD_RESPONSE, req->hdr.seq);
+    fill_wrapper_tlv_byte(resp, TLV_STATUS, status);
+    fill_wrapper_tlv_bytes(resp, TLV_MESSAGE, strlen(message), message);
+
+    return 0;
+}
+
+/* Whether hostapd came up: each BSS answered before the deadline, and hostapd didn't exit meanwhile */
+static int start_ap_started() {
+    return indigo_request_event_result() >= 0 && process_find(get_hapd_exec_file()) != 0;
+}
+
+static int start_ap_ready(struct packet_wrapper *req, struct packet_wrapper *resp) {
+    return start_ap_done(req, resp, start_ap_started() ? TLV_VALUE_STATUS_OK : TLV_VALUE_STATUS_NOT_OK);
+}
+
+/* Set when the request waits for hostapd on the control interface of a BSS, to continue with start_ap_resume */
+static int start_ap_deferred;
+static api_callback_func start_ap_resume;
+
+static void start_ap_wait_ready(void *if_info) {
+    if (indigo_request_defer_ready(get_hapd_ctrl_path_by_id((struct interface_info *) if_info), get_hapd_exec_file(),
+                                   start_ap_resume) == 0) {
+        start_ap_deferred = 1;
+    }
+}
+
 // RESP: {<ResponseTLV.STATUS: 40961>: '0', <ResponseTLV.MESSAGE: 40960>: 'AP is up : Hostapd service is active'} 
 static int start_ap_handler(struct packet_wrapper *req, struct packet_wrapper *resp) {
-    char *message = TLV_VALUE_HOSTAPD_START_OK;
     char buffer[S_BUFFER_LEN];
     int len;
-    int status = TLV_VALUE_STATUS_OK;
     int swap_hostapd = 0;
 
 #ifdef _WTS_OPENWRT_
@@ -884,29 +996,50 @@ static int start_ap_handler(struct packet_wrapper *req, struct packet_wrapper *r
 #endif
 
     memset(buffer, 0, sizeof(buffer));
-    sprintf(buffer, "%s -B -t -P /var/run/hostapd.pid -g %s %s -f /var/log/hostapd.log %s",
+    sprintf(buffer, "%s -t -P /var/run/hostapd.pid -g %s %s -f /var/log/hostapd.log %s",
         get_hapd_full_exec_path(),
         get_hapd_global_ctrl_path(),
         get_hostapd_debug_arguments(), 
         get_all_hapd_conf_files(&swap_hostapd));
-    len = system(buffer);
-    sleep(1);
+    len = process_start(buffer) < 0;
 
     /* Bring up VAPs with MBSSID disable using WFA hostapd */
     if (swap_hostapd) {
 #ifdef HOSTAPD_SUPPORT_MBSSID_WAR
-        indigo_logger(LOG_LEVEL_INFO, "Use WFA hostapd for MBSSID disable VAPs with RNR");
+        indigo_log(LOG_CATEGORY_HAPD, LOG_LEVEL_INFO, "Use WFA hostapd for MBSSID disable VAPs with RNR");
         system("cp /overlay/hostapd /usr/sbin/hostapd");
         use_openwrt_wpad = 0;
         memset(buffer, 0, sizeof(buffer));
-        sprintf(buffer, "%s -B -t -P /var/run/hostapd_1.pid %s -f /var/log/hostapd_1.log %s",
+        sprintf(buffer, "%s -t -P /var/run/hostapd_1.pid %s -f /var/log/hostapd_1.log %s",
                 get_hapd_full_exec_path(),
                 get_hostapd_debug_arguments(),
                 get_all_hapd_conf_files(&swap_hostapd));
-        len = system(buffer);
-        sleep(1);
+        len = process_start(buffer) < 0;
 #endif
     }
+    if (len) {
+        return start_ap_done(req, resp, TLV_VALUE_STATUS_NOT_OK);
+    }
+
+    /* Continue once hostapd answers on the control interface of each BSS. Other requests are served
+     * meanwhile. */
+    start_ap_deferred = 0;
+    start_ap_resume = start_ap_ready;
+    iterate_all_wlan_interfaces(start_ap_wait_ready);
+    if (start_ap_deferred) {
+        return 0;
+    }
+    return start_ap_ready(req, resp);
+}
+
+static int configure_ap_wsc_ready(struct packet_wrapper *req, struct packet_wrapper *resp) {
+    char *message = "Confiugre and start wsc ap successfully. (Configure and start)";
+    int status = TLV_VALUE_STATUS_OK;
+
+    if (!start_ap_started()) {
+        status = TLV_VALUE_STATUS_NOT_OK;
+        message = "Failed to start hostapd.";
+    }
 
 #ifndef _WTS_OPENWRT_
     iterate_all_wlan_interfaces(start_ap_set_wlan_params);
@@ -915,42 +1048,35 @@ static int start_ap_handler(struct packet_wrapper *req, struct packet_wrapper *r
     bridge_init(get_wlans_bridge());
 
     fill_wrapper_message_hdr(resp, API_CMD_RESPONSE, req->hdr.seq);
-    fill_wrapper_tlv_byte(resp, TLV_STATUS, len == 0 ? TLV_VALUE_STATUS_OK : TLV_VALUE_STATUS_NOT_OK);
+    fill_wrapper_tlv_byte(resp, TLV_STATUS, status);
     fill_wrapper_tlv_bytes(resp, TLV_MESSAGE, strlen(message), message);
 
     return 0;
 }
 
 // RESP: {<ResponseTLV.STATUS: 40961>: '0', <ResponseTLV.MESSAGE: 40960>: 'Configure and start wsc ap successfully. (Configure and start)'}
-static int configure_ap_wsc_handler(struct packet_wrapper *req, struct packet_wrapper *resp) {
+static int configure_ap_wsc_stopped(struct packet_wrapper *req, struct packet_wrapper *resp) {
     int len_1 = -1, len_2 = 0, len_3 = -1;
     char buffer[L_BUFFER_LEN], ifname[S_BUFFER_LEN];
     struct tlv_hdr *tlv;
     char *message = NULL;
     int bss_identifier = 0, band;
     struct interface_info* wlan = NULL;
-    char bss_identifier_str[16], hw_mode_str[8];
+    char hw_mode_str[8];
     struct bss_identifier_info bss_info;
-    char *parameter[] = {"pidof", get_hapd_exec_file(), NULL};
     int swap_hostapd = 0;
 
     /* Stop hostapd [Begin] */
-    memset(buffer, 0, sizeof(buffer));
-    sprintf(buffer, "killall %s 1>/dev/null 2>/dev/null", get_hapd_exec_file());
-    system(buffer);
-    sleep(2);
-
 #ifdef _OPENWRT_
 #else
     len_1 = system("rfkill unblock wlan");
     if (len_1) {
-        indigo_logger(LOG_LEVEL_DEBUG, "Failed to run rfkill unblock wlan");
+        indigo_log(LOG_CATEGORY_HAPD, LOG_LEVEL_DEBUG, "Failed to run rfkill unblock wlan");
     }
     sleep(1);
 #endif
 
-    memset(buffer, 0, sizeof(buffer));
-    len_1 = pipe_command(buffer, sizeof(buffer), "/bin/pidof", parameter);
+    len_1 = process_find(get_hapd_exec_file());
     if (len_1) {
         message = TLV_VALUE_HOSTAPD_STOP_NOT_OK;
         goto done;
@@ -964,9 +1090,7 @@ static int configure_ap_wsc_handler(struct packet_wrapper *req, struct packet_wr
     memset(&bss_info, 0, sizeof(bss_info));
     if (tlv) {
         /* Multiple wlans configure must carry TLV_BSS_IDENTIFIER */
-        memset(bss_identifier_str, 0, sizeof(bss_identifier_str));
-        memcpy(bss_identifier_str, tlv->value, tlv->len);
-        bss_identifier = atoi(bss_identifier_str);
+        bss_identifier = get_wrapper_tlv_int(req, TLV_BSS_IDENTIFIER);
         parse_bss_identifier(bss_identifier, &bss_info);
         wlan = get_wireless_interface_info(bss_info.band, bss_info.identifier);
         if (NULL == wlan) {
@@ -1049,41 +1173,41 @@ static int configure_ap_wsc_handler(struct packet_wrapper *req, struct packet_wr
 #endif
 
     memset(buffer, 0, sizeof(buffer));
-    sprintf(buffer, "%s -B -t -P /var/run/hostapd.pid -g %s %s -f /var/log/hostapd.log %s",
+    sprintf(buffer, "%s -t -P /var/run/hostapd.pid -g %s %s -f /var/log/hostapd.log %s",
         get_hapd_full_exec_path(),
         get_hapd_global_ctrl_path(),
         get_hostapd_debug_arguments(),
         get_all_hapd_conf_files(&swap_hostapd));
-    len_3 = system(buffer);
-    sleep(1);
+    len_3 = process_start(buffer) < 0;
 
     /* Bring up VAPs with MBSSID disable using WFA hostapd */
     if (swap_hostapd) {
 #ifdef HOSTAPD_SUPPORT_MBSSID_WAR
-        indigo_logger(LOG_LEVEL_INFO, "Use WFA hostapd for MBSSID disable VAPs with RNR");
+        indigo_log(LOG_CATEGORY_HAPD, LOG_LEVEL_INFO, "Use WFA hostapd for MBSSID disable VAPs with RNR");
         system("cp /overlay/hostapd /usr/sbin/hostapd");
         use_openwrt_wpad = 0;
         memset(buffer, 0, sizeof(buffer));
-        sprintf(buffer, "%s -B -t -P /var/run/hostapd_1.pid %s -f /var/log/hostapd_1.log %s",
+        sprintf(buffer, "%s -t -P /var/run/hostapd_1.pid %s -f /var/log/hostapd_1.log %s",
                 get_hapd_full_exec_path(),
                 get_hostapd_debug_arguments(),
                 get_all_hapd_conf_files(&swap_hostapd));
-        len_3 = system(buffer);
-        sleep(1);
+        len_3 = process_start(buffer) < 0;
 #endif
     }
-
-#ifndef _WTS_OPENWRT_
-    iterate_all_wlan_interfaces(start_ap_set_wlan_params);
-#endif
-
-    bridge_init(get_wlans_bridge());
-    if (len_3 == 0)
-        message = "Confiugre and start wsc ap successfully. (Configure and start)";
-    else
-        message = "Failed to start hostapd.";
     /* Start hostapd [End] */
 
+    /* Respond once hostapd answers on the control interface of each BSS, or has failed to. Other requests
+     * are served meanwhile. */
+    if (len_3 == 0) {
+        start_ap_deferred = 0;
+        start_ap_resume = configure_ap_wsc_ready;
+        iterate_all_wlan_interfaces(start_ap_wait_ready);
+        if (start_ap_deferred) {
+            return 0;
+        }
+    }
+    return configure_ap_wsc_ready(req, resp);
+
 done:
     fill_wrapper_message_hdr(resp, API_CMD_RESPONSE, req->hdr.seq);
     fill_wrapper_tlv_byte(resp, TLV_STATUS, (len_1 == 0 || len_2 > 0 || len_3 == 0) ? TLV_VALUE_STATUS_OK : TLV_VALUE_STATUS_NOT_OK);
@@ -1092,6 +1216,12 @@ done:
     return 0;
 }
 
+static int configure_ap_wsc_handler(struct packet_wrapper *req, struct packet_wrapper *resp) {
+    /* Continue once hostapd has exited. Other requests are served meanwhile. */
+    process_stop_async(get_hapd_exec_file(), indigo_request_event, indigo_request_defer_event(configure_ap_wsc_stopped));
+    return 0;
+}
+
 /* deprecated */
 static int create_bridge_network_handler(struct packet_wrapper *req, struct packet_wrapper *resp) {
     int err = 0;
@@ -1185,14 +1315,13 @@ static int get_mac_addr_handler(struct packet_wrapper *req, struct packet_wrappe
 
     char band[S_BUFFER_LEN];
     char ssid[S_BUFFER_LEN];
-    char role[S_BUFFER_LEN];
+    int role = 0;
 
     char connected_freq[S_BUFFER_LEN];
     char connected_ssid[S_BUFFER_LEN];
     char mac_addr[S_BUFFER_LEN];
     int bss_identifier = 0;
     struct interface_info* wlan = NULL;
-    char bss_identifier_str[16];
     struct bss_identifier_info bss_info;
     char buff[S_BUFFER_LEN];
 
@@ -1204,11 +1333,7 @@ static int get_mac_addr_handler(struct packet_wrapper *req, struct packet_wrappe
         goto done;
     } else {
         /* TLV: TLV_ROLE */
-        memset(role, 0, sizeof(role));
-        tlv = find_wrapper_tlv_by_id(req, TLV_ROLE);
-        if (tlv) {
-            memcpy(role, tlv->value, tlv->len);
-        }
+        role = get_wrapper_tlv_int(req, TLV_ROLE);
 
         /* TLV: TLV_BAND */
         memset(band, 0, sizeof(band));
@@ -1227,12 +1352,10 @@ static int get_mac_addr_handler(struct packet_wrapper *req, struct packet_wrappe
         memset(&bss_info, 0, sizeof(bss_info));
         tlv = find_wrapper_tlv_by_id(req, TLV_BSS_IDENTIFIER);
         if (tlv) {
-            memset(bss_identifier_str, 0, sizeof(bss_identifier_str));
-            memcpy(bss_identifier_str, tlv->value, tlv->len);
-            bss_identifier = atoi(bss_identifier_str);
+            bss_identifier = get_wrapper_tlv_int(req, TLV_BSS_IDENTIFIER);
             parse_bss_identifier(bss_identifier, &bss_info);
 
-            indigo_logger(LOG_LEVEL_DEBUG, "TLV_BSS_IDENTIFIER 0x%x identifier %d band %d\n", 
+            indigo_log(LOG_CATEGORY_NETIF, LOG_LEVEL_DEBUG, "TLV_BSS_IDENTIFIER 0x%x identifier %d band %d\n", 
                     bss_identifier,
                     bss_info.identifier,
                     bss_info.band
@@ -1242,12 +1365,12 @@ static int get_mac_addr_handler(struct packet_wrapper *req, struct packet_wrappe
         }
     }
 
-    if (atoi(role) == DUT_TYPE_STAUT) {
+    if (role == DUT_TYPE_STAUT) {
         w = wpa_ctrl_open(get_wpas_ctrl_path());
-    } else if (atoi(role) == DUT_TYPE_P2PUT) {
+    } else if (role == DUT_TYPE_P2PUT) {
         /* Get P2P GO/Client or Device MAC */
         if (get_p2p_mac_addr(mac_addr, sizeof(mac_addr))) {
-            indigo_logger(LOG_LEVEL_INFO, "Can't find P2P Device MAC. Use wireless IF MAC");
+            indigo_log(LOG_CATEGORY_NETIF, LOG_LEVEL_INFO, "Can't find P2P Device MAC. Use wireless IF MAC");
             get_mac_address(mac_addr, sizeof(mac_addr), get_wireless_interface());
         }
         status = TLV_VALUE_STATUS_OK;
@@ -1259,7 +1382,7 @@ static int get_mac_addr_handler(struct packet_wrapper *req, struct packet_wrappe
     }
 
     if (!w) {
-        indigo_logger(LOG_LEVEL_ERROR, "Failed to connect to %s", atoi(role) == DUT_TYPE_STAUT ? "wpa_supplicant" : "hostapd");
+        indigo_log(LOG_CATEGORY_NETIF, LOG_LEVEL_ERROR, "Failed to connect to %s", role == DUT_TYPE_STAUT ? "wpa_supplicant" : "hostapd");
         status = TLV_VALUE_STATUS_NOT_OK;
         message = TLV_VALUE_NOT_OK;
         goto done;
@@ -1277,7 +1400,7 @@ static int get_mac_addr_handler(struct packet_wrapper *req, struct packet_wrappe
     get_key_value(connected_freq, response, "freq");
 
     memset(mac_addr, 0, sizeof(mac_addr));
-    if (atoi(role) == DUT_TYPE_STAUT) {
+    if (role == DUT_TYPE_STAUT) {
         get_key_value(connected_ssid, response, "ssid");
         get_key_value(mac_addr, response, "address");
     } else {
@@ -1298,7 +1421,7 @@ static int get_mac_addr_handler(struct packet_wrapper *req, struct packet_wrappe
     }
 
     if (bss_info.identifier >= 0) {
-        indigo_logger(LOG_LEVEL_DEBUG, "Get mac_addr %s\n", mac_addr);
+        indigo_log(LOG_CATEGORY_NETIF, LOG_LEVEL_DEBUG, "Get mac_addr %s\n", mac_addr);
         status = TLV_VALUE_STATUS_OK;
         message = TLV_VALUE_OK;
         goto done;
@@ -1364,17 +1487,17 @@ static int start_loopback_server(struct packet_wrapper *req, struct packet_wrapp
     /* Find network interface. If P2P Group or bridge exists, then use it. Otherwise, it uses the initiation value. */
     memset(local_ip, 0, sizeof(local_ip));
     if (get_p2p_group_if(if_name, sizeof(if_name)) == 0 && find_interface_ip(local_ip, sizeof(local_ip), if_name)) {
-        indigo_logger(LOG_LEVEL_DEBUG, "use %s", if_name);
+        indigo_log(LOG_CATEGORY_LOOPBACK, LOG_LEVEL_DEBUG, "use %s", if_name);
     } else if (find_interface_ip(local_ip, sizeof(local_ip), get_wlans_bridge())) {
-        indigo_logger(LOG_LEVEL_DEBUG, "use %s", get_wlans_bridge());
+        indigo_log(LOG_CATEGORY_LOOPBACK, LOG_LEVEL_DEBUG, "use %s", get_wlans_bridge());
     } else if (find_interface_ip(local_ip, sizeof(local_ip), get_wireless_interface())) {
-        indigo_logger(LOG_LEVEL_DEBUG, "use %s", get_wireless_interface());
+        indigo_log(LOG_CATEGORY_LOOPBACK, LOG_LEVEL_DEBUG, "use %s", get_wireless_interface());
 // #ifdef __TEST__        
     } else if (find_interface_ip(local_ip, sizeof(local_ip), "eth0")) {
-        indigo_logger(LOG_LEVEL_DEBUG, "use %s", "eth0");
+        indigo_log(LOG_CATEGORY_LOOPBACK, LOG_LEVEL_DEBUG, "use %s", "eth0");
 // #endif /* __TEST__ */
     } else {
-        indigo_logger(LOG_LEVEL_ERROR, "No available interface");
+        indigo_log(LOG_CATEGORY_LOOPBACK, LOG_LEVEL_ERROR, "No available interface");
         goto done;
     }
     /* Start loopback */
@@ -1409,17 +1532,15 @@ static int send_ap_disconnect_handler(struct packet_wrapper *req, struct packet_
     char buffer[S_BUFFER_LEN];
     char response[S_BUFFER_LEN];
     char address[32];
-    char *parameter[] = {"pidof", get_hapd_exec_file(), NULL};
     char *message = NULL;
     struct tlv_hdr *tlv = NULL;
     struct wpa_ctrl *w = NULL;
     size_t resp_len;
 
     /* Check hostapd status. TODO: it may use UDS directly */
-    memset(buffer, 0, sizeof(buffer));
-    len = pipe_command(buffer, sizeof(buffer), "/bin/pidof", parameter);
+    len = process_find(get_hapd_exec_file());
     if (len == 0) {
-        indigo_logger(LOG_LEVEL_ERROR, "Failed to find hostapd PID");
+        indigo_log(LOG_CATEGORY_HAPD, LOG_LEVEL_ERROR, "Failed to find hostapd PID");
         status = TLV_VALUE_STATUS_NOT_OK;
         message = TLV_VALUE_HOSTAPD_NOT_OK;
         goto done;
@@ -1427,7 +1548,7 @@ static int send_ap_disconnect_handler(struct packet_wrapper *req, struct packet_
     /* Open hostapd UDS socket */
     w = wpa_ctrl_open(get_hapd_ctrl_path());
     if (!w) {
-        indigo_logger(LOG_LEVEL_ERROR, "Failed to connect to hostapd");
+        indigo_log(LOG_CATEGORY_HAPD, LOG_LEVEL_ERROR, "Failed to connect to hostapd");
         status = TLV_VALUE_STATUS_NOT_OK;
         message = TLV_VALUE_HOSTAPD_CTRL_NOT_OK;
         goto done;
@@ -1439,7 +1560,7 @@ static int send_ap_disconnect_handler(struct packet_wrapper *req, struct packet_
     if (tlv) {
         memcpy(address, tlv->value, tlv->len);
     } else {
-        indigo_logger(LOG_LEVEL_ERROR, "Missed TLV:Address");
+        indigo_log(LOG_CATEGORY_HAPD, LOG_LEVEL_ERROR, "Missed TLV:Address");
         status = TLV_VALUE_STATUS_NOT_OK;
         message = TLV_VALUE_INSUFFICIENT_TLV;
         goto done;
@@ -1452,7 +1573,7 @@ static int send_ap_disconnect_handler(struct packet_wrapper *req, struct packet_
     wpa_ctrl_request(w, buffer, strlen(buffer), response, &resp_len, NULL);
     /* Check response */
     if (strncmp(response, WPA_CTRL_OK, strlen(WPA_CTRL_OK)) != 0) {
-        indigo_logger(LOG_LEVEL_ERROR, "Failed to execute the command. Response: %s", response);
+        indigo_log(LOG_CATEGORY_HAPD, LOG_LEVEL_ERROR, "Failed to execute the command. Response: %s", response);
         message = TLV_VALUE_HOSTAPD_RESP_NOT_OK;
         goto done;
     }
@@ -1482,7 +1603,7 @@ static int set_ap_parameter_handler(struct packet_wrapper *req, struct packet_wr
     /* Open hostapd UDS socket */
     w = wpa_ctrl_open(get_hapd_ctrl_path());
     if (!w) {
-        indigo_logger(LOG_LEVEL_ERROR, "Failed to connect to hostapd");
+        indigo_log(LOG_CATEGORY_HAPD, LOG_LEVEL_ERROR, "Failed to connect to hostapd");
         status = TLV_VALUE_STATUS_NOT_OK;
         message = TLV_VALUE_HOSTAPD_CTRL_NOT_OK;
         goto done;
@@ -1501,7 +1622,7 @@ static int set_ap_parameter_handler(struct packet_wrapper *req, struct packet_wr
     } else {
         status = TLV_VALUE_STATUS_NOT_OK;
         message = TLV_VALUE_INSUFFICIENT_TLV;
-        indigo_logger(LOG_LEVEL_ERROR, "Missed TLV: TLV_MBO_ASSOC_DISALLOW or TLV_GAS_COMEBACK_DELAY");
+        indigo_log(LOG_CATEGORY_HAPD, LOG_LEVEL_ERROR, "Missed TLV: TLV_MBO_ASSOC_DISALLOW or TLV_GAS_COMEBACK_DELAY");
         goto done;
     }
     /* Assemble hostapd command */
@@ -1512,7 +1633,7 @@ static int set_ap_parameter_handler(struct packet_wrapper *req, struct packet_wr
     wpa_ctrl_request(w, buffer, strlen(buffer), response, &resp_len, NULL);
     /* Check response */
     if (strncmp(response, WPA_CTRL_OK, strlen(WPA_CTRL_OK)) != 0) {
-        indigo_logger(LOG_LEVEL_ERROR, "Failed to execute the command. Response: %s", response);
+        indigo_log(LOG_CATEGORY_HAPD, LOG_LEVEL_ERROR, "Failed to execute the command. Response: %s", response);
         message = TLV_VALUE_HOSTAPD_RESP_NOT_OK;
         goto done;
     }
@@ -1538,7 +1659,8 @@ static int send_ap_btm_handler(struct packet_wrapper *req, struct packet_wrapper
     char response[4096];
     char buffer[1024];
 
-    char bssid[256];
+    char bssid[32];
+    unsigned char mac[6];
     char disassoc_imminent[256];
     char disassoc_timer[256];
     char candidate_list[256];
@@ -1558,9 +1680,8 @@ static int send_ap_btm_handler(struct packet_wrapper *req, struct packet_wrapper
 
     /* ControlApp on DUT */
     /* TLV: BSSID (required) */
-    tlv = find_wrapper_tlv_by_id(req, TLV_BSSID);
-    if (tlv) {
-        memcpy(bssid, tlv->value, tlv->len);
+    if (get_wrapper_tlv_mac(req, TLV_BSSID, mac) == 0) {
+        snprintf(bssid, sizeof(bssid), MACSTR, MAC2STR(mac));
     }
     /* DISASSOC_IMMINENT            disassoc_imminent=%s */
     tlv = find_wrapper_tlv_by_id(req, TLV_DISASSOC_IMMINENT);
@@ -1631,12 +1752,12 @@ static int send_ap_btm_handler(struct packet_wrapper *req, struct packet_wrapper
         sprintf(buffer, " pref=1");
         strcat(request, buffer);
     }
-    indigo_logger(LOG_LEVEL_DEBUG, "cmd:%s", request);
+    indigo_log(LOG_CATEGORY_HAPD, LOG_LEVEL_DEBUG, "cmd:%s", request);
 
     /* Open hostapd UDS socket */
     w = wpa_ctrl_open(get_hapd_ctrl_path());
     if (!w) {
-        indigo_logger(LOG_LEVEL_ERROR, "Failed to connect to hostapd");
+        indigo_log(LOG_CATEGORY_HAPD, LOG_LEVEL_ERROR, "Failed to connect to hostapd");
         status = TLV_VALUE_STATUS_NOT_OK;
         message = TLV_VALUE_HOSTAPD_CTRL_NOT_OK;
         goto done;
@@ -1645,7 +1766,7 @@ static int send_ap_btm_handler(struct packet_wrapper *req, struct packet_wrapper
     wpa_ctrl_request(w, request, strlen(request), response, &resp_len, NULL);
     /* Check response */
     if (strncmp(response, WPA_CTRL_OK, strlen(WPA_CTRL_OK)) != 0) {
-        indigo_logger(LOG_LEVEL_ERROR, "Failed to execute the command. Response: %s", response);
+        indigo_log(LOG_CATEGORY_HAPD, LOG_LEVEL_ERROR, "Failed to execute the command. Response: %s", response);
         message = TLV_VALUE_HOSTAPD_RESP_NOT_OK;
         goto done;
     }
@@ -1665,54 +1786,44 @@ static int trigger_ap_channel_switch(struct packet_wrapper *req, struct packet_w
     int status = TLV_VALUE_STATUS_NOT_OK;
     size_t resp_len;
     char *message = NULL;
-    struct tlv_hdr *tlv = NULL;
     struct wpa_ctrl *w = NULL;
     char request[S_BUFFER_LEN];
     char response[S_BUFFER_LEN];
 
-    char channel[64];
-    char frequency[64];
-    int freq, center_freq, offset;
-
-    memset(channel, 0, sizeof(channel));
-    memset(frequency, 0, sizeof(frequency));
+    int channel, freq, center_freq, offset;
 
     /* ControlApp on DUT */
     /* TLV: TLV_CHANNEL (required) */
-    tlv = find_wrapper_tlv_by_id(req, TLV_CHANNEL);
-    if (tlv) {
-        memcpy(channel, tlv->value, tlv->len);
-    } else {
+    if (find_wrapper_tlv_by_id(req, TLV_CHANNEL) == NULL) {
         status = TLV_VALUE_STATUS_NOT_OK;
         message = TLV_VALUE_INSUFFICIENT_TLV;
-        indigo_logger(LOG_LEVEL_ERROR, "Missed TLV: TLV_CHANNEL");
+        indigo_log(LOG_CATEGORY_HAPD, LOG_LEVEL_ERROR, "Missed TLV: TLV_CHANNEL");
         goto done;
     }
+    channel = get_wrapper_tlv_int(req, TLV_CHANNEL);
     /* TLV_FREQUENCY (required) */
-    tlv = find_wrapper_tlv_by_id(req, TLV_FREQUENCY);
-    if (tlv) {
-        memcpy(frequency, tlv->value, tlv->len);
-    } else {
+    if (find_wrapper_tlv_by_id(req, TLV_FREQUENCY) == NULL) {
         status = TLV_VALUE_STATUS_NOT_OK;
         message = TLV_VALUE_INSUFFICIENT_TLV;
-        indigo_logger(LOG_LEVEL_ERROR, "Missed TLV: TLV_FREQUENCY");
+        indigo_log(LOG_CATEGORY_HAPD, LOG_LEVEL_ERROR, "Missed TLV: TLV_FREQUENCY");
+        goto done;
     }
+    freq = get_wrapper_tlv_int(req, TLV_FREQUENCY);
 
-    center_freq = 5000 + get_center_freq_index(atoi(channel), 1) * 5;
-    freq = atoi(frequency);
+    center_freq = 5000 + get_center_freq_index(channel, 1) * 5;
     if ((center_freq == freq + 30) || (center_freq == freq - 10))
         offset = 1;
     else
         offset = -1;
     /* Assemble hostapd command for channel switch */
     memset(request, 0, sizeof(request));
-    sprintf(request, "CHAN_SWITCH 10 %s center_freq1=%d sec_channel_offset=%d bandwidth=80 vht", frequency, center_freq, offset);
-    indigo_logger(LOG_LEVEL_INFO, "%s", request);
+    sprintf(request, "CHAN_SWITCH 10 %d center_freq1=%d sec_channel_offset=%d bandwidth=80 vht", freq, center_freq, offset);
+    indigo_log(LOG_CATEGORY_HAPD, LOG_LEVEL_INFO, "%s", request);
 
     /* Open hostapd UDS socket */
     w = wpa_ctrl_open(get_hapd_ctrl_path());
     if (!w) {
-        indigo_logger(LOG_LEVEL_ERROR, "Failed to connect to hostapd");
+        indigo_log(LOG_CATEGORY_HAPD, LOG_LEVEL_ERROR, "Failed to connect to hostapd");
         status = TLV_VALUE_STATUS_NOT_OK;
         message = TLV_VALUE_HOSTAPD_CTRL_NOT_OK;
         goto done;
@@ -1721,7 +1832,7 @@ static int trigger_ap_channel_switch(struct packet_wrapper *req, struct packet_w
     wpa_ctrl_request(w, request, strlen(request), response, &resp_len, NULL);
     /* Check response */
     if (strncmp(response, WPA_CTRL_OK, strlen(WPA_CTRL_OK)) != 0) {
-        indigo_logger(LOG_LEVEL_ERROR, "Failed to execute the command. Response: %s", response);
+        indigo_log(LOG_CATEGORY_HAPD, LOG_LEVEL_ERROR, "Failed to execute the command. Response: %s", response);
         message = TLV_VALUE_HOSTAPD_RESP_NOT_OK;
         goto done;
     }
@@ -1741,16 +1852,11 @@ static int get_ip_addr_handler(struct packet_wrapper *req, struct packet_wrapper
     int status = TLV_VALUE_STATUS_NOT_OK;
     char *message = NULL;
     char buffer[64];
-    struct tlv_hdr *tlv = NULL;
-    char value[16], if_name[32];
+    char if_name[32];
     int role = 0;
 
-    memset(value, 0, sizeof(value));
-    tlv = find_wrapper_tlv_by_id(req, TLV_ROLE);
-    if (tlv) {
-            memcpy(value, tlv->value, tlv->len);
-            role = atoi(value);
-    }
+    /* TLV: TLV_ROLE */
+    role = get_wrapper_tlv_int(req, TLV_ROLE);
 
     if (role == DUT_TYPE_P2PUT && get_p2p_group_if(if_name, sizeof(if_name)) == 0 && find_interface_ip(buffer, sizeof(buffer), if_name)) {
         status = TLV_VALUE_STATUS_OK;
@@ -1776,48 +1882,25 @@ done:
     return 0;
 }
 
-static int stop_sta_handler(struct packet_wrapper *req, struct packet_wrapper *resp) {
+static int stop_sta_stopped(struct packet_wrapper *req, struct packet_wrapper *resp) {
     int len = 0, reset = 0;
-    char buffer[S_BUFFER_LEN], reset_type[16];
-    char *parameter[] = {"pidof", get_wpas_exec_file(), NULL};
     char *message = NULL;
-    struct tlv_hdr *tlv = NULL;
 
     /* TLV: RESET_TYPE */
-    tlv = find_wrapper_tlv_by_id(req, TLV_RESET_TYPE);
-    memset(reset_type, 0, sizeof(reset_type));
-    if (tlv) {
-        memcpy(reset_type, tlv->value, tlv->len);
-        reset = atoi(reset_type);
-        indigo_logger(LOG_LEVEL_DEBUG, "Reset Type: %d", reset);
+    if (find_wrapper_tlv_by_id(req, TLV_RESET_TYPE)) {
+        reset = get_wrapper_tlv_int(req, TLV_RESET_TYPE);
     }
 
-    if (reset == RESET_TYPE_INIT) {
-        open_tc_app_log();
-        /* clean the log */
-        system("rm -rf /var/log/supplicant.log >/dev/null 2>/dev/null");
-
-        /* remove pac file if needed */
-        if (strlen(pac_file_path)) {
-            remove_pac_file(pac_file_path);
-            memset(pac_file_path, 0, sizeof(pac_file_path));
-        }
-    }
-
-    memset(buffer, 0, sizeof(buffer));
-    sprintf(buffer, "killall %s 1>/dev/null 2>/dev/null", get_wpas_exec_file());
-    system(buffer);
-    sleep(2);
     sta_configured = 0;
     sta_started = 0;
 
     len = reset_interface_ip(get_wireless_interface());
     if (len) {
-        indigo_logger(LOG_LEVEL_DEBUG, "Failed to free IP address");
+        indigo_log(LOG_CATEGORY_WPAS, LOG_LEVEL_DEBUG, "Failed to free IP address");
     }
     sleep(1);
 
-    len = pipe_command(buffer, sizeof(buffer), "/bin/pidof", parameter);
+    len = process_find(get_wpas_exec_file());
     if (len) {
         message = TLV_VALUE_WPA_S_STOP_NOT_OK;
     } else {
@@ -1836,6 +1919,32 @@ static int stop_sta_handler(struct packet_wrapper *req, struct packet_wrapper *r
     return 0;
 }
 
+static int stop_sta_handler(struct packet_wrapper *req, struct packet_wrapper *resp) {
+    int reset = 0;
+
+    /* TLV: RESET_TYPE */
+    if (find_wrapper_tlv_by_id(req, TLV_RESET_TYPE)) {
+        reset = get_wrapper_tlv_int(req, TLV_RESET_TYPE);
+        indigo_log(LOG_CATEGORY_WPAS, LOG_LEVEL_DEBUG, "Reset Type: %d", reset);
+    }
+
+    if (reset == RESET_TYPE_INIT) {
+        open_tc_app_log();
+        /* clean the log */
+        system("rm -rf /var/log/supplicant.log >/dev/null 2>/dev/null");
+
+        /* remove pac file if needed */
+        if (strlen(pac_file_path)) {
+            remove_pac_file(pac_file_path);
+            memset(pac_file_path, 0, sizeof(pac_file_path));
+        }
+    }
+
+    /* The response is sent once the daemon has exited. Other requests are served meanwhile. */
+    process_stop_async(get_wpas_exec_file(), indigo_request_event, indigo_request_defer_event(stop_sta_stopped));
+    return 0;
+}
+
 #ifdef _RESERVED_
 /* The function is reserved for the defeault wpas config */
 #define WPAS_DEFAULT_CONFIG_SSID                    "QuickTrack"
@@ -1984,39 +2093,51 @@ static int configure_sta_handler(struct packet_wrapper *req, struct packet_wrapp
     return 0;
 }
 
-static int associate_sta_handler(struct packet_wrapper *req, struct packet_wrapper *resp) {
-    char *message = TLV_VALUE_WPA_S_START_UP_NOT_OK;
-    char buffer[256];
-    int len, status = TLV_VALUE_STATUS_NOT_OK;
+/* Response of the handlers that start wpa_supplicant, once it answers on its control interface or the wait
+ * has timed out */
+static int wpas_start_up_ready(struct packet_wrapper *req, struct packet_wrapper *resp) {
+    char *message = TLV_VALUE_WPA_S_START_UP_OK;
+    int status = TLV_VALUE_STATUS_OK;
 
-#ifdef _OPENWRT_
-#else
-    system("rfkill unblock wlan");
-    sleep(1);
-#endif
+    if (indigo_request_event_result() < 0) {
+        status = TLV_VALUE_STATUS_NOT_OK;
+        message = TLV_VALUE_WPA_S_START_UP_NOT_OK;
+    }
 
-    memset(buffer, 0, sizeof(buffer));
-    sprintf(buffer, "killall %s 1>/dev/null 2>/dev/null", get_wpas_exec_file());
-    system(buffer);
-    sleep(3);
+    fill_wrapper_message_hdr(resp, API_CMD_RESPONSE, req->hdr.seq);
+    fill_wrapper_tlv_byte(resp, TLV_STATUS, status);
+    fill_wrapper_tlv_bytes(resp, TLV_MESSAGE, strlen(message), message);
+    return 0;
+}
+
+static int associate_sta_start_wpas(struct packet_wrapper *req, struct packet_wrapper *resp) {
+    char buffer[256];
 
     /* Start WPA supplicant */
     memset(buffer, 0 ,sizeof(buffer));
-    sprintf(buffer, "%s -B -t -c %s %s -i %s -f /var/log/supplicant.log", 
+    sprintf(buffer, "%s -t -c %s %s -i %s -f /var/log/supplicant.log", 
         get_wpas_full_exec_path(),
         get_wpas_conf_file(),
         get_wpas_debug_arguments(),
         get_wireless_interface());
-    len = system(buffer);
-    sleep(2);
+    process_start(buffer);
 
-    status = TLV_VALUE_STATUS_OK;
-    message = TLV_VALUE_WPA_S_START_UP_OK;
+    /* Respond once wpa_supplicant answers on its control interface. Other requests are served meanwhile. */
+    if (indigo_request_defer_ready(get_wpas_ctrl_path(), get_wpas_exec_file(), wpas_start_up_ready) == 0) {
+        return 0;
+    }
+    return wpas_start_up_ready(req, resp);
+}
 
-done:
-    fill_wrapper_message_hdr(resp, API_CMD_RESPONSE, req->hdr.seq);
-    fill_wrapper_tlv_byte(resp, TLV_STATUS, status);
-    fill_wrapper_tlv_bytes(resp, TLV_MESSAGE, strlen(message), message);
+static int associate_sta_handler(struct packet_wrapper *req, struct packet_wrapper *resp) {
+
+#ifdef _OPENWRT_
+#else
+    system("rfkill unblock wlan");
+#endif
+
+    /* Start wpa_supplicant again once it has exited. Other requests are served meanwhile. */
+    process_stop_async(get_wpas_exec_file(), indigo_request_event, indigo_request_defer_event(associate_sta_start_wpas));
     return 0;
 }
 
@@ -2030,7 +2151,7 @@ static int send_sta_disconnect_handler(struct packet_wrapper *req, struct packet
     /* Open WPA supplicant UDS socket */
     w = wpa_ctrl_open(get_wpas_ctrl_path());
     if (!w) {
-        indigo_logger(LOG_LEVEL_ERROR, "Failed to connect to wpa_supplicant");
+        indigo_log(LOG_CATEGORY_WPAS, LOG_LEVEL_ERROR, "Failed to connect to wpa_supplicant");
         status = TLV_VALUE_STATUS_NOT_OK;
         message = TLV_VALUE_WPA_S_DISCONNECT_NOT_OK;
         goto done;
@@ -2042,7 +2163,7 @@ static int send_sta_disconnect_handler(struct packet_wrapper *req, struct packet
     resp_len = sizeof(response) - 1;
     wpa_ctrl_request(w, buffer, strlen(buffer), response, &resp_len, NULL);
     if (strncmp(response, WPA_CTRL_OK, strlen(WPA_CTRL_OK)) != 0) {
-        indigo_logger(LOG_LEVEL_ERROR, "Failed to execute the command. Response: %s", response);
+        indigo_log(LOG_CATEGORY_WPAS, LOG_LEVEL_ERROR, "Failed to execute the command. Response: %s", response);
         goto done;
     }
     status = TLV_VALUE_STATUS_OK;
@@ -2068,7 +2189,7 @@ static int send_sta_reconnect_handler(struct packet_wrapper *req, struct packet_
     /* Open WPA supplicant UDS socket */
     w = wpa_ctrl_open(get_wpas_ctrl_path());
     if (!w) {
-        indigo_logger(LOG_LEVEL_ERROR, "Failed to connect to wpa_supplicant");
+        indigo_log(LOG_CATEGORY_WPAS, LOG_LEVEL_ERROR, "Failed to connect to wpa_supplicant");
         status = TLV_VALUE_STATUS_NOT_OK;
         message = TLV_VALUE_WPA_S_RECONNECT_NOT_OK;
         goto done;
@@ -2080,7 +2201,7 @@ static int send_sta_reconnect_handler(struct packet_wrapper *req, struct packet_
     resp_len = sizeof(response) - 1;
     wpa_ctrl_request(w, buffer, strlen(buffer), response, &resp_len, NULL);
     if (strncmp(response, WPA_CTRL_OK, strlen(WPA_CTRL_OK)) != 0) {
-        indigo_logger(LOG_LEVEL_ERROR, "Failed to execute the command. Response: %s", response);
+        indigo_log(LOG_CATEGORY_WPAS, LOG_LEVEL_ERROR, "Failed to execute the command. Response: %s", response);
         goto done;
     }
     status = TLV_VALUE_STATUS_OK;
@@ -2110,7 +2231,7 @@ static int set_sta_parameter_handler(struct packet_wrapper *req, struct packet_w
     /* Open wpa_supplicant UDS socket */
     w = wpa_ctrl_open(get_wpas_ctrl_path());
     if (!w) {
-        indigo_logger(LOG_LEVEL_ERROR, "Failed to connect to wpa_supplicant");
+        indigo_log(LOG_CATEGORY_WPAS, LOG_LEVEL_ERROR, "Failed to connect to wpa_supplicant");
         status = TLV_VALUE_STATUS_NOT_OK;
         message = TLV_VALUE_WPA_S_CTRL_NOT_OK;
         goto done;
@@ -2131,7 +2252,7 @@ static int set_sta_parameter_handler(struct packet_wrapper *req, struct packet_w
         wpa_ctrl_request(w, buffer, strlen(buffer), response, &resp_len, NULL);
         /* Check response */
         if (strncmp(response, WPA_CTRL_OK, strlen(WPA_CTRL_OK)) != 0) {
-            indigo_logger(LOG_LEVEL_ERROR, "Failed to execute the command. Response: %s", response);
+            indigo_log(LOG_CATEGORY_WPAS, LOG_LEVEL_ERROR, "Failed to execute the command. Response: %s", response);
             message = TLV_VALUE_WPA_SET_PARAMETER_NO_OK;
             goto done;
         }
@@ -2163,7 +2284,7 @@ static int send_sta_btm_query_handler(struct packet_wrapper *req, struct packet_
     /* Open wpa_supplicant UDS socket */
     w = wpa_ctrl_open(get_wpas_ctrl_path());
     if (!w) {
-        indigo_logger(LOG_LEVEL_ERROR, "Failed to connect to wpa_supplicant");
+        indigo_log(LOG_CATEGORY_WPAS, LOG_LEVEL_ERROR, "Failed to connect to wpa_supplicant");
         status = TLV_VALUE_STATUS_NOT_OK;
         message = TLV_VALUE_WPA_S_CTRL_NOT_OK;
         goto done;
@@ -2193,7 +2314,7 @@ static int send_sta_btm_query_handler(struct packet_wrapper *req, struct packet_
     wpa_ctrl_request(w, buffer, strlen(buffer), response, &resp_len, NULL);
     /* Check response */
     if (strncmp(response, WPA_CTRL_OK, strlen(WPA_CTRL_OK)) != 0) {
-        indigo_logger(LOG_LEVEL_ERROR, "Failed to execute the command. Response: %s", response);
+        indigo_log(LOG_CATEGORY_WPAS, LOG_LEVEL_ERROR, "Failed to execute the command. Response: %s", response);
         goto done;
     }
     status = TLV_VALUE_STATUS_OK;
@@ -2209,12 +2330,13 @@ done:
     return 0;
 }
 
-static int send_sta_anqp_query_handler(struct packet_wrapper *req, struct packet_wrapper *resp) {
-    int len, status = TLV_VALUE_STATUS_NOT_OK, i;
+static int send_sta_anqp_query_ready(struct packet_wrapper *req, struct packet_wrapper *resp) {
+    int status = TLV_VALUE_STATUS_NOT_OK, i;
     char *message = TLV_VALUE_WPA_S_BTM_QUERY_NOT_OK;
     char buffer[1024];
     char response[1024];
-    char bssid[256];
+    char bssid[32];
+    unsigned char mac[6];
     char anqp_info_id[256];
     struct tlv_hdr *tlv = NULL;
     struct wpa_ctrl *w = NULL;
@@ -2223,25 +2345,10 @@ static int send_sta_anqp_query_handler(struct packet_wrapper *req, struct packet
     char *delimit = ";";
     char realm[S_BUFFER_LEN];
 
-    /* It may need to check whether to just scan */
-    memset(buffer, 0, sizeof(buffer));
-    len = sprintf(buffer, "ctrl_interface=%s\nap_scan=1\n", WPAS_CTRL_PATH_DEFAULT);
-    if (len) {
-        write_file(get_wpas_conf_file(), buffer, len);
-    }
-
-    memset(buffer, 0 ,sizeof(buffer));
-    sprintf(buffer, "%s -B -t -c %s -i %s -f /var/log/supplicant.log",
-        get_wpas_full_exec_path(),
-        get_wpas_conf_file(),
-        get_wireless_interface());
-    len = system(buffer);
-    sleep(2);
-
     /* Open wpa_supplicant UDS socket */
     w = wpa_ctrl_open(get_wpas_ctrl_path());
     if (!w) {
-        indigo_logger(LOG_LEVEL_ERROR, "Failed to connect to wpa_supplicant");
+        indigo_log(LOG_CATEGORY_WPAS, LOG_LEVEL_ERROR, "Failed to connect to wpa_supplicant");
         status = TLV_VALUE_STATUS_NOT_OK;
         message = TLV_VALUE_WPA_S_CTRL_NOT_OK;
         goto done;
@@ -2254,19 +2361,16 @@ static int send_sta_anqp_query_handler(struct packet_wrapper *req, struct packet
     wpa_ctrl_request(w, buffer, strlen(buffer), response, &resp_len, NULL);
     /* Check response */
     if (strncmp(response, WPA_CTRL_OK, strlen(WPA_CTRL_OK)) != 0) {
-        indigo_logger(LOG_LEVEL_ERROR, "Failed to execute the command. Response: %s", response);
+        indigo_log(LOG_CATEGORY_WPAS, LOG_LEVEL_ERROR, "Failed to execute the command. Response: %s", response);
         goto done;
     }
     sleep(10);
 
     /* TLV: BSSID */
-    tlv = find_wrapper_tlv_by_id(req, TLV_BSSID);
-    if (tlv) {
-        memset(bssid, 0, sizeof(bssid));
-        memcpy(bssid, tlv->value, tlv->len);
-    } else {
+    if (get_wrapper_tlv_mac(req, TLV_BSSID, mac) < 0) {
         goto done;
     }
+    snprintf(bssid, sizeof(bssid), MACSTR, MAC2STR(mac));
 
     /* TLV: ANQP_INFO_ID */
     tlv = find_wrapper_tlv_by_id(req, TLV_ANQP_INFO_ID);
@@ -2307,10 +2411,10 @@ static int send_sta_anqp_query_handler(struct packet_wrapper *req, struct packet
     resp_len = sizeof(response) - 1;
     wpa_ctrl_request(w, buffer, strlen(buffer), response, &resp_len, NULL);
 
-    indigo_logger(LOG_LEVEL_DEBUG, "%s -> resp: %s\n", buffer, response);
+    indigo_log(LOG_CATEGORY_WPAS, LOG_LEVEL_DEBUG, "%s -> resp: %s\n", buffer, response);
     /* Check response */
     if (strncmp(response, WPA_CTRL_OK, strlen(WPA_CTRL_OK)) != 0) {
-        indigo_logger(LOG_LEVEL_ERROR, "Failed to execute the command. Response: %s", response);
+        indigo_log(LOG_CATEGORY_WPAS, LOG_LEVEL_ERROR, "Failed to execute the command. Response: %s", response);
         goto done;
     }
     status = TLV_VALUE_STATUS_OK;
@@ -2326,21 +2430,34 @@ done:
     return 0;
 }
 
-static int start_up_p2p_handler(struct packet_wrapper *req, struct packet_wrapper *resp) {
-    char *message = TLV_VALUE_WPA_S_START_UP_NOT_OK;
-    char buffer[S_BUFFER_LEN];
-    int len, status = TLV_VALUE_STATUS_NOT_OK;
-
-#ifdef _OPENWRT_
-#else
-    system("rfkill unblock wlan");
-    sleep(1);
-#endif
+static int send_sta_anqp_query_handler(struct packet_wrapper *req, struct packet_wrapper *resp) {
+    char buffer[1024];
+    int len;
 
+    /* It may need to check whether to just scan */
     memset(buffer, 0, sizeof(buffer));
-    sprintf(buffer, "killall %s 1>/dev/null 2>/dev/null", get_wpas_exec_file());
-    system(buffer);
-    sleep(3);
+    len = sprintf(buffer, "ctrl_interface=%s\nap_scan=1\n", WPAS_CTRL_PATH_DEFAULT);
+    if (len) {
+        write_file(get_wpas_conf_file(), buffer, len);
+    }
+
+    memset(buffer, 0 ,sizeof(buffer));
+    sprintf(buffer, "%s -t -c %s -i %s -f /var/log/supplicant.log",
+        get_wpas_full_exec_path(),
+        get_wpas_conf_file(),
+        get_wireless_interface());
+    process_start(buffer);
+
+    /* Query once wpa_supplicant answers on its control interface. Other requests are served meanwhile. */
+    if (indigo_request_defer_ready(get_wpas_ctrl_path(), get_wpas_exec_file(), send_sta_anqp_query_ready) == 0) {
+        return 0;
+    }
+    return send_sta_anqp_query_ready(req, resp);
+}
+
+static int start_up_p2p_stopped(struct packet_wrapper *req, struct packet_wrapper *resp) {
+    char buffer[S_BUFFER_LEN];
+    int len;
 
     /* Generate P2P config file */
     sprintf(buffer, "ctrl_interface=%s\n", WPAS_CTRL_PATH_DEFAULT);
@@ -2357,21 +2474,29 @@ static int start_up_p2p_handler(struct packet_wrapper *req, struct packet_wrappe
 
     /* Start WPA supplicant */
     memset(buffer, 0 ,sizeof(buffer));
-    sprintf(buffer, "%s -B -t -c %s %s -i %s -f /var/log/supplicant.log",
+    sprintf(buffer, "%s -t -c %s %s -i %s -f /var/log/supplicant.log",
         get_wpas_full_exec_path(),
         get_wpas_conf_file(),
         get_wpas_debug_arguments(),
         get_wireless_interface());
-    len = system(buffer);
-    sleep(2);
+    process_start(buffer);
 
-    status = TLV_VALUE_STATUS_OK;
-    message = TLV_VALUE_WPA_S_START_UP_OK;
+    /* Respond once wpa_supplicant answers on its control interface. Other requests are served meanwhile. */
+    if (indigo_request_defer_ready(get_wpas_ctrl_path(), get_wpas_exec_file(), wpas_start_up_ready) == 0) {
+        return 0;
+    }
+    return wpas_start_up_ready(req, resp);
+}
 
-done:
-    fill_wrapper_message_hdr(resp, API_CMD_RESPONSE, req->hdr.seq);
-    fill_wrapper_tlv_byte(resp, TLV_STATUS, status);
-    fill_wrapper_tlv_bytes(resp, TLV_MESSAGE, strlen(message), message);
+static int start_up_p2p_handler(struct packet_wrapper *req, struct packet_wrapper *resp) {
+#ifdef _OPENWRT_
+#else
+    system("rfkill unblock wlan");
+    sleep(1);
+#endif
+
+    /* Continue once wpa_supplicant has exited. Other requests are served meanwhile. */
+    process_stop_async(get_wpas_exec_file(), indigo_request_event, indigo_request_defer_event(start_up_p2p_stopped));
     return 0;
 }
 
@@ -2385,7 +2510,7 @@ static int p2p_find_handler(struct packet_wrapper *req, struct packet_wrapper *r
     /* Open wpa_supplicant UDS socket */
     w = wpa_ctrl_open(get_wpas_ctrl_path());
     if (!w) {
-        indigo_logger(LOG_LEVEL_ERROR, "Failed to connect to wpa_supplicant");
+        indigo_log(LOG_CATEGORY_WPAS, LOG_LEVEL_ERROR, "Failed to connect to wpa_supplicant");
         status = TLV_VALUE_STATUS_NOT_OK;
         message = TLV_VALUE_WPA_S_CTRL_NOT_OK;
         goto done;
@@ -2398,7 +2523,7 @@ static int p2p_find_handler(struct packet_wrapper *req, struct packet_wrapper *r
     wpa_ctrl_request(w, buffer, strlen(buffer), response, &resp_len, NULL);
     /* Check response */
     if (strncmp(response, WPA_CTRL_OK, strlen(WPA_CTRL_OK)) != 0) {
-        indigo_logger(LOG_LEVEL_ERROR, "Failed to execute the command. Response: %s", response);
+        indigo_log(LOG_CATEGORY_WPAS, LOG_LEVEL_ERROR, "Failed to execute the command. Response: %s", response);
         goto done;
     }
     status = TLV_VALUE_STATUS_OK;
@@ -2424,7 +2549,7 @@ static int p2p_listen_handler(struct packet_wrapper *req, struct packet_wrapper
     /* Open wpa_supplicant UDS socket */
     w = wpa_ctrl_open(get_wpas_ctrl_path());
     if (!w) {
-        indigo_logger(LOG_LEVEL_ERROR, "Failed to connect to wpa_supplicant");
+        indigo_log(LOG_CATEGORY_WPAS, LOG_LEVEL_ERROR, "Failed to connect to wpa_supplicant");
         status = TLV_VALUE_STATUS_NOT_OK;
         message = TLV_VALUE_WPA_S_CTRL_NOT_OK;
         goto done;
@@ -2437,7 +2562,7 @@ static int p2p_listen_handler(struct packet_wrapper *req, struct packet_wrapper
     wpa_ctrl_request(w, buffer, strlen(buffer), response, &resp_len, NULL);
     /* Check response */
     if (strncmp(response, WPA_CTRL_OK, strlen(WPA_CTRL_OK)) != 0) {
-        indigo_logger(LOG_LEVEL_ERROR, "Failed to execute the command. Response: %s", response);
+        indigo_log(LOG_CATEGORY_WPAS, LOG_LEVEL_ERROR, "Failed to execute the command. Response: %s", response);
         goto done;
     }
     status = TLV_VALUE_STATUS_OK;
@@ -2456,21 +2581,19 @@ done:
 static int add_p2p_group_handler(struct packet_wrapper *req, struct packet_wrapper *resp) {
     struct wpa_ctrl *w = NULL;
     char buffer[S_BUFFER_LEN], response[BUFFER_LEN];
-    char freq[64], he[16];
+    char he[16];
     size_t resp_len;
-    int status = TLV_VALUE_STATUS_NOT_OK;
+    int freq, status = TLV_VALUE_STATUS_NOT_OK;
     char *message = TLV_VALUE_P2P_ADD_GROUP_NOT_OK;
     struct tlv_hdr *tlv = NULL;
 
-    memset(freq, 0, sizeof(freq));
     /* TLV_FREQUENCY (required) */
-    tlv = find_wrapper_tlv_by_id(req, TLV_FREQUENCY);
-    if (tlv) {
-        memcpy(freq, tlv->value, tlv->len);
+    if (find_wrapper_tlv_by_id(req, TLV_FREQUENCY)) {
+        freq = get_wrapper_tlv_int(req, TLV_FREQUENCY);
     } else {
         status = TLV_VALUE_STATUS_NOT_OK;
         message = TLV_VALUE_INSUFFICIENT_TLV;
-        indigo_logger(LOG_LEVEL_ERROR, "Missed TLV: TLV_FREQUENCY");
+        indigo_log(LOG_CATEGORY_WPAS, LOG_LEVEL_ERROR, "Missed TLV: TLV_FREQUENCY");
         goto done;
     }
 
@@ -2482,7 +2605,7 @@ static int add_p2p_group_handler(struct packet_wrapper *req, struct packet_wrapp
     /* Open wpa_supplicant UDS socket */
     w = wpa_ctrl_open(get_wpas_ctrl_path());
     if (!w) {
-        indigo_logger(LOG_LEVEL_ERROR, "Failed to connect to wpa_supplicant");
+        indigo_log(LOG_CATEGORY_WPAS, LOG_LEVEL_ERROR, "Failed to connect to wpa_supplicant");
         status = TLV_VALUE_STATUS_NOT_OK;
         message = TLV_VALUE_WPA_S_CTRL_NOT_OK;
         goto done;
@@ -2490,12 +2613,12 @@ static int add_p2p_group_handler(struct packet_wrapper *req, struct packet_wrapp
 
     memset(buffer, 0, sizeof(buffer));
     memset(response, 0, sizeof(response));
-    sprintf(buffer, "P2P_GROUP_ADD freq=%s%s", freq, he);
+    sprintf(buffer, "P2P_GROUP_ADD freq=%d%s", freq, he);
     resp_len = sizeof(response) - 1;
     wpa_ctrl_request(w, buffer, strlen(buffer), response, &resp_len, NULL);
     /* Check response */
     if (strncmp(response, WPA_CTRL_OK, strlen(WPA_CTRL_OK)) != 0) {
-        indigo_logger(LOG_LEVEL_ERROR, "Failed to execute the command. Response: %s", response);
+        indigo_log(LOG_CATEGORY_WPAS, LOG_LEVEL_ERROR, "Failed to execute the command. Response: %s", response);
         goto done;
     }
     status = TLV_VALUE_STATUS_OK;
@@ -2529,7 +2652,7 @@ static int stop_p2p_group_handler(struct packet_wrapper *req, struct packet_wrap
     /* Open wpa_supplicant UDS socket */
     w = wpa_ctrl_open(get_wpas_ctrl_path());
     if (!w) {
-        indigo_logger(LOG_LEVEL_ERROR, "Failed to connect to wpa_supplicant");
+        indigo_log(LOG_CATEGORY_WPAS, LOG_LEVEL_ERROR, "Failed to connect to wpa_supplicant");
         status = TLV_VALUE_STATUS_NOT_OK;
         message = TLV_VALUE_WPA_S_CTRL_NOT_OK;
         goto done;
@@ -2546,7 +2669,7 @@ static int stop_p2p_group_handler(struct packet_wrapper *req, struct packet_wrap
     wpa_ctrl_request(w, buffer, strlen(buffer), response, &resp_len, NULL);
     /* Check response */
     if (strncmp(response, WPA_CTRL_OK, strlen(WPA_CTRL_OK)) != 0) {
-        indigo_logger(LOG_LEVEL_ERROR, "Failed to execute the command. Response: %s", response);
+        indigo_log(LOG_CATEGORY_WPAS, LOG_LEVEL_ERROR, "Failed to execute the command. Response: %s", response);
         goto done;
     }
     if (w) {
@@ -2557,11 +2680,11 @@ static int stop_p2p_group_handler(struct packet_wrapper *req, struct packet_wrap
     if (persist == 1) {
         /* Can use global ctrl if global ctrl is initialized */
         get_p2p_dev_if(p2p_dev_if, sizeof(p2p_dev_if));
-        indigo_logger(LOG_LEVEL_DEBUG, "P2P Dev IF: %s", p2p_dev_if);
+        indigo_log(LOG_CATEGORY_WPAS, LOG_LEVEL_DEBUG, "P2P Dev IF: %s", p2p_dev_if);
         /* Open wpa_supplicant UDS socket */
         w = wpa_ctrl_open(get_wpas_if_ctrl_path(p2p_dev_if));
         if (!w) {
-            indigo_logger(LOG_LEVEL_ERROR, "Failed to connect to wpa_supplicant");
+            indigo_log(LOG_CATEGORY_WPAS, LOG_LEVEL_ERROR, "Failed to connect to wpa_supplicant");
             status = TLV_VALUE_STATUS_NOT_OK;
             message = TLV_VALUE_WPA_S_CTRL_NOT_OK;
             goto done;
@@ -2575,7 +2698,7 @@ static int stop_p2p_group_handler(struct packet_wrapper *req, struct packet_wrap
         wpa_ctrl_request(w, buffer, strlen(buffer), response, &resp_len, NULL);
         /* Check response */
         if (strncmp(response, WPA_CTRL_OK, strlen(WPA_CTRL_OK)) != 0) {
-            indigo_logger(LOG_LEVEL_ERROR, "Failed to execute the command. Response: %s", response);
+            indigo_log(LOG_CATEGORY_WPAS, LOG_LEVEL_ERROR, "Failed to execute the command. Response: %s", response);
             goto done;
         }
     }
@@ -2613,13 +2736,13 @@ static int p2p_start_wps_handler(struct packet_wrapper *req, struct packet_wrapp
 
     /* Open wpa_supplicant UDS socket */
     if (get_p2p_group_if(if_name, sizeof(if_name))) {
-        indigo_logger(LOG_LEVEL_ERROR, "Failed to get P2P group interface");
+        indigo_log(LOG_CATEGORY_WPAS, LOG_LEVEL_ERROR, "Failed to get P2P group interface");
         goto done;
     }
-    indigo_logger(LOG_LEVEL_DEBUG, "P2P group interface: %s", if_name);
+    indigo_log(LOG_CATEGORY_WPAS, LOG_LEVEL_DEBUG, "P2P group interface: %s", if_name);
     w = wpa_ctrl_open(get_wpas_if_ctrl_path(if_name));
     if (!w) {
-        indigo_logger(LOG_LEVEL_ERROR, "Failed to connect to wpa_supplicant");
+        indigo_log(LOG_CATEGORY_WPAS, LOG_LEVEL_ERROR, "Failed to connect to wpa_supplicant");
         status = TLV_VALUE_STATUS_NOT_OK;
         message = TLV_VALUE_WPA_S_CTRL_NOT_OK;
         goto done;
@@ -2629,7 +2752,7 @@ static int p2p_start_wps_handler(struct packet_wrapper *req, struct packet_wrapp
     resp_len = sizeof(response) - 1;
     wpa_ctrl_request(w, buffer, strlen(buffer), response, &resp_len, NULL);
     if (strncmp(response, WPA_CTRL_FAIL, strlen(WPA_CTRL_FAIL)) == 0) {
-        indigo_logger(LOG_LEVEL_ERROR, "Failed to execute the command(%s).", buffer);
+        indigo_log(LOG_CATEGORY_WPAS, LOG_LEVEL_ERROR, "Failed to execute the command(%s).", buffer);
         goto done;
     }
 
@@ -2646,14 +2769,65 @@ done:
     return 0;
 }
 
-static int sta_scan_handler(struct packet_wrapper *req, struct packet_wrapper *resp) {
-    int len, status = TLV_VALUE_STATUS_NOT_OK, i;
+static int sta_scan_done(struct packet_wrapper *req, struct packet_wrapper *resp) {
+    fill_wrapper_message_hdr(resp, API_CMD_RESPONSE, req->hdr.seq);
+    fill_wrapper_tlv_byte(resp, TLV_STATUS, TLV_VALUE_STATUS_OK);
+    fill_wrapper_tlv_bytes(resp, TLV_MESSAGE, strlen(TLV_VALUE_OK), TLV_VALUE_OK);
+    return 0;
+}
+
+static int sta_scan_ready(struct packet_wrapper *req, struct packet_wrapper *resp) {
+    int status = TLV_VALUE_STATUS_NOT_OK;
     char *message = TLV_VALUE_WPA_S_SCAN_NOT_OK;
     char buffer[1024];
     char response[1024];
-    struct tlv_hdr *tlv = NULL;
     struct wpa_ctrl *w = NULL;
     size_t resp_len;
+
+    /* Open wpa_supplicant UDS socket */
+    w = wpa_ctrl_open(get_wpas_ctrl_path());
+    if (!w) {
+        indigo_log(LOG_CATEGORY_WPAS, LOG_LEVEL_ERROR, "Failed to connect to wpa_supplicant");
+        status = TLV_VALUE_STATUS_NOT_OK;
+        message = TLV_VALUE_WPA_S_CTRL_NOT_OK;
+        goto done;
+    }
+    // SCAN
+    memset(buffer, 0, sizeof(buffer));
+    memset(response, 0, sizeof(response));
+    sprintf(buffer, "SCAN");
+    resp_len = sizeof(response) - 1;
+    wpa_ctrl_request(w, buffer, strlen(buffer), response, &resp_len, NULL);
+    /* Check response */
+    if (strncmp(response, WPA_CTRL_OK, strlen(WPA_CTRL_OK)) != 0) {
+        indigo_log(LOG_CATEGORY_WPAS, LOG_LEVEL_ERROR, "Failed to execute the command. Response: %s", response);
+        goto done;
+    }
+    indigo_log(LOG_CATEGORY_WPAS, LOG_LEVEL_DEBUG, "%s -> resp: %s\n", buffer, response);
+    /* Respond when the scan is done. Other requests are served meanwhile. */
+    if (indigo_request_defer_timeout(10, 0, sta_scan_done) == 0) {
+        wpa_ctrl_close(w);
+        return 0;
+    }
+    sleep(10);
+
+    status = TLV_VALUE_STATUS_OK;
+    message = TLV_VALUE_OK;
+
+done:
+    fill_wrapper_message_hdr(resp, API_CMD_RESPONSE, req->hdr.seq);
+    fill_wrapper_tlv_byte(resp, TLV_STATUS, status);
+    fill_wrapper_tlv_bytes(resp, TLV_MESSAGE, strlen(message), message);
+    if (w) {
+        wpa_ctrl_close(w);
+    }
+    return 0;
+}
+
+static int sta_scan_handler(struct packet_wrapper *req, struct packet_wrapper *resp) {
+    int len, i;
+    char buffer[1024];
+    struct tlv_hdr *tlv = NULL;
     struct tlv_to_config_name* cfg = NULL;
     char value[TLV_VALUE_SIZE], cfg_item[2*S_BUFFER_LEN];
 
@@ -2681,46 +2855,17 @@ static int sta_scan_handler(struct packet_wrapper *req, struct packet_wrapper *r
     }
 
     memset(buffer, 0 ,sizeof(buffer));
-    sprintf(buffer, "%s -B -t -c %s -i %s -f /var/log/supplicant.log",
+    sprintf(buffer, "%s -t -c %s -i %s -f /var/log/supplicant.log",
         get_wpas_full_exec_path(),
         get_wpas_conf_file(),
         get_wireless_interface());
-    len = system(buffer);
-    sleep(2);
-
-    /* Open wpa_supplicant UDS socket */
-    w = wpa_ctrl_open(get_wpas_ctrl_path());
-    if (!w) {
-        indigo_logger(LOG_LEVEL_ERROR, "Failed to connect to wpa_supplicant");
-        status = TLV_VALUE_STATUS_NOT_OK;
-        message = TLV_VALUE_WPA_S_CTRL_NOT_OK;
-        goto done;
-    }
-    // SCAN
-    memset(buffer, 0, sizeof(buffer));
-    memset(response, 0, sizeof(response));
-    sprintf(buffer, "SCAN");
-    resp_len = sizeof(response) - 1;
-    wpa_ctrl_request(w, buffer, strlen(buffer), response, &resp_len, NULL);
-    /* Check response */
-    if (strncmp(response, WPA_CTRL_OK, strlen(WPA_CTRL_OK)) != 0) {
-        indigo_logger(LOG_LEVEL_ERROR, "Failed to execute the command. Response: %s", response);
-        goto done;
-    }
-    indigo_logger(LOG_LEVEL_DEBUG, "%s -> resp: %s\n", buffer, response);
-    sleep(10);
+    process_start(buffer);
 
-    status = TLV_VALUE_STATUS_OK;
-    message = TLV_VALUE_OK;
-
-done:
-    fill_wrapper_message_hdr(resp, API_CMD_RESPONSE, req->hdr.seq);
-    fill_wrapper_tlv_byte(resp, TLV_STATUS, status);
-    fill_wrapper_tlv_bytes(resp, TLV_MESSAGE, strlen(message), message);
-    if (w) {
-        wpa_ctrl_close(w);
+    /* Scan once wpa_supplicant answers on its control interface. Other requests are served meanwhile. */
+    if (indigo_request_defer_ready(get_wpas_ctrl_path(), get_wpas_exec_file(), sta_scan_ready) == 0) {
+        return 0;
     }
-    return 0;
+    return sta_scan_ready(req, resp);
 }
 
 static int set_sta_hs2_associate_handler(struct packet_wrapper *req, struct packet_wrapper *resp) {
@@ -2729,26 +2874,21 @@ static int set_sta_hs2_associate_handler(struct packet_wrapper *req, struct pack
     char *message = TLV_VALUE_WPA_S_ASSOC_NOT_OK;
     char buffer[BUFFER_LEN];
     char response[BUFFER_LEN];
-    char bssid[256];
-    struct tlv_hdr *tlv = NULL;
+    unsigned char mac[6];
     struct wpa_ctrl *w = NULL;
 
     /* Open wpa_supplicant UDS socket */
     w = wpa_ctrl_open(get_wpas_ctrl_path());
     if (!w) {
-        indigo_logger(LOG_LEVEL_ERROR, "Failed to connect to wpa_supplicant");
+        indigo_log(LOG_CATEGORY_WPAS, LOG_LEVEL_ERROR, "Failed to connect to wpa_supplicant");
         status = TLV_VALUE_STATUS_NOT_OK;
         message = TLV_VALUE_WPA_S_CTRL_NOT_OK;
         goto done;
     }
 
-    memset(bssid, 0, sizeof(bssid));
-    tlv = find_wrapper_tlv_by_id(req, TLV_BSSID);
-    if (tlv) {
-        memset(bssid, 0, sizeof(bssid));
-        memcpy(bssid, tlv->value, tlv->len);
+    if (get_wrapper_tlv_mac(req, TLV_BSSID, mac) == 0) {
         memset(buffer, 0, sizeof(buffer));
-        snprintf(buffer, sizeof(buffer), "INTERWORKING_CONNECT %s", bssid);
+        snprintf(buffer, sizeof(buffer), "INTERWORKING_CONNECT " MACSTR, MAC2STR(mac));
     } else {
         memset(buffer, 0, sizeof(buffer));
         snprintf(buffer, sizeof(buffer), "INTERWORKING_SELECT auto");
@@ -2759,7 +2899,7 @@ static int set_sta_hs2_associate_handler(struct packet_wrapper *req, struct pack
     wpa_ctrl_request(w, buffer, strlen(buffer), response, &resp_len, NULL);
     /* Check response */
     if (strncmp(response, WPA_CTRL_OK, strlen(WPA_CTRL_OK)) != 0) {
-        indigo_logger(LOG_LEVEL_ERROR, "Failed to execute the command %s.\n Response: %s", buffer, response);
+        indigo_log(LOG_CATEGORY_WPAS, LOG_LEVEL_ERROR, "Failed to execute the command %s.\n Response: %s", buffer, response);
         goto done;
     }
     status = TLV_VALUE_STATUS_OK;
@@ -2774,10 +2914,10 @@ done:
     return 0;
 }
 
-static int sta_add_credential_handler(struct packet_wrapper *req, struct packet_wrapper *resp) {
+static int sta_add_credential_ready(struct packet_wrapper *req, struct packet_wrapper *resp) {
     char *message = TLV_VALUE_WPA_S_ADD_CRED_NOT_OK;
     char buffer[BUFFER_LEN];
-    int len, status = TLV_VALUE_STATUS_NOT_OK, i, cred_id, wpa_ret;
+    int status = TLV_VALUE_STATUS_NOT_OK, i, cred_id, wpa_ret;
     size_t resp_len;
     char response[BUFFER_LEN];
     char param_value[256];
@@ -2785,42 +2925,10 @@ static int sta_add_credential_handler(struct packet_wrapper *req, struct packet_
     struct wpa_ctrl *w = NULL;
     struct tlv_to_config_name* cfg = NULL;
 
-    if (sta_configured == 0) {
-        sta_configured = 1;
-#ifdef _OPENWRT_
-#else
-        system("rfkill unblock wlan");
-        sleep(1);
-#endif
-        memset(buffer, 0, sizeof(buffer));
-        sprintf(buffer, "killall %s 1>/dev/null 2>/dev/null", get_wpas_exec_file());
-        system(buffer);
-        sleep(3);
-
-        memset(buffer, 0, sizeof(buffer));
-        sprintf(buffer, "ctrl_interface=%s\nap_scan=1\n", WPAS_CTRL_PATH_DEFAULT);
-        len = strlen(buffer);
-        if (len) {
-            write_file(get_wpas_conf_file(), buffer, len);
-        }
-    }
-    if (sta_started == 0) {
-        sta_started = 1;
-        /* Start WPA supplicant */
-        memset(buffer, 0 ,sizeof(buffer));
-        sprintf(buffer, "%s -B -t -c %s %s -i %s -f /var/log/supplicant.log", 
-            get_wpas_full_exec_path(),
-            get_wpas_conf_file(),
-            get_wpas_debug_arguments(),
-            get_wireless_interface());
-        len = system(buffer);
-        sleep(2);
-    }
-
     /* Open wpa_supplicant UDS socket */
     w = wpa_ctrl_open(get_wpas_ctrl_path());
     if (!w) {
-        indigo_logger(LOG_LEVEL_ERROR, "Failed to connect to wpa_supplicant");
+        indigo_log(LOG_CATEGORY_WPAS, LOG_LEVEL_ERROR, "Failed to connect to wpa_supplicant");
         status = TLV_VALUE_STATUS_NOT_OK;
         message = TLV_VALUE_WPA_S_CTRL_NOT_OK;
         goto done;
@@ -2831,7 +2939,7 @@ static int sta_add_credential_handler(struct packet_wrapper *req, struct packet_
     resp_len = sizeof(response) - 1;
     wpa_ret = wpa_ctrl_request(w, buffer, strlen(buffer), response, &resp_len, NULL);
     if (wpa_ret < 0) {
-        indigo_logger(LOG_LEVEL_ERROR, "Failed to execute the command ADD_CRED. Response: %s", response);
+        indigo_log(LOG_CATEGORY_WPAS, LOG_LEVEL_ERROR, "Failed to execute the command ADD_CRED. Response: %s", response);
         goto done;
     }
     cred_id = atoi(response);
@@ -2853,13 +2961,13 @@ static int sta_add_credential_handler(struct packet_wrapper *req, struct packet_
         } else {
             snprintf(buffer, sizeof(buffer), "SET_CRED %d %s %s", cred_id, cfg->config_name, param_value);
         }
-        indigo_logger(LOG_LEVEL_DEBUG, "Execute the command: %s", buffer);
+        indigo_log(LOG_CATEGORY_WPAS, LOG_LEVEL_DEBUG, "Execute the command: %s", buffer);
         /* Send command to wpa_supplicant UDS socket */
         resp_len = sizeof(response) - 1;
         wpa_ctrl_request(w, buffer, strlen(buffer), response, &resp_len, NULL);
         /* Check response */
         if (strncmp(response, WPA_CTRL_OK, strlen(WPA_CTRL_OK)) != 0) {
-            indigo_logger(LOG_LEVEL_ERROR, "Failed to execute the command. Response: %s", response);
+            indigo_log(LOG_CATEGORY_WPAS, LOG_LEVEL_ERROR, "Failed to execute the command. Response: %s", response);
             message = TLV_VALUE_WPA_SET_PARAMETER_NO_OK;
             goto done;
         }
@@ -2875,6 +2983,57 @@ done:
     return 0;
 }
 
+static int sta_add_credential_start(struct packet_wrapper *req, struct packet_wrapper *resp) {
+    char buffer[BUFFER_LEN];
+
+    if (sta_started == 0) {
+        sta_started = 1;
+        /* Start WPA supplicant */
+        memset(buffer, 0 ,sizeof(buffer));
+        sprintf(buffer, "%s -t -c %s %s -i %s -f /var/log/supplicant.log", 
+            get_wpas_full_exec_path(),
+            get_wpas_conf_file(),
+            get_wpas_debug_arguments(),
+            get_wireless_interface());
+        process_start(buffer);
+
+        /* Add the credential once wpa_supplicant answers on its control interface. Other requests are
+         * served meanwhile. */
+        if (indigo_request_defer_ready(get_wpas_ctrl_path(), get_wpas_exec_file(), sta_add_credential_ready) == 0) {
+            return 0;
+        }
+    }
+    return sta_add_credential_ready(req, resp);
+}
+
+static int sta_add_credential_stopped(struct packet_wrapper *req, struct packet_wrapper *resp) {
+    char buffer[BUFFER_LEN];
+    int len;
+
+    memset(buffer, 0, sizeof(buffer));
+    sprintf(buffer, "ctrl_interface=%s\nap_scan=1\n", WPAS_CTRL_PATH_DEFAULT);
+    len = strlen(buffer);
+    if (len) {
+        write_file(get_wpas_conf_file(), buffer, len);
+    }
+    return sta_add_credential_start(req, resp);
+}
+
+static int sta_add_credential_handler(struct packet_wrapper *req, struct packet_wrapper *resp) {
+    if (sta_configured == 0) {
+        sta_configured = 1;
+#ifdef _OPENWRT_
+#else
+        system("rfkill unblock wlan");
+        sleep(1);
+#endif
+        /* Continue once wpa_supplicant has exited. Other requests are served meanwhile. */
+        process_stop_async(get_wpas_exec_file(), indigo_request_event, indigo_request_defer_event(sta_add_credential_stopped));
+        return 0;
+    }
+    return sta_add_credential_start(req, resp);
+}
+
 static int run_hs20_osu_client(const char *params)
 {
 	char buf[BUFFER_LEN], cmd[S_BUFFER_LEN];
@@ -2893,7 +3052,7 @@ static int run_hs20_osu_client(const char *params)
 
     indigo_logger(LOG_LEVEL_DEBUG, "Run: %s", buf);
 
-	if (system(buf) != 0) {
+	if (process_run(buf) != 0) {
 		indigo_logger(LOG_LEVEL_ERROR, "Failed to run: %s", buf);
 		return -1;
 	}
@@ -2901,33 +3060,14 @@ static int run_hs20_osu_client(const char *params)
 	return 0;
 }
 
-static int set_sta_install_ppsmo_handler(struct packet_wrapper *req, struct packet_wrapper *resp) {
+static int set_sta_install_ppsmo_ready(struct packet_wrapper *req, struct packet_wrapper *resp) {
     int status = TLV_VALUE_STATUS_NOT_OK;
     char *message = TLV_VALUE_HS2_INSTALL_PPSMO_NOT_OK;
-    int len, i;
     char buffer[L_BUFFER_LEN], ppsmo_file[S_BUFFER_LEN];
     struct tlv_hdr *tlv;
     char *fqdn = NULL;
     char fqdn_buf[S_BUFFER_LEN];
 
-    memset(buffer, 0, sizeof(buffer));
-    snprintf(buffer, sizeof(buffer), "ctrl_interface=%s\nap_scan=1\n", WPAS_CTRL_PATH_DEFAULT);
-    
-    len = strlen(buffer);
-    if (len) {
-        write_file(get_wpas_conf_file(), buffer, len);
-    }
-
-    snprintf(buffer, sizeof(buffer), "%s -B -t -c %s -i %s -f /var/log/supplicant.log",
-            get_wpas_full_exec_path(),
-            get_wpas_conf_file(),
-            get_wireless_interface());
-    if (system(buffer)) {
-        indigo_logger(LOG_LEVEL_ERROR, "Failed to run wpa_supplicant.");
-        goto done;
-    }
-    sleep(2);
-
     tlv = find_wrapper_tlv_by_id(req, TLV_PPSMO_FILE);
     if (tlv) {
         memset(ppsmo_file, 0, sizeof(ppsmo_file));
@@ -2938,9 +3078,9 @@ static int set_sta_install_ppsmo_handler(struct packet_wrapper *req, struct pack
 
     unlink("pps-tnds.xml");
     snprintf(buffer, sizeof(buffer), "wget -T 10 -t 3 -O pps-tnds.xml '%s'", ppsmo_file);
-    indigo_logger(LOG_LEVEL_DEBUG, "RUN: %s\n", buffer);
+    indigo_log(LOG_CATEGORY_WPAS, LOG_LEVEL_DEBUG, "RUN: %s\n", buffer);
     if (system(buffer) != 0) {
-        indigo_logger(LOG_LEVEL_ERROR, "Failed to download PPS MO from %s\n", ppsmo_file);
+        indigo_log(LOG_CATEGORY_WPAS, LOG_LEVEL_ERROR, "Failed to download PPS MO from %s\n", ppsmo_file);
         goto done;
     }
 
@@ -2957,9 +3097,9 @@ static int set_sta_install_ppsmo_handler(struct packet_wrapper *req, struct pack
 				fqdn_buf[sizeof(fqdn_buf) - 1] = '\0';
 				fqdn = fqdn_buf;
                 if (fqdn)
-                    indigo_logger(LOG_LEVEL_DEBUG, "FQDN: %s", fqdn);
+                    indigo_log(LOG_CATEGORY_WPAS, LOG_LEVEL_DEBUG, "FQDN: %s", fqdn);
                 else {
-                    indigo_logger(LOG_LEVEL_ERROR, "Get FQDN ERROR" );
+                    indigo_log(LOG_CATEGORY_WPAS, LOG_LEVEL_ERROR, "Get FQDN ERROR" );
                     goto done;
                 }
             }
@@ -2973,13 +3113,13 @@ static int set_sta_install_ppsmo_handler(struct packet_wrapper *req, struct pack
 
     snprintf(buffer, sizeof(buffer), "dl_aaa_ca pps.xml SP/%s/aaa-ca.pem", fqdn);
     if (run_hs20_osu_client(buffer) < 0) {
-        indigo_logger(LOG_LEVEL_ERROR, "Failed to download AAA CA cert");
+        indigo_log(LOG_CATEGORY_WPAS, LOG_LEVEL_ERROR, "Failed to download AAA CA cert");
         goto done;
     }
 
     snprintf(buffer, sizeof(buffer), "set_pps pps.xml");
 	if (run_hs20_osu_client(buffer) < 0) {
-		indigo_logger(LOG_LEVEL_ERROR,
+		indigo_log(LOG_CATEGORY_WPAS, LOG_LEVEL_ERROR,
 			  "errorCode,Failed to configure credential from PPSMO");
         goto done;
 	}
@@ -2995,6 +3135,38 @@ done:
     return 0;
 }
 
+static int set_sta_install_ppsmo_handler(struct packet_wrapper *req, struct packet_wrapper *resp) {
+    char *message = TLV_VALUE_HS2_INSTALL_PPSMO_NOT_OK;
+    int len;
+    char buffer[L_BUFFER_LEN];
+
+    memset(buffer, 0, sizeof(buffer));
+    snprintf(buffer, sizeof(buffer), "ctrl_interface=%s\nap_scan=1\n", WPAS_CTRL_PATH_DEFAULT);
+    
+    len = strlen(buffer);
+    if (len) {
+        write_file(get_wpas_conf_file(), buffer, len);
+    }
+
+    snprintf(buffer, sizeof(buffer), "%s -t -c %s -i %s -f /var/log/supplicant.log",
+            get_wpas_full_exec_path(),
+            get_wpas_conf_file(),
+            get_wireless_interface());
+    if (process_start(buffer) < 0) {
+        indigo_log(LOG_CATEGORY_WPAS, LOG_LEVEL_ERROR, "Failed to run wpa_supplicant.");
+        fill_wrapper_message_hdr(resp, API_CMD_RESPONSE, req->hdr.seq);
+        fill_wrapper_tlv_byte(resp, TLV_STATUS, TLV_VALUE_STATUS_NOT_OK);
+        fill_wrapper_tlv_bytes(resp, TLV_MESSAGE, strlen(message), message);
+        return 0;
+    }
+
+    /* Install once wpa_supplicant answers on its control interface. Other requests are served meanwhile. */
+    if (indigo_request_defer_ready(get_wpas_ctrl_path(), get_wpas_exec_file(), set_sta_install_ppsmo_ready) == 0) {
+        return 0;
+    }
+    return set_sta_install_ppsmo_ready(req, resp);
+}
+
 static int p2p_connect_handler(struct packet_wrapper *req, struct packet_wrapper *resp) {
     struct wpa_ctrl *w = NULL;
     char buffer[S_BUFFER_LEN], response[BUFFER_LEN];
@@ -3005,7 +3177,7 @@ static int p2p_connect_handler(struct packet_wrapper *req, struct packet_wrapper
     char *message = TLV_VALUE_P2P_CONNECT_NOT_OK;
     struct tlv_hdr *tlv = NULL;
     char go_intent[32], he[16], persist[32];
-    int intent_value = P2P_GO_INTENT;
+    int intent_value = P2P_GO_INTENT, conn_type;
 
     memset(buffer, 0, sizeof(buffer));
     memset(mac, 0, sizeof(mac));
@@ -3017,22 +3189,19 @@ static int p2p_connect_handler(struct packet_wrapper *req, struct packet_wrapper
     if (tlv) {
         memcpy(mac, tlv->value, tlv->len);
     } else {
-        indigo_logger(LOG_LEVEL_ERROR, "Missed TLV: TLV_ADDRESS");
+        indigo_log(LOG_CATEGORY_WPAS, LOG_LEVEL_ERROR, "Missed TLV: TLV_ADDRESS");
         goto done;
     }
-    tlv = find_wrapper_tlv_by_id(req, TLV_GO_INTENT);
-    if (tlv) {
-        memset(go_intent, 0, sizeof(go_intent));
-        memcpy(go_intent, tlv->value, tlv->len);
-        intent_value = atoi(go_intent);
+    if (find_wrapper_tlv_by_id(req, TLV_GO_INTENT)) {
+        intent_value = get_wrapper_tlv_int(req, TLV_GO_INTENT);
     }
+    memset(go_intent, 0, sizeof(go_intent));
     tlv = find_wrapper_tlv_by_id(req, TLV_P2P_CONN_TYPE);
     if (tlv) {
-        memcpy(type, tlv->value, tlv->len);
-        if (atoi(type) == P2P_CONN_TYPE_JOIN) {
+        conn_type = get_wrapper_tlv_int(req, TLV_P2P_CONN_TYPE);
+        if (conn_type == P2P_CONN_TYPE_JOIN) {
             snprintf(type, sizeof(type), " join");
-            memset(go_intent, 0, sizeof(go_intent));
-        } else if (atoi(type) == P2P_CONN_TYPE_AUTH) {
+        } else if (conn_type == P2P_CONN_TYPE_AUTH) {
             snprintf(type, sizeof(type), " auth");
             snprintf(go_intent, sizeof(go_intent), " go_intent=%d", intent_value);
         }
@@ -3055,7 +3224,7 @@ static int p2p_connect_handler(struct packet_wrapper *req, struct packet_wrapper
         if (tlv) {
             memcpy(method, tlv->value, tlv->len);
         } else {
-            indigo_logger(LOG_LEVEL_ERROR, "Missed TLV PIN_METHOD???");
+            indigo_log(LOG_CATEGORY_WPAS, LOG_LEVEL_ERROR, "Missed TLV PIN_METHOD???");
         }
         sprintf(buffer, "P2P_CONNECT %s %s %s%s%s%s%s", mac, pin_code, method, type, go_intent, he, persist);
     } else {
@@ -3063,16 +3232,16 @@ static int p2p_connect_handler(struct packet_wrapper *req, struct packet_wrapper
         if (tlv) {
             memcpy(method, tlv->value, tlv->len);
         } else {
-            indigo_logger(LOG_LEVEL_ERROR, "Missed TLV WSC_METHOD");
+            indigo_log(LOG_CATEGORY_WPAS, LOG_LEVEL_ERROR, "Missed TLV WSC_METHOD");
         }
         sprintf(buffer, "P2P_CONNECT %s %s%s%s%s%s", mac, method, type, go_intent, he, persist);
     }
-    indigo_logger(LOG_LEVEL_DEBUG, "Command: %s", buffer);
+    indigo_log(LOG_CATEGORY_WPAS, LOG_LEVEL_DEBUG, "Command: %s", buffer);
 
     /* Open wpa_supplicant UDS socket */
     w = wpa_ctrl_open(get_wpas_ctrl_path());
     if (!w) {
-        indigo_logger(LOG_LEVEL_ERROR, "Failed to connect to wpa_supplicant");
+        indigo_log(LOG_CATEGORY_WPAS, LOG_LEVEL_ERROR, "Failed to connect to wpa_supplicant");
         status = TLV_VALUE_STATUS_NOT_OK;
         message = TLV_VALUE_WPA_S_CTRL_NOT_OK;
         goto done;
@@ -3082,7 +3251,7 @@ static int p2p_connect_handler(struct packet_wrapper *req, struct packet_wrapper
     resp_len = sizeof(response) - 1;
     wpa_ctrl_request(w, buffer, strlen(buffer), response, &resp_len, NULL);
     if (strncmp(response, WPA_CTRL_OK, strlen(WPA_CTRL_OK)) != 0) {
-        indigo_logger(LOG_LEVEL_ERROR, "Failed to execute the command. Response: %s", response);
+        indigo_log(LOG_CATEGORY_WPAS, LOG_LEVEL_ERROR, "Failed to execute the command. Response: %s", response);
         goto done;
     }
     status = TLV_VALUE_STATUS_OK;
@@ -3103,22 +3272,20 @@ static int start_dhcp_handler(struct packet_wrapper *req, struct packet_wrapper
     int status = TLV_VALUE_STATUS_NOT_OK;
     char *message = TLV_VALUE_START_DHCP_NOT_OK;
     char buffer[S_BUFFER_LEN];
-    char ip_addr[32], role[8];
+    char ip_addr[32];
     struct tlv_hdr *tlv = NULL;
     char if_name[32];
 
-    memset(role, 0, sizeof(role));
-    tlv = find_wrapper_tlv_by_id(req, TLV_ROLE);
-    if (tlv) {
-        memcpy(role, tlv->value, tlv->len);
-        if (atoi(role) == DUT_TYPE_P2PUT) {
+    /* TLV: TLV_ROLE */
+    if (find_wrapper_tlv_by_id(req, TLV_ROLE)) {
+        if (get_wrapper_tlv_int(req, TLV_ROLE) == DUT_TYPE_P2PUT) {
             get_p2p_group_if(if_name, sizeof(if_name));
         } else {
-            indigo_logger(LOG_LEVEL_ERROR, "DHCP only supports in P2PUT");
+            indigo_log(LOG_CATEGORY_NETIF, LOG_LEVEL_ERROR, "DHCP only supports in P2PUT");
             goto done;
         }
     } else {
-        indigo_logger(LOG_LEVEL_ERROR, "Missed TLV: TLV_ROLE");
+        indigo_log(LOG_CATEGORY_NETIF, LOG_LEVEL_ERROR, "Missed TLV: TLV_ROLE");
         goto done;
     }
 
@@ -3151,23 +3318,20 @@ static int stop_dhcp_handler(struct packet_wrapper *req, struct packet_wrapper *
     int status = TLV_VALUE_STATUS_NOT_OK;
     char *message = TLV_VALUE_NOT_OK;
     char buffer[S_BUFFER_LEN];
-    char role[8];
     struct tlv_hdr *tlv = NULL;
     char if_name[32];
 
-    memset(role, 0, sizeof(role));
-    tlv = find_wrapper_tlv_by_id(req, TLV_ROLE);
-    if (tlv) {
-        memcpy(role, tlv->value, tlv->len);
-        if (atoi(role) == DUT_TYPE_P2PUT) {
+    /* TLV: TLV_ROLE */
+    if (find_wrapper_tlv_by_id(req, TLV_ROLE)) {
+        if (get_wrapper_tlv_int(req, TLV_ROLE) == DUT_TYPE_P2PUT) {
             if (!get_p2p_group_if(if_name, sizeof(if_name)))
                 reset_interface_ip(if_name);
         } else {
-            indigo_logger(LOG_LEVEL_ERROR, "DHCP only supports in P2PUT");
+            indigo_log(LOG_CATEGORY_NETIF, LOG_LEVEL_ERROR, "DHCP only supports in P2PUT");
             goto done;
         }
     } else {
-        indigo_logger(LOG_LEVEL_ERROR, "Missed TLV: TLV_ROLE");
+        indigo_log(LOG_CATEGORY_NETIF, LOG_LEVEL_ERROR, "Missed TLV: TLV_ROLE");
         goto done;
     }
 
@@ -3195,17 +3359,13 @@ static int get_wsc_pin_handler(struct packet_wrapper *req, struct packet_wrapper
     int status = TLV_VALUE_STATUS_NOT_OK;
     char *message = TLV_VALUE_NOT_OK;
     char buffer[64], response[S_BUFFER_LEN];
-    struct tlv_hdr *tlv = NULL;
-    char value[16];
     int role = 0;
     struct wpa_ctrl *w = NULL;
     size_t resp_len;
 
-    memset(value, 0, sizeof(value));
-    tlv = find_wrapper_tlv_by_id(req, TLV_ROLE);
-    if (tlv) {
-            memcpy(value, tlv->value, tlv->len);
-            role = atoi(value);
+    /* TLV: TLV_ROLE */
+    if (find_wrapper_tlv_by_id(req, TLV_ROLE)) {
+        role = get_wrapper_tlv_int(req, TLV_ROLE);
     } else {
         indigo_logger(LOG_LEVEL_ERROR, "Missed TLV: TLV_ROLE");
         goto done;
@@ -3302,9 +3462,9 @@ static int start_wps_ap_handler(struct packet_wrapper *req, struct packet_wrappe
         if (0 == access(WPS_PIN_VALIDATION_FILE, F_OK)) {
             len = pipe_command(pipebuf, sizeof(pipebuf), "/bin/sh", parameter);
             if (len && atoi(pipebuf)) {
-                indigo_logger(LOG_LEVEL_INFO, "Valid PIN Code: %s", pin_code);
+                indigo_log(LOG_CATEGORY_HAPD, LOG_LEVEL_INFO, "Valid PIN Code: %s", pin_code);
             } else {
-                indigo_logger(LOG_LEVEL_INFO, "Invalid PIN Code: %s", pin_code);
+                indigo_log(LOG_CATEGORY_HAPD, LOG_LEVEL_INFO, "Invalid PIN Code: %s", pin_code);
                 message = TLV_VALUE_AP_WSC_PIN_CODE_NOT_OK;
                 goto done;
             }
@@ -3320,7 +3480,7 @@ static int start_wps_ap_handler(struct packet_wrapper *req, struct packet_wrappe
     /* Open hostapd UDS socket */
     w = wpa_ctrl_open(get_hapd_ctrl_path());
     if (!w) {
-        indigo_logger(LOG_LEVEL_ERROR, "Failed to connect to hostapd");
+        indigo_log(LOG_CATEGORY_HAPD, LOG_LEVEL_ERROR, "Failed to connect to hostapd");
         status = TLV_VALUE_STATUS_NOT_OK;
         message = TLV_VALUE_WPA_S_CTRL_NOT_OK;
         goto done;
@@ -3330,7 +3490,7 @@ static int start_wps_ap_handler(struct packet_wrapper *req, struct packet_wrappe
     resp_len = sizeof(response) - 1;
     wpa_ctrl_request(w, buffer, strlen(buffer), response, &resp_len, NULL);
     if (strncmp(response, WPA_CTRL_FAIL, strlen(WPA_CTRL_FAIL)) == 0) {
-        indigo_logger(LOG_LEVEL_ERROR, "Failed to execute the command(%s).", buffer);
+        indigo_log(LOG_CATEGORY_HAPD, LOG_LEVEL_ERROR, "Failed to execute the command(%s).", buffer);
         goto done;
     }
 
@@ -3372,7 +3532,7 @@ static int start_wps_sta_handler(struct packet_wrapper *req, struct packet_wrapp
             *  hyphen(dash) attached with 4 or 8-digit PIN code, then
             *  start WPS PIN Registration with stripped PIN code.
             * */
-            indigo_logger(LOG_LEVEL_ERROR, "Unrecognized PIN: %s", pin_code);
+            indigo_log(LOG_CATEGORY_WPAS, LOG_LEVEL_ERROR, "Unrecognized PIN: %s", pin_code);
             goto done;
         }
     } else {
@@ -3382,7 +3542,7 @@ static int start_wps_sta_handler(struct packet_wrapper *req, struct packet_wrapp
     /* Open wpa_supplicant UDS socket */
     w = wpa_ctrl_open(get_wpas_ctrl_path());
     if (!w) {
-        indigo_logger(LOG_LEVEL_ERROR, "Failed to connect to wpa_supplicant");
+        indigo_log(LOG_CATEGORY_WPAS, LOG_LEVEL_ERROR, "Failed to connect to wpa_supplicant");
         status = TLV_VALUE_STATUS_NOT_OK;
         message = TLV_VALUE_WPA_S_CTRL_NOT_OK;
         goto done;
@@ -3392,7 +3552,7 @@ static int start_wps_sta_handler(struct packet_wrapper *req, struct packet_wrapp
     resp_len = sizeof(response) - 1;
     wpa_ctrl_request(w, buffer, strlen(buffer), response, &resp_len, NULL);
     if (strncmp(response, WPA_CTRL_FAIL, strlen(WPA_CTRL_FAIL)) == 0) {
-        indigo_logger(LOG_LEVEL_ERROR, "Failed to execute the command(%s).", buffer);
+        indigo_log(LOG_CATEGORY_WPAS, LOG_LEVEL_ERROR, "Failed to execute the command(%s).", buffer);
         goto done;
     }
 
@@ -3422,16 +3582,14 @@ struct _cfg_cred {
 static int get_wsc_cred_handler(struct packet_wrapper *req, struct packet_wrapper *resp) {
     int status = TLV_VALUE_STATUS_NOT_OK;
     char *message = TLV_VALUE_NOT_OK;
-    char *pos = NULL, *data = NULL, value[16];
+    char *pos = NULL, *data = NULL;
     int i, len, ret = -1, count = 0, role = 0;
     struct tlv_hdr *tlv = NULL;
     struct _cfg_cred *p_cfg = NULL;
 
-    memset(value, 0, sizeof(value));
-    tlv = find_wrapper_tlv_by_id(req, TLV_ROLE);
-    if (tlv) {
-            memcpy(value, tlv->value, tlv->len);
-            role = atoi(value);
+    /* TLV: TLV_ROLE */
+    if (find_wrapper_tlv_by_id(req, TLV_ROLE)) {
+        role = get_wrapper_tlv_int(req, TLV_ROLE);
     } else {
         indigo_logger(LOG_LEVEL_ERROR, "Missed TLV: TLV_ROLE");
         goto done;
@@ -3520,7 +3678,7 @@ static int p2p_invite_handler(struct packet_wrapper *req, struct packet_wrapper
     struct wpa_ctrl *w = NULL;
     char buffer[S_BUFFER_LEN], response[BUFFER_LEN];
     char addr[32], if_name[16], persist[32], p2p_dev_if[32];
-    char freq[16], he[16];
+    char he[16];
     size_t resp_len;
     int status = TLV_VALUE_STATUS_NOT_OK;
     char *message = TLV_VALUE_P2P_INVITE_NOT_OK;
@@ -3534,7 +3692,7 @@ static int p2p_invite_handler(struct packet_wrapper *req, struct packet_wrapper
     } else {
         status = TLV_VALUE_STATUS_NOT_OK;
         message = TLV_VALUE_INSUFFICIENT_TLV;
-        indigo_logger(LOG_LEVEL_ERROR, "Missed TLV: TLV_ADDRESS");
+        indigo_log(LOG_CATEGORY_WPAS, LOG_LEVEL_ERROR, "Missed TLV: TLV_ADDRESS");
         goto done;
     }
 
@@ -3550,11 +3708,11 @@ static int p2p_invite_handler(struct packet_wrapper *req, struct packet_wrapper
 
     /* Can use global ctrl if global ctrl is initialized */
     get_p2p_dev_if(p2p_dev_if, sizeof(p2p_dev_if));
-    indigo_logger(LOG_LEVEL_DEBUG, "P2P Dev IF: %s", p2p_dev_if);
+    indigo_log(LOG_CATEGORY_WPAS, LOG_LEVEL_DEBUG, "P2P Dev IF: %s", p2p_dev_if);
     /* Open wpa_supplicant UDS socket */
     w = wpa_ctrl_open(get_wpas_if_ctrl_path(p2p_dev_if));
     if (!w) {
-        indigo_logger(LOG_LEVEL_ERROR, "Failed to connect to wpa_supplicant");
+        indigo_log(LOG_CATEGORY_WPAS, LOG_LEVEL_ERROR, "Failed to connect to wpa_supplicant");
         status = TLV_VALUE_STATUS_NOT_OK;
         message = TLV_VALUE_WPA_S_CTRL_NOT_OK;
         goto done;
@@ -3568,23 +3726,21 @@ static int p2p_invite_handler(struct packet_wrapper *req, struct packet_wrapper
         if (tlv)
             snprintf(he, sizeof(he), " he");
 
-        tlv = find_wrapper_tlv_by_id(req, TLV_FREQUENCY);
-        if (tlv) {
-            memset(freq, 0, sizeof(freq));
-            memcpy(freq, tlv->value, tlv->len);
-            sprintf(buffer, "P2P_INVITE %s peer=%s%s freq=%s", persist, addr, he, freq);
+        if (find_wrapper_tlv_by_id(req, TLV_FREQUENCY)) {
+            sprintf(buffer, "P2P_INVITE %s peer=%s%s freq=%d", persist, addr, he,
+                    (int) get_wrapper_tlv_int(req, TLV_FREQUENCY));
         } else {
             sprintf(buffer, "P2P_INVITE %s peer=%s%s", persist, addr, he);
         }
     } else {
         sprintf(buffer, "P2P_INVITE group=%s peer=%s", if_name, addr);
     }
-    indigo_logger(LOG_LEVEL_DEBUG, "Command: %s", buffer);
+    indigo_log(LOG_CATEGORY_WPAS, LOG_LEVEL_DEBUG, "Command: %s", buffer);
     resp_len = sizeof(response) - 1;
     wpa_ctrl_request(w, buffer, strlen(buffer), response, &resp_len, NULL);
     /* Check response */
     if (strncmp(response, WPA_CTRL_OK, strlen(WPA_CTRL_OK)) != 0) {
-        indigo_logger(LOG_LEVEL_ERROR, "Failed to execute the command. Response: %s", response);
+        indigo_log(LOG_CATEGORY_WPAS, LOG_LEVEL_ERROR, "Failed to execute the command. Response: %s", response);
         goto done;
     }
     status = TLV_VALUE_STATUS_OK;
@@ -3621,11 +3777,11 @@ static int set_p2p_serv_disc_handler(struct packet_wrapper *req, struct packet_w
 
     /* Can use global ctrl if global ctrl is initialized */
     get_p2p_dev_if(p2p_dev_if, sizeof(p2p_dev_if));
-    indigo_logger(LOG_LEVEL_DEBUG, "P2P Dev IF: %s", p2p_dev_if);
+    indigo_log(LOG_CATEGORY_WPAS, LOG_LEVEL_DEBUG, "P2P Dev IF: %s", p2p_dev_if);
     /* Open wpa_supplicant UDS socket */
     w = wpa_ctrl_open(get_wpas_if_ctrl_path(p2p_dev_if));
     if (!w) {
-        indigo_logger(LOG_LEVEL_ERROR, "Failed to connect to wpa_supplicant");
+        indigo_log(LOG_CATEGORY_WPAS, LOG_LEVEL_ERROR, "Failed to connect to wpa_supplicant");
         status = TLV_VALUE_STATUS_NOT_OK;
         message = TLV_VALUE_WPA_S_CTRL_NOT_OK;
         goto done;
@@ -3635,7 +3791,7 @@ static int set_p2p_serv_disc_handler(struct packet_wrapper *req, struct packet_w
     memset(response, 0, sizeof(response));
     if (addr[0] != 0) {
         sprintf(buffer, "P2P_SERV_DISC_REQ %s 02000001", addr);
-        indigo_logger(LOG_LEVEL_DEBUG, "Command: %s", buffer);
+        indigo_log(LOG_CATEGORY_WPAS, LOG_LEVEL_DEBUG, "Command: %s", buffer);
     } else {
         sprintf(buffer, "P2P_SERVICE_ADD bonjour 096d797072696e746572045f697070c00c001001 09747874766572733d311a70646c3d6170706c69636174696f6e2f706f7374736372797074");
     }
@@ -3644,13 +3800,13 @@ static int set_p2p_serv_disc_handler(struct packet_wrapper *req, struct packet_w
 
     if (addr[0] == 0) {
         if (strncmp(response, WPA_CTRL_OK, strlen(WPA_CTRL_OK)) != 0) {
-            indigo_logger(LOG_LEVEL_ERROR, "Failed to execute the command. Response: %s", response);
+            indigo_log(LOG_CATEGORY_WPAS, LOG_LEVEL_ERROR, "Failed to execute the command. Response: %s", response);
             goto done;
         }
         sprintf(buffer, "P2P_SERVICE_ADD upnp 10 uuid:5566d33e-9774-09ab-4822-333456785632::urn:schemas-upnp-org:service:ContentDirectory:2");
         wpa_ctrl_request(w, buffer, strlen(buffer), response, &resp_len, NULL);
         if (strncmp(response, WPA_CTRL_OK, strlen(WPA_CTRL_OK)) != 0) {
-            indigo_logger(LOG_LEVEL_ERROR, "Failed to execute the command. Response: %s", response);
+            indigo_log(LOG_CATEGORY_WPAS, LOG_LEVEL_ERROR, "Failed to execute the command. Response: %s", response);
             goto done;
         }
     }
@@ -3677,7 +3833,7 @@ static int set_p2p_ext_listen_handler(struct packet_wrapper *req, struct packet_
     /* Open wpa_supplicant UDS socket */
     w = wpa_ctrl_open(get_wpas_ctrl_path());
     if (!w) {
-        indigo_logger(LOG_LEVEL_ERROR, "Failed to connect to wpa_supplicant");
+        indigo_log(LOG_CATEGORY_WPAS, LOG_LEVEL_ERROR, "Failed to connect to wpa_supplicant");
         status = TLV_VALUE_STATUS_NOT_OK;
         message = TLV_VALUE_WPA_S_CTRL_NOT_OK;
         goto done;
@@ -3689,7 +3845,7 @@ static int set_p2p_ext_listen_handler(struct packet_wrapper *req, struct packet_
     wpa_ctrl_request(w, buffer, strlen(buffer), response, &resp_len, NULL);
     /* Check response */
     if (strncmp(response, WPA_CTRL_OK, strlen(WPA_CTRL_OK)) != 0) {
-        indigo_logger(LOG_LEVEL_ERROR, "Failed to execute the command. Response: %s", response);
+        indigo_log(LOG_CATEGORY_WPAS, LOG_LEVEL_ERROR, "Failed to execute the command. Response: %s", response);
         goto done;
     }
     status = TLV_VALUE_STATUS_OK;
@@ -3705,25 +3861,13 @@ done:
     return 0;
 }
 
-static int enable_wsc_sta_handler(struct packet_wrapper *req, struct packet_wrapper *resp) {
-    char *message = TLV_VALUE_WPA_S_START_UP_NOT_OK;
+static int enable_wsc_sta_stopped(struct packet_wrapper *req, struct packet_wrapper *resp) {
     char buffer[L_BUFFER_LEN];
-    char value[S_BUFFER_LEN], cfg_item[2*S_BUFFER_LEN], buf[S_BUFFER_LEN];
-    int i, len = 0, status = TLV_VALUE_STATUS_NOT_OK;
+    char value[S_BUFFER_LEN], cfg_item[2*S_BUFFER_LEN];
+    int i, len = 0;
     struct tlv_hdr *tlv = NULL;
     struct tlv_to_config_name* cfg = NULL;
 
-#ifdef _OPENWRT_
-#else
-    system("rfkill unblock wlan");
-    sleep(1);
-#endif
-
-    memset(buffer, 0, sizeof(buffer));
-    sprintf(buffer, "killall %s 1>/dev/null 2>/dev/null", get_wpas_exec_file());
-    system(buffer);
-    sleep(3);
-
     /* Generate configuration */
     memset(buffer, 0, sizeof(buffer));
     sprintf(buffer, "ctrl_interface=%s\nap_scan=1\npmf=1\n", WPAS_CTRL_PATH_DEFAULT);
@@ -3746,19 +3890,19 @@ static int enable_wsc_sta_handler(struct packet_wrapper *req, struct packet_wrap
         /* To get STA wps vendor info */
         wps_setting *s = get_vendor_wps_settings(WPS_STA);
         if (!s) {
-            indigo_logger(LOG_LEVEL_WARNING, "Failed to get STAUT WPS settings");
+            indigo_log(LOG_CATEGORY_WPAS, LOG_LEVEL_WARNING, "Failed to get STAUT WPS settings");
         } else if (atoi(value) == WPS_ENABLE_NORMAL) {
             for (i = 0; i < STA_SETTING_NUM; i++) {
                 memset(cfg_item, 0, sizeof(cfg_item));
                 sprintf(cfg_item, "%s=%s\n", s[i].wkey, s[i].value);
                 strcat(buffer, cfg_item);
             }
-            indigo_logger(LOG_LEVEL_INFO, "STAUT Configure WPS");
+            indigo_log(LOG_CATEGORY_WPAS, LOG_LEVEL_INFO, "STAUT Configure WPS");
         } else {
-            indigo_logger(LOG_LEVEL_ERROR, "Invalid WPS TLV value: %d (TLV ID 0x%04x)", atoi(value), tlv->id);
+            indigo_log(LOG_CATEGORY_WPAS, LOG_LEVEL_ERROR, "Invalid WPS TLV value: %d (TLV ID 0x%04x)", atoi(value), tlv->id);
         }
     } else {
-        indigo_logger(LOG_LEVEL_WARNING, "No WSC TLV found. Failed to append STA WSC data");
+        indigo_log(LOG_CATEGORY_WPAS, LOG_LEVEL_WARNING, "No WSC TLV found. Failed to append STA WSC data");
     }
 
     len = strlen(buffer);
@@ -3769,19 +3913,27 @@ static int enable_wsc_sta_handler(struct packet_wrapper *req, struct packet_wrap
 
     /* Start wpa supplicant */
     memset(buffer, 0 ,sizeof(buffer));
-    sprintf(buffer, "%s -B -t -c %s -i %s -f /var/log/supplicant.log",
+    sprintf(buffer, "%s -t -c %s -i %s -f /var/log/supplicant.log",
         get_wpas_full_exec_path(),
         get_wpas_conf_file(),
         get_wireless_interface());
-    system(buffer);
-    sleep(2);
+    process_start(buffer);
 
-    status = TLV_VALUE_STATUS_OK;
-    message = TLV_VALUE_WPA_S_START_UP_OK;
+    /* Respond once wpa_supplicant answers on its control interface. Other requests are served meanwhile. */
+    if (indigo_request_defer_ready(get_wpas_ctrl_path(), get_wpas_exec_file(), wpas_start_up_ready) == 0) {
+        return 0;
+    }
+    return wpas_start_up_ready(req, resp);
+}
 
-done:
-    fill_wrapper_message_hdr(resp, API_CMD_RESPONSE, req->hdr.seq);
-    fill_wrapper_tlv_byte(resp, TLV_STATUS, status);
-    fill_wrapper_tlv_bytes(resp, TLV_MESSAGE, strlen(message), message);
+static int enable_wsc_sta_handler(struct packet_wrapper *req, struct packet_wrapper *resp) {
+#ifdef _OPENWRT_
+#else
+    system("rfkill unblock wlan");
+    sleep(1);
+#endif
+
+    /* Continue once wpa_supplicant has exited. Other requests are served meanwhile. */
+    process_stop_async(get_wpas_exec_file(), indigo_request_event, indigo_request_defer_event(enable_wsc_sta_stopped));
     return 0;
 }
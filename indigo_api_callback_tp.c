@@ -23,11 +23,15 @@
 #include <arpa/inet.h>
 
 #include "indigo_api.h"
+#include "indigo_log.h"
+#include "indigo_process.h"
 #include "vendor_specific.h"
 #include "utils.h"
+#include "indigo_request.h"
 #include "wpa_ctrl.h"
 #include "indigo_api_callback.h"
 #include "hs2_profile.h"
+#include "eloop.h"
 
 struct sta_platform_config sta_hw_config = {PHYMODE_AUTO, CHWIDTH_AUTO, false, false};
 struct interface_info* band_transmitter[16];
@@ -37,7 +41,6 @@ struct interface_info* band_first_wlan[16];
 int rrm = 0, he_mu_edca = 0;
 #endif
 
-extern struct sockaddr_in *tool_addr;
 extern wps_setting* get_vendor_wps_settings_for_ie_frag_test(enum wps_device_role role);
 int additional_tp_id = 0;
 
@@ -54,6 +57,9 @@ void register_apis() {
     register_api(API_START_DHCP, NULL, start_dhcp_handler);
     register_api(API_STOP_DHCP, NULL, stop_dhcp_handler);
     register_api(API_GET_WSC_CRED, NULL, get_wsc_cred_handler);
+    register_api(API_GET_EVENT_LOOP_STATS, NULL, get_event_loop_stats_handler);
+    register_api(API_BATCH_COMMANDS, NULL, indigo_request_batch_commands);
+    register_api(API_SET_LOG_LEVEL, NULL, set_log_level_handler);
     register_api(API_STA_SEND_ICON_REQ, NULL, send_sta_icon_req_handler);
     /* AP */
     register_api(API_AP_START_UP, NULL, start_ap_handler);
@@ -86,10 +92,92 @@ static int get_control_app_handler(struct packet_wrapper *req, struct packet_wra
     return 0;
 }
 
+static int get_event_loop_stats_handler(struct packet_wrapper *req, struct packet_wrapper *resp) {
+    int len, pos, status = TLV_VALUE_STATUS_OK;
+    char *message = TLV_VALUE_OK;
+    /* Statistics are split to TLVs of up to 255 bytes and fit one response packet.
+     * The extended encoding carries them whole in one TLV. */
+    char buffer[L_BUFFER_LEN];
+    int extended = req->hdr.version == API_VERSION_EXTENDED;
+    int size = extended ? sizeof(buffer) : 5 * (TLV_VALUE_SIZE - 1) + 1;
+    long long action;
+
+    /* TLV: EVENT_LOOP_STATS_ACTION (Optional) */
+    if (find_wrapper_tlv_by_id(req, TLV_EVENT_LOOP_STATS_ACTION)) {
+        action = get_wrapper_tlv_int(req, TLV_EVENT_LOOP_STATS_ACTION);
+        switch (action) {
+        case EVENT_LOOP_STATS_DISABLE:
+            eloop_stats_enable(0);
+            break;
+        case EVENT_LOOP_STATS_ENABLE:
+            if (eloop_stats_enable(1) < 0) {
+                status = TLV_VALUE_STATUS_NOT_OK;
+                message = TLV_VALUE_NOT_OK;
+            }
+            break;
+        case EVENT_LOOP_STATS_RESET:
+            eloop_stats_reset();
+            break;
+        default:
+            indigo_log(LOG_CATEGORY_ELOOP, LOG_LEVEL_ERROR, "Unknown event loop stats action %lld", action);
+            status = TLV_VALUE_STATUS_NOT_OK;
+            message = TLV_VALUE_NOT_OK;
+            break;
+        }
+    }
+
+    fill_wrapper_message_hdr(resp, API_CMD_RESPONSE, req->hdr.seq);
+    fill_wrapper_tlv_byte(resp, TLV_STATUS, status);
+    fill_wrapper_tlv_bytes(resp, TLV_MESSAGE, strlen(message), message);
+    len = eloop_stats_dump(buffer, size, 0);
+    len += indigo_request_batch_dump(buffer + len, size - len);
+    if (extended) {
+        fill_wrapper_tlv_bytes(resp, TLV_EVENT_LOOP_STATS, len, buffer);
+        return 0;
+    }
+    for (pos = 0; pos < len; pos += TLV_VALUE_SIZE - 1) {
+        fill_wrapper_tlv_bytes(resp, TLV_EVENT_LOOP_STATS,
+            len - pos < TLV_VALUE_SIZE - 1 ? len - pos : TLV_VALUE_SIZE - 1, buffer + pos);
+    }
+    return 0;
+}
+
+static int set_log_level_handler(struct packet_wrapper *req, struct packet_wrapper *resp) {
+    int len, category = LOG_CATEGORY_ALL, status = TLV_VALUE_STATUS_OK;
+    char *message = TLV_VALUE_OK;
+    char name[TLV_VALUE_SIZE], buffer[S_BUFFER_LEN];
+    long long level;
+
+    /* TLV: LOG_CATEGORY (Optional). All the categories when it is missing. */
+    if (get_wrapper_tlv_string(req, TLV_LOG_CATEGORY, name, sizeof(name)) > 0) {
+        category = indigo_log_category_by_name(name);
+    }
+
+    /* TLV: LOG_LEVEL (Optional). The levels are only returned when it is missing. */
+    if (category < LOG_CATEGORY_ALL) {
+        indigo_logger(LOG_LEVEL_ERROR, "Unknown log category %s", name);
+        status = TLV_VALUE_STATUS_NOT_OK;
+        message = TLV_VALUE_NOT_OK;
+    } else if (find_wrapper_tlv_by_id(req, TLV_LOG_LEVEL)) {
+        level = get_wrapper_tlv_int(req, TLV_LOG_LEVEL);
+        indigo_log_set_level(category, level);
+        indigo_logger(LOG_LEVEL_NOTICE, "Log level of %s set to %lld",
+                      category == LOG_CATEGORY_ALL ? "all" : name, level);
+    }
+
+    fill_wrapper_message_hdr(resp, API_CMD_RESPONSE, req->hdr.seq);
+    fill_wrapper_tlv_byte(resp, TLV_STATUS, status);
+    fill_wrapper_tlv_bytes(resp, TLV_MESSAGE, strlen(message), message);
+    len = indigo_log_levels_dump(buffer, sizeof(buffer));
+    fill_wrapper_tlv_bytes(resp, TLV_LOG_LEVELS, len, buffer);
+    return 0;
+}
+
 /*
  * void (*callback_fn)(void *), callback of active wlans iterator
  */
 void upload_wlan_hapd_conf(void *if_info) {
+    struct sockaddr_in *tool_addr = get_tool_addr();
     struct interface_info *wlan = (struct interface_info *) if_info;
     char buffer[S_BUFFER_LEN], conf_name[128];
     int id = 0;
@@ -117,61 +205,27 @@ void upload_wlan_hapd_conf(void *if_info) {
 }
 
 // RESP: {<ResponseTLV.STATUS: 40961>: '0', <ResponseTLV.MESSAGE: 40960>: 'AP stop completed : Hostapd service is inactive.'} 
-static int stop_ap_handler(struct packet_wrapper *req, struct packet_wrapper *resp) {
+static int stop_ap_stopped(struct packet_wrapper *req, struct packet_wrapper *resp) {
+    struct sockaddr_in *tool_addr = get_tool_addr();
     int len = 0, reset = 0, id = 0;
-    char buffer[S_BUFFER_LEN], reset_type[16], log_name[128];
-    char *parameter[] = {"pidof", get_hapd_exec_file(), NULL};
+    char buffer[S_BUFFER_LEN], log_name[128];
     char *message = NULL;
     int status = TLV_VALUE_STATUS_NOT_OK;
-    struct tlv_hdr *tlv = NULL;
 
     /* TLV: RESET_TYPE */
-    tlv = find_wrapper_tlv_by_id(req, TLV_RESET_TYPE);
-    memset(reset_type, 0, sizeof(reset_type));
-    if (tlv) {
-        memcpy(reset_type, tlv->value, tlv->len);
-        reset = atoi(reset_type);
-        indigo_logger(LOG_LEVEL_DEBUG, "Reset Type: %d", reset);
+    if (find_wrapper_tlv_by_id(req, TLV_RESET_TYPE)) {
+        reset = get_wrapper_tlv_int(req, TLV_RESET_TYPE);
     }
 
-    if (reset == RESET_TYPE_INIT) {
-        open_tc_app_log();
-        len = unlink(get_hapd_conf_file());
-        if (len) {
-            indigo_logger(LOG_LEVEL_DEBUG, "Failed to remove hostapd.conf");
-        }
-
-        /* clean the log */
-        snprintf(buffer, sizeof(buffer), "rm -rf %s >/dev/null 2>/dev/null", HAPD_LOG_FILE);
-        system(buffer);
-        memset(buffer, 0, sizeof(buffer));
-#ifdef _WTS_OPENWRT_
-        /* Reset uci configurations */
-        snprintf(buffer, sizeof(buffer), "uci -q delete wireless.wifi0.country");
-        system(buffer);
-
-        snprintf(buffer, sizeof(buffer), "uci -q delete wireless.wifi1.country");
-        system(buffer);
-
-        system("uci -q delete wireless.@wifi-iface[0].own_ie_override");
-        system("uci -q delete wireless.@wifi-iface[1].own_ie_override");
-#endif
-    }
-
-    memset(buffer, 0, sizeof(buffer));
-    sprintf(buffer, "killall %s 1>/dev/null 2>/dev/null", get_hapd_exec_file());
-    system(buffer);
-    sleep(2);
-
 #ifndef _OPENWRT_
     len = system("rfkill unblock wlan");
     if (len) {
-        indigo_logger(LOG_LEVEL_DEBUG, "Failed to run rfkill unblock wlan");
+        indigo_log(LOG_CATEGORY_HAPD, LOG_LEVEL_DEBUG, "Failed to run rfkill unblock wlan");
     }
     sleep(1);
 #endif
 
-    len = pipe_command(buffer, sizeof(buffer), "/bin/pidof", parameter);
+    len = process_find(get_hapd_exec_file());
     if (len) {
         message = TLV_VALUE_HOSTAPD_STOP_NOT_OK;
     } else {
@@ -182,13 +236,10 @@ static int stop_ap_handler(struct packet_wrapper *req, struct packet_wrapper *re
     /* Test case teardown case */
     if (reset == RESET_TYPE_TEARDOWN) {
         /* TLV: ADDITIONAL_TEST_PLATFORM_ID */
-        tlv = find_wrapper_tlv_by_id(req, TLV_ADDITIONAL_TEST_PLATFORM_ID);
-        memset(buffer, 0, sizeof(buffer));
-        if (tlv) {
-            memcpy(buffer, tlv->value, tlv->len);
-            additional_tp_id = atoi(buffer);
+        if (find_wrapper_tlv_by_id(req, TLV_ADDITIONAL_TEST_PLATFORM_ID)) {
+            additional_tp_id = get_wrapper_tlv_int(req, TLV_ADDITIONAL_TEST_PLATFORM_ID);
             id = additional_tp_id & 0x0F;
-            indigo_logger(LOG_LEVEL_DEBUG, "Additional AP test platform id: %d", id);
+            indigo_log(LOG_CATEGORY_HAPD, LOG_LEVEL_DEBUG, "Additional AP test platform id: %d", id);
         }
 
         /* Send hostapd conf and log to Tool */
@@ -216,7 +267,7 @@ static int stop_ap_handler(struct packet_wrapper *req, struct packet_wrapper *re
                 http_file_post(inet_ntoa(tool_addr->sin_addr), TOOL_POST_PORT, HAPD_UPLOAD_API, HAPD_LOG_FILE);
             }
         } else {
-            indigo_logger(LOG_LEVEL_ERROR, "Can't get tool IP address");
+            indigo_log(LOG_CATEGORY_HAPD, LOG_LEVEL_ERROR, "Can't get tool IP address");
         }
 
         reset_bridge(get_wlans_bridge());
@@ -241,6 +292,45 @@ static int stop_ap_handler(struct packet_wrapper *req, struct packet_wrapper *re
     return 0;
 }
 
+static int stop_ap_handler(struct packet_wrapper *req, struct packet_wrapper *resp) {
+    int len = 0, reset = 0;
+    char buffer[S_BUFFER_LEN];
+
+    /* TLV: RESET_TYPE */
+    if (find_wrapper_tlv_by_id(req, TLV_RESET_TYPE)) {
+        reset = get_wrapper_tlv_int(req, TLV_RESET_TYPE);
+        indigo_log(LOG_CATEGORY_HAPD, LOG_LEVEL_DEBUG, "Reset Type: %d", reset);
+    }
+
+    if (reset == RESET_TYPE_INIT) {
+        open_tc_app_log();
+        len = unlink(get_hapd_conf_file());
+        if (len) {
+            indigo_log(LOG_CATEGORY_HAPD, LOG_LEVEL_DEBUG, "Failed to remove hostapd.conf");
+        }
+
+        /* clean the log */
+        snprintf(buffer, sizeof(buffer), "rm -rf %s >/dev/null 2>/dev/null", HAPD_LOG_FILE);
+        system(buffer);
+        memset(buffer, 0, sizeof(buffer));
+#ifdef _WTS_OPENWRT_
+        /* Reset uci configurations */
+        snprintf(buffer, sizeof(buffer), "uci -q delete wireless.wifi0.country");
+        system(buffer);
+
+        snprintf(buffer, sizeof(buffer), "uci -q delete wireless.wifi1.country");
+        system(buffer);
+
+        system("uci -q delete wireless.@wifi-iface[0].own_ie_override");
+        system("uci -q delete wireless.@wifi-iface[1].own_ie_override");
+#endif
+    }
+
+    /* The response is sent once the daemon has exited. Other requests are served meanwhile. */
+    process_stop_async(get_hapd_exec_file(), indigo_request_event, indigo_request_defer_event(stop_ap_stopped));
+    return 0;
+}
+
 #ifdef _RESERVED_
 /* The function is reserved for the defeault hostapd config */
 #define HOSTAPD_DEFAULT_CONFIG_SSID                 "QuickTrack"
@@ -320,7 +410,6 @@ static int generate_hostapd_config(char *output, int output_size, struct packet_
     struct tlv_hdr *tlv = NULL;
     int has_owe = 0, enable_hs20 = 0;
     struct tlv_to_profile *profile = NULL;
-    int semicolon_list_size = sizeof(semicolon_list) / sizeof(struct tlv_to_config_name);
     int hs20_icons_attached = 0;
     int enable_wps = 0, is_g_mode = 0, is_a_mode = 0, use_mbss = 0;
     int bss_load_tlv = 0;
@@ -356,7 +445,7 @@ static int generate_hostapd_config(char *output, int output_size, struct packet_
         /* This is used when hostapd will use multiple lines to 
          * configure multiple items in the same configuration parameter
          * (use semicolon to separate multiple configurations) */
-        cfg = find_generic_tlv_config(tlv->id, semicolon_list, semicolon_list_size);
+        cfg = find_semicolon_tlv_config(tlv->id);
         if (cfg) {
             char *token = NULL, *delimit = ";";
 
@@ -409,7 +498,7 @@ static int generate_hostapd_config(char *output, int output_size, struct packet_
             }
 
             if (atoi(buffer) > profile->size) {
-                indigo_logger(LOG_LEVEL_ERROR, "profile index out of bound!: %d, array_size:%d", atoi(buffer), profile->size);
+                indigo_log(LOG_CATEGORY_HAPD, LOG_LEVEL_ERROR, "profile index out of bound!: %d, array_size:%d", atoi(buffer), profile->size);
             } else {
                 hs2_config = (char *)profile->profile[atoi(buffer)];
             }
@@ -436,7 +525,7 @@ static int generate_hostapd_config(char *output, int output_size, struct packet_
             else
                 s = get_vendor_wps_settings(WPS_AP);
             if (!s) {
-                indigo_logger(LOG_LEVEL_ERROR, "Failed to get AP WPS settings.");
+                indigo_log(LOG_CATEGORY_HAPD, LOG_LEVEL_ERROR, "Failed to get AP WPS settings.");
                 continue;
             }
             if (atoi(buffer) == WPS_ENABLE_OOB) {
@@ -446,7 +535,7 @@ static int generate_hostapd_config(char *output, int output_size, struct packet_
                     sprintf(cfg_item, "%s=%s\n", s[j].wkey, s[j].value);
                     strcat(output, cfg_item);
                 }
-                indigo_logger(LOG_LEVEL_INFO, "AP Configure WPS: OOB.");
+                indigo_log(LOG_CATEGORY_HAPD, LOG_LEVEL_INFO, "AP Configure WPS: OOB.");
             } else if (atoi(buffer) == WPS_ENABLE_NORMAL) {
                 /* WPS Normal: Configure manually. */
                 for (j = 0; j < AP_SETTING_NUM; j++) {
@@ -464,15 +553,15 @@ static int generate_hostapd_config(char *output, int output_size, struct packet_
                     }
                     strcat(output, cfg_item);
                 }
-                indigo_logger(LOG_LEVEL_INFO, "AP Configure WPS: Manually Configured.");
+                indigo_log(LOG_CATEGORY_HAPD, LOG_LEVEL_INFO, "AP Configure WPS: Manually Configured.");
             } else {
-                indigo_logger(LOG_LEVEL_ERROR, "Unknown WPS TLV value: %d (TLV ID 0x%04x)", atoi(buffer), tlv->id);
+                indigo_log(LOG_CATEGORY_HAPD, LOG_LEVEL_ERROR, "Unknown WPS TLV value: %d (TLV ID 0x%04x)", atoi(buffer), tlv->id);
             }
             continue;
         }
         cfg = find_tlv_config(tlv->id);
         if (!cfg) {
-            indigo_logger(LOG_LEVEL_ERROR, "Unknown AP configuration name: TLV ID 0x%04x", tlv->id);
+            indigo_log(LOG_CATEGORY_HAPD, LOG_LEVEL_ERROR, "Unknown AP configuration name: TLV ID 0x%04x", tlv->id);
             continue;
         }
 
@@ -509,15 +598,11 @@ static int generate_hostapd_config(char *output, int output_size, struct packet_
         }
 
         if (tlv->id == TLV_CHANNEL) {
-            memset(value, 0, sizeof(value));
-            memcpy(value, tlv->value, tlv->len);
-            channel = atoi(value);
+            channel = get_wrapper_tlv_int(wrapper, tlv->id);
         }
 
         if (tlv->id == TLV_HE_OPER_CHWIDTH || tlv->id == TLV_VHT_OPER_CHWIDTH) {
-            memset(value, 0, sizeof(value));
-            memcpy(value, tlv->value, tlv->len);
-            chwidth = atoi(value);
+            chwidth = get_wrapper_tlv_int(wrapper, tlv->id);
         }
 
         if (tlv->id == TLV_HT_CAPB && strstr(tlv->value, "40")) {
@@ -554,17 +639,14 @@ static int generate_hostapd_config(char *output, int output_size, struct packet_
             struct bss_identifier_info bss_info;
             struct interface_info *wlan;
             int bss_identifier;
-            char bss_identifier_str[8];
             memset(&bss_info, 0, sizeof(bss_info));
-            memset(bss_identifier_str, 0, sizeof(bss_identifier_str));
-            memcpy(bss_identifier_str, tlv->value, tlv->len);
-            bss_identifier = atoi(bss_identifier_str);
+            bss_identifier = get_wrapper_tlv_int(wrapper, TLV_OWE_TRANSITION_BSS_IDENTIFIER);
             parse_bss_identifier(bss_identifier, &bss_info);
             wlan = get_wireless_interface_info(bss_info.band, bss_info.identifier);
             if (NULL == wlan) {
                 wlan = assign_wireless_interface_info(&bss_info);
             }
-            indigo_logger(LOG_LEVEL_DEBUG, "TLV_OWE_TRANSITION_BSS_IDENTIFIER: TLV_BSS_IDENTIFIER 0x%x identifier %d mapping ifname %s\n", 
+            indigo_log(LOG_CATEGORY_HAPD, LOG_LEVEL_DEBUG, "TLV_OWE_TRANSITION_BSS_IDENTIFIER: TLV_BSS_IDENTIFIER 0x%x identifier %d mapping ifname %s\n", 
                     bss_identifier,
                     bss_info.identifier,
                     wlan ? wlan->ifname : "n/a"
@@ -613,7 +695,7 @@ static int generate_hostapd_config(char *output, int output_size, struct packet_
     }
 
     if (ctrl_iface == 0) {
-        indigo_logger(LOG_LEVEL_ERROR, "No Remote UDP ctrl interface TLV for TP");
+        indigo_log(LOG_CATEGORY_HAPD, LOG_LEVEL_ERROR, "No Remote UDP ctrl interface TLV for TP");
         return 0;
     }
 #if HOSTAPD_SUPPORT_MBSSID
@@ -701,12 +783,12 @@ static int generate_hostapd_config(char *output, int output_size, struct packet_
 // RESP: {<ResponseTLV.STATUS: 40961>: '0', <ResponseTLV.MESSAGE: 40960>: 'DUT configured as AP : Configuration file created'} 
 static int configure_ap_handler(struct packet_wrapper *req, struct packet_wrapper *resp) {
     int band, len;
-    char hw_mode_str[8], op_class[8];
+    char hw_mode_str[8];
+    int op_class;
     char buffer[L_BUFFER_LEN], ifname[S_BUFFER_LEN];
     char *message = "DUT configured as AP : Configuration file created";
     struct tlv_hdr *tlv;
     struct interface_info* wlan = NULL;
-    char bss_identifier_str[16];
     struct bss_identifier_info bss_info;
     int bss_identifier = 0;
 
@@ -715,9 +797,7 @@ static int configure_ap_handler(struct packet_wrapper *req, struct packet_wrappe
     memset(&bss_info, 0, sizeof(bss_info));
     if (tlv) {
         /* Multiple wlans configure must carry TLV_BSS_IDENTIFIER */
-        memset(bss_identifier_str, 0, sizeof(bss_identifier_str));
-        memcpy(bss_identifier_str, tlv->value, tlv->len);
-        bss_identifier = atoi(bss_identifier_str);
+        bss_identifier = get_wrapper_tlv_int(req, TLV_BSS_IDENTIFIER);
         parse_bss_identifier(bss_identifier, &bss_info);
         wlan = get_wireless_interface_info(bss_info.band, bss_info.identifier);
         if (NULL == wlan) {
@@ -729,7 +809,7 @@ static int configure_ap_handler(struct packet_wrapper *req, struct packet_wrappe
                 band_transmitter[bss_info.band] = wlan;
             }
         }
-        indigo_logger(LOG_LEVEL_DEBUG, "TLV_BSS_IDENTIFIER 0x%x band %d multiple_bssid %d transmitter %d identifier %d\n", 
+        indigo_log(LOG_CATEGORY_HAPD, LOG_LEVEL_DEBUG, "TLV_BSS_IDENTIFIER 0x%x band %d multiple_bssid %d transmitter %d identifier %d\n", 
                bss_identifier,
                bss_info.band,
                bss_info.mbssid_enable,
@@ -745,13 +825,9 @@ static int configure_ap_handler(struct packet_wrapper *req, struct packet_wrappe
             memcpy(hw_mode_str, tlv->value, tlv->len);
             if (!strncmp(hw_mode_str, "a", 1)) {
                 band = BAND_5GHZ;
-                tlv = find_wrapper_tlv_by_id(req, TLV_OP_CLASS);
-                if (tlv) {
-                    memset(op_class, 0, sizeof(op_class));
-                    memcpy(op_class, tlv->value, tlv->len);
-                    if (atoi(op_class) >= OP_CLASS_6G_20 && atoi(op_class) <= OP_CLASS_6G_160)
-                        band = BAND_6GHZ;
-                }
+                op_class = get_wrapper_tlv_int(req, TLV_OP_CLASS);
+                if (op_class >= OP_CLASS_6G_20 && op_class <= OP_CLASS_6G_160)
+                    band = BAND_6GHZ;
             } else {
                 band = BAND_24GHZ;
             }
@@ -762,7 +838,7 @@ static int configure_ap_handler(struct packet_wrapper *req, struct packet_wrappe
         }
     }
     if (wlan) {
-        indigo_logger(LOG_LEVEL_DEBUG, "ifname %s hostapd conf file %s\n", 
+        indigo_log(LOG_CATEGORY_HAPD, LOG_LEVEL_DEBUG, "ifname %s hostapd conf file %s\n", 
                wlan ? wlan->ifname : "n/a",
                wlan ? wlan->hapd_conf_file: "n/a"
                );
@@ -772,13 +848,13 @@ static int configure_ap_handler(struct packet_wrapper *req, struct packet_wrappe
 #if HOSTAPD_SUPPORT_MBSSID
             if (bss_info.mbssid_enable && !bss_info.transmitter) {
                 if (band_transmitter[bss_info.band]) {
-                    indigo_logger(LOG_LEVEL_DEBUG, "Append bss conf to %s", band_transmitter[bss_info.band]->hapd_conf_file);
+                    indigo_log(LOG_CATEGORY_HAPD, LOG_LEVEL_DEBUG, "Append bss conf to %s", band_transmitter[bss_info.band]->hapd_conf_file);
                     append_file(band_transmitter[bss_info.band]->hapd_conf_file, buffer, len);
                 }
                 memset(wlan->hapd_conf_file, 0, sizeof(wlan->hapd_conf_file));
             }
             else if (band_first_wlan[bss_info.band]) {
-                indigo_logger(LOG_LEVEL_DEBUG, "Append bss conf to %s", band_first_wlan[bss_info.band]->hapd_conf_file);
+                indigo_log(LOG_CATEGORY_HAPD, LOG_LEVEL_DEBUG, "Append bss conf to %s", band_first_wlan[bss_info.band]->hapd_conf_file);
                 append_file(band_first_wlan[bss_info.band]->hapd_conf_file, buffer, len);
                 memset(wlan->hapd_conf_file, 0, sizeof(wlan->hapd_conf_file));
             }
@@ -807,57 +883,82 @@ static int configure_ap_handler(struct packet_wrapper *req, struct packet_wrappe
     return 0;
 }
 
+static int start_ap_done(struct packet_wrapper *req, struct packet_wrapper *resp, int status) {
+    char *message = status == TLV_VALUE_STATUS_OK ? TLV_VALUE_HOSTAPD_START_OK : TLV_VALUE_HOSTAPD_START_NOT_OK;
+
+    bridge_init(get_wlans_bridge());
+
+    fill_wrapper_message_hdr(resp, API_CMD_RESPONSE, req->hdr.seq);
+    fill_wrapper_tlv_byte(resp, TLV_STATUS, status);
+    fill_wrapper_tlv_bytes(resp, TLV_MESSAGE, strlen(message), message);
+
+    return 0;
+}
+
+static int start_ap_ready(struct packet_wrapper *req, struct packet_wrapper *resp) {
+    int status = TLV_VALUE_STATUS_NOT_OK;
+
+    /* Each BSS answered before the deadline, and hostapd didn't exit meanwhile */
+    if (indigo_request_event_result() >= 0 && process_find(get_hapd_exec_file())) {
+        status = TLV_VALUE_STATUS_OK;
+    }
+    return start_ap_done(req, resp, status);
+}
+
+/* Set when the request waits for hostapd on the control interface of a BSS */
+static int start_ap_deferred;
+
+static void start_ap_wait_ready(void *if_info) {
+    if (indigo_request_defer_ready(get_hapd_ctrl_path_by_id((struct interface_info *) if_info), get_hapd_exec_file(),
+                                   start_ap_ready) == 0) {
+        start_ap_deferred = 1;
+    }
+}
+
 // RESP: {<ResponseTLV.STATUS: 40961>: '0', <ResponseTLV.MESSAGE: 40960>: 'AP is up : Hostapd service is active'} 
 static int start_ap_handler(struct packet_wrapper *req, struct packet_wrapper *resp) {
-    char *message = TLV_VALUE_HOSTAPD_START_OK;
-    char buffer[S_BUFFER_LEN], g_ctrl_iface[64], log_level[TLV_VALUE_SIZE];
-    int len;
+    char buffer[S_BUFFER_LEN], g_ctrl_iface[64];
+    int len, log_level = -1;
     struct tlv_hdr *tlv;
     int swap_hostapd = 0;
     struct bss_identifier_info bss_info;
-    char bss_identifier_str[16];
     int bss_identifier = 0;
     struct interface_info* wlan = NULL;
 
     sprintf(g_ctrl_iface, "%s", get_hapd_global_ctrl_path());
 
     /* TLV: DEBUG_LEVEL */
-    tlv = find_wrapper_tlv_by_id(req, TLV_DEBUG_LEVEL);
-    memset(log_level, 0, sizeof(log_level));
-    if (tlv) {
-        memcpy(log_level, tlv->value, tlv->len);
+    if (find_wrapper_tlv_by_id(req, TLV_DEBUG_LEVEL)) {
+        log_level = get_wrapper_tlv_int(req, TLV_DEBUG_LEVEL);
     }
 
     memset(&bss_info, 0, sizeof(bss_info));
     tlv = find_wrapper_tlv_by_id(req, TLV_BSS_IDENTIFIER);
     if (tlv) {
-        memset(bss_identifier_str, 0, sizeof(bss_identifier_str));
-        memcpy(bss_identifier_str, tlv->value, tlv->len);
-        bss_identifier = atoi(bss_identifier_str);
+        bss_identifier = get_wrapper_tlv_int(req, TLV_BSS_IDENTIFIER);
         parse_bss_identifier(bss_identifier, &bss_info);
 
-        indigo_logger(LOG_LEVEL_DEBUG, "TLV_BSS_IDENTIFIER 0x%x identifier %d band %d\n",
+        indigo_log(LOG_CATEGORY_HAPD, LOG_LEVEL_DEBUG, "TLV_BSS_IDENTIFIER 0x%x identifier %d band %d\n",
                bss_identifier,
                bss_info.identifier,
                bss_info.band);
         wlan = get_wireless_interface_info(bss_info.band, bss_info.identifier);
     }
 
-    if (strlen(log_level)) {
-        set_hostapd_debug_level(get_debug_level(atoi(log_level)));
+    if (log_level >= 0) {
+        set_hostapd_debug_level(get_debug_level(log_level));
     }
 
 #ifdef _OPENWRT_
 #ifdef _WTS_OPENWRT_
     // Apply radio configurations via native hostpad
-    system("hostapd -g /var/run/hostapd/global -B -P /var/run/hostapd-global.pid");
+    process_start("hostapd -g /var/run/hostapd/global -P /var/run/hostapd-global.pid");
     sleep(1);
     system("wifi down");
     sleep(2);
     system("wifi up");
     sleep(3);
-    system("killall hostapd >/dev/null 2>/dev/null");
-    sleep(2);
+    process_stop("hostapd");
 
     // Apply runtime configuratoins before hostapd starts.
     // DFS wait again if apply this after hostapd starts.
@@ -880,23 +981,30 @@ static int start_ap_handler(struct packet_wrapper *req, struct packet_wrapper *r
     system(buffer);
 #endif
 #endif
-    sprintf(buffer, "%s -B -t -P /var/run/hostapd.pid -g %s %s -f %s %s",
+    sprintf(buffer, "%s -t -P /var/run/hostapd.pid -g %s %s -f %s %s",
         get_hapd_full_exec_path(),
         g_ctrl_iface,
         get_hostapd_debug_arguments(),
         HAPD_LOG_FILE,
         wlan ? wlan->hapd_conf_file :get_all_hapd_conf_files(&swap_hostapd));
-    indigo_logger(LOG_LEVEL_DEBUG, "%s", buffer);
-    len = system(buffer);
-    sleep(1);
-
-    bridge_init(get_wlans_bridge());
-
-    fill_wrapper_message_hdr(resp, API_CMD_RESPONSE, req->hdr.seq);
-    fill_wrapper_tlv_byte(resp, TLV_STATUS, len == 0 ? TLV_VALUE_STATUS_OK : TLV_VALUE_STATUS_NOT_OK);
-    fill_wrapper_tlv_bytes(resp, TLV_MESSAGE, strlen(message), message);
+    indigo_log(LOG_CATEGORY_HAPD, LOG_LEVEL_DEBUG, "%s", buffer);
+    len = process_start(buffer) < 0;
+    if (len) {
+        return start_ap_done(req, resp, TLV_VALUE_STATUS_NOT_OK);
+    }
 
-    return 0;
+    /* Continue once hostapd answers on the control interface of the BSS, or of each one. Other requests
+     * are served meanwhile. */
+    start_ap_deferred = 0;
+    if (wlan) {
+        start_ap_wait_ready(wlan);
+    } else {
+        iterate_all_wlan_interfaces(start_ap_wait_ready);
+    }
+    if (start_ap_deferred) {
+        return 0;
+    }
+    return start_ap_ready(req, resp);
 }
 
 // Bytes to DUT : 01 50 06 00 ed ff ff 00 55 0c 31 39 32 2e 31 36 38 2e 31 30 2e 33
@@ -952,43 +1060,36 @@ static int assign_static_ip_handler(struct packet_wrapper *req, struct packet_wr
 static int get_mac_addr_handler(struct packet_wrapper *req, struct packet_wrapper *resp) {
     char mac_addr[S_BUFFER_LEN];
     struct bss_identifier_info bss_info;
-    char bss_identifier_str[16];
     int bss_identifier = 0;
     struct tlv_hdr *tlv;
     struct interface_info* wlan = NULL;
     int status = TLV_VALUE_STATUS_NOT_OK;
     char *message = TLV_VALUE_NOT_OK;
-    char role[16];
 
     memset(&bss_info, 0, sizeof(bss_info));
     tlv = find_wrapper_tlv_by_id(req, TLV_BSS_IDENTIFIER);
     if (tlv) {
-        memset(bss_identifier_str, 0, sizeof(bss_identifier_str));
-        memcpy(bss_identifier_str, tlv->value, tlv->len);
-        bss_identifier = atoi(bss_identifier_str);
+        bss_identifier = get_wrapper_tlv_int(req, TLV_BSS_IDENTIFIER);
         parse_bss_identifier(bss_identifier, &bss_info);
 
-        indigo_logger(LOG_LEVEL_DEBUG, "TLV_BSS_IDENTIFIER 0x%x identifier %d band %d\n",
+        indigo_log(LOG_CATEGORY_NETIF, LOG_LEVEL_DEBUG, "TLV_BSS_IDENTIFIER 0x%x identifier %d band %d\n",
                bss_identifier,
                bss_info.identifier,
                bss_info.band);
         wlan = get_wireless_interface_info(bss_info.band, bss_info.identifier);
         if (wlan) {
             get_mac_address(mac_addr, sizeof(mac_addr), wlan->ifname);
-            indigo_logger(LOG_LEVEL_DEBUG, "Get mac_addr %s\n", mac_addr);
+            indigo_log(LOG_CATEGORY_NETIF, LOG_LEVEL_DEBUG, "Get mac_addr %s\n", mac_addr);
             status = TLV_VALUE_STATUS_OK;
             message = TLV_VALUE_OK;
         } 
     } else {
         /* TLV: TLV_ROLE */
-        memset(role, 0, sizeof(role));
-        tlv = find_wrapper_tlv_by_id(req, TLV_ROLE);
-        if (tlv) {
-            memcpy(role, tlv->value, tlv->len);
-            if (atoi(role) == DUT_TYPE_P2PUT) {
+        if (find_wrapper_tlv_by_id(req, TLV_ROLE)) {
+            if (get_wrapper_tlv_int(req, TLV_ROLE) == DUT_TYPE_P2PUT) {
                 /* Get P2P GO/Client or Device MAC */
                 if (get_p2p_mac_addr(mac_addr, sizeof(mac_addr))) {
-                    indigo_logger(LOG_LEVEL_ERROR, "Failed to get TP P2P MAC address!");
+                    indigo_log(LOG_CATEGORY_NETIF, LOG_LEVEL_ERROR, "Failed to get TP P2P MAC address!");
                     get_mac_address(mac_addr, sizeof(mac_addr), get_wireless_interface());
                 }
             }
@@ -1018,7 +1119,7 @@ static int stop_loopback_data_handler(struct packet_wrapper *req, struct packet_
     int recvd, sent;
 
     recvd = stop_loopback_data(&sent);
-    indigo_logger(LOG_LEVEL_INFO, "Stop continuous loopdata data, send: %d receive: %d",
+    indigo_log(LOG_CATEGORY_LOOPBACK, LOG_LEVEL_INFO, "Stop continuous loopdata data, send: %d receive: %d",
                   sent, recvd);
     snprintf(recv_count, sizeof(recv_count), "%d", recvd);
     snprintf(send_count, sizeof(send_count), "%d", sent);
@@ -1032,64 +1133,29 @@ static int stop_loopback_data_handler(struct packet_wrapper *req, struct packet_
 }
 
 static int send_loopback_data_handler(struct packet_wrapper *req, struct packet_wrapper *resp) {
-    struct tlv_hdr *tlv;
-    char dst_ip[64];
-    char dut_port[32];
-    char rate[16], pkt_count[16], pkt_size[16], recv_count[16], pkt_type[16];
+    char dst_ip[INET_ADDRSTRLEN];
+    char recv_count[16], pkt_type[16];
+    unsigned int addr;
     int status = TLV_VALUE_STATUS_NOT_OK, recvd = 0;
+    int dut_port, pkt_count, pkt_size;
+    double rate;
     char *message = TLV_VALUE_SEND_LOOPBACK_DATA_NOT_OK;
 
-    /* TLV: TLV_DUT_IP_ADDRESS */
-    memset(dst_ip, 0, sizeof(dst_ip));
-    tlv = find_wrapper_tlv_by_id(req, TLV_DUT_IP_ADDRESS);
-    if (tlv) {
-        memcpy(dst_ip, tlv->value, tlv->len);
-    } else {
-        /* TLV: TLV_TP_IP_ADDRESS */
-        tlv = find_wrapper_tlv_by_id(req, TLV_TP_IP_ADDRESS);
-        if (tlv) {
-            memcpy(dst_ip, tlv->value, tlv->len);
-        } else {
-            goto done;
-        }
-    }
-    memset(dut_port, 0, sizeof(dut_port));
-    tlv = find_wrapper_tlv_by_id(req, TLV_DUT_UDP_PORT);
-    if (tlv) {
-        memcpy(dut_port, tlv->value, tlv->len);
-    } else {
+    /* TLV: TLV_DUT_IP_ADDRESS, or TLV_TP_IP_ADDRESS */
+    if (get_wrapper_tlv_ipv4(req, TLV_DUT_IP_ADDRESS, &addr) < 0 &&
+        get_wrapper_tlv_ipv4(req, TLV_TP_IP_ADDRESS, &addr) < 0) {
         goto done;
     }
-
-    memset(rate, 0, sizeof(rate));
-    tlv = find_wrapper_tlv_by_id(req, TLV_PACKET_RATE);
-    if (tlv) {
-        memcpy(rate, tlv->value, tlv->len);
-    } else {
-        snprintf(rate, sizeof(rate), "1");
-    }
-
-    memset(pkt_count, 0, sizeof(pkt_count));
-    tlv = find_wrapper_tlv_by_id(req, TLV_PACKET_COUNT);
-    if (tlv) {
-        memcpy(pkt_count, tlv->value, tlv->len);
-    } else {
-        snprintf(pkt_count, sizeof(pkt_count), "10");
-    }
-
-    memset(pkt_size, 0, sizeof(pkt_size));
-    tlv = find_wrapper_tlv_by_id(req, TLV_PACKET_SIZE);
-    if (tlv) {
-        memcpy(pkt_size, tlv->value, tlv->len);
-    } else {
-        snprintf(pkt_size, sizeof(pkt_size), "1000");
+    inet_ntop(AF_INET, &addr, dst_ip, sizeof(dst_ip));
+    if (find_wrapper_tlv_by_id(req, TLV_DUT_UDP_PORT) == NULL) {
+        goto done;
     }
+    dut_port = get_wrapper_tlv_int(req, TLV_DUT_UDP_PORT);
+    rate = get_wrapper_tlv_double(req, TLV_PACKET_RATE);
+    pkt_count = get_wrapper_tlv_int(req, TLV_PACKET_COUNT);
+    pkt_size = get_wrapper_tlv_int(req, TLV_PACKET_SIZE);
 
-    memset(pkt_type, 0, sizeof(pkt_type));
-    tlv = find_wrapper_tlv_by_id(req, TLV_PACKET_TYPE);
-    if (tlv) {
-        memcpy(pkt_type, tlv->value, tlv->len);
-    } else {
+    if (get_wrapper_tlv_string(req, TLV_PACKET_TYPE, pkt_type, sizeof(pkt_type)) < 0) {
         snprintf(pkt_type, sizeof(pkt_type), "udp");
     }
 
@@ -1100,13 +1166,13 @@ static int send_loopback_data_handler(struct packet_wrapper *req, struct packet_
     snprintf(recv_count, sizeof(recv_count), "0");
 
     if (strcmp(pkt_type, "icmp") == 0) {
-        recvd = send_icmp_data(dst_ip, atoi(pkt_count), atoi(pkt_size), atof(rate));
+        recvd = send_icmp_data(dst_ip, pkt_count, pkt_size, rate);
     } else if (strcmp(pkt_type, "udp") == 0) {
-        recvd = send_udp_data(dst_ip, atoi(dut_port), atoi(pkt_count), atoi(pkt_size), atof(rate));
+        recvd = send_udp_data(dst_ip, dut_port, pkt_count, pkt_size, rate);
     }
 
     /* -1 : Continuous data case uses timer and directly reply OK */
-    if (recvd > 0 || atoi(pkt_count) == -1) {
+    if (recvd > 0 || pkt_count == -1) {
         status = TLV_VALUE_STATUS_OK;
         message = TLV_VALUE_SEND_LOOPBACK_DATA_OK;
         snprintf(recv_count, sizeof(recv_count), "%d", recvd);
@@ -1131,17 +1197,17 @@ static int start_loopback_server(struct packet_wrapper *req, struct packet_wrapp
     /* Find network interface. If P2P Group or bridge exists, then use it. Otherwise, it uses the initiation value. */
     memset(local_ip, 0, sizeof(local_ip));
     if (get_p2p_group_if(if_name, sizeof(if_name)) == 0 && find_interface_ip(local_ip, sizeof(local_ip), if_name)) {
-        indigo_logger(LOG_LEVEL_DEBUG, "use %s", if_name);
+        indigo_log(LOG_CATEGORY_LOOPBACK, LOG_LEVEL_DEBUG, "use %s", if_name);
     } else if (find_interface_ip(local_ip, sizeof(local_ip), get_wlans_bridge())) {
-        indigo_logger(LOG_LEVEL_DEBUG, "use %s", get_wlans_bridge());
+        indigo_log(LOG_CATEGORY_LOOPBACK, LOG_LEVEL_DEBUG, "use %s", get_wlans_bridge());
     } else if (find_interface_ip(local_ip, sizeof(local_ip), get_wireless_interface())) {
-        indigo_logger(LOG_LEVEL_DEBUG, "use %s", get_wireless_interface());
+        indigo_log(LOG_CATEGORY_LOOPBACK, LOG_LEVEL_DEBUG, "use %s", get_wireless_interface());
 // #ifdef __TEST__
     } else if (find_interface_ip(local_ip, sizeof(local_ip), "eth0")) {
-        indigo_logger(LOG_LEVEL_DEBUG, "use %s", "eth0");
+        indigo_log(LOG_CATEGORY_LOOPBACK, LOG_LEVEL_DEBUG, "use %s", "eth0");
 // #endif /* __TEST__ */
     } else {
-        indigo_logger(LOG_LEVEL_ERROR, "No available interface");
+        indigo_log(LOG_CATEGORY_LOOPBACK, LOG_LEVEL_ERROR, "No available interface");
         goto done;
     }
     /* Start loopback */
@@ -1172,43 +1238,23 @@ static int stop_loop_back_server_handler(struct packet_wrapper *req, struct pack
 }
 
 static int send_ap_arp_handler(struct packet_wrapper *req, struct packet_wrapper *resp) {
-    struct tlv_hdr *tlv;
-    char target_ip[64];
-    char rate[16], arp_count[16], recv_count[16];
+    char target_ip[INET_ADDRSTRLEN];
+    char recv_count[16];
+    unsigned int addr;
     int status = TLV_VALUE_STATUS_NOT_OK, recvd = 0, send = 0;
     char *message = TLV_VALUE_BROADCAST_ARP_TEST_NOT_OK;
 
     /* TLV: TLV_ARP_TARGET_IP */
-    memset(target_ip, 0, sizeof(target_ip));
-    tlv = find_wrapper_tlv_by_id(req, TLV_ARP_TARGET_IP);
-    if (tlv) {
-        memcpy(target_ip, tlv->value, tlv->len);
-    } else {
+    if (get_wrapper_tlv_ipv4(req, TLV_ARP_TARGET_IP, &addr) < 0) {
         goto done;
     }
-
+    inet_ntop(AF_INET, &addr, target_ip, sizeof(target_ip));
     /* TLV: TLV_ARP_FRAME_COUNT */
-    memset(arp_count, 0, sizeof(arp_count));
-    tlv = find_wrapper_tlv_by_id(req, TLV_ARP_FRAME_COUNT);
-    if (tlv) {
-        memcpy(arp_count, tlv->value, tlv->len);
-    } else {
-        snprintf(arp_count, sizeof(arp_count), "2");
-    }
-    send = atoi(arp_count);
-
-    /* TLV_ARP_TRANSMISSION_RATE */
-    memset(rate, 0, sizeof(rate));
-    tlv = find_wrapper_tlv_by_id(req, TLV_ARP_TRANSMISSION_RATE);
-    if (tlv) {
-        memcpy(rate, tlv->value, tlv->len);
-    } else {
-        snprintf(rate, sizeof(rate), "1");
-    }
+    send = get_wrapper_tlv_int(req, TLV_ARP_FRAME_COUNT);
 
     /* Send broadcast ARP */
     memset(recv_count, 0, sizeof(recv_count));
-    recvd = send_broadcast_arp(target_ip, &send, atoi(rate));
+    recvd = send_broadcast_arp(target_ip, &send, get_wrapper_tlv_int(req, TLV_ARP_TRANSMISSION_RATE));
     snprintf(recv_count, sizeof(recv_count), "%d", recvd);
     if (send > 0) {
         status = TLV_VALUE_STATUS_OK;
@@ -1225,50 +1271,26 @@ done:
 }
 
 int delete_sta_if = 0;
-static int stop_sta_handler(struct packet_wrapper *req, struct packet_wrapper *resp) {
+static int stop_sta_stopped(struct packet_wrapper *req, struct packet_wrapper *resp) {
+    struct sockaddr_in *tool_addr = get_tool_addr();
     int len = 0, reset = 0, id = 0;
-    char buffer[S_BUFFER_LEN*2], reset_type[16];
+    char buffer[S_BUFFER_LEN*2];
     char log_name[128], conf_name[128];
-    char *parameter[] = {"pidof", get_wpas_exec_file(), NULL};
     char *message = NULL;
-    struct tlv_hdr *tlv = NULL;
     static int reconf_count = 0;
 
     /* TLV: RESET_TYPE */
-    tlv = find_wrapper_tlv_by_id(req, TLV_RESET_TYPE);
-    memset(reset_type, 0, sizeof(reset_type));
-    if (tlv) {
-        memcpy(reset_type, tlv->value, tlv->len);
-        reset = atoi(reset_type);
-        indigo_logger(LOG_LEVEL_DEBUG, "Reset Type: %d", reset);
-    }
-    if (reset == RESET_TYPE_INIT) {
-        open_tc_app_log();
-        len = unlink(get_wpas_conf_file());
-        if (len) {
-            indigo_logger(LOG_LEVEL_DEBUG, "Failed to remove wpa_supplicant.conf");
-        }
-
-        /* clean the log */
-        snprintf(buffer, sizeof(buffer), "rm -rf %s >/dev/null 2>/dev/null", WPAS_LOG_FILE);
-        system(buffer);
+    if (find_wrapper_tlv_by_id(req, TLV_RESET_TYPE)) {
+        reset = get_wrapper_tlv_int(req, TLV_RESET_TYPE);
     }
 
-    memset(buffer, 0, sizeof(buffer));
-    sprintf(buffer, "killall %s 1>/dev/null 2>/dev/null", get_wpas_exec_file());
-    system(buffer);
-    sleep(2);
-
     /* Test case teardown case */
     if (reset == RESET_TYPE_TEARDOWN) {
         /* TLV: ADDITIONAL_TEST_PLATFORM_ID */
-        tlv = find_wrapper_tlv_by_id(req, TLV_ADDITIONAL_TEST_PLATFORM_ID);
-        memset(buffer, 0, sizeof(buffer));
-        if (tlv) {
-            memcpy(buffer, tlv->value, tlv->len);
-            additional_tp_id = atoi(buffer);
+        if (find_wrapper_tlv_by_id(req, TLV_ADDITIONAL_TEST_PLATFORM_ID)) {
+            additional_tp_id = get_wrapper_tlv_int(req, TLV_ADDITIONAL_TEST_PLATFORM_ID);
             id = additional_tp_id & 0x0F;
-            indigo_logger(LOG_LEVEL_DEBUG, "Additional STA test platform id: %d", id);
+            indigo_log(LOG_CATEGORY_WPAS, LOG_LEVEL_DEBUG, "Additional STA test platform id: %d", id);
         }
 
         /* Send supplicant conf and log to Tool */
@@ -1302,17 +1324,17 @@ static int stop_sta_handler(struct packet_wrapper *req, struct packet_wrapper *r
                 http_file_post(inet_ntoa(tool_addr->sin_addr), TOOL_POST_PORT, WPAS_UPLOAD_API, WPAS_LOG_FILE);
             }
         } else {
-            indigo_logger(LOG_LEVEL_ERROR, "Can't get tool IP address");
+            indigo_log(LOG_CATEGORY_WPAS, LOG_LEVEL_ERROR, "Can't get tool IP address");
         }
 
         if (sta_hw_config.chwidth != CHWIDTH_AUTO) {
             if (sta_hw_config.phymode != PHYMODE_AUTO) {
-                indigo_logger(LOG_LEVEL_DEBUG, "Reset STA PHY mode in teardown");
+                indigo_log(LOG_CATEGORY_WPAS, LOG_LEVEL_DEBUG, "Reset STA PHY mode in teardown");
                 sta_hw_config.phymode_isset = true;
                 sta_hw_config.phymode = PHYMODE_AUTO;
                 set_phy_mode();
             }
-            indigo_logger(LOG_LEVEL_DEBUG, "Reset STA channel width in teardown");
+            indigo_log(LOG_CATEGORY_WPAS, LOG_LEVEL_DEBUG, "Reset STA channel width in teardown");
             sta_hw_config.chwidth_isset = true;
             sta_hw_config.chwidth = CHWIDTH_AUTO;
             set_channel_width();
@@ -1323,13 +1345,10 @@ static int stop_sta_handler(struct packet_wrapper *req, struct packet_wrapper *r
 
     if (reset == RESET_TYPE_RECONFIGURE) {
         /* TLV: ADDITIONAL_TEST_PLATFORM_ID */
-        tlv = find_wrapper_tlv_by_id(req, TLV_ADDITIONAL_TEST_PLATFORM_ID);
-        memset(buffer, 0, sizeof(buffer));
-        if (tlv) {
-            memcpy(buffer, tlv->value, tlv->len);
-            additional_tp_id = atoi(buffer);
+        if (find_wrapper_tlv_by_id(req, TLV_ADDITIONAL_TEST_PLATFORM_ID)) {
+            additional_tp_id = get_wrapper_tlv_int(req, TLV_ADDITIONAL_TEST_PLATFORM_ID);
             id = additional_tp_id & 0x0F;
-            indigo_logger(LOG_LEVEL_DEBUG, "Additional STA test platform id: %d", id);
+            indigo_log(LOG_CATEGORY_WPAS, LOG_LEVEL_DEBUG, "Additional STA test platform id: %d", id);
         }
         reconf_count++;
 
@@ -1364,17 +1383,17 @@ static int stop_sta_handler(struct packet_wrapper *req, struct packet_wrapper *r
             snprintf(buffer, sizeof(buffer), "rm -rf %s >/dev/null 2>/dev/null", log_name);
             system(buffer);
         } else {
-            indigo_logger(LOG_LEVEL_ERROR, "Can't get tool IP address");
+            indigo_log(LOG_CATEGORY_WPAS, LOG_LEVEL_ERROR, "Can't get tool IP address");
         }
     }
 
     len = reset_interface_ip(get_wireless_interface());
     if (len) {
-        indigo_logger(LOG_LEVEL_DEBUG, "Failed to free IP address");
+        indigo_log(LOG_CATEGORY_WPAS, LOG_LEVEL_DEBUG, "Failed to free IP address");
     }
     sleep(1);
 
-    len = pipe_command(buffer, sizeof(buffer), "/bin/pidof", parameter);
+    len = process_find(get_wpas_exec_file());
     if (len) {
         message = TLV_VALUE_WPA_S_STOP_NOT_OK;
     } else {
@@ -1397,6 +1416,32 @@ static int stop_sta_handler(struct packet_wrapper *req, struct packet_wrapper *r
     return 0;
 }
 
+static int stop_sta_handler(struct packet_wrapper *req, struct packet_wrapper *resp) {
+    int len = 0, reset = 0;
+    char buffer[S_BUFFER_LEN*2];
+
+    /* TLV: RESET_TYPE */
+    if (find_wrapper_tlv_by_id(req, TLV_RESET_TYPE)) {
+        reset = get_wrapper_tlv_int(req, TLV_RESET_TYPE);
+        indigo_log(LOG_CATEGORY_WPAS, LOG_LEVEL_DEBUG, "Reset Type: %d", reset);
+    }
+    if (reset == RESET_TYPE_INIT) {
+        open_tc_app_log();
+        len = unlink(get_wpas_conf_file());
+        if (len) {
+            indigo_log(LOG_CATEGORY_WPAS, LOG_LEVEL_DEBUG, "Failed to remove wpa_supplicant.conf");
+        }
+
+        /* clean the log */
+        snprintf(buffer, sizeof(buffer), "rm -rf %s >/dev/null 2>/dev/null", WPAS_LOG_FILE);
+        system(buffer);
+    }
+
+    /* The response is sent once the daemon has exited. Other requests are served meanwhile. */
+    process_stop_async(get_wpas_exec_file(), indigo_request_event, indigo_request_defer_event(stop_sta_stopped));
+    return 0;
+}
+
 #ifdef _RESERVED_
 /* The function is reserved for the defeault wpas config */
 #define WPAS_DEFAULT_CONFIG_SSID                    "QuickTrack"
@@ -1553,76 +1598,82 @@ static int configure_sta_handler(struct packet_wrapper *req, struct packet_wrapp
     return 0;
 }
 
-static int associate_sta_handler(struct packet_wrapper *req, struct packet_wrapper *resp) {
-    char *message = TLV_VALUE_WPA_S_START_UP_NOT_OK;
-    char buffer[256], log_level[TLV_VALUE_SIZE];
-    int len, status = TLV_VALUE_STATUS_NOT_OK;
-    struct tlv_hdr *tlv = NULL;
-
-    /* TLV: DEBUG_LEVEL */
-    tlv = find_wrapper_tlv_by_id(req, TLV_DEBUG_LEVEL);
-    memset(log_level, 0, sizeof(log_level));
-    if (tlv) {
-        memcpy(log_level, tlv->value, tlv->len);
-    }
+/* Response of the handlers that start wpa_supplicant, once it answers on its control interface or the wait
+ * has timed out */
+static int wpas_start_up_ready(struct packet_wrapper *req, struct packet_wrapper *resp) {
+    char *message = TLV_VALUE_WPA_S_START_UP_OK;
+    int status = TLV_VALUE_STATUS_OK;
 
-    if (strlen(log_level)) {
-        set_wpas_debug_level(get_debug_level(atoi(log_level)));
+    if (indigo_request_event_result() < 0) {
+        status = TLV_VALUE_STATUS_NOT_OK;
+        message = TLV_VALUE_WPA_S_START_UP_NOT_OK;
     }
 
-#ifdef _OPENWRT_
-#else
-    system("rfkill unblock wlan");
-    sleep(1);
-#endif
+    fill_wrapper_message_hdr(resp, API_CMD_RESPONSE, req->hdr.seq);
+    fill_wrapper_tlv_byte(resp, TLV_STATUS, status);
+    fill_wrapper_tlv_bytes(resp, TLV_MESSAGE, strlen(message), message);
+    return 0;
+}
 
-    memset(buffer, 0, sizeof(buffer));
-    sprintf(buffer, "killall %s 1>/dev/null 2>/dev/null", get_wpas_exec_file());
-    system(buffer);
-    sleep(3);
+static int associate_sta_start_wpas(struct packet_wrapper *req, struct packet_wrapper *resp) {
+    char buffer[256];
 
     /* Start WPA supplicant */
     memset(buffer, 0 ,sizeof(buffer));
-    sprintf(buffer, "%s -B -t -c %s %s -i %s -f %s",
+    sprintf(buffer, "%s -t -c %s %s -i %s -f %s",
         get_wpas_full_exec_path(), 
         get_wpas_conf_file(),
         get_wpas_debug_arguments(),
         get_wireless_interface(),
         WPAS_LOG_FILE);
-    indigo_logger(LOG_LEVEL_DEBUG, "%s", buffer);
-    len = system(buffer);
+    indigo_log(LOG_CATEGORY_WPAS, LOG_LEVEL_DEBUG, "%s", buffer);
+    process_start(buffer);
 
-    message = TLV_VALUE_WPA_S_START_UP_OK;
-    status = TLV_VALUE_STATUS_OK;
+    /* Respond once wpa_supplicant answers on its control interface. Other requests are served meanwhile. */
+    if (indigo_request_defer_ready(get_wpas_ctrl_path(), get_wpas_exec_file(), wpas_start_up_ready) == 0) {
+        return 0;
+    }
+    return wpas_start_up_ready(req, resp);
+}
+
+static int associate_sta_handler(struct packet_wrapper *req, struct packet_wrapper *resp) {
+    /* TLV: DEBUG_LEVEL */
+    if (find_wrapper_tlv_by_id(req, TLV_DEBUG_LEVEL)) {
+        set_wpas_debug_level(get_debug_level(get_wrapper_tlv_int(req, TLV_DEBUG_LEVEL)));
+    }
+
+#ifdef _OPENWRT_
+#else
+    system("rfkill unblock wlan");
+#endif
+
+    /* Start wpa_supplicant again once it has exited. Other requests are served meanwhile. */
+    process_stop_async(get_wpas_exec_file(), indigo_request_event, indigo_request_defer_event(associate_sta_start_wpas));
+    return 0;
+}
+
+static int start_up_sta_ready(struct packet_wrapper *req, struct packet_wrapper *resp) {
+    char *message = TLV_VALUE_WPA_S_START_UP_NOT_OK;
+    int status = TLV_VALUE_STATUS_NOT_OK;
+
+    if (indigo_request_event_result() >= 0 && process_find(get_wpas_exec_file())) {
+        status = TLV_VALUE_STATUS_OK;
+        message = TLV_VALUE_WPA_S_START_UP_OK;
+    }
 
-done:
     fill_wrapper_message_hdr(resp, API_CMD_RESPONSE, req->hdr.seq);
     fill_wrapper_tlv_byte(resp, TLV_STATUS, status);
     fill_wrapper_tlv_bytes(resp, TLV_MESSAGE, strlen(message), message);
     return 0;
 }
 
-static int start_up_sta_handler(struct packet_wrapper *req, struct packet_wrapper *resp) {
-    struct wpa_ctrl *w = NULL;
-    char *message = TLV_VALUE_WPA_S_START_UP_NOT_OK;
-    char buffer[BUFFER_LEN], response[1024], log_level[TLV_VALUE_SIZE], value[TLV_VALUE_SIZE];
+static int start_up_sta_stopped(struct packet_wrapper *req, struct packet_wrapper *resp) {
+    char buffer[BUFFER_LEN], value[TLV_VALUE_SIZE];
     char ssid[S_BUFFER_LEN], cfg_item[2*S_BUFFER_LEN];
-    int len, status = TLV_VALUE_STATUS_NOT_OK, i, ssid_len;
-    size_t resp_len;
-    char *parameter[] = {"pidof", get_wpas_exec_file(), NULL};
+    int len, i, ssid_len;
     struct tlv_hdr *tlv = NULL;
     struct tlv_to_config_name* cfg = NULL;
     int perform_wps_ie_frag = 0;
-#ifdef _OPENWRT_
-#else
-    system("rfkill unblock wlan");
-    sleep(1);
-#endif
-
-    memset(buffer, 0, sizeof(buffer));
-    sprintf(buffer, "killall %s 1>/dev/null 2>/dev/null", get_wpas_exec_file());
-    system(buffer);
-    sleep(3);
 
     tlv = find_wrapper_tlv_by_id(req, TLV_SSID);
     memset(ssid, 0, sizeof(ssid));
@@ -1679,16 +1730,16 @@ static int start_up_sta_handler(struct packet_wrapper *req, struct packet_wrappe
             else
                 s = get_vendor_wps_settings(WPS_STA);
             if (!s) {
-                indigo_logger(LOG_LEVEL_ERROR, "Failed to get AP WPS settings.");
+                indigo_log(LOG_CATEGORY_WPAS, LOG_LEVEL_ERROR, "Failed to get AP WPS settings.");
             } else if (atoi(value) == WPS_ENABLE_NORMAL) {
                 for (j = 0; j < STA_SETTING_NUM; j++) {
                     memset(cfg_item, 0, sizeof(cfg_item));
                     sprintf(cfg_item, "%s=%s\n", s[j].wkey, s[j].value);
                     strcat(buffer, cfg_item);
                 }
-                indigo_logger(LOG_LEVEL_INFO, "STA Configure WPS");
+                indigo_log(LOG_CATEGORY_WPAS, LOG_LEVEL_INFO, "STA Configure WPS");
             } else {
-                indigo_logger(LOG_LEVEL_ERROR, "Invalid WPS TLV value: %d (TLV ID 0x%04x)", atoi(value), tlv->id);
+                indigo_log(LOG_CATEGORY_WPAS, LOG_LEVEL_ERROR, "Invalid WPS TLV value: %d (TLV ID 0x%04x)", atoi(value), tlv->id);
             }
         }
 
@@ -1705,43 +1756,36 @@ static int start_up_sta_handler(struct packet_wrapper *req, struct packet_wrappe
     }
 
     /* TLV: DEBUG_LEVEL */
-    tlv = find_wrapper_tlv_by_id(req, TLV_DEBUG_LEVEL);
-    memset(log_level, 0, sizeof(log_level));
-    if (tlv) {
-        memcpy(log_level, tlv->value, tlv->len);
-    }
-
-    if (strlen(log_level)) {
-        set_wpas_debug_level(get_debug_level(atoi(log_level)));
+    if (find_wrapper_tlv_by_id(req, TLV_DEBUG_LEVEL)) {
+        set_wpas_debug_level(get_debug_level(get_wrapper_tlv_int(req, TLV_DEBUG_LEVEL)));
     }
 
     /* Start WPA supplicant */
     memset(buffer, 0 ,sizeof(buffer));
-    sprintf(buffer, "%s -B -t -c %s %s -i %s -f %s",
+    sprintf(buffer, "%s -t -c %s %s -i %s -f %s",
         get_wpas_full_exec_path(),
         get_wpas_conf_file(),
         get_wpas_debug_arguments(),
         get_wireless_interface(),
         WPAS_LOG_FILE);
-    len = system(buffer);
-    sleep(2);
+    process_start(buffer);
 
-    len = pipe_command(buffer, sizeof(buffer), "/bin/pidof", parameter);
-    if (len) {
-        status = TLV_VALUE_STATUS_OK;
-        message = TLV_VALUE_WPA_S_START_UP_OK;
-    } else {
-        status = TLV_VALUE_STATUS_NOT_OK;
-        message = TLV_VALUE_WPA_S_START_UP_NOT_OK;
+    /* Respond once wpa_supplicant answers on its control interface. Other requests are served meanwhile. */
+    if (indigo_request_defer_ready(get_wpas_ctrl_path(), get_wpas_exec_file(), start_up_sta_ready) == 0) {
+        return 0;
     }
+    return start_up_sta_ready(req, resp);
+}
 
-done:
-    fill_wrapper_message_hdr(resp, API_CMD_RESPONSE, req->hdr.seq);
-    fill_wrapper_tlv_byte(resp, TLV_STATUS, status);
-    fill_wrapper_tlv_bytes(resp, TLV_MESSAGE, strlen(message), message);
-    if (w) {
-        wpa_ctrl_close(w);
-    }
+static int start_up_sta_handler(struct packet_wrapper *req, struct packet_wrapper *resp) {
+#ifdef _OPENWRT_
+#else
+    system("rfkill unblock wlan");
+    sleep(1);
+#endif
+
+    /* Continue once wpa_supplicant has exited. Other requests are served meanwhile. */
+    process_stop_async(get_wpas_exec_file(), indigo_request_event, indigo_request_defer_event(start_up_sta_stopped));
     return 0;
 }
 
@@ -1757,7 +1801,7 @@ static int set_sta_phy_mode_handler(struct packet_wrapper *req, struct packet_wr
     tlv = find_wrapper_tlv_by_id(req, TLV_PHYMODE);
     if (tlv) {
         memcpy(param_value, tlv->value, tlv->len);
-        indigo_logger(LOG_LEVEL_ERROR, "PHY mode value: %s", param_value);
+        indigo_log(LOG_CATEGORY_WPAS, LOG_LEVEL_ERROR, "PHY mode value: %s", param_value);
     } else {
         goto done;
     }
@@ -1817,7 +1861,7 @@ static int set_sta_channel_width_handler(struct packet_wrapper *req, struct pack
     tlv = find_wrapper_tlv_by_id(req, TLV_CHANNEL_WIDTH);
     if (tlv) {
         memcpy(param_value, tlv->value, tlv->len);
-        indigo_logger(LOG_LEVEL_ERROR, "channel width value: %s", param_value);
+        indigo_log(LOG_CATEGORY_WPAS, LOG_LEVEL_ERROR, "channel width value: %s", param_value);
     } else {
         goto done;
     }
@@ -1870,7 +1914,7 @@ static int set_sta_power_save_handler(struct packet_wrapper *req, struct packet_
     tlv = find_wrapper_tlv_by_id(req, TLV_STA_POWER_SAVE);
     if (tlv) {
         memcpy(param_value, tlv->value, tlv->len);
-        indigo_logger(LOG_LEVEL_DEBUG, "power save value: %s", param_value);
+        indigo_log(LOG_CATEGORY_WPAS, LOG_LEVEL_DEBUG, "power save value: %s", param_value);
     } else {
         goto done;
     }
@@ -1881,7 +1925,7 @@ static int set_sta_power_save_handler(struct packet_wrapper *req, struct packet_
     iface = get_wireless_interface();
     sprintf(buffer, "iw dev %s set power_save %s && iw dev %s get power_save", 
             iface, (char *)&conf, iface);
-    indigo_logger(LOG_LEVEL_DEBUG, "cmd: %s", buffer);
+    indigo_log(LOG_CATEGORY_WPAS, LOG_LEVEL_DEBUG, "cmd: %s", buffer);
     system(buffer);
 
     fp = popen(buffer, "r");
@@ -1891,7 +1935,7 @@ static int set_sta_power_save_handler(struct packet_wrapper *req, struct packet_
     /* Power save output format: Power save: on */
     fscanf(fp, "%*s %*s %s", (char *)&result);
     pclose(fp);
-    indigo_logger(LOG_LEVEL_DEBUG, "power save config: %s, result: %s", conf, result);
+    indigo_log(LOG_CATEGORY_WPAS, LOG_LEVEL_DEBUG, "power save config: %s, result: %s", conf, result);
 
     /* Check response */
     if (!strcmp(conf, result)) {
@@ -1907,26 +1951,12 @@ done:
     return 0;
 }
 
-static int start_up_p2p_handler(struct packet_wrapper *req, struct packet_wrapper *resp) {
-    char *message = TLV_VALUE_WPA_S_START_UP_NOT_OK;
-    char buffer[S_BUFFER_LEN], response[1024], log_level[TLV_VALUE_SIZE], value[TLV_VALUE_SIZE];
-    int len, status = TLV_VALUE_STATUS_NOT_OK, i;
-    size_t resp_len;
-    char *parameter[] = {"pidof", get_wpas_exec_file(), NULL};
+static int start_up_p2p_stopped(struct packet_wrapper *req, struct packet_wrapper *resp) {
+    char buffer[S_BUFFER_LEN], value[TLV_VALUE_SIZE];
+    int len;
     struct tlv_hdr *tlv = NULL;
     char if_name[32];
 
-#ifdef _OPENWRT_
-#else
-    system("rfkill unblock wlan");
-    sleep(1);
-#endif
-
-    memset(buffer, 0, sizeof(buffer));
-    sprintf(buffer, "killall %s 1>/dev/null 2>/dev/null", get_wpas_exec_file());
-    system(buffer);
-    sleep(3);
-
     tlv = find_wrapper_tlv_by_id(req, TLV_AP_STA_COEXIST);
     if (tlv) {
         create_sta_interface();
@@ -1955,44 +1985,40 @@ static int start_up_p2p_handler(struct packet_wrapper *req, struct packet_wrappe
             write_file(get_wpas_conf_file(), buffer, len);
         }
     } else {
-        indigo_logger(LOG_LEVEL_ERROR, "No remote UDP port in TP");
+        indigo_log(LOG_CATEGORY_WPAS, LOG_LEVEL_ERROR, "No remote UDP port in TP");
     }
 
     /* TLV: DEBUG_LEVEL */
-    tlv = find_wrapper_tlv_by_id(req, TLV_DEBUG_LEVEL);
-    memset(log_level, 0, sizeof(log_level));
-    if (tlv) {
-        memcpy(log_level, tlv->value, tlv->len);
-    }
-
-    if (strlen(log_level)) {
-        set_wpas_debug_level(get_debug_level(atoi(log_level)));
+    if (find_wrapper_tlv_by_id(req, TLV_DEBUG_LEVEL)) {
+        set_wpas_debug_level(get_debug_level(get_wrapper_tlv_int(req, TLV_DEBUG_LEVEL)));
     }
 
     /* Start WPA supplicant */
     memset(buffer, 0 ,sizeof(buffer));
-    sprintf(buffer, "%s -B -t -c %s %s -i %s -f %s",
+    sprintf(buffer, "%s -t -c %s %s -i %s -f %s",
         get_wpas_full_exec_path(),
         get_wpas_conf_file(),
         get_wpas_debug_arguments(),
         if_name,
         WPAS_LOG_FILE);
-    len = system(buffer);
-    sleep(2);
+    process_start(buffer);
 
-    len = pipe_command(buffer, sizeof(buffer), "/bin/pidof", parameter);
-    if (len) {
-        status = TLV_VALUE_STATUS_OK;
-        message = TLV_VALUE_WPA_S_START_UP_OK;
-    } else {
-        status = TLV_VALUE_STATUS_NOT_OK;
-        message = TLV_VALUE_WPA_S_START_UP_NOT_OK;
+    /* Respond once wpa_supplicant answers on its control interface. Other requests are served meanwhile. */
+    if (indigo_request_defer_ready(get_wpas_if_ctrl_path(if_name), get_wpas_exec_file(), start_up_sta_ready) == 0) {
+        return 0;
     }
+    return start_up_sta_ready(req, resp);
+}
 
-done:
-    fill_wrapper_message_hdr(resp, API_CMD_RESPONSE, req->hdr.seq);
-    fill_wrapper_tlv_byte(resp, TLV_STATUS, status);
-    fill_wrapper_tlv_bytes(resp, TLV_MESSAGE, strlen(message), message);
+static int start_up_p2p_handler(struct packet_wrapper *req, struct packet_wrapper *resp) {
+#ifdef _OPENWRT_
+#else
+    system("rfkill unblock wlan");
+    sleep(1);
+#endif
+
+    /* Continue once wpa_supplicant has exited. Other requests are served meanwhile. */
+    process_stop_async(get_wpas_exec_file(), indigo_request_event, indigo_request_defer_event(start_up_p2p_stopped));
     return 0;
 }
 
@@ -2001,20 +2027,18 @@ static int start_dhcp_handler(struct packet_wrapper *req, struct packet_wrapper
     int status = TLV_VALUE_STATUS_NOT_OK;
     char *message = TLV_VALUE_START_DHCP_NOT_OK;
     char buffer[S_BUFFER_LEN];
-    char ip_addr[32], role[8];
+    char ip_addr[32];
     struct tlv_hdr *tlv = NULL;
     char if_name[32];
 
-    memset(role, 0, sizeof(role));
-    tlv = find_wrapper_tlv_by_id(req, TLV_ROLE);
-    if (tlv) {
-        memcpy(role, tlv->value, tlv->len);
-        if (atoi(role) == DUT_TYPE_P2PUT) {
+    /* TLV: TLV_ROLE */
+    if (find_wrapper_tlv_by_id(req, TLV_ROLE)) {
+        if (get_wrapper_tlv_int(req, TLV_ROLE) == DUT_TYPE_P2PUT) {
             get_p2p_group_if(if_name, sizeof(if_name));
         } else {
         }
     } else {
-        indigo_logger(LOG_LEVEL_INFO, "Missed TLV_ROLE, Use default wireless IF");
+        indigo_log(LOG_CATEGORY_NETIF, LOG_LEVEL_INFO, "Missed TLV_ROLE, Use default wireless IF");
         snprintf(if_name, sizeof(if_name), "%s", get_wireless_interface());
     }
 
@@ -2048,15 +2072,12 @@ static int stop_dhcp_handler(struct packet_wrapper *req, struct packet_wrapper *
     int status = TLV_VALUE_STATUS_NOT_OK;
     char *message = TLV_VALUE_NOT_OK;
     char buffer[S_BUFFER_LEN];
-    char role[8];
     struct tlv_hdr *tlv = NULL;
     char if_name[32];
 
-    memset(role, 0, sizeof(role));
-    tlv = find_wrapper_tlv_by_id(req, TLV_ROLE);
-    if (tlv) {
-        memcpy(role, tlv->value, tlv->len);
-        if (atoi(role) == DUT_TYPE_P2PUT) {
+    /* TLV: TLV_ROLE */
+    if (find_wrapper_tlv_by_id(req, TLV_ROLE)) {
+        if (get_wrapper_tlv_int(req, TLV_ROLE) == DUT_TYPE_P2PUT) {
             if (get_p2p_group_if(if_name, sizeof(if_name)))
                 reset_interface_ip(if_name);
         } else {
@@ -2095,16 +2116,14 @@ struct _cfg_cred {
 static int get_wsc_cred_handler(struct packet_wrapper *req, struct packet_wrapper *resp) {
     int status = TLV_VALUE_STATUS_NOT_OK;
     char *message = TLV_VALUE_NOT_OK;
-    char *pos = NULL, *data = NULL, value[16];
+    char *pos = NULL, *data = NULL;
     int i, len, ret = -1, count = 0, role = 0;
     struct tlv_hdr *tlv = NULL;
     struct _cfg_cred *p_cfg = NULL;
 
-    memset(value, 0, sizeof(value));
-    tlv = find_wrapper_tlv_by_id(req, TLV_ROLE);
-    if (tlv) {
-            memcpy(value, tlv->value, tlv->len);
-            role = atoi(value);
+    /* TLV: TLV_ROLE */
+    if (find_wrapper_tlv_by_id(req, TLV_ROLE)) {
+        role = get_wrapper_tlv_int(req, TLV_ROLE);
     } else {
         indigo_logger(LOG_LEVEL_ERROR, "Missed TLV: TLV_ROLE");
         goto done;
@@ -2195,7 +2214,8 @@ static int send_sta_icon_req_handler(struct packet_wrapper *req, struct packet_w
     char *message = TLV_VALUE_NOT_OK;
     char buffer[1024];
     char response[1024];
-    char bssid[256];
+    char bssid[32];
+    unsigned char mac[6];
     char icon_file[256], icon_checksum[64];
     struct tlv_hdr *tlv = NULL;
     struct wpa_ctrl *w = NULL;
@@ -2205,21 +2225,18 @@ static int send_sta_icon_req_handler(struct packet_wrapper *req, struct packet_w
     /* Open wpa_supplicant UDS socket */
     w = wpa_ctrl_open(get_wpas_ctrl_path());
     if (!w) {
-        indigo_logger(LOG_LEVEL_ERROR, "Failed to connect to wpa_supplicant");
+        indigo_log(LOG_CATEGORY_WPAS, LOG_LEVEL_ERROR, "Failed to connect to wpa_supplicant");
         status = TLV_VALUE_STATUS_NOT_OK;
         message = TLV_VALUE_WPA_S_CTRL_NOT_OK;
         goto done;
     }
 
     /* TLV: BSSID */
-    tlv = find_wrapper_tlv_by_id(req, TLV_BSSID);
-    if (tlv) {
-        memset(bssid, 0, sizeof(bssid));
-        memcpy(bssid, tlv->value, tlv->len);
-    } else {
-        indigo_logger(LOG_LEVEL_ERROR, "missing BSSID configuration");
+    if (get_wrapper_tlv_mac(req, TLV_BSSID, mac) < 0) {
+        indigo_log(LOG_CATEGORY_WPAS, LOG_LEVEL_ERROR, "missing BSSID configuration");
         goto done;
     }
+    snprintf(bssid, sizeof(bssid), MACSTR, MAC2STR(mac));
 
     /* TLV: ICON_FILE */
     tlv = find_wrapper_tlv_by_id(req, TLV_ICON_FILE);
@@ -2227,7 +2244,7 @@ static int send_sta_icon_req_handler(struct packet_wrapper *req, struct packet_w
         memset(icon_file, 0, sizeof(icon_file));
         memcpy(icon_file, tlv->value, tlv->len);
     } else {
-        indigo_logger(LOG_LEVEL_ERROR, "missing icon_file configuration");
+        indigo_log(LOG_CATEGORY_WPAS, LOG_LEVEL_ERROR, "missing icon_file configuration");
         goto done;
     }
 
@@ -2243,9 +2260,9 @@ static int send_sta_icon_req_handler(struct packet_wrapper *req, struct packet_w
     resp_len = sizeof(response) - 1;
     wpa_ctrl_request(w, buffer, strlen(buffer), response, &resp_len, NULL);
 
-    indigo_logger(LOG_LEVEL_DEBUG, "%s -> resp: %s\n", buffer, response);
+    indigo_log(LOG_CATEGORY_WPAS, LOG_LEVEL_DEBUG, "%s -> resp: %s\n", buffer, response);
     if (strncmp(response, WPA_CTRL_OK, strlen(WPA_CTRL_OK)) != 0) {
-        indigo_logger(LOG_LEVEL_ERROR, "Failed to execute the command. Response: %s", response);
+        indigo_log(LOG_CATEGORY_WPAS, LOG_LEVEL_ERROR, "Failed to execute the command. Response: %s", response);
         goto done;
     }
 
@@ -2254,9 +2271,9 @@ static int send_sta_icon_req_handler(struct packet_wrapper *req, struct packet_w
     resp_len = sizeof(response) - 1;
     wpa_ctrl_request(w, buffer, strlen(buffer), response, &resp_len, NULL);
 
-    indigo_logger(LOG_LEVEL_DEBUG, "%s -> resp: %s\n", buffer, response);
+    indigo_log(LOG_CATEGORY_WPAS, LOG_LEVEL_DEBUG, "%s -> resp: %s\n", buffer, response);
     if (strncmp(response, WPA_CTRL_OK, strlen(WPA_CTRL_OK)) != 0) {
-        indigo_logger(LOG_LEVEL_ERROR, "Failed to execute the command. Response: %s", response);
+        indigo_log(LOG_CATEGORY_WPAS, LOG_LEVEL_ERROR, "Failed to execute the command. Response: %s", response);
         goto done;
     }
 
@@ -2264,7 +2281,7 @@ static int send_sta_icon_req_handler(struct packet_wrapper *req, struct packet_w
 
     /* calculate checksum of the downloaded icon file */
     sprintf(buffer, "md5sum /tmp/osu-icon-1.png");
-    indigo_logger(LOG_LEVEL_DEBUG, "cmd: %s", buffer);
+    indigo_log(LOG_CATEGORY_WPAS, LOG_LEVEL_DEBUG, "cmd: %s", buffer);
 
     fp = popen(buffer, "r");
     if (fp == NULL)
@@ -0,0 +1,394 @@
+/* Copyright (c) 2020 Wi-Fi Alliance                                                */
+
+/* Permission to use, copy, modify, and/or distribute this software for any         */
+/* purpose with or without fee is hereby granted, provided that the above           */
+/* copyright notice and this permission notice appear in all copies.                */
+
+/* THE SOFTWARE IS PROVIDED 'AS IS' AND THE AUTHOR DISCLAIMS ALL                    */
+/* WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED                    */
+/* WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL                     */
+/* THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR                       */
+/* CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING                        */
+/* FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF                       */
+/* CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT                       */
+/* OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS                          */
+/* SOFTWARE. */
+
+
+#define LOG_CATEGORY                            LOG_CATEGORY_PACKET
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "eloop.h"
+#include "indigo_capture.h"
+#include "utils.h"
+
+/* pcapng blocks and options */
+#define PCAPNG_SECTION_HEADER                   0x0a0d0d0a
+#define PCAPNG_INTERFACE_DESCRIPTION            0x00000001
+#define PCAPNG_ENHANCED_PACKET                  0x00000006
+#define PCAPNG_BYTE_ORDER_MAGIC                 0x1a2b3c4d
+#define PCAPNG_OPT_END                          0
+#define PCAPNG_OPT_COMMENT                      1
+#define PCAPNG_OPT_IF_NAME                      2
+#define PCAPNG_OPT_EPB_FLAGS                    2
+#define PCAPNG_LINKTYPE_IPV4                    228
+
+/* IPv4 and UDP headers put in front of each message */
+#define CAPTURE_IP_UDP_LEN                      28
+/* Sockets whose local address is remembered */
+#define CAPTURE_LOCAL_SIZE                      16
+
+struct capture_buffer {
+    char *data;
+    int len;
+};
+
+static struct {
+    int fd;
+    char *path;
+    /* Records are appended to active, while writing is written by a worker thread */
+    struct capture_buffer buffers[2];
+    struct capture_buffer *active;
+    struct capture_buffer *writing;
+    /* Set from the submit of writing until it is released by the event loop */
+    int busy;
+    /* Set until the worker has written writing. Protected by lock, as capture_close() may write it first. */
+    int write_pending;
+    pthread_mutex_t lock;
+    int flush_scheduled;
+    struct {
+        int sock;
+        struct sockaddr_in addr;
+    } local[CAPTURE_LOCAL_SIZE];
+    int local_num;
+    unsigned long messages;
+    unsigned long bytes;
+    unsigned long dropped;
+    unsigned long write_errors;
+} capture = { .fd = -1, .lock = PTHREAD_MUTEX_INITIALIZER };
+
+static void capture_flush();
+
+static int pad4(int len) {
+    return (len + 3) & ~3;
+}
+
+static void put16(char *p, unsigned short value) {
+    memcpy(p, &value, sizeof(value));
+}
+
+static void put32(char *p, unsigned int value) {
+    memcpy(p, &value, sizeof(value));
+}
+
+/* Add a pcapng option. Returns its length with the padding. */
+static int put_option(char *p, unsigned short code, const void *value, int len) {
+    put16(p, code);
+    put16(p + 2, len);
+    if (len) {
+        memcpy(p + 4, value, len);
+    }
+    memset(p + 4 + len, 0, pad4(len) - len);
+    return 4 + pad4(len);
+}
+
+static int write_all(int fd, char *data, int len) {
+    int ret;
+
+    while (len > 0) {
+        ret = write(fd, data, len);
+        if (ret < 0) {
+            return -1;
+        }
+        data += ret;
+        len -= ret;
+    }
+    return 0;
+}
+
+/* Worker thread. Skipped if capture_close() has written the buffer already. */
+static void capture_write(void *ctx) {
+    struct capture_buffer *buffer = ctx;
+
+    pthread_mutex_lock(&capture.lock);
+    if (capture.write_pending) {
+        if (write_all(capture.fd, buffer->data, buffer->len) < 0) {
+            capture.write_errors++;
+        }
+        capture.write_pending = 0;
+    }
+    pthread_mutex_unlock(&capture.lock);
+}
+
+static void capture_write_done(void *ctx) {
+    if (capture.fd < 0) {
+        return;
+    }
+    capture.writing->len = 0;
+    capture.writing = NULL;
+    capture.busy = 0;
+    /* Records that came in meanwhile */
+    if (capture.active->len > CAPTURE_BUFFER_SIZE / 2) {
+        capture_flush();
+    }
+}
+
+/* Hand the collected records to a worker thread, unless it is still writing the previous ones */
+static void capture_flush() {
+    struct capture_buffer *buffer = capture.active;
+
+    if (capture.busy || buffer->len == 0) {
+        return;
+    }
+    capture.active = buffer == &capture.buffers[0] ? &capture.buffers[1] : &capture.buffers[0];
+    capture.writing = buffer;
+    capture.busy = 1;
+    capture.write_pending = 1;
+    if (eloop_submit_work(capture_write, capture_write_done, buffer) < 0) {
+        capture_write(buffer);
+        capture_write_done(buffer);
+    }
+}
+
+static void capture_flush_timeout(void *eloop_ctx, void *timeout_ctx) {
+    capture.flush_scheduled = 0;
+    capture_flush();
+    /* The worker was busy. Try again later. */
+    if (capture.active->len && !capture.flush_scheduled) {
+        capture.flush_scheduled = 1;
+        eloop_register_timeout(0, CAPTURE_FLUSH_INTERVAL * 1000, capture_flush_timeout, NULL, NULL);
+    }
+}
+
+/* Reserve room for a record in the buffer, or NULL if it is full */
+static char* capture_reserve(int len) {
+    if (capture.active->len + len > CAPTURE_BUFFER_SIZE) {
+        capture_flush();
+        if (capture.active->len + len > CAPTURE_BUFFER_SIZE) {
+            return NULL;
+        }
+    }
+    capture.active->len += len;
+    return capture.active->data + capture.active->len - len;
+}
+
+/* Local address of the socket. Other than IPv4 is left as zero. */
+static struct sockaddr_in* capture_local_addr(int sock) {
+    int i;
+    socklen_t len;
+
+    for (i = 0; i < capture.local_num; i++) {
+        if (capture.local[i].sock == sock) {
+            return &capture.local[i].addr;
+        }
+    }
+    i = capture.local_num < CAPTURE_LOCAL_SIZE ? capture.local_num++ : sock % CAPTURE_LOCAL_SIZE;
+    capture.local[i].sock = sock;
+    len = sizeof(capture.local[i].addr);
+    if (getsockname(sock, (struct sockaddr *)&capture.local[i].addr, &len) < 0 ||
+        capture.local[i].addr.sin_family != AF_INET) {
+        memset(&capture.local[i].addr, 0, sizeof(capture.local[i].addr));
+    }
+    return &capture.local[i].addr;
+}
+
+static unsigned short ip_checksum(unsigned char *hdr, int len) {
+    unsigned int sum = 0;
+    int i;
+
+    for (i = 0; i < len; i += 2) {
+        sum += (hdr[i] << 8) | hdr[i + 1];
+    }
+    while (sum >> 16) {
+        sum = (sum & 0xffff) + (sum >> 16);
+    }
+    return ~sum & 0xffff;
+}
+
+/* IPv4 and UDP headers of a message from src to dst */
+static void put_ip_udp(char *p, struct sockaddr_in *src, struct sockaddr_in *dst, int len) {
+    unsigned char *ip = (unsigned char *) p;
+    int ip_len = CAPTURE_IP_UDP_LEN + len > 0xffff ? 0xffff : CAPTURE_IP_UDP_LEN + len;
+    unsigned short value;
+
+    memset(p, 0, CAPTURE_IP_UDP_LEN);
+    ip[0] = 0x45;
+    ip[2] = ip_len >> 8;
+    ip[3] = ip_len & 0xff;
+    ip[8] = 64;
+    ip[9] = IPPROTO_UDP;
+    memcpy(ip + 12, &src->sin_addr, 4);
+    memcpy(ip + 16, &dst->sin_addr, 4);
+    value = htons(ip_checksum(ip, 20));
+    memcpy(ip + 10, &value, 2);
+    memcpy(ip + 20, &src->sin_port, 2);
+    memcpy(ip + 22, &dst->sin_port, 2);
+    ip[24] = (ip_len - 20) >> 8;
+    ip[25] = (ip_len - 20) & 0xff;
+}
+
+/* Start a pcapng section in the file. The file is appended to, so the earlier captures are kept. */
+int capture_open(char *path) {
+    char block[64];
+    int len = 0, block_len;
+    char name[] = "controlappc";
+
+    capture.buffers[0].data = malloc(CAPTURE_BUFFER_SIZE);
+    capture.buffers[1].data = malloc(CAPTURE_BUFFER_SIZE);
+    capture.fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (capture.fd < 0 || capture.buffers[0].data == NULL || capture.buffers[1].data == NULL) {
+        indigo_logger(LOG_LEVEL_ERROR, "Failed to open the capture file %s", path);
+        capture_close();
+        return -1;
+    }
+    capture.path = path;
+    capture.active = &capture.buffers[0];
+
+    /* Section header block */
+    put32(block + len, PCAPNG_SECTION_HEADER);
+    put32(block + len + 4, 28);
+    put32(block + len + 8, PCAPNG_BYTE_ORDER_MAGIC);
+    put16(block + len + 12, 1);
+    put16(block + len + 14, 0);
+    /* Section length is not known */
+    memset(block + len + 16, 0xff, 8);
+    put32(block + len + 24, 28);
+    len += 28;
+
+    /* Interface description block of the control port */
+    put32(block + len, PCAPNG_INTERFACE_DESCRIPTION);
+    put16(block + len + 8, PCAPNG_LINKTYPE_IPV4);
+    put16(block + len + 10, 0);
+    put32(block + len + 12, 0);
+    block_len = 16;
+    block_len += put_option(block + len + block_len, PCAPNG_OPT_IF_NAME, name, strlen(name));
+    block_len += put_option(block + len + block_len, PCAPNG_OPT_END, NULL, 0);
+    block_len += 4;
+    put32(block + len + 4, block_len);
+    put32(block + len + block_len - 4, block_len);
+    len += block_len;
+
+    if (write_all(capture.fd, block, len) < 0) {
+        indigo_logger(LOG_LEVEL_ERROR, "Failed to write the capture file %s", path);
+        capture_close();
+        return -1;
+    }
+    indigo_logger(LOG_LEVEL_INFO, "Capture the control messages to %s", path);
+    return 0;
+}
+
+/* Write what is left and close the file */
+void capture_close() {
+    eloop_cancel_timeout(capture_flush_timeout, NULL, NULL);
+    capture.flush_scheduled = 0;
+
+    pthread_mutex_lock(&capture.lock);
+    if (capture.fd >= 0) {
+        if (capture.write_pending && capture.writing && write_all(capture.fd, capture.writing->data, capture.writing->len) < 0) {
+            capture.write_errors++;
+        }
+        capture.write_pending = 0;
+        if (capture.active && capture.active->len && write_all(capture.fd, capture.active->data, capture.active->len) < 0) {
+            capture.write_errors++;
+        }
+        indigo_logger(LOG_LEVEL_INFO, "Captured %lu messages to %s, %lu dropped", capture.messages,
+                      capture.path, capture.dropped);
+        close(capture.fd);
+        capture.fd = -1;
+    }
+    free(capture.buffers[0].data);
+    free(capture.buffers[1].data);
+    memset(capture.buffers, 0, sizeof(capture.buffers));
+    capture.active = capture.writing = NULL;
+    capture.busy = 0;
+    pthread_mutex_unlock(&capture.lock);
+}
+
+/* Append an enhanced packet block of the message. A message is dropped rather than waiting for the disk. */
+void capture_message(int direction, int sock, struct sockaddr *peer, socklen_t peerlen, char *message, int len, long latency_us) {
+    struct sockaddr_in remote, *local;
+    struct timespec ts;
+    unsigned long long usecs;
+    unsigned int flags = direction;
+    char comment[32], *p;
+    int comment_len = 0, data_len, block_len;
+
+    if (capture.fd < 0) {
+        return;
+    }
+
+    if (latency_us >= 0) {
+        comment_len = snprintf(comment, sizeof(comment), "latency %ld us", latency_us);
+    }
+    data_len = CAPTURE_IP_UDP_LEN + len;
+    block_len = 28 + pad4(data_len) + 8 + (comment_len ? 4 + pad4(comment_len) : 0) + 4 + 4;
+    p = capture_reserve(block_len);
+    if (p == NULL) {
+        capture.dropped++;
+        return;
+    }
+
+    memset(&remote, 0, sizeof(remote));
+    if (peer && peer->sa_family == AF_INET && peerlen >= sizeof(remote)) {
+        memcpy(&remote, peer, sizeof(remote));
+    }
+    local = capture_local_addr(sock);
+    clock_gettime(CLOCK_REALTIME, &ts);
+    usecs = (unsigned long long) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+
+    put32(p, PCAPNG_ENHANCED_PACKET);
+    put32(p + 4, block_len);
+    put32(p + 8, 0);
+    put32(p + 12, usecs >> 32);
+    put32(p + 16, usecs & 0xffffffff);
+    put32(p + 20, data_len);
+    put32(p + 24, data_len);
+    p += 28;
+    if (direction == CAPTURE_RECEIVED) {
+        put_ip_udp(p, &remote, local, len);
+    } else {
+        put_ip_udp(p, local, &remote, len);
+    }
+    memcpy(p + CAPTURE_IP_UDP_LEN, message, len);
+    memset(p + data_len, 0, pad4(data_len) - data_len);
+    p += pad4(data_len);
+    p += put_option(p, PCAPNG_OPT_EPB_FLAGS, &flags, sizeof(flags));
+    if (comment_len) {
+        p += put_option(p, PCAPNG_OPT_COMMENT, comment, comment_len);
+    }
+    p += put_option(p, PCAPNG_OPT_END, NULL, 0);
+    put32(p, block_len);
+
+    capture.messages++;
+    capture.bytes += block_len;
+    if (capture.active->len > CAPTURE_BUFFER_SIZE / 2) {
+        capture_flush();
+    } else if (!capture.flush_scheduled) {
+        capture.flush_scheduled = 1;
+        eloop_register_timeout(0, CAPTURE_FLUSH_INTERVAL * 1000, capture_flush_timeout, NULL, NULL);
+    }
+}
+
+int capture_dump(char *buffer, int size) {
+    int len;
+
+    if (capture.fd < 0) {
+        return 0;
+    }
+    len = snprintf(buffer, size, "capture: %lu messages, %lu bytes, %lu dropped, %lu write errors\n",
+                   capture.messages, capture.bytes, capture.dropped, capture.write_errors);
+    if (len < 0) {
+        return 0;
+    }
+    return len < size ? len : size - 1;
+}
@@ -0,0 +1,40 @@
+/* Copyright (c) 2020 Wi-Fi Alliance                                                */
+
+/* Permission to use, copy, modify, and/or distribute this software for any         */
+/* purpose with or without fee is hereby granted, provided that the above           */
+/* copyright notice and this permission notice appear in all copies.                */
+
+/* THE SOFTWARE IS PROVIDED 'AS IS' AND THE AUTHOR DISCLAIMS ALL                    */
+/* WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED                    */
+/* WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL                     */
+/* THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR                       */
+/* CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING                        */
+/* FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF                       */
+/* CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT                       */
+/* OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS                          */
+/* SOFTWARE. */
+
+
+#ifndef _INDIGO_CAPTURE_
+#define _INDIGO_CAPTURE_  1
+
+#include <sys/socket.h>
+
+/* Capture of the control traffic (-c). Messages are appended to a pcapng file as IPv4/UDP packets between
+ * the tool and the control port, so Wireshark shows the peer and port of each one. */
+#define CAPTURE_FILE_DEFAULT                    "/tmp/controlappc.pcapng"
+/* Records are collected in one buffer while the other one is written by a worker thread */
+#define CAPTURE_BUFFER_SIZE                     (256 * 1024)
+/* Milliseconds a record waits in the buffer before it is written */
+#define CAPTURE_FLUSH_INTERVAL                  200
+
+/* Direction of a message, as the inbound/outbound bits of the pcapng epb_flags option */
+#define CAPTURE_RECEIVED                        1
+#define CAPTURE_SENT                            2
+
+int capture_open(char *path);
+void capture_close();
+/* latency_us is the time from the request to the message, or -1. It is kept as the comment of the packet. */
+void capture_message(int direction, int sock, struct sockaddr *peer, socklen_t peerlen, char *message, int len, long latency_us);
+int capture_dump(char *buffer, int size);
+#endif
@@ -0,0 +1,945 @@
+/* Copyright (c) 2020 Wi-Fi Alliance                                                */
+
+/* Permission to use, copy, modify, and/or distribute this software for any         */
+/* purpose with or without fee is hereby granted, provided that the above           */
+/* copyright notice and this permission notice appear in all copies.                */
+
+/* THE SOFTWARE IS PROVIDED 'AS IS' AND THE AUTHOR DISCLAIMS ALL                    */
+/* WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED                    */
+/* WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL                     */
+/* THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR                       */
+/* CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING                        */
+/* FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF                       */
+/* CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT                       */
+/* OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS                          */
+/* SOFTWARE. */
+
+
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <syslog.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+#include <sys/mman.h>
+
+#include "indigo_log.h"
+#include "utils.h"
+
+/* Bytes of output collected before a write */
+#define LOG_OUTPUT_SIZE                         (16 * 1024)
+
+/* Runtime level of each category */
+int log_category_level[LOG_CATEGORY_COUNT] = {
+#define LOG_CATEGORY_LEVEL(category, name) [category] = LOG_LEVEL_DEBUG,
+    INDIGO_LOG_CATEGORY_LIST(LOG_CATEGORY_LEVEL)
+#undef LOG_CATEGORY_LEVEL
+};
+
+static const char *log_category_names[LOG_CATEGORY_COUNT] = {
+#define LOG_CATEGORY_NAME(category, name) [category] = name,
+    INDIGO_LOG_CATEGORY_LIST(LOG_CATEGORY_NAME)
+#undef LOG_CATEGORY_NAME
+};
+
+/* Start of the round of the ring a position falls in */
+#define LOG_ROUND(pos)                          ((pos) & ~(unsigned long) (LOG_RING_SIZE - 1))
+
+/* Binary log file: the header, the formats, then the blocks of records */
+#define LOG_BINARY_MAGIC                        "QTBLOG1"
+#define LOG_BINARY_BYTE_ORDER                   0x1a2b3c4d
+/* Format ID of a line kept as text */
+#define LOG_FORMAT_TEXT                         0xffff
+/* Formats interned at once, a power of two, and the arguments of one */
+#define LOG_FORMAT_SLOTS                        2048
+#define LOG_FORMAT_ARGS_MAX                     16
+
+struct log_binary_header {
+    char magic[8];
+    unsigned int byte_order;
+    unsigned int formats_offset;
+    unsigned int formats_size;
+    /* Bytes and count of the formats, updated after each one is added */
+    unsigned int formats_len;
+    unsigned int format_count;
+    unsigned int blocks_offset;
+    unsigned int block_size;
+    unsigned int block_count;
+};
+
+/* Records never cross a block. seq orders the blocks, and is 0 for one never used. */
+struct log_binary_block {
+    unsigned long long seq;
+    unsigned int used;
+    unsigned int reserved;
+};
+
+/* A record is followed by the arguments of its format: 8 bytes of each integer (q) or pointer (p), the
+ * doubles (d), and 2 bytes of length then the bytes of each string (s). A text record is followed by the text. */
+struct __attribute__((__packed__)) log_binary_record {
+    unsigned short len;
+    unsigned short format;
+    unsigned char level;
+    unsigned char reserved[3];
+    unsigned int sec;
+    unsigned int nsec;
+};
+
+/* A format in the file is its ID, its length, the number of its arguments, their types then the format */
+struct __attribute__((__packed__)) log_binary_format {
+    unsigned short id;
+    unsigned short len;
+    unsigned char argc;
+};
+
+/* Type of an argument as va_arg() takes it */
+enum {
+    LOG_ARG_INT,
+    LOG_ARG_UINT,
+    LOG_ARG_LONG,
+    LOG_ARG_ULONG,
+    LOG_ARG_LLONG,
+    LOG_ARG_ULLONG,
+    LOG_ARG_SIZE,
+    LOG_ARG_INTMAX,
+    LOG_ARG_PTRDIFF,
+    LOG_ARG_DOUBLE,
+    LOG_ARG_STRING,
+    LOG_ARG_POINTER,
+};
+
+struct log_format {
+    /* Published last. The format is interned once it is set. */
+    const char *fmt;
+    unsigned short id;
+    /* Cleared when the arguments can't be kept raw, like %m or a wide string */
+    unsigned char binary;
+    unsigned char argc;
+    unsigned char args[LOG_FORMAT_ARGS_MAX];
+    /* Bytes of the arguments but the strings */
+    int fixed;
+};
+
+/* A slot of the ring. seq is the start of the round the slot is free for, plus one once the line of the
+ * round is written, so producers and the flusher don't need a lock to share the slot.
+ * text holds the arguments of a line kept in binary. */
+struct log_record {
+    unsigned long seq;
+    int level;
+    struct timespec time;
+    unsigned short format;
+    unsigned short len;
+    char text[LOG_LINE_MAX];
+};
+
+static struct {
+    struct log_record ring[LOG_RING_SIZE];
+    /* Next position to write, taken by the producers */
+    unsigned long head;
+    /* Next position to read. Read while lock is held. */
+    unsigned long tail;
+    unsigned long lines;
+    unsigned long dropped;
+    unsigned long dropped_reported;
+    int initialized;
+    int running;
+    pthread_t thread;
+    sem_t wake;
+    pthread_mutex_t lock;
+    /* Test case log */
+    FILE *file;
+    /* Timestamp of the last second written */
+    time_t stamp_time;
+    char stamp[32];
+    char output[LOG_OUTPUT_SIZE];
+    int output_len;
+    /* Binary log. binary is set while the file is mapped. block is written by the flusher. */
+    int binary;
+    char *map;
+    struct log_binary_header *header;
+    struct log_binary_block *block;
+    unsigned int block_index;
+    unsigned long long block_seq;
+    unsigned long binary_records;
+    pthread_mutex_t format_lock;
+    /* Interned formats, kept for the life of the process so the producers can read them without a lock.
+     * A file gets the formats interned before it is opened at once, and the others as they come. */
+    struct log_format formats[LOG_FORMAT_SLOTS];
+    struct log_format *format_ids[LOG_FORMAT_SLOTS / 2];
+    int format_count;
+} indigo_log = { .lock = PTHREAD_MUTEX_INITIALIZER, .format_lock = PTHREAD_MUTEX_INITIALIZER };
+
+static const char *log_type(int level) {
+    switch (level) {
+    case LOG_LEVEL_DEBUG_VERBOSE:
+        return "debugverbose";
+    case LOG_LEVEL_DEBUG:
+        return "debug";
+    case LOG_LEVEL_NOTICE:
+        return "notice";
+    case LOG_LEVEL_WARNING:
+        return "warning";
+    default:
+        return "info";
+    }
+}
+
+static int log_priority(int level) {
+    switch (level) {
+    case LOG_LEVEL_DEBUG_VERBOSE:
+    case LOG_LEVEL_DEBUG:
+        return LOG_DEBUG;
+    case LOG_LEVEL_NOTICE:
+        return LOG_NOTICE;
+    case LOG_LEVEL_WARNING:
+        return LOG_WARNING;
+    default:
+        return LOG_INFO;
+    }
+}
+
+/* The timestamp is formatted once a second */
+static const char *log_timestamp(time_t time) {
+    struct tm info;
+
+    if (time != indigo_log.stamp_time) {
+        indigo_log.stamp_time = time;
+        if (localtime_r(&time, &info) == NULL || strftime(indigo_log.stamp, sizeof(indigo_log.stamp),
+                                                          "%b %d %H:%M:%S", &info) == 0) {
+            indigo_log.stamp[0] = 0;
+        }
+    }
+    return indigo_log.stamp;
+}
+
+static void log_output_flush() {
+    if (indigo_log.output_len == 0) {
+        return;
+    }
+    fwrite(indigo_log.output, 1, indigo_log.output_len, stdout);
+    fflush(stdout);
+    if (indigo_log.file) {
+        fwrite(indigo_log.output, 1, indigo_log.output_len, indigo_log.file);
+        fflush(indigo_log.file);
+    }
+    indigo_log.output_len = 0;
+}
+
+static void log_output(int level, time_t time, const char *text) {
+    int len;
+
+    syslog(log_priority(level), "controlappc.%8s  %s", log_type(level), text);
+    for (;;) {
+        len = snprintf(indigo_log.output + indigo_log.output_len, LOG_OUTPUT_SIZE - indigo_log.output_len,
+                       "%s controlappc.%8s  %s\n", log_timestamp(time), log_type(level), text);
+        if (len < 0) {
+            return;
+        }
+        if (indigo_log.output_len + len < LOG_OUTPUT_SIZE || indigo_log.output_len == 0) {
+            break;
+        }
+        log_output_flush();
+    }
+    indigo_log.output_len += len < LOG_OUTPUT_SIZE ? len : LOG_OUTPUT_SIZE - 1;
+}
+
+static int log_format_arg(struct log_format *format, int arg) {
+    if (format->argc == LOG_FORMAT_ARGS_MAX) {
+        return -1;
+    }
+    format->args[format->argc++] = arg;
+    format->fixed += arg == LOG_ARG_STRING ? 2 : 8;
+    return 0;
+}
+
+/* Find the arguments of the format. Returns -1 if one of them can't be kept raw. */
+static int log_format_parse(struct log_format *format, const char *fmt) {
+    /* Argument types by the length modifier: none, l, ll, z, j, t */
+    static const unsigned char signed_args[] = { LOG_ARG_INT, LOG_ARG_LONG, LOG_ARG_LLONG, LOG_ARG_SIZE,
+                                                 LOG_ARG_INTMAX, LOG_ARG_PTRDIFF };
+    static const unsigned char unsigned_args[] = { LOG_ARG_UINT, LOG_ARG_ULONG, LOG_ARG_ULLONG, LOG_ARG_SIZE,
+                                                   LOG_ARG_INTMAX, LOG_ARG_PTRDIFF };
+    const char *p = fmt;
+    int length, arg;
+
+    while ((p = strchr(p, '%')) != NULL) {
+        p++;
+        if (*p == '%') {
+            p++;
+            continue;
+        }
+        p += strspn(p, "-+ #0'");
+        if (*p == '*') {
+            if (log_format_arg(format, LOG_ARG_INT) < 0) {
+                return -1;
+            }
+            p++;
+        }
+        p += strspn(p, "0123456789");
+        if (*p == '.') {
+            p++;
+            if (*p == '*') {
+                if (log_format_arg(format, LOG_ARG_INT) < 0) {
+                    return -1;
+                }
+                p++;
+            }
+            p += strspn(p, "0123456789");
+        }
+        length = 0;
+        if (*p == 'h') {
+            p += p[1] == 'h' ? 2 : 1;
+        } else if (*p == 'l') {
+            length = p[1] == 'l' ? 2 : 1;
+            p += length;
+        } else if (*p == 'q') {
+            length = 2;
+            p++;
+        } else if (*p == 'z' || *p == 'j' || *p == 't') {
+            length = *p == 'z' ? 3 : *p == 'j' ? 4 : 5;
+            p++;
+        }
+        switch (*p) {
+        case 'c':
+            if (length) {
+                return -1;
+            }
+            /* fall through */
+        case 'd':
+        case 'i':
+            arg = signed_args[length];
+            break;
+        case 'o':
+        case 'u':
+        case 'x':
+        case 'X':
+            arg = unsigned_args[length];
+            break;
+        case 'e':
+        case 'E':
+        case 'f':
+        case 'F':
+        case 'g':
+        case 'G':
+        case 'a':
+        case 'A':
+            arg = LOG_ARG_DOUBLE;
+            break;
+        case 's':
+            if (length) {
+                return -1;
+            }
+            arg = LOG_ARG_STRING;
+            break;
+        case 'p':
+            arg = LOG_ARG_POINTER;
+            break;
+        default:
+            return -1;
+        }
+        if (log_format_arg(format, arg) < 0) {
+            return -1;
+        }
+        p++;
+    }
+    return 0;
+}
+
+/* Add the format to the file. Called with format_lock held. */
+static void log_binary_add_format(struct log_binary_header *header, struct log_format *format, const char *fmt) {
+    struct log_binary_format def;
+    char *p = indigo_log.map + header->formats_offset + header->formats_len;
+    int i, len = strlen(fmt);
+
+    if (!format->binary || header->formats_len + sizeof(def) + format->argc + len > header->formats_size) {
+        __atomic_store_n(&format->binary, 0, __ATOMIC_RELAXED);
+        return;
+    }
+    def.id = format->id;
+    def.len = len;
+    def.argc = format->argc;
+    memcpy(p, &def, sizeof(def));
+    p += sizeof(def);
+    for (i = 0; i < format->argc; i++) {
+        *p++ = format->args[i] == LOG_ARG_DOUBLE ? 'd' : format->args[i] == LOG_ARG_STRING ? 's' :
+               format->args[i] == LOG_ARG_POINTER ? 'p' : 'q';
+    }
+    memcpy(p, fmt, len);
+    header->formats_len += sizeof(def) + format->argc + len;
+    __atomic_store_n(&header->format_count, header->format_count + 1, __ATOMIC_RELEASE);
+}
+
+/* Interned format of the literal, or NULL to keep the line as text */
+static struct log_format* log_format_get(const char *fmt) {
+    unsigned int slot = (unsigned int) (((uintptr_t) fmt >> 2) * 2654435761u) & (LOG_FORMAT_SLOTS - 1);
+    struct log_format *format;
+    const char *key;
+    int i;
+
+    for (i = 0; i < LOG_FORMAT_SLOTS; i++, slot = (slot + 1) & (LOG_FORMAT_SLOTS - 1)) {
+        format = &indigo_log.formats[slot];
+        key = __atomic_load_n(&format->fmt, __ATOMIC_ACQUIRE);
+        if (key == fmt) {
+            return __atomic_load_n(&format->binary, __ATOMIC_RELAXED) ? format : NULL;
+        }
+        if (key == NULL) {
+            break;
+        }
+    }
+    if (i == LOG_FORMAT_SLOTS) {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&indigo_log.format_lock);
+    /* Another thread may have taken the slot */
+    while ((key = indigo_log.formats[slot].fmt) != NULL && key != fmt) {
+        slot = (slot + 1) & (LOG_FORMAT_SLOTS - 1);
+    }
+    format = &indigo_log.formats[slot];
+    if (key == NULL) {
+        if (indigo_log.format_count >= LOG_FORMAT_SLOTS / 2 || indigo_log.format_count >= LOG_FORMAT_TEXT) {
+            pthread_mutex_unlock(&indigo_log.format_lock);
+            return NULL;
+        }
+        format->id = indigo_log.format_count++;
+        format->binary = log_format_parse(format, fmt) == 0;
+        if (indigo_log.header) {
+            log_binary_add_format(indigo_log.header, format, fmt);
+        }
+        indigo_log.format_ids[format->id] = format;
+        __atomic_store_n(&format->fmt, fmt, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&indigo_log.format_lock);
+    return format->binary ? format : NULL;
+}
+
+/* Keep the arguments raw. Strings are cut to what the others leave of the buffer. */
+static int log_encode(char *buffer, int size, const struct log_format *format, va_list ap) {
+    int i, len = 0, room = size - format->fixed;
+    long long integer = 0;
+    double number;
+    const char *string;
+    unsigned short string_len;
+
+    for (i = 0; i < format->argc; i++) {
+        switch (format->args[i]) {
+        case LOG_ARG_INT:
+            integer = va_arg(ap, int);
+            break;
+        case LOG_ARG_UINT:
+            integer = va_arg(ap, unsigned int);
+            break;
+        case LOG_ARG_LONG:
+            integer = va_arg(ap, long);
+            break;
+        case LOG_ARG_ULONG:
+            integer = va_arg(ap, unsigned long);
+            break;
+        case LOG_ARG_LLONG:
+            integer = va_arg(ap, long long);
+            break;
+        case LOG_ARG_ULLONG:
+            integer = va_arg(ap, unsigned long long);
+            break;
+        case LOG_ARG_SIZE:
+            integer = va_arg(ap, size_t);
+            break;
+        case LOG_ARG_INTMAX:
+            integer = va_arg(ap, intmax_t);
+            break;
+        case LOG_ARG_PTRDIFF:
+            integer = va_arg(ap, ptrdiff_t);
+            break;
+        case LOG_ARG_POINTER:
+            integer = (uintptr_t) va_arg(ap, void *);
+            break;
+        case LOG_ARG_DOUBLE:
+            number = va_arg(ap, double);
+            memcpy(buffer + len, &number, sizeof(number));
+            len += sizeof(number);
+            continue;
+        case LOG_ARG_STRING:
+            string = va_arg(ap, const char *);
+            if (string == NULL) {
+                string = "(null)";
+            }
+            string_len = room > 0 ? strnlen(string, room) : 0;
+            room -= string_len;
+            memcpy(buffer + len, &string_len, sizeof(string_len));
+            memcpy(buffer + len + sizeof(string_len), string, string_len);
+            len += sizeof(string_len) + string_len;
+            continue;
+        }
+        memcpy(buffer + len, &integer, sizeof(integer));
+        len += sizeof(integer);
+    }
+    return len;
+}
+
+/* Next raw argument of a line. Returns -1 past the end of the arguments. */
+static int log_decode_arg(const char *args, int args_len, int *pos, int type, long long *integer, double *number,
+                          char *string) {
+    unsigned short string_len;
+
+    if (type == LOG_ARG_STRING) {
+        if (*pos + (int) sizeof(string_len) > args_len) {
+            return -1;
+        }
+        memcpy(&string_len, args + *pos, sizeof(string_len));
+        *pos += sizeof(string_len);
+        if (*pos + string_len > args_len) {
+            return -1;
+        }
+        memcpy(string, args + *pos, string_len);
+        string[string_len] = 0;
+        *pos += string_len;
+        return 0;
+    }
+    if (*pos + 8 > args_len) {
+        return -1;
+    }
+    if (type == LOG_ARG_DOUBLE) {
+        memcpy(number, args + *pos, sizeof(*number));
+    } else {
+        memcpy(integer, args + *pos, sizeof(*integer));
+    }
+    *pos += 8;
+    return 0;
+}
+
+/* Conversion of the spec with the widths and precisions of its stars first */
+#define LOG_FORMAT_CONVERSION(value) \
+    (stars == 0 ? snprintf(buffer + len, size - len, spec, value) : \
+     stars == 1 ? snprintf(buffer + len, size - len, spec, (int) star[0], value) : \
+     snprintf(buffer + len, size - len, spec, (int) star[0], (int) star[1], value))
+
+/* Render the arguments of a line kept raw to the text vsnprintf() would have made. The format is walked
+ * the way log_format_parse() walks it. */
+static void log_format_text(char *buffer, int size, const struct log_format *format, const char *args,
+                            int args_len) {
+    const char *p = format->fmt, *start;
+    char spec[32], string[LOG_LINE_MAX];
+    long long integer = 0, star[2];
+    double number = 0;
+    int arg = 0, pos = 0, len = 0, stars, ret = 0;
+
+    while (*p && len < size - 1) {
+        if (*p != '%') {
+            buffer[len++] = *p++;
+            continue;
+        }
+        if (p[1] == '%') {
+            buffer[len++] = '%';
+            p += 2;
+            continue;
+        }
+        start = p++;
+        stars = 0;
+        p += strspn(p, "-+ #0'");
+        if (*p == '*') {
+            p++;
+            if (log_decode_arg(args, args_len, &pos, format->args[arg++], &star[stars++], &number, string) < 0) {
+                break;
+            }
+        }
+        p += strspn(p, "0123456789");
+        if (*p == '.') {
+            p++;
+            if (*p == '*') {
+                p++;
+                if (log_decode_arg(args, args_len, &pos, format->args[arg++], &star[stars++], &number, string) < 0) {
+                    break;
+                }
+            }
+            p += strspn(p, "0123456789");
+        }
+        p += strspn(p, "hlqzjt");
+        p++;
+        if (p - start >= (int) sizeof(spec) || arg >= format->argc ||
+            log_decode_arg(args, args_len, &pos, format->args[arg], &integer, &number, string) < 0) {
+            break;
+        }
+        memcpy(spec, start, p - start);
+        spec[p - start] = 0;
+        switch (format->args[arg++]) {
+        case LOG_ARG_INT:
+            ret = LOG_FORMAT_CONVERSION((int) integer);
+            break;
+        case LOG_ARG_UINT:
+            ret = LOG_FORMAT_CONVERSION((unsigned int) integer);
+            break;
+        case LOG_ARG_LONG:
+            ret = LOG_FORMAT_CONVERSION((long) integer);
+            break;
+        case LOG_ARG_ULONG:
+            ret = LOG_FORMAT_CONVERSION((unsigned long) integer);
+            break;
+        case LOG_ARG_LLONG:
+            ret = LOG_FORMAT_CONVERSION(integer);
+            break;
+        case LOG_ARG_ULLONG:
+            ret = LOG_FORMAT_CONVERSION((unsigned long long) integer);
+            break;
+        case LOG_ARG_SIZE:
+            ret = LOG_FORMAT_CONVERSION((size_t) integer);
+            break;
+        case LOG_ARG_INTMAX:
+            ret = LOG_FORMAT_CONVERSION((intmax_t) integer);
+            break;
+        case LOG_ARG_PTRDIFF:
+            ret = LOG_FORMAT_CONVERSION((ptrdiff_t) integer);
+            break;
+        case LOG_ARG_DOUBLE:
+            ret = LOG_FORMAT_CONVERSION(number);
+            break;
+        case LOG_ARG_STRING:
+            ret = LOG_FORMAT_CONVERSION(string);
+            break;
+        case LOG_ARG_POINTER:
+            ret = LOG_FORMAT_CONVERSION((void *) (uintptr_t) integer);
+            break;
+        }
+        if (ret < 0) {
+            break;
+        }
+        len += ret < size - len ? ret : size - len - 1;
+    }
+    buffer[len] = 0;
+}
+
+static void log_binary_next_block() {
+    struct log_binary_header *header = indigo_log.header;
+
+    indigo_log.block_index = indigo_log.block_seq ? (indigo_log.block_index + 1) % header->block_count : 0;
+    indigo_log.block = (struct log_binary_block *) (indigo_log.map + header->blocks_offset +
+                                                   (size_t) indigo_log.block_index * header->block_size);
+    /* A reader skips the block until its seq is set */
+    indigo_log.block->seq = 0;
+    indigo_log.block->used = sizeof(struct log_binary_block);
+    __atomic_store_n(&indigo_log.block->seq, ++indigo_log.block_seq, __ATOMIC_RELEASE);
+}
+
+/* Append the line to the binary log. Called with lock held. */
+static void log_binary_append(struct log_record *record) {
+    struct log_binary_record header;
+    int len = record->format == LOG_FORMAT_TEXT ? strlen(record->text) : record->len;
+    char *p;
+
+    if (indigo_log.block->used + sizeof(header) + len > indigo_log.header->block_size) {
+        log_binary_next_block();
+    }
+    header.len = sizeof(header) + len;
+    header.format = record->format;
+    header.level = record->level;
+    memset(header.reserved, 0, sizeof(header.reserved));
+    header.sec = record->time.tv_sec;
+    header.nsec = record->time.tv_nsec;
+    p = (char *) indigo_log.block + indigo_log.block->used;
+    memcpy(p, &header, sizeof(header));
+    memcpy(p + sizeof(header), record->text, len);
+    __atomic_store_n(&indigo_log.block->used, indigo_log.block->used + header.len, __ATOMIC_RELEASE);
+    indigo_log.binary_records++;
+}
+
+/* Write the lines in the ring. Called with lock held, which makes the caller the only reader. Lines queued
+ * meanwhile are left to the next call, so the lock isn't held as long as the producers keep up. */
+static void log_drain() {
+    struct log_record *record;
+    unsigned long dropped, end = __atomic_load_n(&indigo_log.head, __ATOMIC_RELAXED);
+    char text[LOG_LINE_MAX];
+
+    while (indigo_log.tail != end) {
+        record = &indigo_log.ring[indigo_log.tail & (LOG_RING_SIZE - 1)];
+        if (__atomic_load_n(&record->seq, __ATOMIC_ACQUIRE) != LOG_ROUND(indigo_log.tail) + 1) {
+            break;
+        }
+        if (indigo_log.header) {
+            log_binary_append(record);
+        }
+        /* A line kept raw is formatted here, off the path of the caller of indigo_logger() */
+        if (record->format == LOG_FORMAT_TEXT) {
+            log_output(record->level, record->time.tv_sec, record->text);
+        } else {
+            log_format_text(text, sizeof(text), indigo_log.format_ids[record->format], record->text, record->len);
+            log_output(record->level, record->time.tv_sec, text);
+        }
+        __atomic_store_n(&record->seq, LOG_ROUND(indigo_log.tail) + LOG_RING_SIZE, __ATOMIC_RELEASE);
+        /* The producers read tail to wake the flusher */
+        __atomic_store_n(&indigo_log.tail, indigo_log.tail + 1, __ATOMIC_RELAXED);
+        indigo_log.lines++;
+    }
+    dropped = __atomic_load_n(&indigo_log.dropped, __ATOMIC_RELAXED);
+    if (dropped != indigo_log.dropped_reported) {
+        snprintf(text, sizeof(text), "%lu log lines dropped", dropped - indigo_log.dropped_reported);
+        indigo_log.dropped_reported = dropped;
+        log_output(LOG_LEVEL_WARNING, time(NULL), text);
+    }
+    log_output_flush();
+}
+
+void indigo_log_flush() {
+    pthread_mutex_lock(&indigo_log.lock);
+    log_drain();
+    pthread_mutex_unlock(&indigo_log.lock);
+}
+
+FILE* indigo_log_set_file(FILE *file) {
+    FILE *previous;
+
+    pthread_mutex_lock(&indigo_log.lock);
+    log_drain();
+    previous = indigo_log.file;
+    indigo_log.file = file;
+    pthread_mutex_unlock(&indigo_log.lock);
+    return previous;
+}
+
+static void* log_flusher(void *arg) {
+    struct timespec deadline;
+
+    while (__atomic_load_n(&indigo_log.running, __ATOMIC_ACQUIRE)) {
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += LOG_FLUSH_INTERVAL * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        if (sem_timedwait(&indigo_log.wake, &deadline) == 0) {
+            /* Wakeups that came in meanwhile are served by this round */
+            while (sem_trywait(&indigo_log.wake) == 0);
+        }
+        indigo_log_flush();
+    }
+    return NULL;
+}
+
+/* A child of fork() has no flusher. Its lines are written at once. */
+static void log_fork_prepare() {
+    pthread_mutex_lock(&indigo_log.lock);
+}
+
+static void log_fork_parent() {
+    pthread_mutex_unlock(&indigo_log.lock);
+}
+
+static void log_fork_child() {
+    indigo_log.running = 0;
+    pthread_mutex_unlock(&indigo_log.lock);
+}
+
+int indigo_log_init() {
+    if (indigo_log.running) {
+        return 0;
+    }
+    if (!indigo_log.initialized) {
+        if (sem_init(&indigo_log.wake, 0, 0) < 0) {
+            return -1;
+        }
+        pthread_atfork(log_fork_prepare, log_fork_parent, log_fork_child);
+        atexit(indigo_log_deinit);
+        indigo_log.initialized = 1;
+    }
+    indigo_log.running = 1;
+    if (pthread_create(&indigo_log.thread, NULL, log_flusher, NULL) != 0) {
+        indigo_log.running = 0;
+        return -1;
+    }
+    return 0;
+}
+
+void indigo_log_deinit() {
+    if (!__atomic_load_n(&indigo_log.running, __ATOMIC_ACQUIRE)) {
+        return;
+    }
+    __atomic_store_n(&indigo_log.running, 0, __ATOMIC_RELEASE);
+    sem_post(&indigo_log.wake);
+    pthread_join(indigo_log.thread, NULL);
+    indigo_log_flush();
+}
+
+int indigo_log_binary_open(char *path) {
+    struct log_binary_header *header;
+    int fd, i;
+
+    fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        indigo_logger(LOG_LEVEL_ERROR, "Failed to open the binary log %s: %s", path, strerror(errno));
+        return -1;
+    }
+    if (ftruncate(fd, LOG_BINARY_SIZE) < 0) {
+        indigo_logger(LOG_LEVEL_ERROR, "Failed to size the binary log %s: %s", path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    indigo_log.map = mmap(NULL, LOG_BINARY_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (indigo_log.map == MAP_FAILED) {
+        indigo_log.map = NULL;
+        indigo_logger(LOG_LEVEL_ERROR, "Failed to map the binary log %s: %s", path, strerror(errno));
+        return -1;
+    }
+
+    pthread_mutex_lock(&indigo_log.lock);
+    pthread_mutex_lock(&indigo_log.format_lock);
+    header = (struct log_binary_header *) indigo_log.map;
+    memcpy(header->magic, LOG_BINARY_MAGIC, sizeof(header->magic));
+    header->byte_order = LOG_BINARY_BYTE_ORDER;
+    header->formats_offset = LOG_BINARY_BLOCK_SIZE;
+    header->formats_size = LOG_BINARY_FORMATS_SIZE;
+    header->blocks_offset = header->formats_offset + LOG_BINARY_FORMATS_SIZE;
+    header->block_size = LOG_BINARY_BLOCK_SIZE;
+    header->block_count = (LOG_BINARY_SIZE - header->blocks_offset) / LOG_BINARY_BLOCK_SIZE;
+    /* The formats interned so far are in the file before the producers can see it */
+    for (i = 0; i < indigo_log.format_count; i++) {
+        log_binary_add_format(header, indigo_log.format_ids[i], indigo_log.format_ids[i]->fmt);
+    }
+    indigo_log.header = header;
+    indigo_log.block_seq = 0;
+    log_binary_next_block();
+    __atomic_store_n(&indigo_log.binary, 1, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&indigo_log.format_lock);
+    pthread_mutex_unlock(&indigo_log.lock);
+    indigo_logger(LOG_LEVEL_INFO, "Binary log: %s", path);
+    return 0;
+}
+
+void indigo_log_binary_close() {
+    unsigned long end;
+
+    if (indigo_log.map == NULL) {
+        return;
+    }
+    /* A line that took its slot before binary is cleared may still be kept raw. Those lines are written to
+     * the file before it's closed. The order with the slot taken in indigo_log_write() makes sure a line
+     * either sees binary cleared or is before end. */
+    __atomic_store_n(&indigo_log.binary, 0, __ATOMIC_SEQ_CST);
+    end = __atomic_load_n(&indigo_log.head, __ATOMIC_SEQ_CST);
+    pthread_mutex_lock(&indigo_log.lock);
+    for (;;) {
+        log_drain();
+        if ((long) (indigo_log.tail - end) >= 0) {
+            break;
+        }
+        pthread_mutex_unlock(&indigo_log.lock);
+        sched_yield();
+        pthread_mutex_lock(&indigo_log.lock);
+    }
+    pthread_mutex_lock(&indigo_log.format_lock);
+    indigo_log.header = NULL;
+    indigo_log.block = NULL;
+    pthread_mutex_unlock(&indigo_log.format_lock);
+    msync(indigo_log.map, LOG_BINARY_SIZE, MS_SYNC);
+    munmap(indigo_log.map, LOG_BINARY_SIZE);
+    indigo_log.map = NULL;
+    pthread_mutex_unlock(&indigo_log.lock);
+}
+
+int indigo_log_category_by_name(const char *name) {
+    int category;
+
+    if (strcmp(name, "all") == 0) {
+        return LOG_CATEGORY_ALL;
+    }
+    for (category = 0; category < LOG_CATEGORY_COUNT; category++) {
+        if (strcmp(name, log_category_names[category]) == 0) {
+            return category;
+        }
+    }
+    return -2;
+}
+
+void indigo_log_set_level(int category, int level) {
+    int i;
+
+    for (i = 0; i < LOG_CATEGORY_COUNT; i++) {
+        if (category == LOG_CATEGORY_ALL || category == i) {
+            __atomic_store_n(&log_category_level[i], level, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+int indigo_log_levels_dump(char *buffer, int size) {
+    int category, len = 0, ret;
+
+    for (category = 0; category < LOG_CATEGORY_COUNT && len < size; category++) {
+        ret = snprintf(buffer + len, size - len, "%s%s=%d", category ? " " : "", log_category_names[category],
+                       __atomic_load_n(&log_category_level[category], __ATOMIC_RELAXED));
+        if (ret < 0) {
+            break;
+        }
+        len += ret;
+    }
+    return len < size ? len : size - 1;
+}
+
+int indigo_log_dump(char *buffer, int size) {
+    int len;
+
+    pthread_mutex_lock(&indigo_log.lock);
+    len = snprintf(buffer, size, "log: %lu lines, %lu dropped, %lu binary records\n", indigo_log.lines,
+                   __atomic_load_n(&indigo_log.dropped, __ATOMIC_RELAXED), indigo_log.binary_records);
+    pthread_mutex_unlock(&indigo_log.lock);
+    if (len < 0) {
+        return 0;
+    }
+    return len < size ? len : size - 1;
+}
+
+void indigo_log_write(int level, int literal, const char *fmt, ...) {
+    struct log_record *record;
+    struct log_format *format = NULL;
+    unsigned long pos, seq;
+    va_list ap;
+
+    /* Take the next slot, unless the flusher hasn't read it yet */
+    pos = __atomic_load_n(&indigo_log.head, __ATOMIC_RELAXED);
+    for (;;) {
+        record = &indigo_log.ring[pos & (LOG_RING_SIZE - 1)];
+        seq = __atomic_load_n(&record->seq, __ATOMIC_ACQUIRE);
+        if (seq == LOG_ROUND(pos)) {
+            /* Ordered with the clear of binary in indigo_log_binary_close() */
+            if (__atomic_compare_exchange_n(&indigo_log.head, &pos, pos + 1, 1, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if ((long) (seq - LOG_ROUND(pos)) < 0) {
+            __atomic_fetch_add(&indigo_log.dropped, 1, __ATOMIC_RELAXED);
+            if (!__atomic_load_n(&indigo_log.running, __ATOMIC_ACQUIRE)) {
+                indigo_log_flush();
+            }
+            return;
+        } else {
+            pos = __atomic_load_n(&indigo_log.head, __ATOMIC_RELAXED);
+        }
+    }
+
+    record->level = level;
+    clock_gettime(CLOCK_REALTIME, &record->time);
+    if (literal && level < LOG_LEVEL_WARNING && __atomic_load_n(&indigo_log.binary, __ATOMIC_SEQ_CST)) {
+        format = log_format_get(fmt);
+    }
+    va_start(ap, fmt);
+    if (format) {
+        record->format = format->id;
+        record->len = log_encode(record->text, sizeof(record->text), format, ap);
+    } else {
+        record->format = LOG_FORMAT_TEXT;
+        vsnprintf(record->text, sizeof(record->text), fmt, ap);
+    }
+    va_end(ap);
+    __atomic_store_n(&record->seq, LOG_ROUND(pos) + 1, __ATOMIC_RELEASE);
+
+    if (!__atomic_load_n(&indigo_log.running, __ATOMIC_ACQUIRE)) {
+        indigo_log_flush();
+    } else if (level >= LOG_LEVEL_WARNING ||
+               pos - __atomic_load_n(&indigo_log.tail, __ATOMIC_RELAXED) == LOG_RING_SIZE / 2) {
+        sem_post(&indigo_log.wake);
+    }
+}
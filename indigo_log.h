@@ -0,0 +1,56 @@
+/* Copyright (c) 2020 Wi-Fi Alliance                                                */
+
+/* Permission to use, copy, modify, and/or distribute this software for any         */
+/* purpose with or without fee is hereby granted, provided that the above           */
+/* copyright notice and this permission notice appear in all copies.                */
+
+/* THE SOFTWARE IS PROVIDED 'AS IS' AND THE AUTHOR DISCLAIMS ALL                    */
+/* WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED                    */
+/* WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL                     */
+/* THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR                       */
+/* CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING                        */
+/* FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF                       */
+/* CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT                       */
+/* OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS                          */
+/* SOFTWARE. */
+
+
+#ifndef _INDIGO_LOG_
+#define _INDIGO_LOG_  1
+
+#include <stdio.h>
+
+/* indigo_logger() queues each line in a ring, which any thread may write without a lock. A flusher thread
+ * writes the lines in batches to stdout, the test case log and syslog, so a handler doesn't wait for any of
+ * them. A line that finds the ring full is dropped and counted. */
+#define LOG_RING_SIZE                           1024
+#define LOG_LINE_MAX                            512
+/* Milliseconds a line may wait in the ring. Warnings and errors, and a ring half full, wake the flusher. */
+#define LOG_FLUSH_INTERVAL                      50
+
+/* Binary log (-l). A line of a literal format under LOG_LEVEL_WARNING is queued unformatted, as the ID of its
+ * format and its raw arguments, and kept so in a memory-mapped file. `test.py log <file>` renders the lines
+ * later. The flusher formats those lines for the outputs, so they still have every line. The other lines are
+ * kept in the file as text. The oldest block of the file is reused once the file is full. */
+#define LOG_BINARY_FILE_DEFAULT                 "/tmp/controlappc.blog"
+#define LOG_BINARY_SIZE                         (4 * 1024 * 1024)
+#define LOG_BINARY_FORMATS_SIZE                 (64 * 1024)
+#define LOG_BINARY_BLOCK_SIZE                   4096
+
+/* Until indigo_log_init() and after indigo_log_deinit(), lines are written at once by the caller */
+int indigo_log_init();
+void indigo_log_deinit();
+/* Write the queued lines */
+void indigo_log_flush();
+/* Write the queued lines and switch the test case log. Returns the previous one. */
+FILE* indigo_log_set_file(FILE *file);
+int indigo_log_dump(char *buffer, int size);
+int indigo_log_binary_open(char *path);
+void indigo_log_binary_close();
+/* Category of the name, LOG_CATEGORY_ALL for "all", or -2 */
+int indigo_log_category_by_name(const char *name);
+/* Lines of the category, or of all with LOG_CATEGORY_ALL, under the level aren't written */
+void indigo_log_set_level(int category, int level);
+/* Levels of the categories as "<name>=<level> ..." */
+int indigo_log_levels_dump(char *buffer, int size);
+#endif
@@ -14,22 +14,69 @@
 /* OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS                          */
 /* SOFTWARE. */
 
+#define LOG_CATEGORY                            LOG_CATEGORY_PACKET
+
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <arpa/inet.h>
 
 #include "vendor_specific.h"
 #include "indigo_api.h"
 #include "utils.h"
 
-int capture_packet = 0, capture_count = 0;  /* debug. Write the received packets to files */
 int debug_packet = 0;                       /* used by the packet hexstring print */
 
-/* Parse the QuickTrack message from the packet to the wrapper */
-int parse_packet(struct packet_wrapper *req, char *packet, int packet_len) {
+/* Decode the value of the TLV by the schema. An empty value is left to the default. */
+static int decode_tlv_value(const struct indigo_tlv_schema *schema, struct tlv_hdr *tlv, union tlv_value *value) {
+    char buffer[32], *end = NULL;
+    int n = 0;
+
+    memset(value, 0, sizeof(*value));
+    if (schema->type == TLV_TYPE_STRING || tlv->len == 0) {
+        return 0;
+    }
+    if (tlv->len >= sizeof(buffer)) {
+        return -1;
+    }
+    memcpy(buffer, tlv->value, tlv->len);
+    buffer[tlv->len] = 0;
+
+    switch (schema->type) {
+    case TLV_TYPE_INT:
+        value->integer = strtoll(buffer, &end, 10);
+        if (end == buffer || *end || !(value->integer >= schema->min && value->integer <= schema->max)) {
+            return -1;
+        }
+        break;
+    case TLV_TYPE_DOUBLE:
+        value->number = strtod(buffer, &end);
+        if (end == buffer || *end || !(value->number >= schema->min && value->number <= schema->max)) {
+            return -1;
+        }
+        break;
+    case TLV_TYPE_MAC:
+        if (sscanf(buffer, "%2hhx:%2hhx:%2hhx:%2hhx:%2hhx:%2hhx%n", &value->mac[0], &value->mac[1], &value->mac[2],
+                   &value->mac[3], &value->mac[4], &value->mac[5], &n) != 6 || buffer[n]) {
+            return -1;
+        }
+        break;
+    case TLV_TYPE_IPV4:
+        if (inet_pton(AF_INET, buffer, &value->ipv4) != 1) {
+            return -1;
+        }
+        break;
+    default:
+        break;
+    }
+    return 0;
+}
+
+/* Parse the QuickTrack message from the packet to the wrapper. views doesn't allocate or copy the TLVs. */
+static int parse_packet_wrapper(struct packet_wrapper *req, char *packet, int packet_len, int views) {
     int i = 0, parser = 0, ret = 0;
     struct indigo_api *api = NULL;
-    struct indigo_tlv *tlv = NULL;
+    const struct indigo_tlv *tlv = NULL;
 
     /* Print the debug message */
     if (debug_packet)
@@ -47,19 +94,46 @@ int parse_packet(struct packet_wrapper *req, char *packet, int packet_len) {
     }
 
     /* Parse the TLVs */
+    memset(req->tlv_index, 0, sizeof(req->tlv_index));
+    req->indexed = 1;
+    if (views) {
+        req->views = 1;
+        req->packet = packet;
+        req->packet_len = packet_len;
+    }
     while (packet_len - parser > 0) {
-        req->tlv[req->tlv_num] = (struct tlv_hdr *)malloc(sizeof(struct tlv_hdr));
-        memset(req->tlv[req->tlv_num], 0, sizeof(struct tlv_hdr));
-
-        ret = parse_tlv(req->tlv[req->tlv_num], packet + parser, packet_len - parser);
+        if (req->tlv_num == TLV_NUM) {
+            indigo_logger(LOG_LEVEL_WARNING, "More than %d TLVs", TLV_NUM);
+            return -1;
+        }
+        if (views) {
+            req->tlv[req->tlv_num] = &req->tlv_view[req->tlv_num];
+            ret = parse_tlv_view(req->tlv[req->tlv_num], packet + parser, packet_len - parser, req->hdr.version);
+        } else {
+            req->tlv[req->tlv_num] = (struct tlv_hdr *)malloc(sizeof(struct tlv_hdr));
+            memset(req->tlv[req->tlv_num], 0, sizeof(struct tlv_hdr));
+            ret = parse_tlv(req->tlv[req->tlv_num], packet + parser, packet_len - parser, req->hdr.version);
+        }
+        /* The handlers take the values of a request to be shorter than TLV_VALUE_SIZE. This holds for
+         * API_VERSION_EXTENDED too, where only the ACK and response TLVs may be longer. */
+        if (ret > 0 && req->tlv[req->tlv_num]->len >= TLV_VALUE_SIZE) {
+            indigo_logger(LOG_LEVEL_WARNING, "TLV 0x%04x is too long (%d bytes)", req->tlv[req->tlv_num]->id,
+                          req->tlv[req->tlv_num]->len);
+            req->tlv_num++;
+            return -1;
+        }
         if (ret > 0) {
             if (debug_packet) {
                 print_tlv(req->tlv[req->tlv_num]);
             }
 
+            index_wrapper_tlv(req, req->tlv_num);
             req->tlv_num++;
             parser += ret;
         } else {
+            if (views) {
+                req->tlv[req->tlv_num] = NULL;
+            }
             break;
         }
     }
@@ -82,52 +156,279 @@ int parse_packet(struct packet_wrapper *req, char *packet, int packet_len) {
             indigo_logger(LOG_LEVEL_WARNING, "    TLV: 0x%04x Unknown", req->tlv[i]->id);
             return -1;
         }
+        /* Malformed values are rejected here, before the ACK */
+        if (decode_tlv_value(tlv->schema, req->tlv[i], &req->value[i]) < 0) {
+            indigo_logger(LOG_LEVEL_WARNING, "    TLV: 0x%04x (%s) has an invalid value: %.*s", tlv->id, tlv->name,
+                          req->tlv[i]->len, req->tlv[i]->value);
+            return -1;
+        }
     }
+    req->decoded = 1;
 
-    /* Only for the debug purpose. Write the received packet to files */
-    if (capture_packet) {
-        char fn[S_BUFFER_LEN], value[8];
-        char *buffer;
-        int buffer_len = packet_len*6;
-        api = get_api_by_id(req->hdr.type);
-        if (api) {
-            sprintf(fn, "%02d_%s", capture_count++, api->name);
-        }
-        buffer = (char*)malloc(sizeof(char)*buffer_len);
-        if (!buffer) {
-            return 0;
-        }
-        memset(buffer, 0, buffer_len);
-        for (i = 0; i < packet_len; i++) {
-            memset(value, 0, sizeof(value));
-            sprintf(value, "0x%02x%s", (unsigned char)(packet[i]&0x00ff), (i<packet_len-1) ? ", " : "");
-            strcat(buffer, value);
+    return 0;
+}
+
+int parse_packet(struct packet_wrapper *req, char *packet, int packet_len) {
+    return parse_packet_wrapper(req, packet, packet_len, 0);
+}
+
+/* Parse the message without a heap allocation. The wrapper is valid as long as the packet. */
+int parse_packet_views(struct packet_wrapper *req, char *packet, int packet_len) {
+    return parse_packet_wrapper(req, packet, packet_len, 1);
+}
+
+/* Copy the packet the views point into, so the wrapper outlives the receive buffer */
+int keep_packet_views(struct packet_wrapper *req) {
+    int i;
+    char *copy;
+
+    if (!req->views || req->packet_copy) {
+        return 0;
+    }
+    copy = malloc(req->packet_len ? req->packet_len : 1);
+    if (copy == NULL) {
+        return -1;
+    }
+    memcpy(copy, req->packet, req->packet_len);
+    for (i = 0; i < req->tlv_num; i++) {
+        req->tlv_view[i].value = (unsigned char *) copy + (req->tlv_view[i].value - (unsigned char *) req->packet);
+    }
+    req->packet = req->packet_copy = copy;
+    return 0;
+}
+
+static unsigned int tlv_index_hash(int id) {
+    return (id ^ (id >> 7)) & (TLV_INDEX_SIZE - 1);
+}
+
+/* Position of the first TLV of the ID, or -1 */
+static int tlv_index_find(struct packet_wrapper *wrapper, int id) {
+    unsigned int slot;
+
+    for (slot = tlv_index_hash(id); wrapper->tlv_index[slot]; slot = (slot + 1) & (TLV_INDEX_SIZE - 1)) {
+        if (wrapper->tlv[wrapper->tlv_index[slot] - 1]->id == id) {
+            return wrapper->tlv_index[slot] - 1;
         }
-        write_file(fn, buffer, strlen(buffer));
-        free(buffer);
     }
+    return -1;
+}
 
-    return 0;
+/* Add the TLV at the position to the ID index. Positions must be added in order. */
+void index_wrapper_tlv(struct packet_wrapper *wrapper, int pos) {
+    unsigned int slot;
+    int last;
+    int id = wrapper->tlv[pos]->id;
+
+    if (!wrapper->indexed) {
+        return;
+    }
+    wrapper->tlv_index_next[pos] = 0;
+    for (slot = tlv_index_hash(id); wrapper->tlv_index[slot]; slot = (slot + 1) & (TLV_INDEX_SIZE - 1)) {
+        if (wrapper->tlv[wrapper->tlv_index[slot] - 1]->id == id) {
+            /* Append to the chain of the ID */
+            for (last = wrapper->tlv_index[slot] - 1; wrapper->tlv_index_next[last]; last = wrapper->tlv_index_next[last] - 1);
+            wrapper->tlv_index_next[last] = pos + 1;
+            return;
+        }
+    }
+    wrapper->tlv_index[slot] = pos + 1;
 }
 
-/* Find the specific TLV by TLV ID from the wrapper */
-struct tlv_hdr *find_wrapper_tlv_by_id(struct packet_wrapper *wrapper, int id) {
+/* Position of the first TLV of the ID in the wrapper, or -1 */
+static int find_wrapper_tlv_pos(struct packet_wrapper *wrapper, int id) {
     int i = 0;
 
-    for (i = 0; i < TLV_NUM; i++) {
+    if (wrapper->indexed) {
+        return tlv_index_find(wrapper, id);
+    }
+
+    for (i = 0; i < wrapper->tlv_num; i++) {
         if (wrapper->tlv[i]) {
             if (wrapper->tlv[i]->id == id) {
-                return wrapper->tlv[i];
+                return i;
             }
         }
     }
 
-    return NULL;
+    return -1;
+}
+
+/* Find the specific TLV by TLV ID from the wrapper */
+struct tlv_hdr *find_wrapper_tlv_by_id(struct packet_wrapper *wrapper, int id) {
+    int i = find_wrapper_tlv_pos(wrapper, id);
+
+    return i < 0 ? NULL : wrapper->tlv[i];
+}
+
+/* Iterate the TLVs of the ID in order. Start with *pos = -1. */
+struct tlv_hdr *find_wrapper_tlv_next(struct packet_wrapper *wrapper, int id, int *pos) {
+    int i;
+
+    if (wrapper->indexed) {
+        i = *pos < 0 ? tlv_index_find(wrapper, id) : wrapper->tlv_index_next[*pos] - 1;
+    } else {
+        for (i = *pos + 1; i < wrapper->tlv_num && !(wrapper->tlv[i] && wrapper->tlv[i]->id == id); i++);
+        if (i >= wrapper->tlv_num) {
+            i = -1;
+        }
+    }
+    if (i < 0) {
+        return NULL;
+    }
+    *pos = i;
+    return wrapper->tlv[i];
+}
+
+/* Decoded value of the first TLV of the ID, or NULL when it's missing, empty or not of the type. A wrapper the
+ * parser didn't build is decoded to scratch. */
+static union tlv_value *find_wrapper_tlv_value(struct packet_wrapper *wrapper, int id, enum tlv_type type,
+                                               union tlv_value *scratch) {
+    int i = find_wrapper_tlv_pos(wrapper, id);
+    const struct indigo_tlv *tlv = get_tlv_by_id(id);
+
+    if (i < 0 || tlv == NULL || wrapper->tlv[i]->len == 0) {
+        return NULL;
+    }
+    if (tlv->schema->type != type) {
+        indigo_logger(LOG_LEVEL_ERROR, "TLV 0x%04x (%s) isn't of type %d", tlv->id, tlv->name, type);
+        return NULL;
+    }
+    if (wrapper->decoded) {
+        return &wrapper->value[i];
+    }
+    return decode_tlv_value(tlv->schema, wrapper->tlv[i], scratch) < 0 ? NULL : scratch;
+}
+
+long long get_wrapper_tlv_int(struct packet_wrapper *wrapper, int id) {
+    union tlv_value scratch, *value = find_wrapper_tlv_value(wrapper, id, TLV_TYPE_INT, &scratch);
+    const struct indigo_tlv *tlv;
+
+    if (value) {
+        return value->integer;
+    }
+    tlv = get_tlv_by_id(id);
+    return tlv ? (long long) tlv->schema->def : 0;
+}
+
+double get_wrapper_tlv_double(struct packet_wrapper *wrapper, int id) {
+    union tlv_value scratch, *value = find_wrapper_tlv_value(wrapper, id, TLV_TYPE_DOUBLE, &scratch);
+    const struct indigo_tlv *tlv;
+
+    if (value) {
+        return value->number;
+    }
+    tlv = get_tlv_by_id(id);
+    return tlv ? tlv->schema->def : 0;
+}
+
+int get_wrapper_tlv_mac(struct packet_wrapper *wrapper, int id, unsigned char *mac) {
+    union tlv_value scratch, *value = find_wrapper_tlv_value(wrapper, id, TLV_TYPE_MAC, &scratch);
+
+    if (value == NULL) {
+        return -1;
+    }
+    memcpy(mac, value->mac, sizeof(value->mac));
+    return 0;
+}
+
+int get_wrapper_tlv_ipv4(struct packet_wrapper *wrapper, int id, unsigned int *addr) {
+    union tlv_value scratch, *value = find_wrapper_tlv_value(wrapper, id, TLV_TYPE_IPV4, &scratch);
+
+    if (value == NULL) {
+        return -1;
+    }
+    *addr = value->ipv4;
+    return 0;
+}
+
+/* Copy the value of the first TLV of the ID, of any type, as a string. It's cut to fit the buffer. */
+int get_wrapper_tlv_string(struct packet_wrapper *wrapper, int id, char *buffer, int size) {
+    struct tlv_hdr *tlv = find_wrapper_tlv_by_id(wrapper, id);
+    int len;
+
+    if (tlv == NULL || size <= 0) {
+        return -1;
+    }
+    len = tlv->len < size ? tlv->len : size - 1;
+    memcpy(buffer, tlv->value, len);
+    buffer[len] = 0;
+    return len;
+}
+
+/* Allocate from the arena. Falls back to a malloc'ed block freed on the reset. */
+void *packet_arena_alloc(struct packet_arena *arena, int size) {
+    struct packet_arena_block *block;
+    void *p;
+
+    size = (size + 7) & ~7;
+    if (arena->used + size <= PACKET_ARENA_SIZE) {
+        p = arena->buffer + arena->used;
+        arena->used += size;
+    } else {
+        block = malloc(sizeof(struct packet_arena_block) + size);
+        if (block == NULL) {
+            return NULL;
+        }
+        block->next = arena->overflow;
+        arena->overflow = block;
+        arena->overflow_used += size;
+        p = block->data;
+    }
+    if (arena->used + arena->overflow_used > arena->high_water) {
+        arena->high_water = arena->used + arena->overflow_used;
+    }
+    return p;
+}
+
+/* Release everything allocated from the arena. The high-water mark is kept. */
+void packet_arena_reset(struct packet_arena *arena) {
+    struct packet_arena_block *block;
+
+    while (arena->overflow) {
+        block = arena->overflow;
+        arena->overflow = block->next;
+        free(block);
+    }
+    arena->used = 0;
+    arena->overflow_used = 0;
+}
+
+/* Allocate the storage of a TLV of the wrapper */
+void *wrapper_alloc(struct packet_wrapper *wrapper, int size) {
+    if (wrapper->arena) {
+        return packet_arena_alloc(wrapper->arena, size);
+    }
+    return malloc(size);
 }
 
 /* Free the wrapper malloc's memory */
 int free_packet_wrapper(struct packet_wrapper *wrapper) {
     int i = 0;
+    struct packet_arena *arena = wrapper->arena;
+
+    /* The arena owns the TLVs. The wrapper stays bound to it for the next message. */
+    if (arena) {
+        packet_arena_reset(arena);
+        memset(wrapper->tlv, 0, sizeof(wrapper->tlv[0]) * wrapper->tlv_num);
+        memset(&wrapper->hdr, 0, sizeof(wrapper->hdr));
+        wrapper->tlv_num = 0;
+        wrapper->indexed = 0;
+        wrapper->decoded = 0;
+        return 0;
+    }
+
+    /* Views own nothing but the copy of the packet. Only the used slots are cleared. */
+    if (wrapper->views) {
+        free(wrapper->packet_copy);
+        memset(wrapper->tlv, 0, sizeof(wrapper->tlv[0]) * wrapper->tlv_num);
+        wrapper->tlv_num = 0;
+        wrapper->views = 0;
+        wrapper->indexed = 0;
+        wrapper->decoded = 0;
+        wrapper->packet = wrapper->packet_copy = NULL;
+        wrapper->packet_len = 0;
+        return 0;
+    }
 
     for (i = 0; i < TLV_NUM; i++) {
         if (wrapper->tlv[i]) {
@@ -197,11 +498,24 @@ int print_hex(char *message, int message_len) {
 
 /* Add the TLV to the wrapper */
 int add_wrapper_tlv(struct packet_wrapper *wrapper, int id, int len, char *value) {
-    if (add_tlv(wrapper->tlv[wrapper->tlv_num], id, len, value) == 0) {
-        wrapper->tlv_num++;
-        return 0;
+    struct tlv_hdr *tlv = wrapper->tlv[wrapper->tlv_num];
+    const struct indigo_tlv *decoded_tlv;
+
+    if (!tlv || wrapper->tlv_num >= TLV_NUM)
+        return 1;
+    tlv->id = id;
+    tlv->len = len;
+    tlv->value = wrapper_alloc(wrapper, len);
+    memcpy(tlv->value, value, len);
+    index_wrapper_tlv(wrapper, wrapper->tlv_num);
+    if (wrapper->decoded) {
+        decoded_tlv = get_tlv_by_id(id);
+        if (decoded_tlv == NULL || decode_tlv_value(decoded_tlv->schema, tlv, &wrapper->value[wrapper->tlv_num]) < 0) {
+            memset(&wrapper->value[wrapper->tlv_num], 0, sizeof(wrapper->value[0]));
+        }
     }
-    return 1;
+    wrapper->tlv_num++;
+    return 0;
 }
 
 /* Fill the TLV with the ID, length and value */
@@ -215,31 +529,74 @@ int add_tlv(struct tlv_hdr *tlv, int id, int len, char *value) {
     return 0;
 }
 
-/* Parse the TLV from the packet to the structure */
-int parse_tlv(struct tlv_hdr *tlv, char *packet, int packet_len) {
-    if (packet_len < 3) {
+/* Length of the TLV header in a message of the version */
+int tlv_hdr_len(int version) {
+    return version == API_VERSION_EXTENDED ? 4 : 3;
+}
+
+/* Parse the ID and length. Returns the header length, or -1 if the TLV is cut short. */
+static int parse_tlv_hdr(struct tlv_hdr *tlv, char *packet, int packet_len, int version) {
+    int hdr_len = tlv_hdr_len(version);
+
+    if (packet_len < hdr_len) {
         return -1;
     }
 
     tlv->id = ((packet[0] & 0x00ff) << 8) | (packet[1] & 0x00ff);
-    tlv->len = packet[2];
+    if (version == API_VERSION_EXTENDED) {
+        tlv->len = ((packet[2] & 0x00ff) << 8) | (packet[3] & 0x00ff);
+    } else {
+        tlv->len = packet[2] & 0x00ff;
+    }
+    if (tlv->len + hdr_len > packet_len) {
+        return -1;
+    }
+    return hdr_len;
+}
+
+/* Parse the TLV from the packet to the structure */
+int parse_tlv(struct tlv_hdr *tlv, char *packet, int packet_len, int version) {
+    int hdr_len = parse_tlv_hdr(tlv, packet, packet_len, version);
+
+    if (hdr_len < 0) {
+        return -1;
+    }
     tlv->value = (char*)malloc(sizeof(char) * tlv->len);
-    memcpy(tlv->value, &packet[3], tlv->len);
+    memcpy(tlv->value, &packet[hdr_len], tlv->len);
+
+    return tlv->len + hdr_len;
+}
+
+/* Parse the TLV without copying the value. The value points into the packet. */
+int parse_tlv_view(struct tlv_hdr *tlv, char *packet, int packet_len, int version) {
+    int hdr_len = parse_tlv_hdr(tlv, packet, packet_len, version);
+
+    if (hdr_len < 0) {
+        return -1;
+    }
+    tlv->value = (unsigned char *) &packet[hdr_len];
 
-    return tlv->len+3;
+    return tlv->len + hdr_len;
 }
 
-/* Convert the TLV structure to the packet */
-int gen_tlv(char *packet, int packet_size, struct tlv_hdr *t) {
+/* Convert the TLV structure to the packet. A value over 255 bytes needs the extended encoding. */
+int gen_tlv(char *packet, int packet_size, struct tlv_hdr *t, int version) {
     int len = 0;
 
-    if (packet_size < t->len + 3) {
+    if (packet_size < t->len + tlv_hdr_len(version)) {
+        return -1;
+    }
+    if (version != API_VERSION_EXTENDED && t->len > 0xff) {
+        indigo_logger(LOG_LEVEL_WARNING, "TLV 0x%04x: %d bytes need the extended encoding", t->id, t->len);
         return -1;
     }
 
     packet[len++] = (char) (t->id >> 8);
     packet[len++] = (char) (t->id & 0x00ff);
-    packet[len++] = t->len;
+    if (version == API_VERSION_EXTENDED) {
+        packet[len++] = (char) (t->len >> 8);
+    }
+    packet[len++] = (char) (t->len & 0x00ff);
     memcpy(&packet[len], t->value, t->len);
     len += t->len;
     
@@ -250,7 +607,7 @@ int gen_tlv(char *packet, int packet_size, struct tlv_hdr *t) {
 void print_tlv(struct tlv_hdr *t) {
     int i = 0;
     char buffer[S_BUFFER_LEN], value[S_BUFFER_LEN];
-    struct indigo_tlv *tlv = get_tlv_by_id(t->id);
+    const struct indigo_tlv *tlv = get_tlv_by_id(t->id);
 
     memset(buffer, 0, sizeof(buffer));
     memset(value, 0, sizeof(value));
@@ -261,14 +618,19 @@ void print_tlv(struct tlv_hdr *t) {
     if (t->len > 0) {
         sprintf(buffer, "    Value: ");
     }
-    for (i = 0; i < t->len; i++) {
+    /* As much of the value as fits the line */
+    for (i = 0; i < t->len && strlen(buffer) + 8 < sizeof(buffer); i++) {
         sprintf(value, "%02x ", t->value[i]);
         strcat(buffer, value);
     }
+    if (i < t->len) {
+        strcat(buffer, "...");
+    }
     indigo_logger(LOG_LEVEL_INFO, buffer);
 }
 
-/* Convert the wrapper to the packet includes the message header and all TLVs. Used by the ACK and resposne */
+/* Convert the wrapper to the packet includes the message header and all TLVs. Used by the ACK and resposne.
+ * The TLVs are encoded for the version in the header. The packet ends before the first TLV that doesn't fit. */
 int assemble_packet(char *packet, int packet_size, struct packet_wrapper *wrapper) {
     int i = 0, ret = 0, packet_len = 0;
 
@@ -276,8 +638,8 @@ int assemble_packet(char *packet, int packet_size, struct packet_wrapper *wrappe
     packet_len += ret;
 
     for (i = 0; i < wrapper->tlv_num; i++) {
-        ret = gen_tlv(packet + packet_len, packet_size - packet_len, wrapper->tlv[i]);
-        if (ret) {
+        ret = gen_tlv(packet + packet_len, packet_size - packet_len, wrapper->tlv[i], wrapper->hdr.version);
+        if (ret > 0) {
             packet_len += ret;
         } else {
             break;
@@ -19,6 +19,8 @@
 
 #define TLV_NUM           128
 #define TLV_VALUE_SIZE    256
+/* Slots of the TLV ID index. A power of two, twice TLV_NUM to keep the probes short. */
+#define TLV_INDEX_SIZE    256
 
 /* Packet structure */
 struct __attribute__((__packed__)) message_hdr {
@@ -29,22 +31,71 @@ struct __attribute__((__packed__)) message_hdr {
     unsigned char reserved2;
 };
 
+/* len takes 1 byte in the packet, or 2 in a message of API_VERSION_EXTENDED */
 struct __attribute__((__packed__)) tlv_hdr {
     unsigned short id;
-    unsigned char len;
+    unsigned short len;
     unsigned char *value;
 };
 
+/* Value of a TLV decoded by the schema of its ID. The IPv4 address is in network byte order. */
+union tlv_value {
+    long long integer;
+    double number;
+    unsigned char mac[6];
+    unsigned int ipv4;
+};
+
+/* Bump allocator for the TLVs of the ACK and response of one request. Reset at once after they are sent. */
+#define PACKET_ARENA_SIZE 4096
+
+struct packet_arena_block {
+    struct packet_arena_block *next;
+    char data[];
+};
+
+struct packet_arena {
+    int used;
+    /* Most bytes in use at once, including the overflow blocks */
+    int high_water;
+    int overflow_used;
+    /* Allocations that don't fit in the buffer */
+    struct packet_arena_block *overflow;
+    char buffer[PACKET_ARENA_SIZE] __attribute__((aligned(8)));
+};
+
 struct packet_wrapper {
     struct message_hdr hdr;
     struct tlv_hdr *tlv[TLV_NUM];
     int tlv_num;
+    /* Set by parse_packet_views(). The TLVs are stored in tlv_view and their values point into packet. */
+    int views;
+    char *packet;
+    /* Copy of the packet owned by the wrapper. See keep_packet_views(). */
+    char *packet_copy;
+    int packet_len;
+    struct tlv_hdr tlv_view[TLV_NUM];
+    /* Storage of the TLVs when set. Otherwise each TLV and its value are malloc'ed. */
+    struct packet_arena *arena;
+    /* ID index built by the parser. Open addressing, slots hold the position + 1 of the first TLV of an ID.
+     * tlv_index_next chains the TLVs of the same ID by position + 1. */
+    int indexed;
+    unsigned char tlv_index[TLV_INDEX_SIZE];
+    unsigned char tlv_index_next[TLV_NUM];
+    /* Set by the parser once the typed TLVs are decoded to value, by position */
+    int decoded;
+    union tlv_value value[TLV_NUM];
 };
 
 /* API */
 int assemble_packet(char *packet, int packet_size, struct packet_wrapper *wrapper);
 int parse_packet(struct packet_wrapper *req, char *packet, int packet_len);
+int parse_packet_views(struct packet_wrapper *req, char *packet, int packet_len);
+int keep_packet_views(struct packet_wrapper *req);
 int free_packet_wrapper(struct packet_wrapper *wrapper);
+void *wrapper_alloc(struct packet_wrapper *wrapper, int size);
+void *packet_arena_alloc(struct packet_arena *arena, int size);
+void packet_arena_reset(struct packet_arena *arena);
 
 /* Debug */
 int print_hex(char *message, int message_len);
@@ -55,11 +106,23 @@ int add_message_hdr(char *message, int message_len, struct message_hdr *hdr);
 void print_message_hdr(struct message_hdr *hdr);
 
 /* TLV header */
-int parse_tlv(struct tlv_hdr *tlv, char *message, int message_len);
-int gen_tlv(char *message, int message_len, struct tlv_hdr *t);
+int tlv_hdr_len(int version);
+int parse_tlv(struct tlv_hdr *tlv, char *message, int message_len, int version);
+int parse_tlv_view(struct tlv_hdr *tlv, char *message, int message_len, int version);
+int gen_tlv(char *message, int message_len, struct tlv_hdr *t, int version);
 void print_tlv(struct tlv_hdr *t);
 struct tlv_hdr *find_wrapper_tlv_by_id(struct packet_wrapper *wrapper, int id);
+struct tlv_hdr *find_wrapper_tlv_next(struct packet_wrapper *wrapper, int id, int *pos);
+void index_wrapper_tlv(struct packet_wrapper *wrapper, int pos);
 int add_wrapper_tlv(struct packet_wrapper *wrapper, int id, int len, char *value);
 
+/* Typed values of the TLVs of a request. A number missing or empty gets the default of its schema.
+ * The others return -1 when missing, and the string the length of the value otherwise. */
+long long get_wrapper_tlv_int(struct packet_wrapper *wrapper, int id);
+double get_wrapper_tlv_double(struct packet_wrapper *wrapper, int id);
+int get_wrapper_tlv_mac(struct packet_wrapper *wrapper, int id, unsigned char *mac);
+int get_wrapper_tlv_ipv4(struct packet_wrapper *wrapper, int id, unsigned int *addr);
+int get_wrapper_tlv_string(struct packet_wrapper *wrapper, int id, char *buffer, int size);
+
 int add_tlv(struct tlv_hdr *tlv, int id, int len, char *value);
 #endif /* _INDIGO_PACKET_ */
@@ -0,0 +1,1075 @@
+/* Copyright (c) 2020 Wi-Fi Alliance                                                */
+
+/* Permission to use, copy, modify, and/or distribute this software for any         */
+/* purpose with or without fee is hereby granted, provided that the above           */
+/* copyright notice and this permission notice appear in all copies.                */
+
+/* THE SOFTWARE IS PROVIDED 'AS IS' AND THE AUTHOR DISCLAIMS ALL                    */
+/* WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED                    */
+/* WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL                     */
+/* THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR                       */
+/* CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING                        */
+/* FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF                       */
+/* CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT                       */
+/* OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS                          */
+/* SOFTWARE. */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <signal.h>
+#include <spawn.h>
+#include <time.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+
+#include "eloop.h"
+#include "indigo_process.h"
+#include "utils.h"
+#include "wpa_ctrl.h"
+
+extern char **environ;
+
+/* comm of /proc/<pid>/stat keeps the first 15 bytes of the program name */
+#define PROCESS_COMM_LEN                        15
+/* Milliseconds between checks of a process without a pidfd */
+#define PROCESS_POLL_INTERVAL                   5
+
+struct process {
+    pid_t pid;
+    /* -1 without pidfd support */
+    int pidfd;
+    char name[PROCESS_COMM_LEN + 1];
+    struct timespec start;
+};
+
+static struct {
+    struct process processes[PROCESS_MAX];
+    /* Set once the exits are watched in eloop */
+    int watching;
+    /* Set when pidfd_open() isn't supported, so SIGCHLD is used */
+    int no_pidfd;
+    unsigned long started;
+    unsigned long exited;
+    unsigned long killed;
+    /* Stops in progress without blocking */
+    struct process_stopping *stoppings;
+    /* Readiness of the daemons after their start */
+    struct process_ready *watches;
+    unsigned long ready;
+    unsigned long not_ready;
+    long ready_last_ms;
+    long ready_max_ms;
+} supervisor;
+
+/* A stop waited for without blocking */
+struct process_stopping {
+    char comm[PROCESS_COMM_LEN + 1];
+    /* Processes still running, each with a pidfd of its own or -1 */
+    pid_t pids[PROCESS_MAX * 2];
+    int pidfds[PROCESS_MAX * 2];
+    int count;
+    int total;
+    /* Set once SIGKILL is sent */
+    int killed;
+    struct timespec start;
+    process_event_handler handler;
+    void *ctx;
+    struct process_stopping *next;
+};
+
+/* A daemon waited for without blocking */
+struct process_ready {
+    char path[128];
+    /* inotify instance watching the directory of the socket, or -1 */
+    int fd;
+    /* Connected control interface with a command in flight, or -1 */
+    int sock;
+    /* Daemon whose exit ends the wait, or 0, and set once it has exited */
+    pid_t pid;
+    int exited;
+#ifdef CONFIG_CTRL_IFACE_UDP
+    /* Prefix of the commands, empty until GET_COOKIE is answered */
+    char cookie[128];
+#else
+    struct wpa_ctrl *ctrl;
+#endif
+    struct timespec start;
+    process_event_handler handler;
+    void *ctx;
+    struct process_ready *next;
+};
+
+int process_ready_timeout = PROCESS_READY_TIMEOUT_DEFAULT;
+
+static void process_stopping_free(struct process_stopping *stopping);
+static void process_stopping_expired(void *eloop_ctx, void *timeout_ctx);
+static void process_stopping_retry(void *eloop_ctx, void *timeout_ctx);
+static void process_ready_free(struct process_ready *watch);
+static void process_ready_retry(void *eloop_ctx, void *timeout_ctx);
+static void process_ready_exited(pid_t pid);
+
+static long process_elapsed_ms(struct timespec *since) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - since->tv_sec) * 1000 + (now.tv_nsec - since->tv_nsec) / 1000000;
+}
+
+static int process_pidfd(pid_t pid) {
+#ifdef SYS_pidfd_open
+    int fd;
+
+    if (supervisor.no_pidfd) {
+        return -1;
+    }
+    fd = syscall(SYS_pidfd_open, pid, 0);
+    if (fd < 0 && errno == ENOSYS) {
+        supervisor.no_pidfd = 1;
+    }
+    return fd;
+#else
+    supervisor.no_pidfd = 1;
+    return -1;
+#endif
+}
+
+/* Program name of the command, cut like comm */
+static void process_name(const char *path, char *name) {
+    const char *base = strrchr(path, '/');
+
+    base = base ? base + 1 : path;
+    snprintf(name, PROCESS_COMM_LEN + 1, "%s", base);
+}
+
+static struct process* process_get(pid_t pid) {
+    int i;
+
+    for (i = 0; i < PROCESS_MAX; i++) {
+        if (supervisor.processes[i].pid == pid) {
+            return &supervisor.processes[i];
+        }
+    }
+    return NULL;
+}
+
+static void process_release(struct process *process) {
+    if (process->pidfd >= 0) {
+        if (supervisor.watching) {
+            eloop_unregister_read_sock(process->pidfd);
+        }
+        close(process->pidfd);
+    }
+    memset(process, 0, sizeof(*process));
+    process->pidfd = -1;
+}
+
+/* Reap the process if it has exited. Returns 1 if it has. */
+static int process_reap(struct process *process) {
+    int status;
+    pid_t ret;
+
+    ret = waitpid(process->pid, &status, WNOHANG);
+    if (ret == 0 || (ret < 0 && errno == EINTR)) {
+        return 0;
+    }
+    supervisor.exited++;
+    if (ret < 0) {
+        indigo_logger(LOG_LEVEL_DEBUG, "Process %s (%d) is gone", process->name, process->pid);
+    } else if (WIFSIGNALED(status)) {
+        indigo_logger(LOG_LEVEL_INFO, "Process %s (%d) killed by signal %d after %ld ms", process->name,
+                      process->pid, WTERMSIG(status), process_elapsed_ms(&process->start));
+    } else {
+        indigo_logger(LOG_LEVEL_INFO, "Process %s (%d) exited with status %d after %ld ms", process->name,
+                      process->pid, WEXITSTATUS(status), process_elapsed_ms(&process->start));
+    }
+    process_ready_exited(process->pid);
+    process_release(process);
+    return 1;
+}
+
+static void process_exited(int sock, void *eloop_ctx, void *sock_ctx) {
+    struct process *process = sock_ctx;
+
+    if (process_reap(process) == 0) {
+        /* The pidfd is readable once the process exits, and it is reaped right after */
+        indigo_logger(LOG_LEVEL_WARNING, "Process %s (%d) not reaped", process->name, process->pid);
+        eloop_unregister_read_sock(sock);
+    }
+}
+
+static void process_sigchld(int sig, void *eloop_ctx, void *signal_ctx) {
+    int i;
+
+    for (i = 0; i < PROCESS_MAX; i++) {
+        if (supervisor.processes[i].pid > 0) {
+            process_reap(&supervisor.processes[i]);
+        }
+    }
+}
+
+static void process_watch(struct process *process) {
+    if (!supervisor.watching) {
+        return;
+    }
+    if (process->pidfd >= 0 && eloop_register_read_sock(process->pidfd, process_exited, NULL, process) < 0) {
+        indigo_logger(LOG_LEVEL_WARNING, "Failed to watch process %s (%d)", process->name, process->pid);
+    }
+}
+
+void process_init() {
+    int i, fd;
+
+    fd = process_pidfd(getpid());
+    if (fd >= 0) {
+        close(fd);
+    }
+    supervisor.watching = 1;
+    if (supervisor.no_pidfd) {
+        eloop_register_signal(SIGCHLD, process_sigchld, NULL);
+    }
+    /* Processes started before eloop */
+    for (i = 0; i < PROCESS_MAX; i++) {
+        if (supervisor.processes[i].pid > 0) {
+            process_watch(&supervisor.processes[i]);
+        }
+    }
+}
+
+void process_deinit() {
+    int i;
+
+    /* The daemons keep running, as they did when they were started in the background */
+    for (i = 0; i < PROCESS_MAX; i++) {
+        if (supervisor.processes[i].pid > 0 && supervisor.processes[i].pidfd >= 0) {
+            if (supervisor.watching) {
+                eloop_unregister_read_sock(supervisor.processes[i].pidfd);
+            }
+            close(supervisor.processes[i].pidfd);
+            supervisor.processes[i].pidfd = -1;
+        }
+    }
+    supervisor.watching = 0;
+
+    /* The requests waiting for a daemon are dropped with the others */
+    while (supervisor.stoppings) {
+        process_stopping_free(supervisor.stoppings);
+    }
+    while (supervisor.watches) {
+        process_ready_free(supervisor.watches);
+    }
+}
+
+/* Split the command line in place. Returns the number of arguments. */
+static int process_split(char *line, char *argv[], int size) {
+    int argc = 0;
+    char *p = line, *arg;
+
+    while (argc < size - 1) {
+        while (*p == ' ' || *p == '\t' || *p == '\n') {
+            p++;
+        }
+        if (*p == '\0') {
+            break;
+        }
+        if (*p == '"') {
+            arg = ++p;
+            p = strchr(p, '"');
+            if (p == NULL) {
+                p = arg + strlen(arg);
+            }
+        } else {
+            arg = p;
+            p += strcspn(p, " \t\n");
+        }
+        argv[argc++] = arg;
+        if (*p == '\0') {
+            break;
+        }
+        *p++ = '\0';
+    }
+    argv[argc] = NULL;
+    return argc;
+}
+
+pid_t process_start(const char *command) {
+    char *line, *argv[PROCESS_ARGS_MAX];
+    struct process *process = NULL;
+    posix_spawn_file_actions_t actions;
+    posix_spawnattr_t attr;
+    sigset_t mask;
+    pid_t pid = -1;
+    short flags = POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF;
+    int ret;
+
+    line = strdup(command);
+    if (line == NULL) {
+        return -1;
+    }
+    if (process_split(line, argv, PROCESS_ARGS_MAX) == 0) {
+        goto done;
+    }
+
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+    posix_spawnattr_init(&attr);
+    /* The daemons don't get the signals of the terminal of the app, or its blocked and ignored signals */
+#ifdef POSIX_SPAWN_SETSID
+    flags |= POSIX_SPAWN_SETSID;
+#endif
+    posix_spawnattr_setflags(&attr, flags);
+    sigemptyset(&mask);
+    posix_spawnattr_setsigmask(&attr, &mask);
+    sigfillset(&mask);
+    sigdelset(&mask, SIGKILL);
+    sigdelset(&mask, SIGSTOP);
+    posix_spawnattr_setsigdefault(&attr, &mask);
+    ret = posix_spawnp(&pid, argv[0], &actions, &attr, argv, environ);
+    posix_spawnattr_destroy(&attr);
+    posix_spawn_file_actions_destroy(&actions);
+    if (ret) {
+        indigo_logger(LOG_LEVEL_ERROR, "Failed to run %s: %s", argv[0], strerror(ret));
+        pid = -1;
+        goto done;
+    }
+
+    supervisor.started++;
+    process = process_get(0);
+    if (process == NULL) {
+        /* Still stopped by name, but its exit isn't logged */
+        indigo_logger(LOG_LEVEL_WARNING, "Process %s (%d) isn't tracked, %d processes already", argv[0], pid,
+                      PROCESS_MAX);
+        goto done;
+    }
+    process->pid = pid;
+    process->pidfd = process_pidfd(pid);
+    process_name(argv[0], process->name);
+    clock_gettime(CLOCK_MONOTONIC, &process->start);
+    process_watch(process);
+    indigo_logger(LOG_LEVEL_DEBUG, "Process %s (%d) started: %s", process->name, pid, command);
+
+done:
+    free(line);
+    return pid;
+}
+
+int process_run(const char *command) {
+    struct process *process;
+    int status;
+    pid_t pid, ret;
+
+    pid = process_start(command);
+    if (pid < 0) {
+        return -1;
+    }
+    do {
+        ret = waitpid(pid, &status, 0);
+    } while (ret < 0 && errno == EINTR);
+    process = process_get(pid);
+    if (process) {
+        process_release(process);
+    }
+    supervisor.exited++;
+    if (ret < 0 || !WIFEXITED(status)) {
+        return -1;
+    }
+    return WEXITSTATUS(status);
+}
+
+/* Read comm and the state of the process from /proc/<pid>/stat, "<pid> (<comm>) <state> ...".
+ * Returns 0, or -1 if the process is gone. */
+static int process_stat(pid_t pid, char *comm, char *state) {
+    char path[64], stat[256], *open_paren, *close_paren;
+    int fd, len;
+
+    snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+    len = read(fd, stat, sizeof(stat) - 1);
+    close(fd);
+    if (len <= 0) {
+        return -1;
+    }
+    stat[len] = '\0';
+    open_paren = strchr(stat, '(');
+    close_paren = strrchr(stat, ')');
+    if (open_paren == NULL || close_paren == NULL || close_paren[1] != ' ') {
+        return -1;
+    }
+    *close_paren = '\0';
+    snprintf(comm, PROCESS_COMM_LEN + 1, "%s", open_paren + 1);
+    *state = close_paren[2];
+    return 0;
+}
+
+/* Fill pids with the running processes of the program name. Returns their number. */
+static int process_scan(const char *name, pid_t *pids, int size) {
+    char comm[PROCESS_COMM_LEN + 1], found[PROCESS_COMM_LEN + 1], state;
+    struct dirent *entry;
+    DIR *dir;
+    pid_t pid;
+    int count = 0;
+
+    process_name(name, comm);
+    dir = opendir("/proc");
+    if (dir == NULL) {
+        return 0;
+    }
+    while (count < size && (entry = readdir(dir)) != NULL) {
+        pid = atoi(entry->d_name);
+        if (pid <= 0 || pid == getpid()) {
+            continue;
+        }
+        if (process_stat(pid, found, &state) == 0 && state != 'Z' && strcmp(found, comm) == 0) {
+            pids[count++] = pid;
+        }
+    }
+    closedir(dir);
+    return count;
+}
+
+/* Returns 1 if the process has exited. One the app didn't start may be a zombie until its parent reaps it. */
+static int process_gone(pid_t pid) {
+    struct process *process;
+    char comm[PROCESS_COMM_LEN + 1], state;
+
+    process = process_get(pid);
+    if (process) {
+        return process_reap(process);
+    }
+    return waitpid(pid, NULL, WNOHANG) > 0 || process_stat(pid, comm, &state) < 0 || state == 'Z';
+}
+
+/* Wait for the processes to exit, taking off the ones that have. Returns the number left. */
+static int process_wait(pid_t *pids, int count, int timeout_ms) {
+    struct pollfd fds[PROCESS_MAX];
+    struct process *process;
+    struct timespec start;
+    int i, n, nfds, elapsed, timeout, opened[PROCESS_MAX];
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (;;) {
+        /* Take off the processes that have exited */
+        for (i = 0; i < count; ) {
+            if (process_gone(pids[i])) {
+                pids[i] = pids[--count];
+            } else {
+                i++;
+            }
+        }
+        elapsed = process_elapsed_ms(&start);
+        if (count == 0 || elapsed >= timeout_ms) {
+            return count;
+        }
+
+        /* Wait for a pidfd to be readable, or check again shortly for a process without one */
+        timeout = timeout_ms - elapsed;
+        nfds = 0;
+        for (i = 0; i < count && i < PROCESS_MAX; i++) {
+            process = process_get(pids[i]);
+            opened[nfds] = 0;
+            fds[nfds].fd = process ? process->pidfd : -1;
+            if (fds[nfds].fd < 0) {
+                fds[nfds].fd = process_pidfd(pids[i]);
+                opened[nfds] = fds[nfds].fd >= 0;
+            }
+            if (fds[nfds].fd < 0) {
+                timeout = timeout < PROCESS_POLL_INTERVAL ? timeout : PROCESS_POLL_INTERVAL;
+                continue;
+            }
+            fds[nfds].events = POLLIN;
+            nfds++;
+        }
+        if (count > PROCESS_MAX) {
+            timeout = timeout < PROCESS_POLL_INTERVAL ? timeout : PROCESS_POLL_INTERVAL;
+        }
+        poll(fds, nfds, timeout);
+        for (n = 0; n < nfds; n++) {
+            if (opened[n]) {
+                close(fds[n].fd);
+            }
+        }
+    }
+}
+
+/* Fill pids with the processes of the program name: the ones the app started, then the others, as killall
+ * would. Returns their number. */
+static int process_collect(const char *name, char *comm, pid_t *pids) {
+    int i, j, count, tracked, found;
+
+    process_name(name, comm);
+    count = 0;
+    for (i = 0; i < PROCESS_MAX; i++) {
+        if (supervisor.processes[i].pid > 0 && strcmp(supervisor.processes[i].name, comm) == 0) {
+            pids[count++] = supervisor.processes[i].pid;
+        }
+    }
+    tracked = count;
+    found = process_scan(name, pids + tracked, PROCESS_MAX * 2 - tracked);
+    for (i = tracked; i < tracked + found; i++) {
+        for (j = 0; j < count; j++) {
+            if (pids[j] == pids[i]) {
+                break;
+            }
+        }
+        if (j == count) {
+            pids[count++] = pids[i];
+        }
+    }
+    return count;
+}
+
+int process_stop(const char *name) {
+    pid_t pids[PROCESS_MAX * 2];
+    struct timespec start;
+    char comm[PROCESS_COMM_LEN + 1];
+    int i, count, left;
+
+    count = process_collect(name, comm, pids);
+    if (count == 0) {
+        return 0;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < count; i++) {
+        kill(pids[i], SIGTERM);
+    }
+    left = process_wait(pids, count, PROCESS_STOP_TIMEOUT);
+    if (left) {
+        indigo_logger(LOG_LEVEL_WARNING, "%d %s processes still running after %d ms, killing them", left, comm,
+                      PROCESS_STOP_TIMEOUT);
+        for (i = 0; i < left; i++) {
+            kill(pids[i], SIGKILL);
+        }
+        supervisor.killed += left;
+        left = process_wait(pids, left, PROCESS_KILL_TIMEOUT);
+    }
+    indigo_logger(LOG_LEVEL_DEBUG, "Stopped %d %s processes in %ld ms", count - left, comm,
+                  process_elapsed_ms(&start));
+    if (left) {
+        indigo_logger(LOG_LEVEL_ERROR, "Failed to stop %d %s processes", left, comm);
+        return -1;
+    }
+    return 0;
+}
+
+static void process_stopping_free(struct process_stopping *stopping) {
+    struct process_stopping **prev;
+    int i;
+
+    for (prev = &supervisor.stoppings; *prev; prev = &(*prev)->next) {
+        if (*prev == stopping) {
+            *prev = stopping->next;
+            break;
+        }
+    }
+    eloop_cancel_timeout(process_stopping_expired, stopping, NULL);
+    eloop_cancel_timeout(process_stopping_retry, stopping, NULL);
+    for (i = 0; i < stopping->count; i++) {
+        if (stopping->pidfds[i] >= 0) {
+            eloop_unregister_read_sock(stopping->pidfds[i]);
+            close(stopping->pidfds[i]);
+        }
+    }
+    free(stopping);
+}
+
+static void process_stopping_done(struct process_stopping *stopping, int result) {
+    process_event_handler handler = stopping->handler;
+    void *ctx = stopping->ctx;
+
+    indigo_logger(LOG_LEVEL_DEBUG, "Stopped %d %s processes in %ld ms", stopping->total - stopping->count,
+                  stopping->comm, process_elapsed_ms(&stopping->start));
+    if (result < 0) {
+        indigo_logger(LOG_LEVEL_ERROR, "Failed to stop %d %s processes", stopping->count, stopping->comm);
+    }
+    process_stopping_free(stopping);
+    if (handler) {
+        handler(ctx, result);
+    }
+}
+
+/* Take off the processes that have exited, and finish once all have */
+static void process_stopping_check(struct process_stopping *stopping) {
+    int i, polled = 0;
+
+    for (i = 0; i < stopping->count; ) {
+        if (process_gone(stopping->pids[i])) {
+            if (stopping->pidfds[i] >= 0) {
+                eloop_unregister_read_sock(stopping->pidfds[i]);
+                close(stopping->pidfds[i]);
+            }
+            stopping->count--;
+            stopping->pids[i] = stopping->pids[stopping->count];
+            stopping->pidfds[i] = stopping->pidfds[stopping->count];
+        } else {
+            polled |= stopping->pidfds[i] < 0;
+            i++;
+        }
+    }
+    if (stopping->count == 0) {
+        process_stopping_done(stopping, 0);
+        return;
+    }
+    /* A process without a pidfd is checked again shortly */
+    eloop_cancel_timeout(process_stopping_retry, stopping, NULL);
+    if (polled) {
+        eloop_register_timeout(0, PROCESS_POLL_INTERVAL * 1000, process_stopping_retry, stopping, NULL);
+    }
+}
+
+static void process_stopping_exited(int sock, void *eloop_ctx, void *sock_ctx) {
+    process_stopping_check(eloop_ctx);
+}
+
+static void process_stopping_retry(void *eloop_ctx, void *timeout_ctx) {
+    process_stopping_check(eloop_ctx);
+}
+
+/* SIGTERM wasn't enough. Kill the processes left, and give up if SIGKILL wasn't either. */
+static void process_stopping_expired(void *eloop_ctx, void *timeout_ctx) {
+    struct process_stopping *stopping = eloop_ctx;
+    int i;
+
+    if (stopping->killed) {
+        process_stopping_done(stopping, -1);
+        return;
+    }
+    indigo_logger(LOG_LEVEL_WARNING, "%d %s processes still running after %d ms, killing them", stopping->count,
+                  stopping->comm, PROCESS_STOP_TIMEOUT);
+    for (i = 0; i < stopping->count; i++) {
+        kill(stopping->pids[i], SIGKILL);
+    }
+    supervisor.killed += stopping->count;
+    stopping->killed = 1;
+    eloop_register_timeout(PROCESS_KILL_TIMEOUT / 1000, (PROCESS_KILL_TIMEOUT % 1000) * 1000,
+                           process_stopping_expired, stopping, NULL);
+}
+
+void process_stop_async(const char *name, process_event_handler handler, void *ctx) {
+    struct process_stopping *stopping;
+    int i;
+
+    stopping = malloc(sizeof(*stopping));
+    if (stopping == NULL) {
+        /* Stop it the blocking way rather than not at all */
+        i = process_stop(name);
+        if (handler) {
+            handler(ctx, i);
+        }
+        return;
+    }
+    memset(stopping, 0, sizeof(*stopping));
+    stopping->handler = handler;
+    stopping->ctx = ctx;
+    clock_gettime(CLOCK_MONOTONIC, &stopping->start);
+    stopping->count = stopping->total = process_collect(name, stopping->comm, stopping->pids);
+
+    for (i = 0; i < stopping->count; i++) {
+        kill(stopping->pids[i], SIGTERM);
+        /* A pidfd of its own, the one of a tracked process is watched by the supervisor already */
+        stopping->pidfds[i] = process_pidfd(stopping->pids[i]);
+        if (stopping->pidfds[i] >= 0 &&
+            eloop_register_read_sock(stopping->pidfds[i], process_stopping_exited, stopping, NULL) < 0) {
+            close(stopping->pidfds[i]);
+            stopping->pidfds[i] = -1;
+        }
+    }
+    stopping->next = supervisor.stoppings;
+    supervisor.stoppings = stopping;
+    eloop_register_timeout(PROCESS_STOP_TIMEOUT / 1000, (PROCESS_STOP_TIMEOUT % 1000) * 1000,
+                           process_stopping_expired, stopping, NULL);
+    process_stopping_check(stopping);
+}
+
+pid_t process_find(const char *name) {
+    char comm[PROCESS_COMM_LEN + 1];
+    pid_t pid;
+    int i;
+
+    process_name(name, comm);
+    for (i = 0; i < PROCESS_MAX; i++) {
+        if (supervisor.processes[i].pid > 0 && strcmp(supervisor.processes[i].name, comm) == 0 &&
+            process_reap(&supervisor.processes[i]) == 0) {
+            return supervisor.processes[i].pid;
+        }
+    }
+    return process_scan(name, &pid, 1) ? pid : 0;
+}
+
+/* Whether the control interface can be connected to. A UDP one needs its port. */
+static int process_ready_supported(const char *ctrl_path) {
+#ifdef CONFIG_CTRL_IFACE_UDP
+    return strncmp(ctrl_path, "udp:", 4) == 0;
+#else
+    return strchr(ctrl_path, '/') != NULL;
+#endif
+}
+
+/* Returns 1 if the daemon answers PING */
+static int process_ready_probe(const char *ctrl_path) {
+    struct wpa_ctrl *ctrl;
+    char reply[16];
+    size_t len = sizeof(reply) - 1;
+    int ret;
+
+#ifndef CONFIG_CTRL_IFACE_UDP
+    /* Nothing to connect to before the daemon binds its socket */
+    if (access(ctrl_path, F_OK) != 0) {
+        return 0;
+    }
+#endif
+    ctrl = wpa_ctrl_open(ctrl_path);
+    if (ctrl == NULL) {
+        return 0;
+    }
+    ret = wpa_ctrl_request(ctrl, "PING", 4, reply, &len, NULL);
+    wpa_ctrl_close(ctrl);
+    return ret == 0 && len >= 4 && strncmp(reply, "PONG", 4) == 0;
+}
+
+/* inotify instance watching the directory of the socket for its creation, or -1 if the directory isn't
+ * there yet or the socket isn't a file */
+static int process_ready_inotify(const char *ctrl_path) {
+#ifdef CONFIG_CTRL_IFACE_UDP
+    return -1;
+#else
+    char dir[128], *slash;
+    int fd;
+
+    snprintf(dir, sizeof(dir), "%s", ctrl_path);
+    slash = strrchr(dir, '/');
+    if (slash == NULL) {
+        return -1;
+    }
+    *slash = '\0';
+    fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+    if (inotify_add_watch(fd, slash == dir ? "/" : dir, IN_CREATE | IN_MOVED_TO | IN_ATTRIB) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+#endif
+}
+
+static void process_ready_drain(int fd) {
+    char events[sizeof(struct inotify_event) * 16 + 256];
+
+    while (read(fd, events, sizeof(events)) > 0);
+}
+
+/* Record the result of a wait. Returns the milliseconds it took, or -1 if the daemon wasn't ready. */
+static long process_ready_done(const char *ctrl_path, struct timespec *start, int ready) {
+    long elapsed = process_elapsed_ms(start);
+
+    if (!ready) {
+        supervisor.not_ready++;
+        indigo_logger(LOG_LEVEL_ERROR, "Control interface %s not ready after %ld ms", ctrl_path, elapsed);
+        return -1;
+    }
+    supervisor.ready++;
+    supervisor.ready_last_ms = elapsed;
+    if (elapsed > supervisor.ready_max_ms) {
+        supervisor.ready_max_ms = elapsed;
+    }
+    indigo_logger(LOG_LEVEL_INFO, "Control interface %s ready in %ld ms", ctrl_path, elapsed);
+    return elapsed;
+}
+
+long process_wait_ready(const char *ctrl_path, const char *name) {
+    struct pollfd pfd;
+    struct timespec start;
+    long elapsed, timeout;
+    pid_t pid = 0;
+    int ready = 0;
+
+    if (!process_ready_supported(ctrl_path)) {
+        indigo_logger(LOG_LEVEL_DEBUG, "Control interface %s can't be probed, waiting %d ms", ctrl_path,
+                      PROCESS_READY_FALLBACK);
+        usleep(PROCESS_READY_FALLBACK * 1000);
+        return PROCESS_READY_FALLBACK;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (name) {
+        pid = process_find(name);
+        if (pid == 0) {
+            indigo_logger(LOG_LEVEL_ERROR, "Process %s isn't running", name);
+            return process_ready_done(ctrl_path, &start, 0);
+        }
+    }
+    pfd.fd = process_ready_inotify(ctrl_path);
+    pfd.events = POLLIN;
+    for (;;) {
+        if (process_ready_probe(ctrl_path)) {
+            ready = 1;
+            break;
+        }
+        if (pid > 0 && process_gone(pid)) {
+            indigo_logger(LOG_LEVEL_ERROR, "Daemon of %s exited before it was ready", ctrl_path);
+            break;
+        }
+        elapsed = process_elapsed_ms(&start);
+        if (elapsed >= process_ready_timeout) {
+            break;
+        }
+        timeout = process_ready_timeout - elapsed;
+        timeout = timeout < PROCESS_READY_INTERVAL ? timeout : PROCESS_READY_INTERVAL;
+        if (poll(&pfd, pfd.fd >= 0 ? 1 : 0, timeout) > 0) {
+            process_ready_drain(pfd.fd);
+        }
+    }
+    if (pfd.fd >= 0) {
+        close(pfd.fd);
+    }
+    return process_ready_done(ctrl_path, &start, ready);
+}
+
+/* Send PING, or GET_COOKIE first over UDP. Returns -1 if the control interface isn't there. */
+static int process_ready_send(struct process_ready *watch) {
+    char cmd[sizeof(watch->path) + 8];
+    int len;
+
+#ifdef CONFIG_CTRL_IFACE_UDP
+    if (watch->cookie[0] == '\0') {
+        len = snprintf(cmd, sizeof(cmd), "GET_COOKIE");
+    } else {
+        len = snprintf(cmd, sizeof(cmd), "%s PING", watch->cookie);
+    }
+#else
+    len = snprintf(cmd, sizeof(cmd), "PING");
+#endif
+    return send(watch->sock, cmd, len, MSG_DONTWAIT) < 0 ? -1 : 0;
+}
+
+static void process_ready_disconnect(struct process_ready *watch) {
+    if (watch->sock < 0) {
+        return;
+    }
+    eloop_unregister_read_sock(watch->sock);
+#ifdef CONFIG_CTRL_IFACE_UDP
+    close(watch->sock);
+#else
+    wpa_ctrl_close(watch->ctrl);
+    watch->ctrl = NULL;
+#endif
+    watch->sock = -1;
+}
+
+static void process_ready_free(struct process_ready *watch) {
+    struct process_ready **prev;
+
+    for (prev = &supervisor.watches; *prev; prev = &(*prev)->next) {
+        if (*prev == watch) {
+            *prev = watch->next;
+            break;
+        }
+    }
+    eloop_cancel_timeout(process_ready_retry, watch, NULL);
+    process_ready_disconnect(watch);
+    if (watch->fd >= 0) {
+        eloop_unregister_read_sock(watch->fd);
+        close(watch->fd);
+    }
+    free(watch);
+}
+
+static void process_ready_finish(struct process_ready *watch, int ready) {
+    process_event_handler handler = watch->handler;
+    void *ctx = watch->ctx;
+    long ready_ms;
+
+    ready_ms = process_ready_done(watch->path, &watch->start, ready);
+    process_ready_free(watch);
+    handler(ctx, ready_ms);
+}
+
+/* Answer on the control interface. A datagram that isn't PONG, as an unsolicited event, is skipped. */
+static void process_ready_reply(int sock, void *eloop_ctx, void *sock_ctx) {
+    struct process_ready *watch = eloop_ctx;
+    char reply[sizeof(watch->path)];
+    ssize_t len;
+
+    len = recv(sock, reply, sizeof(reply) - 1, MSG_DONTWAIT);
+    if (len < 0) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+            /* Nothing bound to the interface yet. The next try connects again. */
+            process_ready_disconnect(watch);
+        }
+        return;
+    }
+    reply[len] = '\0';
+    if (reply[0] == '<') {
+        return;
+    }
+#ifdef CONFIG_CTRL_IFACE_UDP
+    if (watch->cookie[0] == '\0') {
+        if (strncmp(reply, "COOKIE=", 7) == 0) {
+            reply[strcspn(reply, "\n")] = '\0';
+            snprintf(watch->cookie, sizeof(watch->cookie), "%s", reply);
+            if (process_ready_send(watch) < 0) {
+                process_ready_disconnect(watch);
+            }
+        }
+        return;
+    }
+#endif
+    if (strncmp(reply, "PONG", 4) == 0) {
+        process_ready_finish(watch, 1);
+    }
+}
+
+/* Connect to the control interface and send the first command without waiting for the answer */
+static int process_ready_connect(struct process_ready *watch) {
+#ifdef CONFIG_CTRL_IFACE_UDP
+    struct sockaddr_in dest;
+    unsigned short port = 0;
+
+    sscanf(watch->path, "udp:%hu", &port);
+    memset(&dest, 0, sizeof(dest));
+    dest.sin_family = AF_INET;
+    dest.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    dest.sin_port = htons(port);
+    watch->sock = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (watch->sock < 0) {
+        return -1;
+    }
+    if (connect(watch->sock, (struct sockaddr *) &dest, sizeof(dest)) < 0) {
+        close(watch->sock);
+        watch->sock = -1;
+        return -1;
+    }
+    watch->cookie[0] = '\0';
+#else
+    /* Nothing to connect to before the daemon binds its socket */
+    if (access(watch->path, F_OK) != 0) {
+        return -1;
+    }
+    watch->ctrl = wpa_ctrl_open(watch->path);
+    if (watch->ctrl == NULL) {
+        return -1;
+    }
+    watch->sock = wpa_ctrl_get_fd(watch->ctrl);
+#endif
+    if (eloop_register_read_sock(watch->sock, process_ready_reply, watch, NULL) < 0 ||
+        process_ready_send(watch) < 0) {
+        process_ready_disconnect(watch);
+        return -1;
+    }
+    return 0;
+}
+
+/* Connect again if the last try found nothing, and give up once the deadline has passed. The answer comes to
+ * process_ready_reply(), so nothing here waits on the daemon. */
+static void process_ready_check(struct process_ready *watch) {
+    long remaining;
+
+    eloop_cancel_timeout(process_ready_retry, watch, NULL);
+    if (watch->exited || (watch->pid > 0 && process_gone(watch->pid))) {
+        indigo_logger(LOG_LEVEL_ERROR, "Daemon of %s exited before it was ready", watch->path);
+        process_ready_finish(watch, 0);
+        return;
+    }
+    remaining = process_ready_timeout - process_elapsed_ms(&watch->start);
+    if (remaining <= 0) {
+        process_ready_finish(watch, 0);
+        return;
+    }
+    if (watch->sock < 0) {
+        process_ready_connect(watch);
+    }
+    remaining = remaining < PROCESS_READY_INTERVAL ? remaining : PROCESS_READY_INTERVAL;
+    eloop_register_timeout(0, remaining * 1000, process_ready_retry, watch, NULL);
+}
+
+static void process_ready_retry(void *eloop_ctx, void *timeout_ctx) {
+    process_ready_check(eloop_ctx);
+}
+
+/* A daemon waited for was reaped. Its waits end from eloop, as the reap may come from any caller. */
+static void process_ready_exited(pid_t pid) {
+    struct process_ready *watch;
+
+    for (watch = supervisor.watches; watch; watch = watch->next) {
+        if (watch->pid == pid && !watch->exited) {
+            watch->exited = 1;
+            eloop_cancel_timeout(process_ready_retry, watch, NULL);
+            eloop_register_timeout(0, 0, process_ready_retry, watch, NULL);
+        }
+    }
+}
+
+static void process_ready_event(int sock, void *eloop_ctx, void *sock_ctx) {
+    process_ready_drain(sock);
+    process_ready_check(eloop_ctx);
+}
+
+int process_watch_ready(const char *ctrl_path, const char *name, process_event_handler handler, void *ctx) {
+    struct process_ready *watch;
+
+    if (!process_ready_supported(ctrl_path) || handler == NULL) {
+        return -1;
+    }
+    watch = malloc(sizeof(*watch));
+    if (watch == NULL) {
+        return -1;
+    }
+    memset(watch, 0, sizeof(*watch));
+    snprintf(watch->path, sizeof(watch->path), "%s", ctrl_path);
+    clock_gettime(CLOCK_MONOTONIC, &watch->start);
+    watch->handler = handler;
+    watch->ctx = ctx;
+    watch->sock = -1;
+    if (name) {
+        watch->pid = process_find(name);
+        if (watch->pid == 0) {
+            /* Gone already, so the first try ends the wait */
+            indigo_logger(LOG_LEVEL_ERROR, "Process %s isn't running", name);
+            watch->exited = 1;
+        }
+    }
+    watch->fd = process_ready_inotify(ctrl_path);
+    if (watch->fd >= 0 && eloop_register_read_sock(watch->fd, process_ready_event, watch, NULL) < 0) {
+        close(watch->fd);
+        watch->fd = -1;
+    }
+    watch->next = supervisor.watches;
+    supervisor.watches = watch;
+    /* The first try runs from eloop, after the request that started the daemon has returned */
+    eloop_register_timeout(0, 0, process_ready_retry, watch, NULL);
+    return 0;
+}
+
+int process_dump(char *buffer, int size) {
+    int i, len, ret;
+
+    len = snprintf(buffer, size, "processes: %lu started, %lu exited, %lu killed\n"
+                   "ready: %lu, %lu not ready, last %ld ms, max %ld ms\n", supervisor.started,
+                   supervisor.exited, supervisor.killed, supervisor.ready, supervisor.not_ready,
+                   supervisor.ready_last_ms, supervisor.ready_max_ms);
+    for (i = 0; i < PROCESS_MAX && len >= 0 && len < size; i++) {
+        if (supervisor.processes[i].pid > 0) {
+            ret = snprintf(buffer + len, size - len, "process %s (%d): up %ld ms\n", supervisor.processes[i].name,
+                           supervisor.processes[i].pid, process_elapsed_ms(&supervisor.processes[i].start));
+            if (ret < 0) {
+                break;
+            }
+            len += ret;
+        }
+    }
+    return len < size ? len : size - 1;
+}
@@ -0,0 +1,68 @@
+/* Copyright (c) 2020 Wi-Fi Alliance                                                */
+
+/* Permission to use, copy, modify, and/or distribute this software for any         */
+/* purpose with or without fee is hereby granted, provided that the above           */
+/* copyright notice and this permission notice appear in all copies.                */
+
+/* THE SOFTWARE IS PROVIDED 'AS IS' AND THE AUTHOR DISCLAIMS ALL                    */
+/* WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED                    */
+/* WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL                     */
+/* THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR                       */
+/* CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING                        */
+/* FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF                       */
+/* CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT                       */
+/* OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS                          */
+/* SOFTWARE. */
+
+#ifndef _INDIGO_PROCESS_
+#define _INDIGO_PROCESS_  1
+
+#include <sys/types.h>
+
+/* Supervisor of the daemons the app runs: hostapd, wpa_supplicant, dhcpd, dhclient and hs20-osu-client.
+ * They are started with posix_spawn() without a shell and kept in the foreground, so the app is their
+ * parent and sees them exit through a pidfd in eloop, or SIGCHLD where pidfds aren't supported. */
+#define PROCESS_MAX                             16
+#define PROCESS_ARGS_MAX                        64
+/* Milliseconds a process has to exit after SIGTERM, then after SIGKILL */
+#define PROCESS_STOP_TIMEOUT                    3000
+#define PROCESS_KILL_TIMEOUT                    1000
+
+/* Called from eloop with the result of an operation that doesn't block. It may also be called before the
+ * function that started the operation returns. */
+typedef void (*process_event_handler)(void *ctx, long result);
+
+void process_init();
+void process_deinit();
+/* Start the command line without a shell. Arguments are split at spaces, and double quotes keep one with
+ * spaces. Returns the pid, or -1 if the program couldn't run. */
+pid_t process_start(const char *command);
+/* Stop every process of the program name, started by the app or not, and wait until they have exited.
+ * Returns 0, or -1 if one is still running. It blocks, so it's for the init and teardown of the app. */
+int process_stop(const char *name);
+/* Same without blocking. The handler, if any, gets 0 once the processes have exited, or -1. */
+void process_stop_async(const char *name, process_event_handler handler, void *ctx);
+/* pid of a running process of the program name, or 0 */
+pid_t process_find(const char *name);
+/* Run the command line to its end. Returns its exit status, or -1 if it couldn't run or was killed. */
+int process_run(const char *command);
+int process_dump(char *buffer, int size);
+
+/* Readiness of a daemon after its start. The control interface is connected as soon as the socket appears in
+ * its directory, watched with inotify, and the daemon is ready once it answers PING with PONG. */
+#define PROCESS_READY_TIMEOUT_DEFAULT           5000
+/* Milliseconds between tries to connect when nothing answers on the socket yet, or its directory can't be watched */
+#define PROCESS_READY_INTERVAL                  20
+/* Fixed wait when the control interface can't be probed, as for a UDP one without its port */
+#define PROCESS_READY_FALLBACK                  2000
+
+/* Milliseconds to wait for a daemon to be ready, set with -w */
+extern int process_ready_timeout;
+
+/* Wait until the daemon of the control interface path is ready. Returns the milliseconds it took, or -1. The
+ * wait ends early with -1 if the process of the program name, when not NULL, isn't running or exits. A path
+ * that can't be probed only gets the fixed wait, and PROCESS_READY_FALLBACK is returned. */
+long process_wait_ready(const char *ctrl_path, const char *name);
+/* Same without blocking. Returns -1 if the control interface can't be watched, and the handler isn't called. */
+int process_watch_ready(const char *ctrl_path, const char *name, process_event_handler handler, void *ctx);
+#endif
@@ -0,0 +1,953 @@
+/* Copyright (c) 2020 Wi-Fi Alliance                                                */
+
+/* Permission to use, copy, modify, and/or distribute this software for any         */
+/* purpose with or without fee is hereby granted, provided that the above           */
+/* copyright notice and this permission notice appear in all copies.                */
+
+/* THE SOFTWARE IS PROVIDED 'AS IS' AND THE AUTHOR DISCLAIMS ALL                    */
+/* WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED                    */
+/* WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL                     */
+/* THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR                       */
+/* CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING                        */
+/* FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF                       */
+/* CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT                       */
+/* OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS                          */
+/* SOFTWARE. */
+
+#define _GNU_SOURCE
+#define LOG_CATEGORY                            LOG_CATEGORY_PACKET
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+
+#include "eloop.h"
+#include "indigo_api.h"
+#include "indigo_capture.h"
+#include "indigo_packet.h"
+#include "indigo_process.h"
+#include "indigo_request.h"
+#include "utils.h"
+
+extern int debug_packet;
+
+/* Requests waiting for their deferred response */
+static struct indigo_request *deferred_requests = NULL;
+/* Request whose handler is running */
+static struct indigo_request *current_request = NULL;
+/* Set while the requests are dropped on exit. Batches don't start their next command. */
+static int request_deinit = 0;
+/* Freed requests, linked by next */
+static struct indigo_request *request_pool = NULL;
+static int request_pool_num = 0;
+
+/* Messages held back until the end of the batch of received requests */
+struct outbox_message {
+    char buffer[BUFFER_LEN];
+    int len;
+    struct sockaddr_storage to;
+    socklen_t tolen;
+};
+
+static struct outbox_message outbox[REQUEST_OUTBOX_SIZE];
+static int outbox_num = 0;
+static int outbox_sock = -1;
+static int batch_active = 0;
+
+/* Syscall accounting of the control port */
+static struct {
+    unsigned long batches;
+    unsigned long requests;
+    unsigned long messages;
+    unsigned long recv_calls;
+    unsigned long send_calls;
+    int largest_batch;
+    /* Of the running batch */
+    int batch_requests;
+    int batch_messages;
+    int batch_send_calls;
+} batch_stats;
+
+/* Responses of the recent requests */
+static struct response_cache_entry response_cache[RESPONSE_CACHE_SIZE];
+/* Fragmented requests being received */
+static struct fragment_reassembly reassembly[FRAGMENT_REASSEMBLY_SIZE];
+
+static void indigo_request_resume(void *eloop_ctx, void *timeout_ctx);
+static void indigo_request_event_done(struct indigo_request *request);
+static void batch_commands_report(struct indigo_request *request, struct packet_wrapper *wrapper);
+static void batch_commands_next(struct indigo_request *request);
+
+static time_t response_cache_now() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec;
+}
+
+static void response_cache_clear(struct response_cache_entry *entry) {
+    if (entry->request) {
+        entry->request->cache = NULL;
+    }
+    free(entry->ack);
+    free(entry->resp);
+    memset(entry, 0, sizeof(struct response_cache_entry));
+}
+
+static int response_cache_used(struct response_cache_entry *entry) {
+    return entry->peerlen != 0;
+}
+
+static struct response_cache_entry* response_cache_find(struct sockaddr *from, socklen_t fromlen, unsigned short seq, unsigned short type) {
+    int i;
+    struct response_cache_entry *entry;
+
+    for (i = 0; i < RESPONSE_CACHE_SIZE; i++) {
+        entry = &response_cache[i];
+        if (response_cache_used(entry) && entry->seq == seq && entry->type == type &&
+            entry->peerlen == fromlen && memcmp(&entry->peer, from, fromlen) == 0) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+/* Store a copy of a sent message */
+static void response_cache_store(char **data, int *data_len, char *buffer, int len) {
+    free(*data);
+    *data_len = 0;
+    *data = malloc(len);
+    if (*data) {
+        memcpy(*data, buffer, len);
+        *data_len = len;
+    }
+}
+
+static void outbox_flush() {
+    struct mmsghdr msgs[REQUEST_OUTBOX_SIZE];
+    struct iovec iovecs[REQUEST_OUTBOX_SIZE];
+    int i, sent = 0, ret;
+
+    if (outbox_num == 0) {
+        return;
+    }
+
+    /* Queued data goes first, so keep the order through the send queue */
+    if (eloop_sock_send_pending(outbox_sock) == 0) {
+        memset(msgs, 0, sizeof(struct mmsghdr) * outbox_num);
+        for (i = 0; i < outbox_num; i++) {
+            iovecs[i].iov_base = outbox[i].buffer;
+            iovecs[i].iov_len = outbox[i].len;
+            msgs[i].msg_hdr.msg_iov = &iovecs[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+            msgs[i].msg_hdr.msg_name = &outbox[i].to;
+            msgs[i].msg_hdr.msg_namelen = outbox[i].tolen;
+        }
+        while (sent < outbox_num) {
+            ret = sendmmsg(outbox_sock, msgs + sent, outbox_num - sent, MSG_CONFIRM | MSG_DONTWAIT);
+            batch_stats.batch_send_calls++;
+            if (ret <= 0) {
+                break;
+            }
+            sent += ret;
+        }
+    }
+    /* The rest is sent or queued one by one */
+    for (i = sent; i < outbox_num; i++) {
+        eloop_sock_send(outbox_sock, outbox[i].buffer, outbox[i].len, MSG_CONFIRM,
+                        (struct sockaddr *)&outbox[i].to, outbox[i].tolen);
+        batch_stats.batch_send_calls++;
+    }
+    outbox_num = 0;
+    outbox_sock = -1;
+}
+
+/* Send a message on the control port. Within a batch, it is held back and sent with the others at the end. */
+int indigo_request_output(int sock, char *buffer, int len, struct sockaddr *to, socklen_t tolen) {
+    struct outbox_message *message;
+
+    if (!batch_active) {
+        batch_stats.messages++;
+        batch_stats.send_calls++;
+        return eloop_sock_send(sock, buffer, len, MSG_CONFIRM, to, tolen);
+    }
+
+    batch_stats.batch_messages++;
+    if (len > BUFFER_LEN || tolen > sizeof(message->to)) {
+        outbox_flush();
+        batch_stats.batch_send_calls++;
+        return eloop_sock_send(sock, buffer, len, MSG_CONFIRM, to, tolen);
+    }
+    if (outbox_num == REQUEST_OUTBOX_SIZE || (outbox_num && outbox_sock != sock)) {
+        outbox_flush();
+    }
+    message = &outbox[outbox_num++];
+    memcpy(message->buffer, buffer, len);
+    message->len = len;
+    memcpy(&message->to, to, tolen);
+    message->tolen = tolen;
+    outbox_sock = sock;
+    return 0;
+}
+
+/* Send a message on the control port, in fragments if it is longer than a datagram. Only a message of
+ * API_VERSION_EXTENDED gets that long. */
+static int output_message(int sock, char *buffer, int len, struct sockaddr *to, socklen_t tolen, long latency_us) {
+    char fragment[BUFFER_LEN];
+    int i, n, count, hdr_len = sizeof(struct message_hdr);
+
+    if (len <= BUFFER_LEN) {
+        capture_message(CAPTURE_SENT, sock, to, tolen, buffer, len, latency_us);
+        return indigo_request_output(sock, buffer, len, to, tolen);
+    }
+    count = (len - hdr_len + FRAGMENT_PAYLOAD_LEN - 1) / FRAGMENT_PAYLOAD_LEN;
+    if (count > FRAGMENT_COUNT_MAX) {
+        return -1;
+    }
+    for (i = 0; i < count; i++) {
+        n = len - hdr_len - i * FRAGMENT_PAYLOAD_LEN;
+        if (n > FRAGMENT_PAYLOAD_LEN) {
+            n = FRAGMENT_PAYLOAD_LEN;
+        }
+        memcpy(fragment, buffer, hdr_len);
+        fragment[5] = i;
+        fragment[6] = count;
+        memcpy(fragment + hdr_len, buffer + hdr_len + i * FRAGMENT_PAYLOAD_LEN, n);
+        capture_message(CAPTURE_SENT, sock, to, tolen, fragment, hdr_len + n, latency_us);
+        if (indigo_request_output(sock, fragment, hdr_len + n, to, tolen) < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int is_fragment(struct message_hdr *hdr) {
+    return hdr->version == API_VERSION_EXTENDED && hdr->reserved2 != API_RESERVED_BYTE && hdr->reserved2 > 1;
+}
+
+/* Start a batch of requests that were received with one syscall */
+void indigo_request_batch_begin(int requests) {
+    batch_active = 1;
+    batch_stats.batch_requests = requests;
+    batch_stats.batch_messages = 0;
+    batch_stats.batch_send_calls = 0;
+}
+
+/* Send the messages of the batch */
+void indigo_request_batch_end() {
+    outbox_flush();
+    batch_active = 0;
+
+    batch_stats.batches++;
+    batch_stats.requests += batch_stats.batch_requests;
+    batch_stats.messages += batch_stats.batch_messages;
+    batch_stats.recv_calls++;
+    batch_stats.send_calls += batch_stats.batch_send_calls;
+    if (batch_stats.batch_requests > batch_stats.largest_batch) {
+        batch_stats.largest_batch = batch_stats.batch_requests;
+    }
+    indigo_logger(LOG_LEVEL_DEBUG, "Batch: %d requests, %d messages, 1 recv and %d send syscalls",
+                  batch_stats.batch_requests, batch_stats.batch_messages, batch_stats.batch_send_calls);
+    batch_stats.batch_requests = batch_stats.batch_messages = batch_stats.batch_send_calls = 0;
+}
+
+int indigo_request_batch_dump(char *buffer, int size) {
+    int len;
+    unsigned long calls = batch_stats.recv_calls + batch_stats.send_calls;
+
+    len = snprintf(buffer, size, "control port: %lu batches (largest %d), %lu requests, %lu messages, "
+                   "%lu recv and %lu send syscalls, %lu.%02lu syscalls per request\n",
+                   batch_stats.batches, batch_stats.largest_batch, batch_stats.requests, batch_stats.messages,
+                   batch_stats.recv_calls, batch_stats.send_calls,
+                   batch_stats.requests ? calls / batch_stats.requests : 0,
+                   batch_stats.requests ? calls * 100 / batch_stats.requests % 100 : 0);
+    if (len < 0) {
+        return 0;
+    }
+    return len < size ? len : size - 1;
+}
+
+/* Send the stored messages again if the packet is a retransmission. Returns 1 if so. */
+int indigo_request_replay(int sock, struct sockaddr *from, socklen_t fromlen, char *packet, int len) {
+    struct message_hdr hdr;
+    struct response_cache_entry *entry;
+    struct indigo_api *api;
+
+    if (parse_message_hdr(&hdr, packet, len) < 0) {
+        return 0;
+    }
+    entry = response_cache_find(from, fromlen, hdr.seq, hdr.type);
+    if (entry == NULL) {
+        return 0;
+    }
+    if (entry->request == NULL && response_cache_now() - entry->done_time > RESPONSE_CACHE_LIFETIME) {
+        response_cache_clear(entry);
+        return 0;
+    }
+    /* A fragmented request is answered once, on its first fragment */
+    if (is_fragment(&hdr) && hdr.reserved != 0) {
+        return 1;
+    }
+
+    api = get_api_by_id(hdr.type);
+    indigo_logger(LOG_LEVEL_INFO, "API %s: Retransmitted request (seq %d), %s", api ? api->name : "Unknown",
+                  hdr.seq, entry->request ? "still in progress" : "replay the response");
+    if (entry->ack) {
+        output_message(sock, entry->ack, entry->ack_len, from, fromlen, -1);
+    }
+    if (entry->request == NULL && entry->resp) {
+        output_message(sock, entry->resp, entry->resp_len, from, fromlen, -1);
+    }
+    return 1;
+}
+
+static void fragment_reassembly_clear(struct fragment_reassembly *r) {
+    free(r->message);
+    memset(r, 0, sizeof(struct fragment_reassembly));
+}
+
+/* Collect a fragment of a request. Returns 0 if the packet is not a fragment, the length of the message in
+ * *message once the last fragment is in, or -1 while fragments are missing. The caller frees the message. */
+int indigo_request_reassemble(struct sockaddr *from, socklen_t fromlen, char *packet, int len, char **message) {
+    struct message_hdr hdr;
+    struct fragment_reassembly *r = NULL, *unused = NULL, *oldest = NULL;
+    time_t now = response_cache_now();
+    int i, payload, hdr_len = sizeof(struct message_hdr);
+
+    if (parse_message_hdr(&hdr, packet, len) < 0 || !is_fragment(&hdr)) {
+        return 0;
+    }
+    payload = len - hdr_len;
+    if (hdr.reserved2 > FRAGMENT_COUNT_MAX || hdr.reserved >= hdr.reserved2 || fromlen > sizeof(r->peer) ||
+        (hdr.reserved < hdr.reserved2 - 1 && payload != FRAGMENT_PAYLOAD_LEN)) {
+        indigo_logger(LOG_LEVEL_WARNING, "Invalid fragment %d of %d (seq %d)", hdr.reserved, hdr.reserved2, hdr.seq);
+        return -1;
+    }
+
+    for (i = 0; i < FRAGMENT_REASSEMBLY_SIZE; i++) {
+        if (reassembly[i].message && now - reassembly[i].start > FRAGMENT_TIMEOUT) {
+            indigo_logger(LOG_LEVEL_WARNING, "Fragments of seq %d timed out, %d of %d received",
+                          reassembly[i].seq, reassembly[i].received, reassembly[i].count);
+            fragment_reassembly_clear(&reassembly[i]);
+        }
+        if (reassembly[i].message == NULL) {
+            if (unused == NULL) {
+                unused = &reassembly[i];
+            }
+        } else if (reassembly[i].seq == hdr.seq && reassembly[i].type == hdr.type &&
+                   reassembly[i].peerlen == fromlen && memcmp(&reassembly[i].peer, from, fromlen) == 0) {
+            r = &reassembly[i];
+        } else if (oldest == NULL || reassembly[i].start < oldest->start) {
+            oldest = &reassembly[i];
+        }
+    }
+    /* The tool reused the sequence number for another message */
+    if (r && r->count != hdr.reserved2) {
+        fragment_reassembly_clear(r);
+        unused = r;
+        r = NULL;
+    }
+    if (r == NULL) {
+        r = unused ? unused : oldest;
+        if (r->message) {
+            indigo_logger(LOG_LEVEL_WARNING, "Drop the fragments of seq %d for seq %d", r->seq, hdr.seq);
+            fragment_reassembly_clear(r);
+        }
+        r->message = malloc(hdr_len + hdr.reserved2 * FRAGMENT_PAYLOAD_LEN);
+        if (r->message == NULL) {
+            return -1;
+        }
+        memcpy(&r->peer, from, fromlen);
+        r->peerlen = fromlen;
+        r->seq = hdr.seq;
+        r->type = hdr.type;
+        r->count = hdr.reserved2;
+        r->start = now;
+        memcpy(r->message, packet, hdr_len);
+    }
+
+    if (r->have[hdr.reserved]) {
+        return -1;
+    }
+    r->have[hdr.reserved] = 1;
+    r->received++;
+    memcpy(r->message + hdr_len + hdr.reserved * FRAGMENT_PAYLOAD_LEN, packet + hdr_len, payload);
+    if (hdr.reserved == r->count - 1) {
+        r->len = hdr.reserved * FRAGMENT_PAYLOAD_LEN + payload;
+    }
+    if (r->received < r->count) {
+        return -1;
+    }
+
+    /* The reassembled message is not a fragment itself */
+    *message = r->message;
+    (*message)[5] = (*message)[6] = API_RESERVED_BYTE;
+    len = hdr_len + r->len;
+    r->message = NULL;
+    fragment_reassembly_clear(r);
+    return len;
+}
+
+/* Record what is sent for the request, so a retransmission of it can be answered from the cache */
+void indigo_request_track(struct indigo_request *request) {
+    int i;
+    struct response_cache_entry *entry = NULL, *oldest = NULL;
+
+    for (i = 0; i < RESPONSE_CACHE_SIZE; i++) {
+        if (!response_cache_used(&response_cache[i])) {
+            entry = &response_cache[i];
+            break;
+        }
+        /* Requests in progress are not evicted */
+        if (response_cache[i].request == NULL &&
+            (oldest == NULL || response_cache[i].done_time < oldest->done_time)) {
+            oldest = &response_cache[i];
+        }
+    }
+    if (entry == NULL) {
+        entry = oldest;
+    }
+    if (entry == NULL) {
+        return;
+    }
+
+    response_cache_clear(entry);
+    memcpy(&entry->peer, &request->from, request->fromlen);
+    entry->peerlen = request->fromlen;
+    entry->seq = request->req.hdr.seq;
+    entry->type = request->req.hdr.type;
+    entry->request = request;
+    request->cache = entry;
+}
+
+struct indigo_request* indigo_request_new(int sock, struct sockaddr *from, socklen_t fromlen) {
+    struct indigo_request *request = NULL;
+
+    if (fromlen > sizeof(request->from)) {
+        return NULL;
+    }
+    /* A pooled request has its wrappers and arena emptied already. Only the other fields are reset. */
+    if (request_pool) {
+        request = request_pool;
+        request_pool = request->next;
+        request_pool_num--;
+        request->stream = 0;
+        request->api = NULL;
+        request->arena.high_water = 0;
+        request->deferred = 0;
+        request->resume = NULL;
+        request->event_wait = 0;
+        request->events = 0;
+        request->event_result = 0;
+        request->event_failed = 0;
+        request->cache = NULL;
+        request->parent = NULL;
+        request->reported = 0;
+        request->commands = NULL;
+        request->next = NULL;
+    } else {
+        request = (struct indigo_request*)calloc(1, sizeof(struct indigo_request));
+        if (request == NULL) {
+            return NULL;
+        }
+        request->resp.arena = &request->arena;
+    }
+    request->sock = sock;
+    memcpy(&request->from, from, fromlen);
+    request->fromlen = fromlen;
+    clock_gettime(CLOCK_MONOTONIC, &request->received);
+    return request;
+}
+
+void indigo_request_free(struct indigo_request *request) {
+    struct indigo_request **prev;
+    struct indigo_request *parent = request->parent;
+    struct packet_wrapper resp;
+
+    /* An embedded request always reports to its batch, even if its handler had no response */
+    if (parent) {
+        if (!request->reported) {
+            memset(&resp, 0, sizeof(resp));
+            fill_wrapper_ack(&resp, request->req.hdr.seq, TLV_VALUE_STATUS_NOT_OK, "No response from the API handler");
+            batch_commands_report(request, &resp);
+            free_packet_wrapper(&resp);
+        }
+        parent->commands->current = NULL;
+    }
+    /* The batch is gone, so the running command has nowhere to report */
+    if (request->commands) {
+        if (request->commands->current) {
+            request->commands->current->parent = NULL;
+            request->commands->current->sock = -1;
+        }
+        free(request->commands->messages);
+        free(request->commands);
+    }
+
+    for (prev = &deferred_requests; *prev; prev = &(*prev)->next) {
+        if (*prev == request) {
+            *prev = request->next;
+            break;
+        }
+    }
+    eloop_cancel_timeout(indigo_request_resume, request, ELOOP_ALL_CTX);
+    if (request->cache) {
+        request->cache->request = NULL;
+        request->cache->done_time = response_cache_now();
+    }
+    if (current_request == request) {
+        current_request = NULL;
+    }
+    free_packet_wrapper(&request->req);
+    free_packet_wrapper(&request->resp);
+    packet_arena_reset(&request->arena);
+    /* Debug mode (-d) logs when an API needs more arena than before */
+    if (request->api && request->arena.high_water > request->api->arena_high_water) {
+        request->api->arena_high_water = request->arena.high_water;
+        if (debug_packet) {
+            indigo_logger(LOG_LEVEL_INFO, "API %s: Arena high-water mark %d bytes%s", request->api->name,
+                          request->arena.high_water, request->arena.high_water > PACKET_ARENA_SIZE ? " (overflow)" : "");
+        }
+    }
+    if (request_pool_num < REQUEST_POOL_SIZE && !request_deinit) {
+        request->next = request_pool;
+        request_pool = request;
+        request_pool_num++;
+    } else {
+        free(request);
+    }
+
+    /* The command finished after it was deferred. Continue the batch. */
+    if (parent && !parent->commands->running && !request_deinit) {
+        batch_commands_next(parent);
+    }
+}
+
+/* Microseconds since the request was received */
+static long request_latency(struct indigo_request *request) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - request->received.tv_sec) * 1000000 + (now.tv_nsec - request->received.tv_nsec) / 1000;
+}
+
+/* Most bytes of a message to the tool. A message of API_VERSION_EXTENDED is fragmented over a datagram. */
+static int message_size_max(struct indigo_request *request, int version) {
+    return (request->stream || version == API_VERSION_EXTENDED) ? STREAM_MESSAGE_MAX : BUFFER_LEN;
+}
+
+/* Send a message to the tool that sent the request */
+int indigo_request_send(struct indigo_request *request, struct packet_wrapper *wrapper) {
+    static char buffer[4 + STREAM_MESSAGE_MAX];
+    int len;
+
+    /* The ACK and response use the encoding of the request */
+    wrapper->hdr.version = request->req.hdr.version == API_VERSION_EXTENDED ? API_VERSION_EXTENDED : API_VERSION;
+
+    if (request->parent) {
+        batch_commands_report(request, wrapper);
+        return 0;
+    }
+
+    if (request->sock < 0) {
+        indigo_logger(LOG_LEVEL_DEBUG, "Connection is closed, drop the message of seq %d", wrapper->hdr.seq);
+        return -1;
+    }
+
+    len = assemble_packet(buffer + 4, message_size_max(request, wrapper->hdr.version), wrapper);
+    if (request->stream) {
+        buffer[0] = (len >> 24) & 0xff;
+        buffer[1] = (len >> 16) & 0xff;
+        buffer[2] = (len >> 8) & 0xff;
+        buffer[3] = len & 0xff;
+        capture_message(CAPTURE_SENT, request->sock, (struct sockaddr *)&request->from, request->fromlen,
+                        buffer + 4, len, request_latency(request));
+        return eloop_sock_send(request->sock, buffer, 4 + len, 0, NULL, 0);
+    }
+
+    if (request->cache) {
+        if (wrapper->hdr.type == API_CMD_ACK) {
+            response_cache_store(&request->cache->ack, &request->cache->ack_len, buffer + 4, len);
+        } else {
+            response_cache_store(&request->cache->resp, &request->cache->resp_len, buffer + 4, len);
+        }
+    }
+    return output_message(request->sock, buffer + 4, len, (struct sockaddr *)&request->from, request->fromlen,
+                          request_latency(request));
+}
+
+/* Run the handler and send the response, unless the handler deferred it. The request is freed once done. */
+void indigo_request_handle(struct indigo_request *request, api_callback_func handler) {
+    int ret;
+    char *name = request->api ? request->api->name : "Unknown";
+    struct indigo_request *r, *caller = current_request;
+
+    /* Commands of a batch are handled within the handler of the batch */
+    request->deferred = 0;
+    request->event_wait = 0;
+    request->events = 0;
+    current_request = request;
+    ret = handler(&request->req, &request->resp);
+    current_request = caller;
+
+    if (request->deferred) {
+        indigo_logger(LOG_LEVEL_DEBUG, "API %s: Response deferred", name);
+        /* The events it waited for came before the handler returned */
+        if (request->event_wait && request->events == 0) {
+            indigo_request_event_done(request);
+        }
+        /* The receive buffer is reused for the next requests */
+        keep_packet_views(&request->req);
+        for (r = deferred_requests; r && r != request; r = r->next);
+        if (r == NULL) {
+            request->next = deferred_requests;
+            deferred_requests = request;
+        }
+        return;
+    }
+
+    if (ret == 0) {
+        indigo_logger(LOG_LEVEL_INFO, "API %s: Return execution result", name);
+        indigo_request_send(request, &request->resp);
+    } else {
+        indigo_logger(LOG_LEVEL_DEBUG, "API %s (0x%04x): No handle function", name, request->req.hdr.type);
+    }
+    indigo_logger(LOG_LEVEL_DEBUG, "API %s: Complete", name);
+    indigo_request_free(request);
+}
+
+struct indigo_request* indigo_request_defer() {
+    if (current_request == NULL) {
+        return NULL;
+    }
+    current_request->deferred = 1;
+    return current_request;
+}
+
+static void indigo_request_resume(void *eloop_ctx, void *timeout_ctx) {
+    struct indigo_request *request = eloop_ctx;
+
+    indigo_request_handle(request, request->resume);
+}
+
+int indigo_request_defer_timeout(unsigned int secs, unsigned int usecs, api_callback_func handler) {
+    struct indigo_request *request = current_request;
+
+    if (request == NULL || handler == NULL) {
+        return -1;
+    }
+    if (eloop_register_timeout(secs, usecs, indigo_request_resume, request, NULL) < 0) {
+        return -1;
+    }
+    request->resume = handler;
+    request->deferred = 1;
+    return 0;
+}
+
+struct indigo_request* indigo_request_defer_event(api_callback_func handler) {
+    struct indigo_request *request = current_request;
+
+    if (request == NULL || handler == NULL) {
+        return NULL;
+    }
+    if (!request->event_wait) {
+        request->event_result = -1;
+        request->event_failed = 0;
+    }
+    request->resume = handler;
+    request->event_wait = 1;
+    request->events++;
+    request->deferred = 1;
+    return request;
+}
+
+/* All the events of the request came. It resumes from eloop. */
+static void indigo_request_event_done(struct indigo_request *request) {
+    request->event_wait = 0;
+    if (eloop_register_timeout(0, 0, indigo_request_resume, request, NULL) < 0) {
+        indigo_logger(LOG_LEVEL_ERROR, "API %s: Failed to resume the request",
+                      request->api ? request->api->name : "Unknown");
+    }
+}
+
+static void indigo_request_event_record(struct indigo_request *request, long result) {
+    if (request->event_failed) {
+        return;
+    }
+    request->event_result = result;
+    request->event_failed = result < 0;
+}
+
+void indigo_request_event(void *ctx, long result) {
+    struct indigo_request *request = ctx;
+
+    if (request == NULL || request->events == 0) {
+        return;
+    }
+    indigo_request_event_record(request, result);
+    /* An event that comes before the handler returns is seen by indigo_request_handle() */
+    if (--request->events == 0 && request != current_request) {
+        indigo_request_event_done(request);
+    }
+}
+
+int indigo_request_defer_ready(const char *ctrl_path, const char *name, api_callback_func handler) {
+    int deferred = current_request ? current_request->deferred : 0;
+    struct indigo_request *request = indigo_request_defer_event(handler);
+    long result;
+
+    if (request && process_watch_ready(ctrl_path, name, indigo_request_event, request) == 0) {
+        return 0;
+    }
+    if (request && --request->events == 0) {
+        /* Not waited for, and no other event is */
+        request->event_wait = 0;
+        request->deferred = deferred;
+    }
+    result = process_wait_ready(ctrl_path, name);
+    if (request) {
+        indigo_request_event_record(request, result);
+    }
+    return request && request->deferred ? 0 : -1;
+}
+
+long indigo_request_event_result() {
+    return current_request ? current_request->event_result : -1;
+}
+
+void indigo_request_complete(struct indigo_request *request) {
+    char *name = request->api ? request->api->name : "Unknown";
+
+    /* Completed before its handler returned, so the handler sends the response */
+    if (request == current_request) {
+        request->deferred = 0;
+        return;
+    }
+
+    indigo_logger(LOG_LEVEL_INFO, "API %s: Return execution result", name);
+    indigo_request_send(request, &request->resp);
+    indigo_logger(LOG_LEVEL_DEBUG, "API %s: Complete", name);
+    indigo_request_free(request);
+}
+
+/* The connection of the socket is closed. Its requests in progress can't send their response anymore. */
+void indigo_request_sock_closed(int sock) {
+    struct indigo_request *request;
+
+    for (request = deferred_requests; request; request = request->next) {
+        if (request->sock == sock) {
+            request->sock = -1;
+        }
+    }
+    if (current_request && current_request->sock == sock) {
+        current_request->sock = -1;
+    }
+}
+
+/* Append an embedded message to the response in TLVs of up to 255 bytes */
+static int batch_commands_append(struct batch_commands *commands, struct packet_wrapper *resp, char *message, int len) {
+    int pos, n, chunks = (len + TLV_VALUE_SIZE - 2) / (TLV_VALUE_SIZE - 1);
+    int hdr_len = tlv_hdr_len(commands->version);
+
+    if (resp->tlv_num + chunks > TLV_NUM || commands->size + len + hdr_len * chunks > commands->size_max) {
+        return -1;
+    }
+    for (pos = 0; pos < len; pos += n) {
+        n = len - pos < TLV_VALUE_SIZE - 1 ? len - pos : TLV_VALUE_SIZE - 1;
+        fill_wrapper_tlv_bytes(resp, pos ? TLV_BATCH_RESPONSE_MORE : TLV_BATCH_RESPONSE, n, message + pos);
+    }
+    commands->size += len + hdr_len * chunks;
+    return 0;
+}
+
+/* Add the response of an embedded request to the response of its batch */
+static void batch_commands_report(struct indigo_request *request, struct packet_wrapper *wrapper) {
+    struct indigo_request *parent = request->parent;
+    struct batch_commands *commands = parent->commands;
+    struct tlv_hdr *tlv;
+    static char buffer[STREAM_MESSAGE_MAX];
+    int len;
+
+    tlv = find_wrapper_tlv_by_id(wrapper, TLV_STATUS);
+    if (tlv && tlv->len > 0 && tlv->value[0] == TLV_VALUE_STATUS_OK) {
+        commands->succeeded++;
+    } else {
+        commands->failed++;
+    }
+    len = assemble_packet(buffer, message_size_max(parent, wrapper->hdr.version), wrapper);
+    if (batch_commands_append(commands, &parent->resp, buffer, len)) {
+        indigo_logger(LOG_LEVEL_WARNING, "API %s: Response of seq %d doesn't fit in the batch response",
+                      request->api ? request->api->name : "Unknown", wrapper->hdr.seq);
+        commands->truncated = 1;
+    }
+    request->reported = 1;
+}
+
+/* Run an embedded request like a received one, without the ACK */
+static void batch_command_run(struct indigo_request *command, char *message, int len) {
+    struct packet_wrapper resp;
+    struct indigo_api *api = NULL;
+
+    memset(&resp, 0, sizeof(resp));
+    resp.arena = &command->arena;
+    if (parse_packet_views(&command->req, message, len)) {
+        fill_wrapper_ack(&resp, command->req.hdr.seq, TLV_VALUE_STATUS_NOT_OK, "Unable to parse the packet");
+    } else if ((api = get_api_by_id(command->req.hdr.type)) == NULL || api->handle == NULL) {
+        fill_wrapper_ack(&resp, command->req.hdr.seq, TLV_VALUE_STATUS_NOT_OK, "Unable to find the API handler");
+    } else if (api->type == API_BATCH_COMMANDS) {
+        fill_wrapper_ack(&resp, command->req.hdr.seq, TLV_VALUE_STATUS_NOT_OK, "Batch can't be nested");
+    } else if (api->verify && api->verify(&command->req, &resp)) {
+        free_packet_wrapper(&resp);
+        fill_wrapper_ack(&resp, command->req.hdr.seq, TLV_VALUE_STATUS_NOT_OK, "Unable to verify the command");
+    } else {
+        command->api = api;
+        indigo_logger(LOG_LEVEL_DEBUG, "API %s: Run in batch", api->name);
+        indigo_request_handle(command, api->handle);
+        return;
+    }
+    indigo_request_send(command, &resp);
+    free_packet_wrapper(&resp);
+    indigo_request_free(command);
+}
+
+/* Run the commands of the batch until one is deferred. The batch completes after the last one. */
+static void batch_commands_next(struct indigo_request *request) {
+    struct batch_commands *commands = request->commands;
+    struct indigo_request *command;
+    struct tlv_hdr *tlv;
+    char message[S_BUFFER_LEN];
+    int i;
+
+    commands->running = 1;
+    while (commands->next < commands->count && !(commands->failed && commands->stop_on_error)) {
+        command = indigo_request_new(request->sock, (struct sockaddr *)&request->from, request->fromlen);
+        if (command == NULL) {
+            break;
+        }
+        command->stream = request->stream;
+        command->parent = request;
+        commands->current = command;
+        i = commands->next++;
+        batch_command_run(command, commands->messages + commands->offset[i], commands->len[i]);
+        if (commands->current) {
+            commands->running = 0;
+            return;
+        }
+    }
+    commands->running = 0;
+
+    /* TLV_STATUS and TLV_MESSAGE of the batch are the first two TLVs of the response */
+    snprintf(message, sizeof(message), "%d of %d commands succeeded, %d failed, %d not run%s",
+             commands->succeeded, commands->count, commands->failed, commands->count - commands->next,
+             commands->truncated ? ", some responses are left out" : "");
+    request->resp.tlv[0]->value[0] = (commands->succeeded == commands->count && !commands->truncated) ?
+                                     TLV_VALUE_STATUS_OK : TLV_VALUE_STATUS_NOT_OK;
+    tlv = request->resp.tlv[1];
+    tlv->len = strlen(message);
+    tlv->value = wrapper_alloc(&request->resp, tlv->len);
+    memcpy(tlv->value, message, tlv->len);
+    indigo_logger(LOG_LEVEL_INFO, "API %s: %s", request->api ? request->api->name : "Unknown", message);
+
+    indigo_request_complete(request);
+}
+
+int indigo_request_batch_commands(struct packet_wrapper *req, struct packet_wrapper *resp) {
+    struct indigo_request *request = current_request;
+    struct batch_commands *commands = NULL;
+    struct tlv_hdr *tlv;
+    char *message = NULL;
+    int i, total = 0;
+
+    fill_wrapper_message_hdr(resp, API_CMD_RESPONSE, req->hdr.seq);
+    fill_wrapper_tlv_byte(resp, TLV_STATUS, TLV_VALUE_STATUS_NOT_OK);
+
+    if (request == NULL) {
+        message = TLV_VALUE_NOT_OK;
+        goto done;
+    }
+    for (i = 0; i < req->tlv_num; i++) {
+        total += req->tlv[i]->len;
+    }
+    commands = calloc(1, sizeof(struct batch_commands));
+    if (commands == NULL || (commands->messages = malloc(total ? total : 1)) == NULL) {
+        message = TLV_VALUE_NOT_OK;
+        goto done;
+    }
+
+    /* TLV: BATCH_STOP_ON_ERROR (Optional, default 1). BATCH_COMMAND starts a message, BATCH_COMMAND_MORE continues it. */
+    commands->stop_on_error = get_wrapper_tlv_int(req, TLV_BATCH_STOP_ON_ERROR);
+    total = 0;
+    for (i = 0; i < req->tlv_num; i++) {
+        tlv = req->tlv[i];
+        if (tlv->id == TLV_BATCH_COMMAND) {
+            commands->offset[commands->count] = total;
+            commands->len[commands->count] = 0;
+            commands->count++;
+        } else if (tlv->id != TLV_BATCH_COMMAND_MORE) {
+            continue;
+        } else if (commands->count == 0) {
+            message = "BATCH_COMMAND_MORE without BATCH_COMMAND";
+            goto done;
+        }
+        memcpy(commands->messages + total, tlv->value, tlv->len);
+        commands->len[commands->count - 1] += tlv->len;
+        total += tlv->len;
+    }
+    if (commands->count == 0) {
+        message = TLV_VALUE_INSUFFICIENT_TLV;
+        goto done;
+    }
+
+    /* Room for the header, the status and the longest message of the batch */
+    commands->version = req->hdr.version;
+    commands->size = sizeof(struct message_hdr) + 2 * tlv_hdr_len(commands->version) + 1 + S_BUFFER_LEN;
+    commands->size_max = message_size_max(request, commands->version);
+    fill_wrapper_tlv_bytes(resp, TLV_MESSAGE, strlen(TLV_VALUE_OK), TLV_VALUE_OK);
+    request->commands = commands;
+    indigo_request_defer();
+    batch_commands_next(request);
+    return 0;
+
+done:
+    if (commands) {
+        free(commands->messages);
+        free(commands);
+    }
+    fill_wrapper_tlv_bytes(resp, TLV_MESSAGE, strlen(message), message);
+    return 0;
+}
+
+/* Drop the requests that are still waiting for their response and the response cache */
+void indigo_request_deinit() {
+    struct indigo_request *r;
+    int i;
+
+    request_deinit = 1;
+    while (deferred_requests) {
+        indigo_logger(LOG_LEVEL_WARNING, "API %s: Dropped deferred response",
+                      deferred_requests->api ? deferred_requests->api->name : "Unknown");
+        indigo_request_free(deferred_requests);
+    }
+    for (i = 0; i < RESPONSE_CACHE_SIZE; i++) {
+        response_cache_clear(&response_cache[i]);
+    }
+    for (i = 0; i < FRAGMENT_REASSEMBLY_SIZE; i++) {
+        fragment_reassembly_clear(&reassembly[i]);
+    }
+    while (request_pool) {
+        r = request_pool;
+        request_pool = r->next;
+        free(r);
+    }
+    request_pool_num = 0;
+}
+
+struct sockaddr_in* get_tool_addr() {
+    if (current_request && current_request->from.ss_family == AF_INET) {
+        return (struct sockaddr_in *)&current_request->from;
+    }
+    return NULL;
+}
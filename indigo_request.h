@@ -0,0 +1,183 @@
+/* Copyright (c) 2020 Wi-Fi Alliance                                                */
+
+/* Permission to use, copy, modify, and/or distribute this software for any         */
+/* purpose with or without fee is hereby granted, provided that the above           */
+/* copyright notice and this permission notice appear in all copies.                */
+
+/* THE SOFTWARE IS PROVIDED 'AS IS' AND THE AUTHOR DISCLAIMS ALL                    */
+/* WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED                    */
+/* WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL                     */
+/* THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR                       */
+/* CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING                        */
+/* FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF                       */
+/* CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT                       */
+/* OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS                          */
+/* SOFTWARE. */
+
+#ifndef _INDIGO_REQUEST_
+#define _INDIGO_REQUEST_  1
+
+#include <time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#include "indigo_api.h"
+#include "utils.h"
+
+/* Datagrams read from the control port with one recvmmsg() and responses written with one sendmmsg() */
+#define REQUEST_BATCH_SIZE                      16
+#define REQUEST_OUTBOX_SIZE                     (3 * REQUEST_BATCH_SIZE)
+
+/* Freed requests kept for reuse, so a request doesn't allocate once the pool is warm */
+#define REQUEST_POOL_SIZE                       (REQUEST_BATCH_SIZE + 16)
+
+/* Stream transport. Each message is preceded by its length in 4 bytes, network byte order. */
+#define STREAM_MESSAGE_MAX                      (64 * 1024)
+#define STREAM_MAX_CONNECTIONS                  16
+
+/* Fragments of a version 2 message over a datagram. reserved of the header holds the index of the fragment
+ * and reserved2 the count. Each fragment carries the header and the next FRAGMENT_PAYLOAD_LEN bytes after it,
+ * all but the last one in full. The message may be as long as a stream message. Each TLV of a request
+ * still has to be shorter than TLV_VALUE_SIZE, so a long request carries many TLVs rather than long ones. */
+#define FRAGMENT_PAYLOAD_LEN                    (BUFFER_LEN - (int) sizeof(struct message_hdr))
+#define FRAGMENT_COUNT_MAX                      ((STREAM_MESSAGE_MAX + FRAGMENT_PAYLOAD_LEN - 1) / FRAGMENT_PAYLOAD_LEN)
+/* Messages reassembled at once, and seconds to wait for their missing fragments */
+#define FRAGMENT_REASSEMBLY_SIZE                8
+#define FRAGMENT_TIMEOUT                        5
+
+struct fragment_reassembly {
+    struct sockaddr_storage peer;
+    socklen_t peerlen;
+    unsigned short seq;
+    unsigned short type;
+    int count;
+    int received;
+    /* Bytes after the header, known once the last fragment is in */
+    int len;
+    time_t start;
+    unsigned char have[FRAGMENT_COUNT_MAX];
+    char *message;
+};
+
+/* Response cache. A retransmitted request gets the stored ACK and response instead of running again. */
+#define RESPONSE_CACHE_SIZE                     32
+/* Seconds a completed request is remembered. The tool may reuse the sequence number later. */
+#define RESPONSE_CACHE_LIFETIME                 60
+
+struct response_cache_entry {
+    struct sockaddr_storage peer;
+    socklen_t peerlen;
+    unsigned short seq;
+    unsigned short type;
+    /* Set while the request is in progress */
+    struct indigo_request *request;
+    time_t done_time;
+    char *ack;
+    int ack_len;
+    char *resp;
+    int resp_len;
+};
+
+/* Commands of a BATCH_COMMANDS request. Each one is a complete message embedded in the TLVs. */
+struct batch_commands {
+    char *messages;
+    int offset[TLV_NUM];
+    int len[TLV_NUM];
+    int count;
+    /* Index of the next command to run */
+    int next;
+    int succeeded;
+    int failed;
+    int stop_on_error;
+    /* Message version of the batch request, which its response is encoded for */
+    int version;
+    /* Set while the commands run from the batch handler, so the finished ones don't start the next */
+    int running;
+    /* Size of the response and the most it may grow to on the transport of the request */
+    int size;
+    int size_max;
+    /* Set when a sub-response didn't fit in the response */
+    int truncated;
+    /* Command in progress */
+    struct indigo_request *current;
+};
+
+/* A request received on the control port. It lives until its response is sent. */
+struct indigo_request {
+    int sock;
+    struct sockaddr_storage from;
+    socklen_t fromlen;
+    /* CLOCK_MONOTONIC time of the receive, for the latency in the capture */
+    struct timespec received;
+    /* Set for stream connections. sock is -1 once the connection is closed. */
+    int stream;
+    struct indigo_api *api;
+    struct packet_wrapper req;
+    struct packet_wrapper resp;
+    /* Storage of the TLVs of the ACK and response */
+    struct packet_arena arena;
+    /* Set when the handler returns before the response is ready */
+    int deferred;
+    /* Handler to continue with when a deferred request resumes */
+    api_callback_func resume;
+    /* Set when the request resumes on events, with the number still to come and the result of the last one,
+     * kept once one fails */
+    int event_wait;
+    int events;
+    long event_result;
+    int event_failed;
+    /* Response cache entry recording what is sent for the request */
+    struct response_cache_entry *cache;
+    /* Batch request that embeds this request. The response goes to the batch instead of the tool. */
+    struct indigo_request *parent;
+    /* Set when the response is handed to the batch */
+    int reported;
+    /* Commands of a batch request */
+    struct batch_commands *commands;
+    struct indigo_request *next;
+};
+
+struct indigo_request* indigo_request_new(int sock, struct sockaddr *from, socklen_t fromlen);
+void indigo_request_free(struct indigo_request *request);
+int indigo_request_send(struct indigo_request *request, struct packet_wrapper *wrapper);
+void indigo_request_handle(struct indigo_request *request, api_callback_func handler);
+void indigo_request_deinit();
+void indigo_request_sock_closed(int sock);
+int indigo_request_output(int sock, char *buffer, int len, struct sockaddr *to, socklen_t tolen);
+void indigo_request_batch_begin(int requests);
+void indigo_request_batch_end();
+int indigo_request_batch_dump(char *buffer, int size);
+int indigo_request_replay(int sock, struct sockaddr *from, socklen_t fromlen, char *packet, int len);
+int indigo_request_reassemble(struct sockaddr *from, socklen_t fromlen, char *packet, int len, char **message);
+void indigo_request_track(struct indigo_request *request);
+
+/* Deferred response. Used by the API handlers.
+ * indigo_request_defer() keeps the running request after its handler returns. The response in
+ * request->resp is sent by indigo_request_complete() later.
+ * indigo_request_defer_timeout() continues the running request with another handler after the timeout
+ * without blocking other requests. The response is sent when a handler returns 0 without deferring again. */
+struct indigo_request* indigo_request_defer();
+int indigo_request_defer_timeout(unsigned int secs, unsigned int usecs, api_callback_func handler);
+void indigo_request_complete(struct indigo_request *request);
+
+/* indigo_request_defer_event() keeps the running request to continue with another handler once
+ * indigo_request_event() is called with it, as the handler of process_stop_async() or process_watch_ready().
+ * Each call adds an event to wait for, and the request resumes after the last one and once its handler has
+ * returned. The handler gets the result of the last event from indigo_request_event_result(), or of the
+ * first one below 0 so that a failure isn't hidden by a later event, and -1 until there is one. */
+struct indigo_request* indigo_request_defer_event(api_callback_func handler);
+void indigo_request_event(void *request, long result);
+long indigo_request_event_result();
+/* Continue the running request with the handler once the daemon of the control interface path is ready, or
+ * the wait has timed out or the process of the program name has exited, with the result -1. Returns 0 if the
+ * request is deferred, or -1 after waiting in place when the path can't be watched. The result of that wait is
+ * recorded the same way. */
+int indigo_request_defer_ready(const char *ctrl_path, const char *name, api_callback_func handler);
+
+/* Handler of BATCH_COMMANDS. The embedded requests run in order through the registered handlers, and the
+ * response carries the response of each one in TLV_BATCH_RESPONSE, continued in TLV_BATCH_RESPONSE_MORE. */
+int indigo_request_batch_commands(struct packet_wrapper *req, struct packet_wrapper *resp);
+
+/* Address of the tool that sent the running request, or NULL */
+struct sockaddr_in* get_tool_addr();
+#endif
@@ -14,14 +14,17 @@
 /* OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS                          */
 /* SOFTWARE. */
 
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 #include <signal.h>
 #include <sys/time.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/un.h>
 #include <arpa/inet.h>
 #include <unistd.h>
 #include <sys/ioctl.h>
@@ -32,16 +35,43 @@
 #include "vendor_specific.h"
 #include "eloop.h"
 #include "indigo_api.h"
+#include "indigo_capture.h"
+#include "indigo_log.h"
+#include "indigo_process.h"
+#include "indigo_request.h"
 #include "utils.h"
 
 
 /* Internal functions */
 static void control_receive_message(int sock, void *eloop_ctx, void *sock_ctx);
+static void stream_accept(int sock, void *eloop_ctx, void *sock_ctx);
 static int parse_parameters(int argc, char *argv[]);
 static void usage();
 
+/* Collect event loop statistics from the start */
+static int eloop_stats = 0;
+
+/* pcapng capture of the control messages (-c) */
+static char *capture_file = NULL;
+
+/* Binary log of the lines with deferred formatting (-l) */
+static char *binary_log_file = NULL;
+
+/* Optional stream listeners of the control protocol */
+static int stream_port = 0;
+static char *stream_path = NULL;
+static int stream_conn_count = 0;
+
+/* Stream connection. Each message is preceded by its length, so many requests can be outstanding at once. */
+struct stream_conn {
+    int sock;
+    struct sockaddr_storage peer;
+    socklen_t peerlen;
+    int len;                                      // bytes received but not handled yet
+    unsigned char buffer[4 + STREAM_MESSAGE_MAX];
+};
+
 /* External variables */
-extern int capture_packet; /* debug. Write the received packets to files */
 extern int debug_packet;   /* used by the packet hexstring print */
 
 /* Initiate the service port. */
@@ -53,7 +83,7 @@ static int control_socket_init(int port) {
     /* Open UDP socket */
     s = socket(PF_INET, SOCK_DGRAM, 0);
     if (s < 0) {
-        indigo_logger(LOG_LEVEL_ERROR, "Failed to open server socket: %s", strerror(errno));
+        indigo_log(LOG_CATEGORY_PACKET, LOG_LEVEL_ERROR, "Failed to open server socket: %s", strerror(errno));
         return -1;
     }
 
@@ -62,7 +92,7 @@ static int control_socket_init(int port) {
     addr.sin_family = AF_INET;
     addr.sin_port = htons(port);
     if (bind(s, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
-        indigo_logger(LOG_LEVEL_ERROR, "Failed to bind server socket: %s", strerror(errno));
+        indigo_log(LOG_CATEGORY_PACKET, LOG_LEVEL_ERROR, "Failed to bind server socket: %s", strerror(errno));
         if (errno == EADDRINUSE) {
             sprintf(cmd, "netstat -lunatp | grep %d", port);
             system(cmd);
@@ -73,104 +103,312 @@ static int control_socket_init(int port) {
 
     /* Register to eloop and ready for the socket event */
     if (eloop_register_read_sock(s, control_receive_message, NULL, NULL)) {
-        indigo_logger(LOG_LEVEL_ERROR, "Failed to initiate ControlAppC");
+        indigo_log(LOG_CATEGORY_PACKET, LOG_LEVEL_ERROR, "Failed to initiate ControlAppC");
         close(s);
         return -1;
     }
     return s;
 }
 
-struct sockaddr_in *tool_addr; // For HTTP Post
-/* Callback function of the QuickTrack API. */
-static void control_receive_message(int sock, void *eloop_ctx, void *sock_ctx) {
+/* Listen for the stream connections. TCP if port is set, otherwise AF_UNIX SOCK_SEQPACKET at path. */
+static int stream_socket_init(int port, char *path) {
+    int s = -1, opt = 1;
+    struct sockaddr_in addr;
+    struct sockaddr_un uaddr;
+
+    if (port) {
+        s = socket(PF_INET, SOCK_STREAM, 0);
+        if (s < 0) {
+            indigo_log(LOG_CATEGORY_PACKET, LOG_LEVEL_ERROR, "Failed to open stream socket: %s", strerror(errno));
+            return -1;
+        }
+        setsockopt(s, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        if (bind(s, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+            indigo_log(LOG_CATEGORY_PACKET, LOG_LEVEL_ERROR, "Failed to bind stream port %d: %s", port, strerror(errno));
+            goto fail;
+        }
+    } else {
+        if (strlen(path) >= sizeof(uaddr.sun_path)) {
+            indigo_log(LOG_CATEGORY_PACKET, LOG_LEVEL_ERROR, "Stream socket path is too long: %s", path);
+            return -1;
+        }
+        s = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+        if (s < 0) {
+            indigo_log(LOG_CATEGORY_PACKET, LOG_LEVEL_ERROR, "Failed to open stream socket: %s", strerror(errno));
+            return -1;
+        }
+        unlink(path);
+        memset(&uaddr, 0, sizeof(uaddr));
+        uaddr.sun_family = AF_UNIX;
+        strcpy(uaddr.sun_path, path);
+        if (bind(s, (struct sockaddr *) &uaddr, sizeof(uaddr)) < 0) {
+            indigo_log(LOG_CATEGORY_PACKET, LOG_LEVEL_ERROR, "Failed to bind stream socket %s: %s", path, strerror(errno));
+            goto fail;
+        }
+    }
+
+    if (listen(s, STREAM_MAX_CONNECTIONS) < 0 || eloop_register_read_sock(s, stream_accept, NULL, NULL)) {
+        indigo_log(LOG_CATEGORY_PACKET, LOG_LEVEL_ERROR, "Failed to listen on stream socket: %s", strerror(errno));
+        goto fail;
+    }
+    return s;
+
+fail:
+    close(s);
+    return -1;
+}
+
+static void stream_socket_deinit(int s, char *path) {
+    if (s < 0) {
+        return ;
+    }
+    eloop_unregister_read_sock(s);
+    close(s);
+    if (path) {
+        unlink(path);
+    }
+}
+
+/* Handle a message of the QuickTrack API. */
+static void control_handle_message(int sock, int stream, unsigned char *buffer, int len, struct sockaddr_storage *from_addr, socklen_t fromlen) {
     int ret;                          // return code
-    int fromlen, len;                 // structure size and received length
-    struct sockaddr_storage from;     // source address of the message
-    unsigned char buffer[BUFFER_LEN]; // buffer to receive the message
-    struct packet_wrapper req, resp;  // packet wrapper for the received message and response
+    struct sockaddr *from = (struct sockaddr *) from_addr; // source address of the message
+    struct packet_wrapper resp;       // packet wrapper for the ACK
     struct indigo_api *api = NULL;    // used for API search, validation and handler call
+    struct indigo_request *request = NULL; // the received message and its response
+    char *message = NULL;             // reassembled from the fragments of the request
 
-    /* Receive request */
-    fromlen = sizeof(from);
-    len = recvfrom(sock, buffer, BUFFER_LEN, 0, (struct sockaddr *) &from, (socklen_t*)&fromlen);
-    if (len < 0) {
-        indigo_logger(LOG_LEVEL_ERROR, "Server: Failed to receive the packet");
+    /* Answer a retransmitted request from the response cache instead of running it again */
+    if (!stream && indigo_request_replay(sock, from, fromlen, (char *) buffer, len)) {
+        return ;
+    }
+
+    /* Wait for all the fragments of a request over a datagram */
+    if (!stream) {
+        ret = indigo_request_reassemble(from, fromlen, (char *) buffer, len, &message);
+        if (ret < 0) {
+            return ;
+        } else if (ret > 0) {
+            buffer = (unsigned char *) message;
+            len = ret;
+        }
+    }
+
+    request = indigo_request_new(sock, from, fromlen);
+    if (request == NULL) {
+        indigo_log(LOG_CATEGORY_PACKET, LOG_LEVEL_ERROR, "Server: Failed to allocate the request");
+        free(message);
         return ;
-    } else {
-        indigo_logger(LOG_LEVEL_DEBUG, "Server: Receive the packet");
     }
-    tool_addr = (struct sockaddr_in *)&from;
+    request->stream = stream;
 
     /* Parse request to HDR and TLV. Response NACK if parser fails. Otherwises, ACK. */
-    memset(&req, 0, sizeof(struct packet_wrapper));
     memset(&resp, 0, sizeof(struct packet_wrapper));
-    ret = parse_packet(&req, buffer, len);
+    resp.arena = &request->arena;
+    ret = parse_packet_views(&request->req, (char *) buffer, len);
     if (ret == 0) {
-        indigo_logger(LOG_LEVEL_DEBUG, "Server: Parsed packet successfully");
+        indigo_log(LOG_CATEGORY_PACKET, LOG_LEVEL_DEBUG, "Server: Parsed packet successfully");
+        if (!stream) {
+            indigo_request_track(request);
+        }
     } else {
-        indigo_logger(LOG_LEVEL_ERROR, "Server: Failed to parse the packet");
-        fill_wrapper_ack(&resp, req.hdr.seq, 0x31, "Unable to parse the packet");
-        len = assemble_packet(buffer, BUFFER_LEN, &resp);
-
-        sendto(sock, (const char *)buffer, len, MSG_CONFIRM, (const struct sockaddr *) &from, fromlen); 
+        indigo_log(LOG_CATEGORY_PACKET, LOG_LEVEL_ERROR, "Server: Failed to parse the packet");
+        fill_wrapper_ack(&resp, request->req.hdr.seq, 0x31, "Unable to parse the packet");
+        indigo_request_send(request, &resp);
         goto done;
     }
 
     /* Find API by ID. If API is not supported, assemble NACK. */
-    api = get_api_by_id(req.hdr.type);
+    api = get_api_by_id(request->req.hdr.type);
     if (api) {
-        indigo_logger(LOG_LEVEL_DEBUG, "API %s: Found handler", api->name);
+        indigo_log(LOG_CATEGORY_PACKET, LOG_LEVEL_DEBUG, "API %s: Found handler", api->name);
     } else {
-        indigo_logger(LOG_LEVEL_ERROR, "API Unknown (0x%04x): No registered handler", req.hdr.type);
-        fill_wrapper_ack(&resp, req.hdr.seq, 0x31, "Unable to find the API handler");
-        len = assemble_packet(buffer, BUFFER_LEN, &resp);
-        sendto(sock, (const char *)buffer, len, MSG_CONFIRM, (const struct sockaddr *) &from, fromlen); 
+        indigo_log(LOG_CATEGORY_PACKET, LOG_LEVEL_ERROR, "API Unknown (0x%04x): No registered handler", request->req.hdr.type);
+        fill_wrapper_ack(&resp, request->req.hdr.seq, 0x31, "Unable to find the API handler");
+        indigo_request_send(request, &resp);
         goto done;
     }
+    request->api = api;
 
     /* Verify. Optional. If validation is failed, then return NACK. */
-    if (api->verify == NULL || (api->verify && api->verify(&req, &resp) == 0)) {
-        indigo_logger(LOG_LEVEL_INFO, "API %s: Return ACK", api->name);
-        fill_wrapper_ack(&resp, req.hdr.seq, 0x30, "ACK: Command received");
-        len = assemble_packet(buffer, BUFFER_LEN, &resp);
-        sendto(sock, (const char *)buffer, len, MSG_CONFIRM, (const struct sockaddr *) &from, fromlen);
+    if (api->verify == NULL || (api->verify && api->verify(&request->req, &resp) == 0)) {
+        indigo_log(LOG_CATEGORY_PACKET, LOG_LEVEL_INFO, "API %s: Return ACK", api->name);
+        fill_wrapper_ack(&resp, request->req.hdr.seq, 0x30, "ACK: Command received");
+        indigo_request_send(request, &resp);
         free_packet_wrapper(&resp);
     } else {
-        indigo_logger(LOG_LEVEL_ERROR, "API %s: Failed to verify and return NACK", api->name);
-        fill_wrapper_ack(&resp, req.hdr.seq, 1, "Unable to find the API handler");
-        len = assemble_packet(buffer, BUFFER_LEN, &resp);
-        sendto(sock, (const char *)buffer, len, MSG_CONFIRM, (const struct sockaddr *) &from, fromlen); 
+        indigo_log(LOG_CATEGORY_PACKET, LOG_LEVEL_ERROR, "API %s: Failed to verify and return NACK", api->name);
+        fill_wrapper_ack(&resp, request->req.hdr.seq, 1, "Unable to find the API handler");
+        indigo_request_send(request, &resp);
         goto done;
     }
 
-    /* Optional, use timer to handle the execution */
-    /* Handle & Response. Call API handle(), assemble packet by response wrapper and send back to source address. */
-    if (api->handle && api->handle(&req, &resp) == 0) {
-        indigo_logger(LOG_LEVEL_INFO, "API %s: Return execution result", api->name);
-        len = assemble_packet(buffer, BUFFER_LEN, &resp);
-        sendto(sock, (const char *)buffer, len, MSG_CONFIRM, (const struct sockaddr *) &from, fromlen); 
-    } else {
-        indigo_logger(LOG_LEVEL_DEBUG, "API %s (0x%04x): No handle function", api ? api->name : "Unknown", req.hdr.type);
+    /* Handle & Response. The handler may defer the response, so other requests are served meanwhile. */
+    if (api->handle) {
+        indigo_request_handle(request, api->handle);
+        free(message);
+        return ;
     }
+    indigo_log(LOG_CATEGORY_PACKET, LOG_LEVEL_DEBUG, "API %s (0x%04x): No handle function", api->name, request->req.hdr.type);
 
 done:
     /* Clean up resource */
-    free_packet_wrapper(&req);
     free_packet_wrapper(&resp);
-    indigo_logger(LOG_LEVEL_DEBUG, "API %s: Complete", api ? api->name : "Unknown");
+    indigo_log(LOG_CATEGORY_PACKET, LOG_LEVEL_DEBUG, "API %s: Complete", api ? api->name : "Unknown");
+    indigo_request_free(request);
+    free(message);
+}
+
+/* Callback function of the QuickTrack API. Reads all the queued datagrams at once. */
+static void control_receive_message(int sock, void *eloop_ctx, void *sock_ctx) {
+    static unsigned char buffers[REQUEST_BATCH_SIZE][BUFFER_LEN]; // buffers to receive the messages
+    static struct sockaddr_storage from[REQUEST_BATCH_SIZE];      // source addresses of the messages
+    struct mmsghdr msgs[REQUEST_BATCH_SIZE];
+    struct iovec iovecs[REQUEST_BATCH_SIZE];
+    int i, n;
+
+    memset(msgs, 0, sizeof(msgs));
+    for (i = 0; i < REQUEST_BATCH_SIZE; i++) {
+        iovecs[i].iov_base = buffers[i];
+        iovecs[i].iov_len = BUFFER_LEN;
+        msgs[i].msg_hdr.msg_iov = &iovecs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+        msgs[i].msg_hdr.msg_name = &from[i];
+        msgs[i].msg_hdr.msg_namelen = sizeof(from[i]);
+    }
+
+    /* Receive requests */
+    n = recvmmsg(sock, msgs, REQUEST_BATCH_SIZE, MSG_DONTWAIT, NULL);
+    if (n < 0) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+            indigo_log(LOG_CATEGORY_PACKET, LOG_LEVEL_ERROR, "Server: Failed to receive the packet");
+        }
+        return ;
+    }
+    indigo_log(LOG_CATEGORY_PACKET, LOG_LEVEL_DEBUG, "Server: Receive %d packet(s)", n);
+
+    /* Captured before any is handled, so the capture keeps the arrival time of each one */
+    for (i = 0; i < n; i++) {
+        capture_message(CAPTURE_RECEIVED, sock, (struct sockaddr *) &from[i], msgs[i].msg_hdr.msg_namelen,
+                        (char *) buffers[i], msgs[i].msg_len, -1);
+    }
+
+    /* ACKs and responses of the batch are sent together */
+    indigo_request_batch_begin(n);
+    for (i = 0; i < n; i++) {
+        control_handle_message(sock, 0, buffers[i], msgs[i].msg_len, &from[i], msgs[i].msg_hdr.msg_namelen);
+    }
+    indigo_request_batch_end();
+}
+
+/* Close the stream connection. The responses of its requests in progress are dropped. */
+static void stream_conn_close(struct stream_conn *conn) {
+    eloop_unregister_read_sock(conn->sock);
+    eloop_sock_send_drop(conn->sock);
+    indigo_request_sock_closed(conn->sock);
+    close(conn->sock);
+    free(conn);
+    stream_conn_count--;
+}
+
+/* Callback function of the stream connection. Handles every complete message in the buffer. */
+static void stream_receive_message(int sock, void *eloop_ctx, void *sock_ctx) {
+    struct stream_conn *conn = eloop_ctx;
+    unsigned char *p;
+    unsigned int msg_len;
+    int n, pos = 0;
+
+    n = recv(sock, conn->buffer + conn->len, sizeof(conn->buffer) - conn->len, MSG_DONTWAIT);
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+        return ;
+    }
+    if (n <= 0) {
+        indigo_log(LOG_CATEGORY_PACKET, LOG_LEVEL_INFO, "Server: Stream connection closed");
+        stream_conn_close(conn);
+        return ;
+    }
+    conn->len += n;
+
+    /* Responses are sent as the handlers finish and are matched to the requests by seq */
+    while (conn->len - pos >= 4) {
+        p = conn->buffer + pos;
+        msg_len = (p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+        if (msg_len > STREAM_MESSAGE_MAX) {
+            indigo_log(LOG_CATEGORY_PACKET, LOG_LEVEL_ERROR, "Server: Stream message is too large (%u bytes)", msg_len);
+            stream_conn_close(conn);
+            return ;
+        }
+        if (conn->len - pos - 4 < msg_len) {
+            break;
+        }
+        capture_message(CAPTURE_RECEIVED, sock, (struct sockaddr *) &conn->peer, conn->peerlen, (char *) p + 4, msg_len, -1);
+        control_handle_message(sock, 1, p + 4, msg_len, &conn->peer, conn->peerlen);
+        pos += 4 + msg_len;
+    }
+
+    /* Keep the partial message at the head of the buffer */
+    if (pos > 0) {
+        conn->len -= pos;
+        memmove(conn->buffer, conn->buffer + pos, conn->len);
+    }
+}
+
+/* Accept a stream connection */
+static void stream_accept(int sock, void *eloop_ctx, void *sock_ctx) {
+    struct stream_conn *conn;
+    int s, opt = 1;
+
+    conn = calloc(1, sizeof(*conn));
+    if (conn == NULL) {
+        indigo_log(LOG_CATEGORY_PACKET, LOG_LEVEL_ERROR, "Server: Failed to allocate the stream connection");
+        return ;
+    }
+    conn->peerlen = sizeof(conn->peer);
+    s = accept4(sock, (struct sockaddr *) &conn->peer, &conn->peerlen, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (s < 0) {
+        free(conn);
+        return ;
+    }
+    if (stream_conn_count >= STREAM_MAX_CONNECTIONS) {
+        indigo_log(LOG_CATEGORY_PACKET, LOG_LEVEL_WARNING, "Server: Too many stream connections");
+        close(s);
+        free(conn);
+        return ;
+    }
+    if (conn->peer.ss_family == AF_INET) {
+        setsockopt(s, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+    }
+    conn->sock = s;
+    if (eloop_register_read_sock(s, stream_receive_message, conn, NULL)) {
+        close(s);
+        free(conn);
+        return ;
+    }
+    stream_conn_count++;
+    indigo_log(LOG_CATEGORY_PACKET, LOG_LEVEL_INFO, "Server: Stream connection accepted");
 }
 
 /* Show the usage */
 static void usage() {
     printf("usage:\n");
-    printf("app [-h] [-p<port number>] [-i<wireless interface>|-i<band>:<interface>[,<band>:<interface>]] [-a<hostapd path>] [-s<wpa_supplicant path>]\n\n");
+    printf("app [-h] [-p<port number>] [-i<wireless interface>|-i<band>:<interface>[,<band>:<interface>]] [-a<hostapd path>] [-s<wpa_supplicant path>] [-t<tcp port>] [-u<unix socket path>]\n\n");
     printf("usage:\n");
     printf("  -a = specify hostapd path\n");
     printf("  -b = specify bridge name for wireless interfaces\n");
+    printf("  -c = capture the control messages and their latency to %s in pcapng\n", CAPTURE_FILE_DEFAULT);
     printf("  -d = debug received and sent message\n");
+    printf("  -e = collect event loop statistics, logged on SIGUSR1\n");
+    printf("  -l = also log the lines to %s in binary, decoded by test.py log\n", LOG_BINARY_FILE_DEFAULT);
     printf("  -i = specify the interface. E.g., -i wlan0. Or, <band>:<interface>.\n       band can be 2 for 2.4GHz, 5 for 5GHz and 6 for 6GHz. E.g., -i 2:wlan0,2:wlan1,5:wlan32,5:wlan33\n");
     printf("  -p = port number of the application\n");
-    printf("  -s = specify wpa_supplicant path\n\n");
+    printf("  -s = specify wpa_supplicant path\n");
+    printf("  -t = also serve the control protocol on the TCP port, length-prefixed\n");
+    printf("  -u = also serve the control protocol on the AF_UNIX SOCK_SEQPACKET socket path, length-prefixed\n");
+    printf("  -w = milliseconds to wait for hostapd and wpa_supplicant to answer PING after their start, %d by default\n\n",
+           PROCESS_READY_TIMEOUT_DEFAULT);
 }
 
 /* Show the welcome message with role and version */
@@ -194,9 +432,9 @@ static int parse_parameters(int argc, char *argv[]) {
     char buf[256];
 
 #ifdef _VERSION_
-    while ((c = getopt(argc, argv, "a:b:s:i:hp:dcv")) != -1) {
+    while ((c = getopt(argc, argv, "a:b:s:i:hp:dcelt:u:w:v")) != -1) {
 #else
-    while ((c = getopt(argc, argv, "a:b:s:i:hp:dc")) != -1) {
+    while ((c = getopt(argc, argv, "a:b:s:i:hp:dcelt:u:w:")) != -1) {
 #endif
         switch (c) {
         case 'a':
@@ -207,11 +445,14 @@ static int parse_parameters(int argc, char *argv[]) {
             bridge_configured = 1;
             break;
         case 'c':
-            capture_packet = 1;
+            capture_file = CAPTURE_FILE_DEFAULT;
             break;
         case 'd':
             debug_packet = 1;
             break;
+        case 'e':
+            eloop_stats = 1;
+            break;
         case 'h':
             usage();
             return 1;
@@ -220,12 +461,24 @@ static int parse_parameters(int argc, char *argv[]) {
                 ifs_configured = 1;
             }
             break;
+        case 'l':
+            binary_log_file = LOG_BINARY_FILE_DEFAULT;
+            break;
         case 'p':
             set_service_port(atoi(optarg));
             break;
         case 's':
             set_wpas_full_exec_path(optarg);
             break;
+        case 't':
+            stream_port = atoi(optarg);
+            break;
+        case 'u':
+            stream_path = optarg;
+            break;
+        case 'w':
+            process_ready_timeout = atoi(optarg);
+            break;
 #ifdef _VERSION_
         case 'v':
             return 1;
@@ -269,8 +522,25 @@ static void handle_term(int sig, void *eloop_ctx, void *signal_ctx) {
     vendor_deinit();
 }
 
+/* Log the event loop statistics */
+static void handle_stats(int sig, void *eloop_ctx, void *signal_ctx) {
+    char buffer[L_BUFFER_LEN];
+    char *line, *saveptr = NULL;
+    int len;
+
+    len = eloop_stats_dump(buffer, sizeof(buffer), 1);
+    len += indigo_request_batch_dump(buffer + len, sizeof(buffer) - len);
+    len += capture_dump(buffer + len, sizeof(buffer) - len);
+    len += indigo_log_dump(buffer + len, sizeof(buffer) - len);
+    len += process_dump(buffer + len, sizeof(buffer) - len);
+    get_api_arena_stats(buffer + len, sizeof(buffer) - len);
+    for (line = strtok_r(buffer, "\n", &saveptr); line; line = strtok_r(NULL, "\n", &saveptr)) {
+        indigo_log(LOG_CATEGORY_ELOOP, LOG_LEVEL_INFO, "%s", line);
+    }
+}
+
 int main(int argc, char* argv[]) {
-    int service_socket = -1;
+    int service_socket = -1, tcp_socket = -1, unix_socket = -1;
 
     /* Welcome message */
     print_welcome();
@@ -291,6 +561,12 @@ int main(int argc, char* argv[]) {
         return 0;
     }
 
+    /* Log lines are written by a thread from now on */
+    indigo_log_init();
+    if (binary_log_file) {
+        indigo_log_binary_open(binary_log_file);
+    }
+
 #ifndef _OPENWRT_
     system("mkdir -p /etc/hostapd/");
 #endif
@@ -323,22 +599,44 @@ int main(int argc, char* argv[]) {
     /* Register SIGTERM */
     eloop_register_signal(SIGINT, handle_term, NULL);
     eloop_register_signal(SIGTERM, handle_term, NULL);
+    eloop_register_signal(SIGUSR1, handle_stats, NULL);
+    /* Watch the exits of the daemons */
+    process_init();
+    if (eloop_stats) {
+        eloop_stats_enable(1);
+    }
+    if (capture_file) {
+        capture_open(capture_file);
+    }
 
     /* Bind the service port and register to eloop */
     service_socket = control_socket_init(get_service_port());
     if (service_socket >= 0) {
+        if (stream_port) {
+            tcp_socket = stream_socket_init(stream_port, NULL);
+        }
+        if (stream_path) {
+            unix_socket = stream_socket_init(0, stream_path);
+        }
         eloop_run();
     } else {
         indigo_logger(LOG_LEVEL_INFO, "Failed to initiate the UDP socket");
     }
 
     /* Stop eloop */
+    stream_socket_deinit(tcp_socket, NULL);
+    stream_socket_deinit(unix_socket, stream_path);
+    indigo_request_deinit();
+    capture_close();
+    process_deinit();
     eloop_destroy();
     indigo_logger(LOG_LEVEL_INFO, "ControlAppC stops");
     if (service_socket >= 0) {
         indigo_logger(LOG_LEVEL_INFO, "Close service port: %d", get_service_port());
         close(service_socket);
     }
+    indigo_log_binary_close();
+    indigo_log_deinit();
 
     return 0;
 }
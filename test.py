@@ -1,4 +1,4 @@
-import random, socket, string, sys, time
+import os, random, re, select, socket, string, struct, sys, time
 
 class Tlv():
     def __init__(self, id, val):
@@ -222,6 +222,14 @@ def test_device_reset():
     m.append_tlv(Tlv(0x0057, bytes(0x30)))
     return m
 
+def test_set_log_level(category=None, level=None):
+    m = Msg(0x5010)
+    if category:
+        m.append_tlv(Tlv(0x00e6, bytes(category.encode()))) # LOG_CATEGORY
+    if level is not None:
+        m.append_tlv(Tlv(0x00e7, bytes(str(level).encode()))) # LOG_LEVEL
+    return m
+
 def test_hex_file(ip, port, fn):
     raw = bytearray()
     f = open(fn, "r")
@@ -232,6 +240,214 @@ def test_hex_file(ip, port, fn):
         raw.append(hex_int & 0x00ff)
     send_indigo_api_raw(ip, port, raw)
 
+# API names from the API list of indigo_api.h, if it is next to this script
+def get_api_names():
+    names = {0x0000: "CMD_RESPONSE", 0x0001: "CMD_ACK"}
+    fn = os.path.join(os.path.dirname(os.path.abspath(__file__)), "indigo_api.h")
+    try:
+        for id, name in re.findall(r'X\(API_\w+,\s*(0x[0-9a-fA-F]+),\s*"(\w+)"\)', open(fn).read()):
+            names[int(id, 16)] = name
+    except IOError:
+        pass
+    return names
+
+# Read the messages of a capture of the app (-c). Returns a list of
+# (timestamp in seconds, received by the app, peer (ip, port), message, latency in us or None)
+def read_capture(fn):
+    records = []
+    data = open(fn, "rb").read()
+    pos = 0
+    while pos + 12 <= len(data):
+        block_type, block_len = struct.unpack("<II", data[pos:pos + 8])
+        if block_len < 12:
+            break
+        # Enhanced packet block: IPv4 and UDP headers in front of the message
+        if block_type == 6:
+            ts_high, ts_low, cap_len = struct.unpack("<III", data[pos + 12:pos + 24])
+            packet = data[pos + 28:pos + 28 + cap_len]
+            src = (socket.inet_ntoa(packet[12:16]), struct.unpack(">H", packet[20:22])[0])
+            dst = (socket.inet_ntoa(packet[16:20]), struct.unpack(">H", packet[22:24])[0])
+            opt = pos + 28 + ((cap_len + 3) & ~3)
+            received, latency = False, None
+            while opt + 4 <= pos + block_len - 4:
+                code, length = struct.unpack("<HH", data[opt:opt + 4])
+                value = data[opt + 4:opt + 4 + length]
+                if code == 0:
+                    break
+                elif code == 2:
+                    received = struct.unpack("<I", value)[0] & 0x3 == 1
+                elif code == 1 and value.startswith(b"latency "):
+                    latency = int(value.split()[1])
+                opt += 4 + ((length + 3) & ~3)
+            records.append((((ts_high << 32) | ts_low) / 1e6, received,
+                            src if received else dst, packet[28:], latency))
+        pos += block_len
+    return records
+
+LOG_LEVEL_NAMES = ["debugverbose", "debug", "info", "notice", "warning"]
+LOG_FORMAT_TEXT = 0xffff
+
+# Render a format of the binary log with its arguments the way printf() would
+def format_log_line(fmt, args):
+    args = list(args)
+    def convert(m):
+        flags, width, precision, length, conv = m.groups()
+        if conv == "%":
+            return "%"
+        if width == "*":
+            width = str(args.pop(0))
+        if precision == ".*":
+            precision = "." + str(args.pop(0))
+        value = args.pop(0) if args else 0
+        if conv == "p":
+            return ("0x%" + flags + width + (precision or "") + "x") % value if value else "(nil)"
+        if conv in "ouxX":
+            mask = {"hh": 0xff, "h": 0xffff, "": 0xffffffff}.get(length, (1 << 64) - 1)
+            value &= mask
+        elif conv == "c":
+            return ("%" + flags.replace("'", "") + width + "c") % chr(value & 0xff)
+        elif conv in "di" and length in ("hh", "h"):
+            bits = 8 if length == "hh" else 16
+            value = ((value + (1 << (bits - 1))) & ((1 << bits) - 1)) - (1 << (bits - 1))
+        if conv == "s":
+            value = value.decode("utf-8", "replace")
+        return ("%" + flags.replace("'", "") + width + (precision or "") + conv) % value
+    return re.sub(r"%([-+ #0']*)(\*|\d*)(\.\*|\.\d*)?(hh|h|ll|l|q|z|j|t)?([diouxXeEfFgGaAcspn%])", convert, fmt)
+
+# Decode the binary log of the app (-l) to the lines of the text log
+def decode_log(fn):
+    data = open(fn, "rb").read()
+    if data[0:8] != b"QTBLOG1\0":
+        print("%s is not a binary log" % fn)
+        return
+    order = "<" if struct.unpack("<I", data[8:12])[0] == 0x1a2b3c4d else ">"
+    (formats_offset, formats_size, formats_len, format_count, blocks_offset,
+     block_size, block_count) = struct.unpack(order + "7I", data[12:40])
+
+    formats = {}
+    pos = formats_offset
+    for i in range(format_count):
+        id, length, argc = struct.unpack(order + "HHB", data[pos:pos + 5])
+        sig = data[pos + 5:pos + 5 + argc].decode()
+        formats[id] = (sig, data[pos + 5 + argc:pos + 5 + argc + length].decode("utf-8", "replace"))
+        pos += 5 + argc + length
+
+    blocks = []
+    for i in range(block_count):
+        offset = blocks_offset + i * block_size
+        seq, used = struct.unpack(order + "QI", data[offset:offset + 12])
+        if seq:
+            blocks.append((seq, offset, used))
+    for seq, offset, used in sorted(blocks):
+        pos = offset + 16
+        while pos + 16 <= offset + used:
+            length, format, level, sec, nsec = struct.unpack(order + "HHB3xII", data[pos:pos + 16])
+            body = data[pos + 16:pos + length]
+            pos += length
+            if format == LOG_FORMAT_TEXT:
+                text = body.decode("utf-8", "replace")
+            elif format in formats:
+                sig, fmt = formats[format]
+                args, p = [], 0
+                for kind in sig:
+                    if kind == "s":
+                        n = struct.unpack(order + "H", body[p:p + 2])[0]
+                        args.append(body[p + 2:p + 2 + n])
+                        p += 2 + n
+                    else:
+                        args.append(struct.unpack(order + {"q": "q", "p": "Q", "d": "d"}[kind], body[p:p + 8])[0])
+                        p += 8
+                text = format_log_line(fmt, args)
+            else:
+                text = "<unknown format %d>" % format
+            name = LOG_LEVEL_NAMES[level] if level < len(LOG_LEVEL_NAMES) else "info"
+            print("%s.%06d controlappc.%8s  %s" % (time.strftime("%b %d %H:%M:%S", time.localtime(sec)),
+                                                  nsec // 1000, name, text))
+
+def get_msg_hdr(msg):
+    version, type, seq, index, count = struct.unpack(">BHHBB", msg[0:7])
+    # The first fragment of a message of the extended encoding, or an unfragmented one
+    first = version != 0x02 or count in (0, 1, 0xff) or index == 0
+    return type, seq, first
+
+# Send the requests of a capture again with their original spacing, divided by speed.
+# speed 0 sends them back to back. Prints the latency of each API against the recording.
+# The recorded latency is measured in the app, the replayed one here, so it includes the round trip.
+def replay_capture(ip, port, fn, speed=1.0, timeout=10):
+    names = get_api_names()
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    server_address = (ip, port)
+    # Kernel receive time of the responses, so a response read late still gets its latency
+    so_timestampns = getattr(socket, "SO_TIMESTAMPNS", 35)
+    sock.setsockopt(socket.SOL_SOCKET, so_timestampns, 1)
+
+    # Pair each request with the recorded latency of its response, matched by peer and seq
+    requests = []
+    waiting = {}
+    for ts, received, peer, msg, latency in read_capture(fn):
+        if len(msg) < 7:
+            continue
+        type, seq, first = get_msg_hdr(msg)
+        if received:
+            request = [ts, type, seq, first, msg, None]
+            requests.append(request)
+            if first:
+                waiting.setdefault((peer, seq), []).append(request)
+        elif type == 0x0000 and first and waiting.get((peer, seq)):
+            waiting[(peer, seq)].pop(0)[5] = latency / 1e3 if latency is not None else None
+    if not requests:
+        print("No request in %s" % fn)
+        return
+
+    # Requests waiting for their response by seq, with the send time and the recorded latency
+    outstanding = {}
+    results = {}
+
+    def receive(until, final=False):
+        while not final or any(outstanding.values()):
+            wait = until - time.time()
+            if wait < 0 or not select.select([sock], [], [], wait)[0]:
+                return
+            data, ancdata, flags, server = sock.recvmsg(65536, 64)
+            now = time.time()
+            for level, cmsg_type, cmsg_data in ancdata:
+                if level == socket.SOL_SOCKET and cmsg_type == so_timestampns and len(cmsg_data) >= 16:
+                    sec, nsec = struct.unpack("@qq", cmsg_data[:16])
+                    now = sec + nsec / 1e9
+            if len(data) < 7:
+                continue
+            type, seq, first = get_msg_hdr(data)
+            if type != 0x0000 or not first or not outstanding.get(seq):
+                continue
+            api, sent, expected = outstanding[seq].pop(0)
+            results.setdefault(api, []).append(((now - sent) * 1e3, expected))
+
+    start = time.time()
+    for ts, type, seq, first, msg, expected in requests:
+        receive(start + (ts - requests[0][0]) / speed if speed > 0 else time.time())
+        sock.sendto(msg, server_address)
+        if first:
+            outstanding.setdefault(seq, []).append((type, time.time(), expected))
+    receive(time.time() + timeout, True)
+
+    print("%-32s %6s %14s %14s %12s" % ("API", "count", "recorded (ms)", "replayed (ms)", "delta (ms)"))
+    for api in sorted(results):
+        replayed = [r for r, e in results[api]]
+        recorded = [e for r, e in results[api] if e is not None]
+        line = "%-32s %6d" % (names.get(api, "0x%04x" % api), len(replayed))
+        if recorded:
+            line += " %14.3f" % (sum(recorded) / len(recorded))
+        else:
+            line += " %14s" % "-"
+        line += " %14.3f" % (sum(replayed) / len(replayed))
+        if recorded:
+            line += " %+12.3f" % (sum(replayed) / len(replayed) - sum(recorded) / len(recorded))
+        print(line)
+    missing = sum(len(v) for v in outstanding.values())
+    if missing:
+        print("%d requests got no response" % missing)
+    sock.close()
+
 command_interval = 1
 outputs = []
 
@@ -285,9 +501,22 @@ elif len(sys.argv) >= 2:
     elif sys.argv[1] == "get_mac_addr":
         m = test_get_mac_addr()
         outputs.append(m.to_bytes())
+    elif sys.argv[1] == "log_level":
+        # log_level [category|all] [level]
+        m = test_set_log_level(sys.argv[2] if len(sys.argv) > 2 else None,
+                               int(sys.argv[3]) if len(sys.argv) > 3 else None)
+        outputs.append(m.to_bytes())
     elif sys.argv[1] == "file":
         test_hex_file(peer_ip, peer_port, sys.argv[2])
         sys.exit()
+    elif sys.argv[1] == "log":
+        # log <binary log file>
+        decode_log(sys.argv[2])
+        sys.exit()
+    elif sys.argv[1] == "replay":
+        # replay <capture file> [speed]
+        replay_capture(peer_ip, peer_port, sys.argv[2], float(sys.argv[3]) if len(sys.argv) > 3 else 1.0)
+        sys.exit()
     else:
         m = test_get_control_app()
         outputs.append(m.to_bytes())
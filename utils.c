@@ -36,18 +36,17 @@
 #include <arpa/inet.h>
 #include <ifaddrs.h>
 #include <stdint.h>
+#include <errno.h>
 typedef uint8_t u_int8_t;
 typedef uint16_t u_int16_t;
 typedef uint32_t u_int32_t;
 
 #include "vendor_specific.h"
 #include "utils.h"
+#include "indigo_log.h"
+#include "indigo_request.h"
 #include "eloop.h"
 
-/* Log */
-int stdout_level = LOG_LEVEL_DEBUG;
-int syslog_level = LOG_LEVEL_INFO;
-
 /* multiple VAPs */
 int interface_count = 0;
 int configured_interface_count = 0;
@@ -58,131 +57,36 @@ static struct loopback_info loopback = {};
 /* bridge used for wireless interfaces */
 char wlans_bridge[32];
 
-#if UPLOAD_TC_APP_LOG
-/* per test case control app log */
-FILE *app_log;
-extern struct sockaddr_in *tool_addr;
-#endif
-
 #ifdef HOSTAPD_SUPPORT_MBSSID_WAR
 int use_openwrt_wpad = 0;
 #endif
 
-void send_continuous_loopback_packet(void *eloop_ctx, void *sock_ctx);
-
-void debug_print_timestamp(void) {
-    time_t rawtime;
-    struct tm *info;
-    char buffer[32];
-
-    time(&rawtime);
-    info = localtime(&rawtime);
-    if (info) {
-        strftime(buffer, sizeof(buffer), "%b %d %H:%M:%S", info);
-    }
-    printf("%s ", buffer);
-#if UPLOAD_TC_APP_LOG
-    if (app_log) {
-        fprintf(app_log, "%s ", buffer);
-    }
-#endif
-}
-
-void indigo_logger(int level, const char *fmt, ...) {
-    char *format, *log_type;
-    int maxlen;
-    int priority;
-    va_list ap;
-
-    maxlen = strlen(fmt) + 100;
-    format = malloc(maxlen);
-    if (!format) {
-        return;
-    }
-
-    switch (level) {
-    case LOG_LEVEL_DEBUG_VERBOSE:
-        log_type = "debugverbose";
-        break;
-    case LOG_LEVEL_DEBUG:
-        log_type = "debug";
-        break;
-    case LOG_LEVEL_INFO:
-        log_type = "info";
-        break;
-    case LOG_LEVEL_NOTICE:
-        log_type = "notice";
-        break;
-    case LOG_LEVEL_WARNING:
-        log_type = "warning";
-        break;
-    default:
-        log_type = "info";
-        break;
-    }
-
-    snprintf(format, maxlen, "controlappc.%8s  %s", log_type, fmt);
-
-    if (level >= stdout_level) {
-        debug_print_timestamp();
-        va_start(ap, fmt);
-        vprintf(format, ap);
-        va_end(ap);
-        printf("\n");
-#if UPLOAD_TC_APP_LOG
-        if (app_log) {
-            va_start(ap, fmt);
-            vfprintf(app_log, format, ap);
-            fprintf(app_log, "\n");
-            va_end(ap);
-        }
-#endif
-    }
-
-    if (level >= stdout_level) {
-        switch (level) {
-        case LOG_LEVEL_DEBUG_VERBOSE:
-        case LOG_LEVEL_DEBUG:
-                priority = LOG_DEBUG;
-                break;
-        case LOG_LEVEL_INFO:
-                priority = LOG_INFO;
-                break;
-        case LOG_LEVEL_NOTICE:
-                priority = LOG_NOTICE;
-                break;
-        case LOG_LEVEL_WARNING:
-                priority = LOG_WARNING;
-                break;
-        default:
-                priority = LOG_INFO;
-                break;
-        }
-        va_start(ap, fmt);
-        vsyslog(priority, format, ap);
-        va_end(ap);
-    }
-}
+void send_continuous_loopback_packet(void *eloop_ctx, void *sock_ctx, unsigned int ticks);
 
 void open_tc_app_log() {
 #if UPLOAD_TC_APP_LOG
+    FILE *app_log;
+
+    app_log = indigo_log_set_file(NULL);
     if (app_log) {
         fclose(app_log);
-        app_log = NULL;
     }
     app_log = fopen(APP_LOG_FILE, "w");
     if (app_log == NULL) {
         indigo_logger(LOG_LEVEL_ERROR, "Failed to open the file %s", APP_LOG_FILE);    
     }
+    indigo_log_set_file(app_log);
 #endif
 }
 
 /* Close file handle and upload test case control app log */
 void close_tc_app_log() {
+    struct sockaddr_in *tool_addr = get_tool_addr();
 #if UPLOAD_TC_APP_LOG
+    FILE *app_log = indigo_log_set_file(NULL);
+
     if (app_log) {
         fclose(app_log);
-        app_log = NULL;
         if (tool_addr != NULL) {
             http_file_post(inet_ntoa(tool_addr->sin_addr), TOOL_POST_PORT, HAPD_UPLOAD_API, APP_LOG_FILE);
         }
@@ -218,7 +122,7 @@ int pipe_command(char *buffer, int buffer_size, char *cmd, char *parameter[]) {
         len = read(pipefds[0], buffer, buffer_size);
         indigo_logger(LOG_LEVEL_DEBUG_VERBOSE, "Pipe system call= %s, Return length= %d, result= %s", cmd, len, buffer);
         close(pipefds[0]);
-        wait(NULL); /* Parent waits for the child to terminate */
+        waitpid(pid, NULL, 0); /* Parent waits for the child to terminate */
     }
     return len;
 }
@@ -296,23 +200,27 @@ static void loopback_server_receive_message(int sock, void *eloop_ctx, void *soc
     fromlen = sizeof(from);
     len = recvfrom(sock, buffer, BUFFER_LEN, 0, (struct sockaddr *) &from, &fromlen);
     if (len < 0) {
-        indigo_logger(LOG_LEVEL_ERROR, "Loopback server recvfrom[server] error");
+        indigo_log(LOG_CATEGORY_LOOPBACK, LOG_LEVEL_ERROR, "Loopback server recvfrom[server] error");
         return ;
     }
 
-    indigo_logger(LOG_LEVEL_INFO, "Loopback server received length = %d", len);
+    indigo_log(LOG_CATEGORY_LOOPBACK, LOG_LEVEL_INFO, "Loopback server received length = %d", len);
 
-    len = sendto(sock, (const char *)buffer, len, MSG_CONFIRM, (struct sockaddr *)&from, sizeof(from));
+    if (eloop_sock_send(sock, buffer, len, MSG_CONFIRM, (struct sockaddr *)&from, fromlen) < 0) {
+        indigo_log(LOG_CATEGORY_LOOPBACK, LOG_LEVEL_ERROR, "Loopback server failed to echo back length = %d", len);
+        return ;
+    }
 
-    indigo_logger(LOG_LEVEL_INFO, "Loopback server echo back length = %d", len);
+    indigo_log(LOG_CATEGORY_LOOPBACK, LOG_LEVEL_INFO, "Loopback server echo back length = %d", len);
 }
 
 static void loopback_server_timeout(void *eloop_ctx, void *timeout_ctx) {
     int s = (intptr_t)eloop_ctx;
     eloop_unregister_read_sock(s);
+    eloop_sock_send_drop(s);
     close(s);
     loopback_socket = 0;
-    indigo_logger(LOG_LEVEL_INFO, "Loopback server stops");
+    indigo_log(LOG_CATEGORY_LOOPBACK, LOG_LEVEL_INFO, "Loopback server stops");
 }
 
 int loopback_server_start(char *local_ip, char *local_port, int timeout) {
@@ -323,7 +231,7 @@ int loopback_server_start(char *local_ip, char *local_port, int timeout) {
    /* Open UDP socket */
     s = socket(PF_INET, SOCK_DGRAM, 0);
     if (s < 0) {
-        indigo_logger(LOG_LEVEL_ERROR, "Failed to open server socket");
+        indigo_log(LOG_CATEGORY_LOOPBACK, LOG_LEVEL_ERROR, "Failed to open server socket");
         return -1;
     }
 
@@ -335,28 +243,28 @@ int loopback_server_start(char *local_ip, char *local_port, int timeout) {
     }
 
     if (bind(s, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
-        indigo_logger(LOG_LEVEL_ERROR, "Failed to bind server socket");
+        indigo_log(LOG_CATEGORY_LOOPBACK, LOG_LEVEL_ERROR, "Failed to bind server socket");
         close(s);
         return -1;
     }
 
     if (getsockname(s, (struct sockaddr *)&addr, &len) == -1) {
-        indigo_logger(LOG_LEVEL_INFO, "Failed to get socket port number");
+        indigo_log(LOG_CATEGORY_LOOPBACK, LOG_LEVEL_INFO, "Failed to get socket port number");
         close(s);
         return -1;
     } else {
-        indigo_logger(LOG_LEVEL_INFO, "loopback server port number %d\n", ntohs(addr.sin_port));
+        indigo_log(LOG_CATEGORY_LOOPBACK, LOG_LEVEL_INFO, "loopback server port number %d\n", ntohs(addr.sin_port));
         sprintf(local_port, "%d", ntohs(addr.sin_port));
     }
 
     /* Register to eloop and ready for the socket event */
     if (eloop_register_read_sock(s, loopback_server_receive_message, NULL, NULL)) {
-        indigo_logger(LOG_LEVEL_ERROR, "Failed to initiate ControlAppC");
+        indigo_log(LOG_CATEGORY_LOOPBACK, LOG_LEVEL_ERROR, "Failed to initiate ControlAppC");
         return -1;
     }
     loopback_socket = s;
     eloop_register_timeout(timeout, 0, loopback_server_timeout, (void*)(intptr_t)s, NULL);
-    indigo_logger(LOG_LEVEL_INFO, "Loopback Client starts ip %s port %s", local_ip, local_port);
+    indigo_log(LOG_CATEGORY_LOOPBACK, LOG_LEVEL_INFO, "Loopback Client starts ip %s port %s", local_ip, local_port);
 
     return 0;
 }
@@ -365,6 +273,7 @@ int loopback_server_stop() {
     if (loopback_socket) {
         eloop_cancel_timeout(loopback_server_timeout, (void*)(intptr_t)loopback_socket, NULL);
         eloop_unregister_read_sock(loopback_socket);
+        eloop_sock_send_drop(loopback_socket);
         close(loopback_socket);
         loopback_socket = 0;
     }
@@ -401,12 +310,10 @@ void setup_icmphdr(u_int8_t type, u_int8_t code, u_int16_t id,
     icmphdr->checksum = icmp_checksum((unsigned short *)icmphdr, packet_size);
 }
 
-void send_one_loopback_icmp_packet(struct loopback_info *info) {
+/* Send one echo request of the continuous loopback. The echo is counted by receive_loopback_echo(). */
+static int send_one_loopback_icmp_packet(struct loopback_info *info) {
     int n;
-    char server_reply[1600];
-    struct in_addr insaddr;
-    struct icmphdr *icmphdr, *recv_icmphdr;
-    struct iphdr *recv_iphdr;
+    struct icmphdr *icmphdr;
     struct sockaddr_in addr;
 
     memset(&addr, 0, sizeof(addr));
@@ -418,76 +325,106 @@ void send_one_loopback_icmp_packet(struct loopback_info *info) {
     info->pkt_sent++;
     setup_icmphdr(ICMP_ECHO, 0, 0, info->pkt_sent, icmphdr, info->pkt_size);
 
-    n = sendto(info->sock, (char *)info->message, info->pkt_size, 0, (struct sockaddr *)&addr, sizeof(addr));
+    n = sendto(info->sock, (char *)info->message, info->pkt_size, MSG_DONTWAIT, (struct sockaddr *)&addr,
+               sizeof(addr));
     if (n < 0) {
-        indigo_logger(LOG_LEVEL_WARNING, "Send failed on icmp packet %d", info->pkt_sent);
-        goto done;
+        indigo_log(LOG_CATEGORY_LOOPBACK, LOG_LEVEL_WARNING, "Send failed on icmp packet %d", info->pkt_sent);
+        return -1;
     }
-    indigo_logger(LOG_LEVEL_INFO, "Packet %d: Send icmp %d bytes data to ip %s",
+    indigo_log(LOG_CATEGORY_LOOPBACK, LOG_LEVEL_INFO, "Packet %d: Send icmp %d bytes data to ip %s",
                   info->pkt_sent, n, info->target_ip);
 
-    memset(&server_reply, 0, sizeof(server_reply));
-    n = recv(info->sock, server_reply, sizeof(server_reply), 0);
-    if (n < 0) {
-        indigo_logger(LOG_LEVEL_WARNING, "recv failed on icmp packet %d", info->pkt_sent);
-        goto done;
-    } else {
+    return 0;
+}
+
+static int send_one_loopback_udp_packet(struct loopback_info *info) {
+    ssize_t send_len = 0;
+
+    info->pkt_sent++;
+    send_len = send(info->sock, info->message, strlen(info->message), MSG_DONTWAIT);
+    if (send_len < 0) {
+        indigo_log(LOG_CATEGORY_LOOPBACK, LOG_LEVEL_INFO, "Send failed on packet %d", info->pkt_sent);
+        return -1;
+    }
+    indigo_log(LOG_CATEGORY_LOOPBACK, LOG_LEVEL_INFO, "Packet %d: Send loopback %d bytes data",
+            info->pkt_sent, send_len);
+
+    return 0;
+}
+
+/* Read handler of the continuous loopback socket. Counts the echoes that have arrived. */
+static void receive_loopback_echo(int sock, void *eloop_ctx, void *sock_ctx) {
+    struct loopback_info *info = (struct loopback_info *)eloop_ctx;
+    char server_reply[1600];
+    struct in_addr insaddr;
+    struct icmphdr *recv_icmphdr;
+    struct iphdr *recv_iphdr;
+    ssize_t n;
+
+    while ((n = recv(sock, server_reply, sizeof(server_reply), MSG_DONTWAIT)) >= 0) {
+        if (info->pkt_type != DATA_TYPE_ICMP) {
+            info->pkt_rcv++;
+            indigo_log(LOG_CATEGORY_LOOPBACK, LOG_LEVEL_INFO, "Receive echo %d bytes data", n);
+            continue;
+        }
+
         recv_iphdr = (struct iphdr *)server_reply;
+        if (n < (ssize_t) sizeof(*recv_iphdr) || n < (recv_iphdr->ihl << 2) + (ssize_t) sizeof(*recv_icmphdr)) {
+            continue;
+        }
         recv_icmphdr = (struct icmphdr *)(server_reply + (recv_iphdr->ihl << 2));
         insaddr.s_addr = recv_iphdr->saddr;
 
         if (!strcmp(info->target_ip, inet_ntoa(insaddr)) && recv_icmphdr->type == ICMP_ECHOREPLY) {
-            indigo_logger(LOG_LEVEL_INFO, "icmp echo reply from %s, Receive echo %d bytes data", info->target_ip, n - 20);
+            indigo_log(LOG_CATEGORY_LOOPBACK, LOG_LEVEL_INFO, "icmp echo reply from %s, Receive echo %d bytes data", info->target_ip, n - 20);
             info->pkt_rcv++;
         } else {
-            indigo_logger(LOG_LEVEL_INFO, "Received packet is not the ICMP reply from the DUT");
+            indigo_log(LOG_CATEGORY_LOOPBACK, LOG_LEVEL_INFO, "Received packet is not the ICMP reply from the DUT");
         }
     }
-
-done:
-    eloop_register_timeout(0, info->rate * 1000000, send_continuous_loopback_packet, info, NULL);
 }
 
-void send_one_loopback_udp_packet(struct loopback_info *info) {
-    char server_reply[1600];
-    ssize_t recv_len = 0, send_len = 0;
+/* Periodic timer callback. ticks > 1 means the loop fell behind, so send the missed packets in one batch.
+ * The packets are sent without waiting for their echoes, which receive_loopback_echo() counts. */
+void send_continuous_loopback_packet(void *eloop_ctx, void *sock_ctx, unsigned int ticks) {
+    struct loopback_info *info = (struct loopback_info *)eloop_ctx;
+    unsigned int i;
 
-    memset(&server_reply, 0, sizeof(server_reply));
+    if (ticks > LOOPBACK_MAX_BURST)
+        ticks = LOOPBACK_MAX_BURST;
 
-    info->pkt_sent++;
-    send_len = send(info->sock, info->message, strlen(info->message), 0);
-    if (send_len < 0) {
-        indigo_logger(LOG_LEVEL_INFO, "Send failed on packet %d", info->pkt_sent);
-        // In case Tool doesn't send stop or doesn't receive stop
-        if (info->pkt_sent < 1000)
-            eloop_register_timeout(0, info->rate*1000000, send_continuous_loopback_packet, info, NULL);
-        return;
+    if (info->pkt_type != DATA_TYPE_ICMP) {
+        // In case Tool doesn't send stop or doesn't receive stop: no echo since the last tick
+        if (info->pkt_sent >= 1000 && info->pkt_rcv == info->pkt_rcv_last) {
+            eloop_cancel_periodic(send_continuous_loopback_packet, info, NULL);
+            return;
+        }
+        info->pkt_rcv_last = info->pkt_rcv;
     }
-    indigo_logger(LOG_LEVEL_INFO, "Packet %d: Send loopback %d bytes data",
-            info->pkt_sent, send_len);
 
-    recv_len = recv(info->sock, server_reply, sizeof(server_reply), 0);
-    if (recv_len < 0) {
-        indigo_logger(LOG_LEVEL_INFO, "recv failed on packet %d", info->pkt_sent);
-        // In case Tool doesn't send stop or doesn't receive stop
-        if (info->pkt_sent < 1000)
-            eloop_register_timeout(0, info->rate*1000000, send_continuous_loopback_packet, info, NULL);
-        return;
+    for (i = 0; i < ticks; i++) {
+        if (info->pkt_type == DATA_TYPE_ICMP) {
+            send_one_loopback_icmp_packet(info);
+        } else {
+            send_one_loopback_udp_packet(info);
+        }
     }
-    info->pkt_rcv++;
-    indigo_logger(LOG_LEVEL_INFO, "Receive echo %d bytes data", recv_len);
-
-    eloop_register_timeout(0, info->rate*1000000, send_continuous_loopback_packet, info, NULL);
 }
 
-void send_continuous_loopback_packet(void *eloop_ctx, void *sock_ctx) {
-    struct loopback_info *info = (struct loopback_info *)eloop_ctx;
+/* Start the periodic sender with the period of the rate (seconds) */
+static int start_continuous_loopback_packet(struct loopback_info *info) {
+    unsigned int period = info->rate * 1000000;
 
-    if (info->pkt_type == DATA_TYPE_ICMP) {
-        send_one_loopback_icmp_packet(info);
-    } else {
-        send_one_loopback_udp_packet(info);
+    if (period == 0)
+        period = 1;
+    info->pkt_rcv_last = -1;
+    if (eloop_register_read_sock(info->sock, receive_loopback_echo, info, NULL) < 0)
+        return -1;
+    if (eloop_register_periodic(period / 1000000, period % 1000000, send_continuous_loopback_packet, info, NULL) < 0) {
+        eloop_unregister_read_sock(info->sock);
+        return -1;
     }
+    return 0;
 }
 
 /* Stop to send continuous loopback data */
@@ -496,7 +433,8 @@ int stop_loopback_data(int *pkt_sent)
     if (loopback.sock <= 0)
         return 0;
 
-    eloop_cancel_timeout(send_continuous_loopback_packet, &loopback, NULL);
+    eloop_cancel_periodic(send_continuous_loopback_packet, &loopback, NULL);
+    eloop_unregister_read_sock(loopback.sock);
     close(loopback.sock);
     loopback.sock = 0;
     if (pkt_sent)
@@ -516,7 +454,7 @@ int send_udp_data(char *target_ip, int target_port, int packet_count, int packet
     /* Open UDP socket */
     s = socket(PF_INET, SOCK_DGRAM, 0);
     if (s < 0) {
-        indigo_logger(LOG_LEVEL_ERROR, "Failed to open socket");
+        indigo_log(LOG_CATEGORY_LOOPBACK, LOG_LEVEL_ERROR, "Failed to open socket");
         return -1;
     }
 
@@ -533,7 +471,7 @@ int send_udp_data(char *target_ip, int target_port, int packet_count, int packet
         snprintf(ifname, sizeof(ifname), "%s", get_wireless_interface());
     const int len = strnlen(ifname, IFNAMSIZ);
     if (setsockopt(s, SOL_SOCKET, SO_BINDTODEVICE, ifname, len) < 0) {
-        indigo_logger(LOG_LEVEL_ERROR, "failed to bind the interface %s", ifname);
+        indigo_log(LOG_CATEGORY_LOOPBACK, LOG_LEVEL_ERROR, "failed to bind the interface %s", ifname);
         return -1;
     }
 
@@ -548,12 +486,12 @@ int send_udp_data(char *target_ip, int target_port, int packet_count, int packet
     addr.sin_port = htons(target_port);
 
     if (connect(s, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
-        indigo_logger(LOG_LEVEL_ERROR, "Connect failed. Error");
+        indigo_log(LOG_CATEGORY_LOOPBACK, LOG_LEVEL_ERROR, "Connect failed. Error");
         close(s);
         return -1;
     }
 
-    indigo_logger(LOG_LEVEL_INFO, "packet_count %d rate %lf\n",
+    indigo_log(LOG_CATEGORY_LOOPBACK, LOG_LEVEL_INFO, "packet_count %d rate %lf\n",
                   packet_count, rate);
 
     /* Continuous data case: reply OK and use eloop timeout to send data */
@@ -565,8 +503,13 @@ int send_udp_data(char *target_ip, int target_port, int packet_count, int packet
         memset(loopback.message, 0, sizeof(loopback.message));
         for (i = 0; (i < packet_size) && (i < sizeof(loopback.message)); i++)
             loopback.message[i] = 0x0A;
-        eloop_register_timeout(0, 0, send_continuous_loopback_packet, &loopback, NULL);
-        indigo_logger(LOG_LEVEL_INFO, "Send continuous loopback data to ip %s port %u",
+        if (start_continuous_loopback_packet(&loopback) < 0) {
+            indigo_log(LOG_CATEGORY_LOOPBACK, LOG_LEVEL_ERROR, "Failed to start the loopback timer");
+            loopback.sock = 0;
+            close(s);
+            return -1;
+        }
+        indigo_log(LOG_CATEGORY_LOOPBACK, LOG_LEVEL_INFO, "Send continuous loopback data to ip %s port %u",
                       target_ip, target_port);
         return 0;
     }
@@ -580,16 +523,16 @@ int send_udp_data(char *target_ip, int target_port, int packet_count, int packet
 
         send_len = send(s, message, strlen(message), 0);
         if (send_len < 0) {
-            indigo_logger(LOG_LEVEL_INFO, "Send failed on packet %d", pkt_sent);
+            indigo_log(LOG_CATEGORY_LOOPBACK, LOG_LEVEL_INFO, "Send failed on packet %d", pkt_sent);
             usleep(rate*1000000);
             continue;
         }
-        indigo_logger(LOG_LEVEL_INFO, "Packet %d: Send loopback %d bytes data to ip %s port %u",
+        indigo_log(LOG_CATEGORY_LOOPBACK, LOG_LEVEL_INFO, "Packet %d: Send loopback %d bytes data to ip %s port %u",
                       pkt_sent, send_len, target_ip, target_port);
 
         recv_len = recv(s, server_reply, sizeof(server_reply), 0);
         if (recv_len < 0) {
-            indigo_logger(LOG_LEVEL_INFO, "recv failed on packet %d", pkt_sent);
+            indigo_log(LOG_CATEGORY_LOOPBACK, LOG_LEVEL_INFO, "recv failed on packet %d", pkt_sent);
             if (rate > 1)
                 usleep((rate-1)*1000000);
             continue;
@@ -597,7 +540,7 @@ int send_udp_data(char *target_ip, int target_port, int packet_count, int packet
         pkt_rcv++;
         usleep(rate*1000000);
 
-        indigo_logger(LOG_LEVEL_INFO, "Receive echo %d bytes data", recv_len);
+        indigo_log(LOG_CATEGORY_LOOPBACK, LOG_LEVEL_INFO, "Receive echo %d bytes data", recv_len);
     }
     close(s);
 
@@ -638,10 +581,10 @@ int send_icmp_data(char *target_ip, int packet_count, int packet_size, double ra
         snprintf(ifname, sizeof(ifname), "%s", get_wireless_interface());
     const int len = strnlen(ifname, IFNAMSIZ);
     if (setsockopt(sock, SOL_SOCKET, SO_BINDTODEVICE, ifname, len) < 0) {
-        indigo_logger(LOG_LEVEL_ERROR, "failed to bind the interface %s", ifname);
+        indigo_log(LOG_CATEGORY_LOOPBACK, LOG_LEVEL_ERROR, "failed to bind the interface %s", ifname);
         return -1;
     }
-    indigo_logger(LOG_LEVEL_DEBUG, "Bind the interface %s", ifname);
+    indigo_log(LOG_CATEGORY_LOOPBACK, LOG_LEVEL_DEBUG, "Bind the interface %s", ifname);
 
     setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, (const char *)&timeout, sizeof(timeout));
     setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, (const char *)&timeout, sizeof(timeout));
@@ -656,8 +599,13 @@ int send_icmp_data(char *target_ip, int packet_count, int packet_size, double ra
         snprintf(loopback.target_ip, sizeof(loopback.target_ip), "%s", target_ip);
         for (i = sizeof(struct icmphdr); (i < packet_size) && (i < sizeof(loopback.message)); i++)
             loopback.message[i] = 0x0A;
-        eloop_register_timeout(0, 0, send_continuous_loopback_packet, &loopback, NULL);
-        indigo_logger(LOG_LEVEL_INFO, "Send continuous loopback data to ip %s", loopback.target_ip);
+        if (start_continuous_loopback_packet(&loopback) < 0) {
+            indigo_log(LOG_CATEGORY_LOOPBACK, LOG_LEVEL_ERROR, "Failed to start the loopback timer");
+            loopback.sock = 0;
+            close(sock);
+            return -1;
+        }
+        indigo_log(LOG_CATEGORY_LOOPBACK, LOG_LEVEL_INFO, "Send continuous loopback data to ip %s", loopback.target_ip);
         return 0;
     }
 
@@ -672,16 +620,16 @@ int send_icmp_data(char *target_ip, int packet_count, int packet_size, double ra
 
         n = sendto(sock, (char *)buf, packet_size, 0, (struct sockaddr *)&addr, sizeof(addr));
         if (n < 0) {
-            indigo_logger(LOG_LEVEL_WARNING, "Send failed on icmp packet %d", pkt_sent);
+            indigo_log(LOG_CATEGORY_LOOPBACK, LOG_LEVEL_WARNING, "Send failed on icmp packet %d", pkt_sent);
             usleep(rate * 1000000);
             continue;
         }
-        indigo_logger(LOG_LEVEL_INFO, "Packet %d: Send icmp %d bytes data to ip %s",
+        indigo_log(LOG_CATEGORY_LOOPBACK, LOG_LEVEL_INFO, "Packet %d: Send icmp %d bytes data to ip %s",
                       pkt_sent, n, target_ip);
 
         n = recv(sock, server_reply, sizeof(server_reply), 0);
         if (n < 0) {
-            indigo_logger(LOG_LEVEL_WARNING, "recv failed on icmp packet %d", pkt_sent);
+            indigo_log(LOG_CATEGORY_LOOPBACK, LOG_LEVEL_WARNING, "recv failed on icmp packet %d", pkt_sent);
             if (rate > 1)
                 usleep((rate - 1) * 1000000);
             continue;
@@ -692,10 +640,10 @@ int send_icmp_data(char *target_ip, int packet_count, int packet_size, double ra
 
             if (!strcmp(target_ip, inet_ntoa(insaddr)) && recv_icmphdr->type == ICMP_ECHOREPLY) {
                 /* IP header 20 bytes */
-                indigo_logger(LOG_LEVEL_INFO, "icmp echo reply from %s, Receive echo %d bytes data", target_ip, n - 20);
+                indigo_log(LOG_CATEGORY_LOOPBACK, LOG_LEVEL_INFO, "icmp echo reply from %s, Receive echo %d bytes data", target_ip, n - 20);
                 pkt_rcv++;
             } else {
-                indigo_logger(LOG_LEVEL_INFO, "Received packet is not the ICMP reply from the Destination");
+                indigo_log(LOG_CATEGORY_LOOPBACK, LOG_LEVEL_INFO, "Received packet is not the ICMP reply from the Destination");
             }
         }
         usleep(rate * 1000000);
@@ -729,7 +677,7 @@ int send_broadcast_arp(char *target_ip, int *send_count, int rate) {
     //arping output format: 1 packets transmitted, 1 packets received,   0% unanswered (0 extra)
     fscanf(fp, "%d %*s %*s %d", send_count, &recv);
 #endif
-    indigo_logger(LOG_LEVEL_INFO, "ARP TEST - send: %d recv: %d", *send_count, recv );
+    indigo_log(LOG_CATEGORY_LOOPBACK, LOG_LEVEL_INFO, "ARP TEST - send: %d recv: %d", *send_count, recv );
     pclose(fp);
 
     return recv;
@@ -910,11 +858,11 @@ void detect_del_arp_entry(char *ip) {
     if (NULL == fgets(buffer, sizeof(buffer), fp)) {
     } else if (3 == sscanf(buffer, "%s %s %s", res_ip, res_dev, res_inf)) {
         if (!strcmp(res_ip, ip) && !strcmp(res_dev, "dev")) {
-            indigo_logger(LOG_LEVEL_INFO, "Delete existing ARP entry: %s", ip);
+            indigo_log(LOG_CATEGORY_NETIF, LOG_LEVEL_INFO, "Delete existing ARP entry: %s", ip);
             snprintf(buffer, sizeof(buffer), "ip neigh del %s %s %s", res_ip, res_dev, res_inf);
             system(buffer);
         } else {
-            indigo_logger(LOG_LEVEL_INFO, "Format mismatch?: %s %s %s\n", res_ip, res_dev, res_inf);
+            indigo_log(LOG_CATEGORY_NETIF, LOG_LEVEL_INFO, "Format mismatch?: %s %s %s\n", res_ip, res_dev, res_inf);
         }
     }
     pclose(fp);
@@ -1184,7 +1132,7 @@ int add_wireless_interface_info(int band, int bssid, char *name) {
 int show_wireless_interface_info() {
     int i;
     char *band;
-    indigo_logger(LOG_LEVEL_INFO, "interface_count=%d", interface_count);
+    indigo_log(LOG_CATEGORY_NETIF, LOG_LEVEL_INFO, "interface_count=%d", interface_count);
 
     for (i = 0; i < interface_count; i++) {
         if (interfaces[i].band == BAND_24GHZ) {
@@ -1195,7 +1143,7 @@ int show_wireless_interface_info() {
             band = "6GHz";
         }
 
-        indigo_logger(LOG_LEVEL_INFO, "Interface Name: %s, Band: %s, identifier %d", 
+        indigo_log(LOG_CATEGORY_NETIF, LOG_LEVEL_INFO, "Interface Name: %s, Band: %s, identifier %d", 
             interfaces[i].ifname, band, interfaces[i].identifier);
     }
     return 0;
@@ -1243,7 +1191,7 @@ void set_default_wireless_interface_info(int band) {
     for (i = 0; i < interface_count; i++) {
         if (interfaces[i].band == band) {
             default_interface = &interfaces[i];
-            indigo_logger(LOG_LEVEL_DEBUG, "Set default_interface %s", default_interface->ifname);
+            indigo_log(LOG_CATEGORY_NETIF, LOG_LEVEL_DEBUG, "Set default_interface %s", default_interface->ifname);
             break;
         }
     }
@@ -1546,14 +1494,14 @@ int insert_wpa_network_config(char *config) {
     f_tmp_ptr = fopen(tmp_path, "w");    
 
     if (f_ptr == NULL || f_tmp_ptr == NULL) {
-        indigo_logger(LOG_LEVEL_ERROR, "Failed to open the files");
+        indigo_log(LOG_CATEGORY_WPAS, LOG_LEVEL_ERROR, "Failed to open the files");
         return -1;
     }
 
     memset(buffer, 0, sizeof(buffer));
     while ((fgets(buffer, S_BUFFER_LEN, f_ptr)) != NULL) {
         if (strstr(buffer, target_str) != NULL) {
-            indigo_logger(LOG_LEVEL_DEBUG, 
+            indigo_log(LOG_CATEGORY_WPAS, LOG_LEVEL_DEBUG, 
                 "insert config: %s into the wpa_supplicant conf.", config);
             fputs(config, f_tmp_ptr);
         }
@@ -1676,12 +1624,12 @@ static char* http_body_multipart(char *boundary, char *param_name, char *file_na
     return buffer;
 }
 
-/* Internal. Create HTTP socket */
+/* Internal. Create HTTP socket. The connection completes in the background. */
 static int http_socket(char *host, int port) {
     int socketfd = 0;
     struct sockaddr_in server_addr;
 
-    if ((socketfd = socket(AF_INET, SOCK_STREAM, 0)) == -1) {
+    if ((socketfd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0)) == -1) {
         return -1;
     }
     memset(&server_addr, 0, sizeof(server_addr));
@@ -1689,7 +1637,8 @@ static int http_socket(char *host, int port) {
     server_addr.sin_port = htons(port);
     server_addr.sin_addr.s_addr = inet_addr(host);
 
-    if (connect(socketfd, (struct sockaddr *)&server_addr, sizeof(struct sockaddr)) == -1) {
+    if (connect(socketfd, (struct sockaddr *)&server_addr, sizeof(struct sockaddr)) == -1 &&
+        errno != EINPROGRESS) {
         close(socketfd);
         return -1;
     }
@@ -1697,12 +1646,82 @@ static int http_socket(char *host, int port) {
     return socketfd;
 }
 
-/*  Upload log by specifying the host, port, path, and the local file name */
+/* Internal. HTTP upload in progress. The request is written as the socket drains. */
+struct http_upload {
+    int sock;
+    char *data;
+    size_t len;
+    size_t sent;
+    char file_name[S_BUFFER_LEN];
+};
+
+static void http_upload_timeout(void *eloop_ctx, void *timeout_ctx);
+
+static void http_upload_free(struct http_upload *upload) {
+    eloop_cancel_timeout(http_upload_timeout, upload, NULL);
+    eloop_unregister_write_sock(upload->sock);
+    eloop_unregister_read_sock(upload->sock);
+    close(upload->sock);
+    free(upload->data);
+    free(upload);
+}
+
+static void http_upload_timeout(void *eloop_ctx, void *timeout_ctx) {
+    struct http_upload *upload = eloop_ctx;
+
+    indigo_log(LOG_CATEGORY_HTTP, LOG_LEVEL_ERROR, "Upload %s timed out", upload->file_name);
+    http_upload_free(upload);
+}
+
+static void http_upload_send(int sock, void *eloop_ctx, void *sock_ctx) {
+    struct http_upload *upload = eloop_ctx;
+    ssize_t n;
+
+    n = send(sock, upload->data + upload->sent, upload->len - upload->sent, MSG_DONTWAIT | MSG_NOSIGNAL);
+    if (n < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+            return;
+        indigo_log(LOG_CATEGORY_HTTP, LOG_LEVEL_ERROR, "Failed to upload file %s: %s", upload->file_name, strerror(errno));
+        http_upload_free(upload);
+        return;
+    }
+    upload->sent += n;
+    if (upload->sent == upload->len) {
+        eloop_unregister_write_sock(sock);
+    }
+}
+
+static void http_upload_receive(int sock, void *eloop_ctx, void *sock_ctx) {
+    struct http_upload *upload = eloop_ctx;
+    char response[1024];
+    ssize_t n;
+
+    n = recv(sock, response, sizeof(response) - 1, MSG_DONTWAIT);
+    if (n > 0) {
+        response[n] = '\0';
+        indigo_log(LOG_CATEGORY_HTTP, LOG_LEVEL_DEBUG, "Server response: %s", response);
+        return;
+    }
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+        return;
+
+    if (n == 0 && upload->sent == upload->len) {
+        indigo_log(LOG_CATEGORY_HTTP, LOG_LEVEL_INFO, "Upload completes");
+    } else {
+        indigo_log(LOG_CATEGORY_HTTP, LOG_LEVEL_ERROR, "Failed to upload file %s: %s", upload->file_name,
+                      n < 0 ? strerror(errno) : "connection closed");
+    }
+    http_upload_free(upload);
+}
+
+/*  Upload log by specifying the host, port, path, and the local file name.
+ *  The file is read right away and uploaded from the event loop, so this returns before the upload completes. */
 int http_file_post(char *host, int port, char *path, char *file_name) {
-    int socketfd = 0, retval = 0, numbytes = 0;
+    int socketfd = -1, retval = -1;
+    size_t header_len, body_len;
     char *header = NULL, *body = NULL;
     char boundary[64];
-    char response[10240];
+    struct http_upload *upload = NULL;
 
     /* Generate boundary, header and body */
     random_boundary(boundary, 41);
@@ -1712,7 +1731,7 @@ int http_file_post(char *host, int port, char *path, char *file_name) {
     else if (!strcmp(path, WPAS_UPLOAD_API))
         body = http_body_multipart(boundary, "wpasLogFile", file_name);
     else {
-        indigo_logger(LOG_LEVEL_ERROR, "Tool doesn't support %s ?", path);
+        indigo_log(LOG_CATEGORY_HTTP, LOG_LEVEL_ERROR, "Tool doesn't support %s ?", path);
         goto done;
     }
     /* Return if body is NULL */
@@ -1720,35 +1739,63 @@ int http_file_post(char *host, int port, char *path, char *file_name) {
         goto done;
     }
 
-    header = http_header_multipart(path, host, port, strlen(body), boundary);
+    body_len = strlen(body);
+    header = http_header_multipart(path, host, port, body_len, boundary);
+    if (header == NULL) {
+        goto done;
+    }
+    header_len = strlen(header);
+
+    upload = (struct http_upload *)calloc(1, sizeof(struct http_upload));
+    if (upload == NULL) {
+        goto done;
+    }
+    upload->data = (char *)malloc(header_len + body_len);
+    if (upload->data == NULL) {
+        goto done;
+    }
+    memcpy(upload->data, header, header_len);
+    memcpy(upload->data + header_len, body, body_len);
+    upload->len = header_len + body_len;
+    strlcpy(upload->file_name, file_name, sizeof(upload->file_name));
 
     socketfd = http_socket(host, port);
-    if (send(socketfd, header, strlen(header), 0) == -1){
-        indigo_logger(LOG_LEVEL_ERROR, "Failed to open HTTP socket");
+    if (socketfd < 0) {
+        indigo_log(LOG_CATEGORY_HTTP, LOG_LEVEL_ERROR, "Failed to open HTTP socket");
         goto done;
     }
+    upload->sock = socketfd;
 
-    if (send(socketfd, body, strlen(body), 0) == -1){
-        indigo_logger(LOG_LEVEL_ERROR, "Failed to upload file");
+    if (eloop_register_write_sock(socketfd, http_upload_send, upload, NULL) < 0) {
+        indigo_log(LOG_CATEGORY_HTTP, LOG_LEVEL_ERROR, "Failed to register HTTP socket");
         goto done;
     }
-    
-    while ((numbytes=recv(socketfd, response, sizeof(response), 0)) > 0) {
-        response[numbytes] = '\0';
-        indigo_logger(LOG_LEVEL_DEBUG, "Server response: %s", response);
+    if (eloop_register_read_sock(socketfd, http_upload_receive, upload, NULL) < 0 ||
+        eloop_register_timeout(HTTP_UPLOAD_TIMEOUT, 0, http_upload_timeout, upload, NULL) < 0) {
+        indigo_log(LOG_CATEGORY_HTTP, LOG_LEVEL_ERROR, "Failed to register HTTP socket");
+        http_upload_free(upload);
+        upload = NULL;
+        goto done;
     }
-    indigo_logger(LOG_LEVEL_INFO, "Upload completes");
-    
+    indigo_log(LOG_CATEGORY_HTTP, LOG_LEVEL_DEBUG, "Upload %s (%zu bytes) starts", file_name, upload->len);
+    upload = NULL;
+    retval = 0;
+
 done:
+    if (upload) {
+        if (socketfd >= 0) {
+            close(socketfd);
+        }
+        free(upload->data);
+        free(upload);
+    }
     if (header) {
         free(header);
     }
     if (body) {
         free(body);
     }
-    if (socketfd) {
-        close(socketfd);
-    }
+    return retval;
 }
 
 int file_exists(const char *fname)
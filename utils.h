@@ -24,6 +24,8 @@
 #define L_BUFFER_LEN              8192
 
 #define TOOL_POST_PORT 8080
+/* Seconds an HTTP upload may take before it is aborted */
+#define HTTP_UPLOAD_TIMEOUT 30
 #define HAPD_UPLOAD_API "/upload-platform-hapd-log"
 #define WPAS_UPLOAD_API "/upload-platform-wpas-log"
 #define ARTIFACTS_UPLOAD_API "/upload-test-artifacts"
@@ -95,6 +97,10 @@ struct channel_info {
     int freq;
 };
 
+/* Format of a MAC address, as decoded by get_wrapper_tlv_mac(), for the commands to hostapd and wpa_supplicant */
+#define MACSTR "%02x:%02x:%02x:%02x:%02x:%02x"
+#define MAC2STR(a) (a)[0], (a)[1], (a)[2], (a)[3], (a)[4], (a)[5]
+
 #define UNUSED_IDENTIFIER -1
 struct interface_info {
     int identifier; // valid only for multiple VAPs case
@@ -115,11 +121,16 @@ struct bss_identifier_info {
     int transmitter;
 };
 
+/* Upper bound of the packets sent at once when the continuous loopback sender catches up */
+#define LOOPBACK_MAX_BURST        16
+
 struct loopback_info {
     int sock;
     double rate;
     int pkt_sent;
     int pkt_rcv;
+    /* Echoes counted at the previous tick of the continuous sender */
+    int pkt_rcv_last;
     int pkt_type;
     int pkt_size;
     char target_ip[64];
@@ -127,7 +138,76 @@ struct loopback_info {
 };
 
 /* log and file API */
-void indigo_logger(int level, const char *fmt, ...);
+/* Log categories: X(category, name). A line is written when its level is at least the runtime level of its
+ * category, set with the SET_LOG_LEVEL API, and at least <category>_MIN_LEVEL. Lines under the minimum,
+ * which may be raised with -D at build time, are compiled out. */
+#define INDIGO_LOG_CATEGORY_LIST(X) \
+    X(LOG_CATEGORY_APP,                        "app") \
+    X(LOG_CATEGORY_PACKET,                     "packet") \
+    X(LOG_CATEGORY_ELOOP,                      "eloop") \
+    X(LOG_CATEGORY_LOOPBACK,                   "loopback") \
+    X(LOG_CATEGORY_HAPD,                       "hapd") \
+    X(LOG_CATEGORY_WPAS,                       "wpas") \
+    X(LOG_CATEGORY_NETIF,                      "netif") \
+    X(LOG_CATEGORY_HTTP,                       "http") \
+    X(LOG_CATEGORY_VENDOR,                     "vendor")
+
+enum {
+#define LOG_CATEGORY_ID(category, name) category,
+    INDIGO_LOG_CATEGORY_LIST(LOG_CATEGORY_ID)
+#undef LOG_CATEGORY_ID
+    LOG_CATEGORY_COUNT
+};
+#define LOG_CATEGORY_ALL                        -1
+
+#ifndef LOG_MIN_LEVEL
+#define LOG_MIN_LEVEL                           LOG_LEVEL_DEBUG_VERBOSE
+#endif
+#ifndef LOG_CATEGORY_APP_MIN_LEVEL
+#define LOG_CATEGORY_APP_MIN_LEVEL              LOG_MIN_LEVEL
+#endif
+#ifndef LOG_CATEGORY_PACKET_MIN_LEVEL
+#define LOG_CATEGORY_PACKET_MIN_LEVEL           LOG_MIN_LEVEL
+#endif
+#ifndef LOG_CATEGORY_ELOOP_MIN_LEVEL
+#define LOG_CATEGORY_ELOOP_MIN_LEVEL            LOG_MIN_LEVEL
+#endif
+#ifndef LOG_CATEGORY_LOOPBACK_MIN_LEVEL
+#define LOG_CATEGORY_LOOPBACK_MIN_LEVEL         LOG_MIN_LEVEL
+#endif
+#ifndef LOG_CATEGORY_HAPD_MIN_LEVEL
+#define LOG_CATEGORY_HAPD_MIN_LEVEL             LOG_MIN_LEVEL
+#endif
+#ifndef LOG_CATEGORY_WPAS_MIN_LEVEL
+#define LOG_CATEGORY_WPAS_MIN_LEVEL             LOG_MIN_LEVEL
+#endif
+#ifndef LOG_CATEGORY_NETIF_MIN_LEVEL
+#define LOG_CATEGORY_NETIF_MIN_LEVEL            LOG_MIN_LEVEL
+#endif
+#ifndef LOG_CATEGORY_HTTP_MIN_LEVEL
+#define LOG_CATEGORY_HTTP_MIN_LEVEL             LOG_MIN_LEVEL
+#endif
+#ifndef LOG_CATEGORY_VENDOR_MIN_LEVEL
+#define LOG_CATEGORY_VENDOR_MIN_LEVEL           LOG_MIN_LEVEL
+#endif
+
+/* Category of indigo_logger(). A file of one subsystem defines it before its includes. */
+#ifndef LOG_CATEGORY
+#define LOG_CATEGORY                            LOG_CATEGORY_APP
+#endif
+
+extern int log_category_level[LOG_CATEGORY_COUNT];
+
+/* The arguments of a line that isn't written aren't evaluated. A literal format may be kept as it is in the
+ * binary log, and its arguments rendered later. */
+#define indigo_log(category, level, fmt, ...) indigo_log_category(category, level, fmt, ##__VA_ARGS__)
+#define indigo_log_category(category, level, fmt, ...) do { \
+    if ((level) >= category##_MIN_LEVEL && (level) >= log_category_level[category]) { \
+        indigo_log_write((level), __builtin_constant_p(fmt), fmt, ##__VA_ARGS__); \
+    } \
+} while (0)
+#define indigo_logger(level, fmt, ...) indigo_log(LOG_CATEGORY, level, fmt, ##__VA_ARGS__)
+void indigo_log_write(int level, int literal, const char *fmt, ...);
 int pipe_command(char *buffer, int buffer_size, char *cmd, char *parameter[]);
 char* read_file(char *fn);
 int write_file(char *fn, char *buffer, int len);
@@ -14,6 +14,8 @@
 /* OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS                          */
 /* SOFTWARE. */
 
+#define LOG_CATEGORY                            LOG_CATEGORY_VENDOR
+
 #include <stdio.h>
 #include <string.h>
 #include <stdarg.h>
@@ -22,6 +24,7 @@
 
 #include "vendor_specific.h"
 #include "utils.h"
+#include "indigo_process.h"
 
 #ifdef HOSTAPD_SUPPORT_MBSSID_WAR
 extern int use_openwrt_wpad;
@@ -128,12 +131,8 @@ void vendor_init() {
 
 /* Be invoked when terminate controlApp */
 void vendor_deinit() {
-    char buffer[S_BUFFER_LEN];
-    memset(buffer, 0, sizeof(buffer));
-    sprintf(buffer, "killall %s 1>/dev/null 2>/dev/null", get_hapd_exec_file());
-    system(buffer);
-    sprintf(buffer, "killall %s 1>/dev/null 2>/dev/null", get_wpas_exec_file());
-    system(buffer);
+    process_stop(get_hapd_exec_file());
+    process_stop(get_wpas_exec_file());
 }
 
 /* Called by reset_device_hander() */
@@ -167,19 +166,16 @@ void openwrt_apply_radio_config(void) {
 #ifdef _WTS_OPENWRT_
     // Apply radio configurations
     memset(buffer, 0, sizeof(buffer));
-    sprintf(buffer, "%s -g /var/run/hostapd/global -B -P /var/run/hostapd-global.pid",
+    sprintf(buffer, "%s -g /var/run/hostapd/global -P /var/run/hostapd-global.pid",
         get_hapd_full_exec_path());
-    system(buffer);
+    process_start(buffer);
     sleep(1);
     system("wifi down >/dev/null 2>/dev/null");
     sleep(2);
     system("wifi up >/dev/null 2>/dev/null");
     sleep(3);
 
-    memset(buffer, 0, sizeof(buffer));
-    sprintf(buffer, "killall %s 1>/dev/null 2>/dev/null", get_hapd_exec_file());
-    system(buffer);
-    sleep(2);
+    process_stop(get_hapd_exec_file());
 #endif
 }
 #endif
@@ -369,27 +365,28 @@ void start_dhcp_server(char *if_name, char *ip_addr)
         fclose(fp);
     }
     system("touch /var/lib/dhcp/dhcpd.leases_QT");
-    snprintf(buffer, sizeof(buffer), "dhcpd -4 -cf /etc/dhcp/QT_dhcpd.conf -lf /var/lib/dhcp/dhcpd.leases_QT %s", if_name);
-    system(buffer);
+    /* -f keeps dhcpd in the foreground under the supervisor */
+    snprintf(buffer, sizeof(buffer), "dhcpd -f -4 -cf /etc/dhcp/QT_dhcpd.conf -lf /var/lib/dhcp/dhcpd.leases_QT %s", if_name);
+    process_start(buffer);
 }
 
 void stop_dhcp_server()
 {
     /* system("systemctl stop isc-dhcp-server.service"); */
-    system("killall dhcpd 1>/dev/null 2>/dev/null");
+    process_stop_async("dhcpd", NULL, NULL);
 }
 
 void start_dhcp_client(char *if_name)
 {
     char buffer[S_BUFFER_LEN];
 
-    snprintf(buffer, sizeof(buffer), "dhclient -4 %s &", if_name);
-    system(buffer);
+    snprintf(buffer, sizeof(buffer), "dhclient -d -4 %s", if_name);
+    process_start(buffer);
 }
 
 void stop_dhcp_client()
 {
-    system("killall dhclient 1>/dev/null 2>/dev/null");
+    process_stop_async("dhclient", NULL, NULL);
 }
 
 wps_setting *p_wps_setting = NULL;
@@ -14,6 +14,8 @@
 /* OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS                          */
 /* SOFTWARE. */
 
+#define LOG_CATEGORY                            LOG_CATEGORY_VENDOR
+
 #include <stdio.h>
 #include <string.h>
 #include <stdarg.h>
@@ -22,6 +24,7 @@
 
 #include "vendor_specific.h"
 #include "utils.h"
+#include "indigo_process.h"
 
 #ifdef HOSTAPD_SUPPORT_MBSSID_WAR
 extern int use_openwrt_wpad;
@@ -222,10 +225,8 @@ void delete_sta_interface() {
 /* Be invoked when start controlApp */
 void vendor_init() {
     /* Make sure native hostapd/wpa_supplicant is inactive */
-    system("killall hostapd 1>/dev/null 2>/dev/null");
-    sleep(1);
-    system("killall wpa_supplicant 1>/dev/null 2>/dev/null");
-    sleep(1);
+    process_stop("hostapd");
+    process_stop("wpa_supplicant");
 
 #if defined(_OPENWRT_) && !defined(_WTS_OPENWRT_)
     char buffer[BUFFER_LEN];
@@ -249,14 +250,11 @@ void vendor_init() {
 
 /* Be invoked when terminate controlApp */
 void vendor_deinit() {
-    char buffer[S_BUFFER_LEN];
-    memset(buffer, 0, sizeof(buffer));
-    system("killall hostapd >/dev/null 2>/dev/null");
+    process_stop("hostapd");
 #ifdef _OPENWRT_
-    system("killall hostapd-wfa >/dev/null 2>/dev/null");
+    process_stop("hostapd-wfa");
 #endif
-    sprintf(buffer, "killall %s 1>/dev/null 2>/dev/null", get_wpas_exec_file());
-    system(buffer);
+    process_stop(get_wpas_exec_file());
 }
 
 /* Called by configure_ap_handler() */
@@ -593,27 +591,28 @@ void start_dhcp_server(char *if_name, char *ip_addr)
         fclose(fp);
     }
     system("touch /var/lib/dhcp/dhcpd.leases_QT");
-    snprintf(buffer, sizeof(buffer), "dhcpd -4 -cf /etc/dhcp/QT_dhcpd.conf -lf /var/lib/dhcp/dhcpd.leases_QT %s", if_name);
-    system(buffer);
+    /* -f keeps dhcpd in the foreground under the supervisor */
+    snprintf(buffer, sizeof(buffer), "dhcpd -f -4 -cf /etc/dhcp/QT_dhcpd.conf -lf /var/lib/dhcp/dhcpd.leases_QT %s", if_name);
+    process_start(buffer);
 }
 
 void stop_dhcp_server()
 {
     /* system("systemctl stop isc-dhcp-server.service"); */
-    system("killall dhcpd 1>/dev/null 2>/dev/null");
+    process_stop_async("dhcpd", NULL, NULL);
 }
 
 void start_dhcp_client(char *if_name)
 {
     char buffer[S_BUFFER_LEN];
 
-    snprintf(buffer, sizeof(buffer), "dhclient -4 %s &", if_name);
-    system(buffer);
+    snprintf(buffer, sizeof(buffer), "dhclient -d -4 %s", if_name);
+    process_start(buffer);
 }
 
 void stop_dhcp_client()
 {
-    system("killall dhclient 1>/dev/null 2>/dev/null");
+    process_stop_async("dhclient", NULL, NULL);
 }
 
 wps_setting wps_settings_ap[GROUP_NUM][AP_SETTING_NUM] = {